@@ -0,0 +1,133 @@
+#include "atcc.h"
+#include "ati/thread.h"
+#include "ati/utils.h"
+#include <stddef.h>
+
+// A node of a kind that ends with `field` only needs the bytes up to and including it.
+#define AST_SIZE_UNTIL(field) (offsetof(ASTNode, field) + sizeof(((ASTNode *) 0)->field))
+#define AST_HEADER_SIZE offsetof(ASTNode, parent)
+
+static const u8 ast_kind_sizes[] = {
+        [AST_NONE] = AST_HEADER_SIZE,
+        [AST_ERROR] = AST_SIZE_UNTIL(value),
+        [AST_PROGRAM] = AST_SIZE_UNTIL(declarations),
+        [AST_DECLARATION_TYPE_NAME] = AST_SIZE_UNTIL(value),
+        [AST_DECLARATION_TYPE_POINTER] = AST_SIZE_UNTIL(parent),
+        [AST_DECLARATION_TYPE_ARRAY] = AST_SIZE_UNTIL(array_is_dynamic),
+        [AST_DECLARATION_TYPE_FUNCTION] = AST_SIZE_UNTIL(function_body),
+        [AST_DECLARATION_ALIAS] = AST_SIZE_UNTIL(alias_type),
+        [AST_DECLARATION_AGGREGATE] = AST_SIZE_UNTIL(aggregate),
+        [AST_DECLARATION_AGGREGATE_FIELD] = AST_SIZE_UNTIL(aggregate_type),
+        [AST_DECLARATION_AGGREGATE_CHILD] = AST_SIZE_UNTIL(aggregate_items),
+        [AST_DECLARATION_VARIABLE] = AST_SIZE_UNTIL(variable_is_const),
+        [AST_DECLARATION_FUNCTION_PARAMETER] = AST_SIZE_UNTIL(function_parameter_type),
+        [AST_DECLARATION_FUNCTION] = AST_SIZE_UNTIL(function_body_arena),
+        [AST_DECLARATION_ENUM_PLACEHOLDER] = AST_SIZE_UNTIL(enum_items),
+
+        [AST_STATEMENT_BLOCK] = AST_SIZE_UNTIL(statements),
+        [AST_STATEMENT_IF] = AST_SIZE_UNTIL(if_false),
+        [AST_STATEMENT_WHILE] = AST_SIZE_UNTIL(while_body),
+        [AST_STATEMENT_DO_WHILE] = AST_SIZE_UNTIL(while_body),
+        [AST_STATEMENT_FOR] = AST_SIZE_UNTIL(for_body),
+        [AST_STATEMENT_SWITCH] = AST_SIZE_UNTIL(switch_cases),
+        [AST_STATEMENT_SWITCH_CASE] = AST_SIZE_UNTIL(switch_case_is_default),
+        [AST_STATEMENT_SWITCH_PATTERN] = AST_SIZE_UNTIL(switch_pattern_end),
+        [AST_STATEMENT_BREAK] = AST_HEADER_SIZE,
+        [AST_STATEMENT_CONTINUE] = AST_HEADER_SIZE,
+        [AST_STATEMENT_RETURN] = AST_SIZE_UNTIL(parent),
+        [AST_STATEMENT_INIT] = AST_SIZE_UNTIL(init_is_nothing),
+        [AST_STATEMENT_EXPRESSION] = AST_SIZE_UNTIL(parent),
+        [AST_STATEMENT_ASSIGN] = AST_SIZE_UNTIL(assign_value),
+
+        [AST_EXPRESSION_PAREN] = AST_SIZE_UNTIL(parent),
+        [AST_EXPRESSION_UNARY] = AST_SIZE_UNTIL(unary_target),
+        [AST_EXPRESSION_BINARY] = AST_SIZE_UNTIL(binary_right),
+        [AST_EXPRESSION_TERNARY] = AST_SIZE_UNTIL(ternary_false),
+        [AST_EXPRESSION_LITERAL_NUMBER] = AST_SIZE_UNTIL(literal_as_u64),
+        [AST_EXPRESSION_LITERAL_CHAR] = AST_SIZE_UNTIL(literal_as_u64),
+        [AST_EXPRESSION_LITERAL_STRING] = AST_SIZE_UNTIL(literal_as_u64),
+        [AST_EXPRESSION_IDENTIFIER] = AST_SIZE_UNTIL(identifier_declaration),
+        [AST_EXPRESSION_SIZEOF] = AST_SIZE_UNTIL(sizeof_type),
+        [AST_EXPRESSION_ALIGNOF] = AST_SIZE_UNTIL(alignof_type),
+        [AST_EXPRESSION_OFFSETOF] = AST_SIZE_UNTIL(offsetof_field),
+        [AST_EXPRESSION_CALL] = AST_SIZE_UNTIL(call_arguments),
+        [AST_EXPRESSION_FIELD] = AST_SIZE_UNTIL(field_name),
+        [AST_EXPRESSION_INDEX] = AST_SIZE_UNTIL(index_index),
+        [AST_EXPRESSION_CAST] = AST_SIZE_UNTIL(cast_target),
+        [AST_EXPRESSION_COMPOUND] = AST_SIZE_UNTIL(compound_fields),
+        [AST_EXPRESSION_COMPOUND_FIELD] = AST_SIZE_UNTIL(compound_field_target),
+        [AST_EXPRESSION_COMPOUND_FIELD_NAME] = AST_SIZE_UNTIL(compound_field_target),
+        [AST_EXPRESSION_COMPOUND_FIELD_INDEX] = AST_SIZE_UNTIL(compound_field_target),
+};
+
+ASTStatistics ast_statistics;
+static Mutex ast_statistics_lock = MUTEX_INITIALIZER;
+
+// Sema sets conversions from several threads at once.
+static PointerTable ast_conversions;
+static PointerTable ast_constants;
+static Mutex ast_tables_lock = MUTEX_INITIALIZER;
+
+void ast_statistics_add(ASTStatistics *statistics) {
+    mutex_lock(&ast_statistics_lock);
+    ast_statistics.nodes += statistics->nodes;
+    ast_statistics.node_bytes += statistics->node_bytes;
+    mutex_unlock(&ast_statistics_lock);
+}
+
+u32 ast_size(ASTKind kind) {
+    assert(kind < array_length(ast_kind_sizes) && ast_kind_sizes[kind] != 0);
+    return ast_kind_sizes[kind];
+}
+
+ASTNode *ast_create(Arena *arena, ASTStatistics *statistics, ASTKind kind, Location location) {
+    u32 size = ast_size(kind);
+    ASTNode *node = arena_alloc(arena, size);
+    node->kind = (u8) kind;
+    node->location = location;
+
+    statistics->nodes++;
+    statistics->node_bytes += size;
+    return node;
+}
+
+Type *ast_conversion(ASTNode *node) {
+    if (!(node->flags & AST_FLAG_CONVERTED))
+        return null;
+
+    mutex_lock(&ast_tables_lock);
+    Type *type = pointer_table_get(&ast_conversions, node);
+    mutex_unlock(&ast_tables_lock);
+    return type;
+}
+
+void ast_set_conversion(ASTNode *node, Type *type) {
+    node->flags |= AST_FLAG_CONVERTED;
+
+    mutex_lock(&ast_tables_lock);
+    pointer_table_set(&ast_conversions, node, type);
+    mutex_unlock(&ast_tables_lock);
+}
+
+Variant ast_constant(ASTNode *node) {
+    if (!(node->flags & AST_FLAG_CONSTANT))
+        return variant_none();
+
+    mutex_lock(&ast_tables_lock);
+    Variant value = *(Variant *) pointer_table_get(&ast_constants, node);
+    mutex_unlock(&ast_tables_lock);
+    return value;
+}
+
+void ast_set_constant(ASTNode *node, Variant value) {
+    mutex_lock(&ast_tables_lock);
+    Variant *stored = pointer_table_get(&ast_constants, node);
+    if (!stored) {
+        stored = make(Variant);
+        pointer_table_set(&ast_constants, node, stored);
+    }
+
+    *stored = value;
+    mutex_unlock(&ast_tables_lock);
+    node->flags |= AST_FLAG_CONSTANT;
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "ati/arena.h"
 #include "ati/basic.h"
+#include "ati/intern.h"
 #include "ati/string.h"
 #include "ati/table.h"
+#include "ati/thread.h"
 #include "emit/bytecode.h"
 
 #include <assert.h>
@@ -23,11 +26,24 @@ typedef enum {
 
 extern VerboseFlags verbose;
 
+// Tokens and nodes only remember where they start, as a byte offset into the
+// concatenation of every registered file. The file, line and column are
+// recovered from the file table when a diagnostic needs them.
+typedef u32 Location;
+
 typedef struct {
     string file;
-    int line;
-    int column;
-} Location;
+    i32 line;
+    i32 column;
+} SourcePosition;
+
+u32 source_register(string filename, Buffer data);
+string source_file_name(u32 file);
+Buffer source_file_data(u32 file);
+Location source_location(u32 file, u64 offset);
+u32 source_file_at(Location location);
+u64 source_line_count(void);
+SourcePosition location_resolve(Location location);
 
 typedef enum {
     TOKEN_NONE,
@@ -120,6 +136,8 @@ typedef enum {
     TOKEN_FLAG_OCT = 1 << 1,
     TOKEN_FLAG_BIN = 1 << 2,
     TOKEN_FLAG_FLOAT = 1 << 3,
+    // A char literal that does not hold exactly one character, the parser reports it.
+    TOKEN_FLAG_INVALID = 1 << 4,
 } TokenFlag;
 
 typedef struct {
@@ -129,7 +147,39 @@ typedef struct {
     string value;
 } Token;
 
-Token *lexer_tokenize(string filename, Buffer data);
+// Enough lookahead for the parser, which never looks past the current token.
+#define LEXER_LOOKAHEAD 4
+
+typedef struct {
+    u32 file;
+    Buffer source;
+    u64 offset;
+    Location base;
+
+    // Batch mode: the whole file is tokenized up front and served from here.
+    Token *tokens;
+    u64 next_token;
+
+    // Streaming mode: tokens that were peeked at but not consumed yet.
+    Token lookahead[LEXER_LOOKAHEAD];
+    u32 lookahead_start;
+    u32 lookahead_count;
+} Lexer;
+
+void lexer_initialize(Lexer *lexer, u32 file, bool batch);
+Token lexer_next(Lexer *lexer);
+Token *lexer_peek(Lexer *lexer, u32 n);
+
+// Skips past the '}' that closes a block whose '{' was just consumed, without
+// producing tokens for it. Returns false if the file ends before the block does.
+bool lexer_skip_block(Lexer *lexer);
+// Continues a streaming lexer from a location inside its file.
+void lexer_seek(Lexer *lexer, Location location);
+
+Token *lexer_tokenize(u32 file);
+TokenKind lexer_keyword_kind(string identifier);
+
+void lexer_register_utest(void);
 
 typedef enum {
     AST_NONE,
@@ -184,18 +234,32 @@ typedef enum {
     AST_EXPRESSION_COMPOUND_FIELD_INDEX,
 } ASTKind;
 
+typedef enum {
+    AST_FLAG_NONE = 0,
+    AST_FLAG_CONVERTED = 1 << 0, // Has an implicit conversion, see ast_conversion.
+    AST_FLAG_CONSTANT = 1 << 1,  // Has an evaluated constant value, see ast_constant.
+    AST_FLAG_DEFERRED = 1 << 2,  // Function whose body has not been parsed yet, see parse_function_body.
+    AST_FLAG_REACHABLE = 1 << 3, // Global declaration reached from Main, see SemanticContext.reachable_only.
+    AST_FLAG_MALFORMED = 1 << 4, // Function whose body had syntax errors, they were already reported.
+} ASTFlag;
+
 typedef struct ASTNode ASTNode;
 typedef struct Type Type;
 
+// Nodes are allocated at the size of their kind by ast_create, so only the
+// fields that belong to the node's own kind may be accessed.
 struct ASTNode {
-    ASTKind kind;
+    u8 kind;
+    u8 flags;
     Location location;
     Type *base_type;
-    Type *conv_type;
-    Variant constant;
 
     union {
-        string value;
+        struct {
+            string value;
+            ASTNode *identifier_declaration; // Set by sema, null for builtin types.
+        };
+
         ASTNode *parent;
         ASTNode **declarations;
         ASTNode **statements;
@@ -217,6 +281,10 @@ struct ASTNode {
             ASTNode *function_return_type;
             bool function_is_variadic;
             ASTNode *function_body;
+
+            // Only for deferred bodies: where the body's '{' is and the arena it goes into.
+            Location function_body_location;
+            Arena *function_body_arena;
         };
 
         struct {
@@ -372,7 +440,45 @@ struct ASTNode {
     };
 };
 
-ASTNode *parse_program(Token *tokens);
+typedef struct {
+    u64 nodes;
+    u64 node_bytes;
+} ASTStatistics;
+
+// Totals over every parse so far. Each parse counts its nodes into its own
+// statistics and adds them here when it is done.
+extern ASTStatistics ast_statistics;
+
+void ast_statistics_add(ASTStatistics *statistics);
+
+u32 ast_size(ASTKind kind);
+ASTNode *ast_create(Arena *arena, ASTStatistics *statistics, ASTKind kind, Location location);
+
+// Conversions and constant values are set on few nodes, so they are kept in
+// side tables instead of on every node.
+Type *ast_conversion(ASTNode *node);
+void ast_set_conversion(ASTNode *node, Type *type);
+Variant ast_constant(ASTNode *node);
+void ast_set_constant(ASTNode *node, Variant value);
+
+// With `defer_bodies`, function bodies are only skipped over and parsed on
+// their first parse_function_body. Syntax errors are written to `diagnostics`,
+// for a deferred body the one its first parse_function_body was given.
+// Parsing separate files on separate threads is safe, as long as every file
+// was registered beforehand and every parse has its own arena.
+ASTNode *parse_program(Lexer *lexer, Arena *arena, bool defer_bodies, FILE *diagnostics);
+ASTNode *parse_function_body(ASTNode *function, FILE *diagnostics);
+
+// Serializes a program parsed from `file` into a compact, pointer-free byte vector.
+u8 *snapshot_create(ASTNode *program, u32 file);
+// Rebuilds a program from a snapshot of `file`, or returns null if the snapshot
+// is corrupt or was made from different source or with different node fields.
+ASTNode *snapshot_load(const u8 *snapshot, u64 length, u32 file, Arena *arena);
+
+// Parse cache: snapshots kept in `directory` under the content hash of their file.
+ASTNode *snapshot_cache_load(string directory, u32 file, Arena *arena);
+void snapshot_cache_store(string directory, u32 file, ASTNode *program);
+void parser_register_utest(void);
 void write_program_dot(ASTNode *node, cstring filename);
 
 typedef enum {
@@ -431,7 +537,13 @@ struct Type {
     };
 };
 
+// Creates a distinct type, only meant for builtins and aggregates.
 Type *make_type(TypeKind kind, u32 size, u32 pack);
+// Return the single instance of their structure, safe to call from several threads.
+Type *type_pointer(Type *base);
+Type *type_array(Type *base, u32 size, bool is_dynamic);
+// Takes ownership of the `parameters` vector.
+Type *type_function(Type **parameters, Type *return_type, bool is_variadic);
 string type_to_string(Type *type);
 
 bool type_match(Type *a, Type *b);
@@ -442,7 +554,16 @@ bool type_is_arithmetic(Type *type);
 
 Type *node_type(ASTNode *node);
 
-Variant eval_expression(ASTNode *node);
+void type_register_utest(void);
+
+typedef struct {
+    ASTNode *node; // Where the evaluation gave up.
+    cstring reason;
+} EvalError;
+
+// Evaluates `node` at compile time, running any calls to functions that only compute values.
+// Returns VARIANT_NONE and fills in `error`, if given, when the value is only known at run time.
+Variant eval_expression(ASTNode *node, EvalError *error);
 
 typedef enum {
     SEMA_ENTRY_NONE,
@@ -464,27 +585,51 @@ typedef struct {
     Type *type;
 } SemanticEntry;
 
-typedef struct SemanticScope SemanticScope;
-struct SemanticScope {
-    StringTable entries;
+// Every name in scope has a stack of bindings, threaded through the binding
+// stack of the context with the innermost on top, so a lookup is a single
+// table probe. A scope is where its first binding would go on that stack.
+typedef struct {
+    u32 binding; // Index + 1 of the innermost binding, 0 when out of scope.
+} SemanticSymbol;
+
+typedef struct {
+    SemanticSymbol *symbol;
+    SemanticEntry *entry;
+    u32 shadowed; // Index + 1 of the binding this one hides.
+} SemanticBinding;
+
+typedef struct {
+    u32 bindings;
     bool can_break;
     bool can_continue;
-    SemanticScope *parent;
-};
+} SemanticScope;
 
 typedef struct {
     Location location;
     string description;
 } SemanticError;
 
-typedef struct {
+typedef struct SemanticContext SemanticContext;
+struct SemanticContext {
     ASTNode **programs;
-    SemanticScope *global;
-    SemanticScope *scope;
+    SymbolTable symbols;
+    SemanticBinding *bindings;
+    SemanticScope scope;
+
+    // For the contexts that analyze function bodies: the one holding the globals.
+    SemanticContext *parent;
     SemanticError *errors;
 
-    PointerTable array_types;
-    PointerTable pointer_types;
+    // Where the syntax errors of bodies parsed during analysis go, see parse_function_body.
+    FILE *diagnostics;
+
+    // Only analyze the declarations reachable from the entry points, marking them
+    // with AST_FLAG_REACHABLE. The globals named by the analyzed code are collected
+    // in `references` along the way. Those named by the initializer of a global
+    // variable are kept apart, and only reached once the variable itself is.
+    bool reachable_only;
+    ASTNode **references;
+    PointerTable initializer_references;
 
     Type *type_void;
     Type *type_i8;
@@ -498,20 +643,38 @@ typedef struct {
     Type *type_f32;
     Type *type_f64;
     Type *type_string;
-} SemanticContext;
+};
+
+// Names the compiler refers to by itself, interned by sema_initialize.
+typedef struct {
+    string main;
+    string start;
+    string length;
+    string data;
+    string init_globals;
+    string string_equals;
+    string memset;
+} Symbols;
+
+extern Symbols symbols;
 
 SemanticContext *sema_initialize(void);
 bool sema_register_program(SemanticContext *context, ASTNode *program);
-bool sema_analyze(SemanticContext *context);
+// Analyzes the function bodies on the threads of `pool`, after resolving every global.
+bool sema_analyze(SemanticContext *context, ThreadPool *pool);
+// Resolves a name in the current scope, which is the global one outside of sema_analyze.
+SemanticEntry *sema_get(SemanticContext *context, string name);
+
+void sema_register_utest(void);
 
 typedef struct {
     SemanticContext *sema;
     BCContext bc;
 
-    StringTable aggregates;
-    StringTable functions;
-    StringTable globals;
-    StringTable locals;
+    SymbolTable aggregates;
+    SymbolTable functions;
+    SymbolTable globals;
+    SymbolTable locals;
 
     PointerTable types;
 
@@ -0,0 +1,85 @@
+#include "arena.h"
+#include "utils.h"
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+#define ARENA_ALIGNMENT 8
+
+VectorHeader arena_empty_vector_header;
+
+struct ArenaBlock {
+    ArenaBlock *next;
+};
+
+void arena_initialize(Arena *arena) {
+    arena->blocks = null;
+    arena->cursor = null;
+    arena->end = null;
+    arena->allocated = 0;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena_initialize(arena);
+}
+
+static void arena_grow(Arena *arena, u64 size) {
+    u64 block_size = sizeof(ArenaBlock) + ARENA_ALIGNMENT + size;
+    if (block_size < ARENA_BLOCK_SIZE)
+        block_size = ARENA_BLOCK_SIZE;
+
+    // Blocks come from calloc and are never reused, so every allocation starts out zeroed.
+    ArenaBlock *block = calloc(1, block_size);
+    if (!block)
+        panic("out of memory allocating a %llu byte arena block", (unsigned long long) block_size);
+
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->cursor = (i8 *) (block + 1);
+    arena->end = (i8 *) block + block_size;
+}
+
+void *arena_alloc(Arena *arena, u64 size) {
+    u64 padding = -(u64) arena->cursor & (ARENA_ALIGNMENT - 1);
+    if (!arena->cursor || (u64) (arena->end - arena->cursor) < padding + size) {
+        arena_grow(arena, size);
+        padding = -(u64) arena->cursor & (ARENA_ALIGNMENT - 1);
+    }
+
+    void *result = arena->cursor + padding;
+    arena->cursor += padding + size;
+    arena->allocated += padding + size;
+    return result;
+}
+
+void *arena_vector(Arena *arena, const void *items, u32 item_size, u32 length) {
+    VectorHeader *header = arena_alloc(arena, sizeof(VectorHeader) + (u64) item_size * length);
+    header->length = length;
+    header->capacity = length;
+
+    if (length)
+        memcpy(header + 1, items, (u64) item_size * length);
+    return header + 1;
+}
+
+void *arena_vector_grow(Arena *arena, void *vector, u32 item_size, u32 increment) {
+    VectorHeader *old = vector_header(vector);
+
+    u64 capacity = old->capacity ? old->capacity * 2 : 4;
+    if (capacity < old->length + increment)
+        capacity = old->length + increment;
+
+    VectorHeader *header = arena_alloc(arena, sizeof(VectorHeader) + (u64) item_size * capacity);
+    header->length = old->length;
+    header->capacity = capacity;
+
+    if (old->length)
+        memcpy(header + 1, old + 1, (u64) item_size * old->length);
+    return header + 1;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "basic.h"
+#include "utils.h"
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator for data that lives and dies together. Allocations are zeroed
+// and cannot be freed on their own, arena_free releases all of them at once.
+typedef struct {
+    ArenaBlock *blocks;
+    i8 *cursor;
+    i8 *end;
+
+    // Bytes handed out so far, including alignment padding.
+    u64 allocated;
+} Arena;
+
+void arena_initialize(Arena *arena);
+void arena_free(Arena *arena);
+
+void *arena_alloc(Arena *arena, u64 size);
+
+// Creates a vector in the arena holding a copy of `length` items. Its capacity
+// is exactly `length`, so it must never be grown with vector_push or vector_add.
+void *arena_vector(Arena *arena, const void *items, u32 item_size, u32 length);
+
+// Makes room for `increment` more items in a vector that lives in the arena, or
+// in `vector_empty`. Growing moves the items and leaves the old copy behind.
+void *arena_vector_grow(Arena *arena, void *vector, u32 item_size, u32 increment);
+
+#define arena_vector_push(arena, vector, value)                                                      \
+    do {                                                                                             \
+        if (vector_length(vector) + 1 > vector_capacity(vector))                                     \
+            *((void **) &(vector)) = arena_vector_grow((arena), (vector), sizeof(*(vector)), 1);     \
+        (vector)[vector_length(vector)++] = value;                                                   \
+    } while (0)
+
+// A shared vector with no items and no capacity, to be replaced by the first arena_vector_push.
+extern VectorHeader arena_empty_vector_header;
+#define vector_empty ((void *) (&arena_empty_vector_header + 1))
+
+#define arena_make(arena, T) ((T *) arena_alloc((arena), sizeof(T)))
@@ -56,9 +56,10 @@ void __attribute__((noreturn)) panicf(const char *file, int line, const char *fo
 typedef struct Buffer {
     i8 *data;
     u64 length;
+    bool is_mapped;
 } Buffer;
 
-#define buffer_free(buffer) free((buffer).data)
+void buffer_free(Buffer buffer);
 
 typedef enum {
     VARIANT_NONE,
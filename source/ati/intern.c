@@ -0,0 +1,113 @@
+#include "intern.h"
+#include "thread.h"
+#include <string.h>
+
+#define INTERN_BLOCK_SIZE (64 * 1024)
+#define INTERN_LOAD_FACTOR 0.75
+
+// Strings are spread over independently locked shards by the top bits of
+// their hash, so lexers running in parallel rarely wait on each other.
+#define INTERN_SHARD_BITS 4
+#define INTERN_SHARDS (1 << INTERN_SHARD_BITS)
+
+typedef struct {
+    u64 hash;
+    string value;
+} InternEntry;
+
+typedef struct {
+    u32 length;
+    u32 capacity;
+    InternEntry *entries;
+
+    // Interned bytes are packed into large blocks instead of one allocation each.
+    i8 *block;
+    u64 block_used;
+} InternShard;
+
+static InternShard intern_shards[INTERN_SHARDS];
+static Mutex intern_locks[INTERN_SHARDS] = {[0 ... INTERN_SHARDS - 1] = MUTEX_INITIALIZER};
+
+static u64 intern_hash(string s) {
+    // FNV-1a, identifiers are short enough that anything fancier does not pay off.
+    u64 hash = 0xcbf29ce484222325ull;
+    for (u64 i = 0; i < s.length; i++) {
+        hash ^= (u8) s.data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static InternEntry *intern_find_entry(InternEntry *entries, u32 capacity, string s, u64 hash) {
+    u32 index = (u32) hash & (capacity - 1);
+    for (;;) {
+        InternEntry *entry = &entries[index];
+        if (!entry->value.data)
+            return entry;
+
+        if (entry->hash == hash && entry->value.length == s.length && memcmp(entry->value.data, s.data, s.length) == 0)
+            return entry;
+
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void intern_resize(InternShard *shard, u32 new_capacity) {
+    InternEntry *new_entries = make_n(InternEntry, new_capacity);
+
+    for (u32 i = 0; i < shard->capacity; i++) {
+        InternEntry *entry = &shard->entries[i];
+        if (!entry->value.data) continue;
+
+        u32 index = (u32) entry->hash & (new_capacity - 1);
+        while (new_entries[index].value.data)
+            index = (index + 1) & (new_capacity - 1);
+        new_entries[index] = *entry;
+    }
+
+    free(shard->entries);
+    shard->entries = new_entries;
+    shard->capacity = new_capacity;
+}
+
+static i8 *intern_copy(InternShard *shard, string s) {
+    u64 size = s.length + 1;
+    if (size > INTERN_BLOCK_SIZE / 4) {
+        i8 *data = malloc(size);
+        memcpy(data, s.data, s.length);
+        data[s.length] = 0;
+        return data;
+    }
+
+    if (!shard->block || shard->block_used + size > INTERN_BLOCK_SIZE) {
+        shard->block = malloc(INTERN_BLOCK_SIZE);
+        shard->block_used = 0;
+    }
+
+    i8 *data = shard->block + shard->block_used;
+    memcpy(data, s.data, s.length);
+    data[s.length] = 0;
+    shard->block_used += size;
+    return data;
+}
+
+string intern(string s) {
+    u64 hash = intern_hash(s);
+    u32 index = (u32) (hash >> (64 - INTERN_SHARD_BITS));
+    InternShard *shard = &intern_shards[index];
+
+    mutex_lock(&intern_locks[index]);
+    if (shard->length + 1 > shard->capacity * INTERN_LOAD_FACTOR)
+        intern_resize(shard, shard->capacity < 1024 ? 1024 : shard->capacity * 2);
+
+    InternEntry *entry = intern_find_entry(shard->entries, shard->capacity, s, hash);
+    if (!entry->value.data) {
+        entry->hash = hash;
+        entry->value = rawstr(intern_copy(shard, s), s.length);
+        shard->length++;
+    }
+
+    string result = entry->value;
+    mutex_unlock(&intern_locks[index]);
+    return result;
+}
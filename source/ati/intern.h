@@ -0,0 +1,33 @@
+#pragma once
+
+#include "basic.h"
+#include "string.h"
+#include "table.h"
+
+// Returns the canonical copy of the string. Interned strings with the same
+// contents share their data pointer, so they compare and hash by address.
+// The copies live until the process exits. Safe to call from several threads.
+string intern(string s);
+
+static inline bool intern_match(string a, string b) {
+    return a.data == b.data;
+}
+
+// Tables keyed on interned strings, looked up by the address of their data.
+typedef PointerTable SymbolTable;
+
+static inline void symbol_table_create(SymbolTable *table) {
+    pointer_table_create(table);
+}
+
+static inline void symbol_table_destroy(SymbolTable *table) {
+    pointer_table_destroy(table);
+}
+
+static inline void *symbol_table_get(SymbolTable *table, string symbol) {
+    return pointer_table_get(table, symbol.data);
+}
+
+static inline bool symbol_table_set(SymbolTable *table, string symbol, void *value) {
+    return pointer_table_set(table, symbol.data, value);
+}
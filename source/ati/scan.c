@@ -0,0 +1,180 @@
+#include "scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SCAN_WIDTH 32
+typedef __m256i ScanVector;
+typedef u32 ScanMask;
+#define SCAN_FULL_MASK 0xFFFFFFFFu
+
+#define scan_load(p) _mm256_loadu_si256((const __m256i *) (p))
+#define scan_splat(c) _mm256_set1_epi8((char) (c))
+#define scan_eq(a, c) _mm256_cmpeq_epi8((a), scan_splat(c))
+#define scan_gt(a, c) _mm256_cmpgt_epi8((a), scan_splat(c))
+#define scan_lt(a, c) _mm256_cmpgt_epi8(scan_splat(c), (a))
+#define scan_or(a, b) _mm256_or_si256((a), (b))
+#define scan_and(a, b) _mm256_and_si256((a), (b))
+#define scan_mask(a) ((ScanMask) _mm256_movemask_epi8(a))
+#define scan_popcount(m) ((u64) __builtin_popcount(m))
+#define SCAN_VECTORIZED
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define SCAN_WIDTH 16
+typedef __m128i ScanVector;
+typedef u32 ScanMask;
+#define SCAN_FULL_MASK 0xFFFFu
+
+#define scan_load(p) _mm_loadu_si128((const __m128i *) (p))
+#define scan_splat(c) _mm_set1_epi8((char) (c))
+#define scan_eq(a, c) _mm_cmpeq_epi8((a), scan_splat(c))
+#define scan_gt(a, c) _mm_cmpgt_epi8((a), scan_splat(c))
+#define scan_lt(a, c) _mm_cmpgt_epi8(scan_splat(c), (a))
+#define scan_or(a, b) _mm_or_si128((a), (b))
+#define scan_and(a, b) _mm_and_si128((a), (b))
+#define scan_mask(a) ((ScanMask) _mm_movemask_epi8(a))
+#define scan_popcount(m) ((u64) __builtin_popcount(m))
+#define SCAN_VECTORIZED
+#endif
+
+static inline bool scan_is_whitespace(i8 c) {
+    // -62 and -96 are the two bytes of a UTF-8 encoded no-break space.
+    return c == ' ' || (c >= '\t' && c <= '\r') || c == -62 || c == -96;
+}
+
+static inline bool scan_is_digit(i8 c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool scan_is_identifier(i8 c) {
+    i8 lower = (i8) (c | 0x20);
+    return (lower >= 'a' && lower <= 'z') || scan_is_digit(c) || c == '_';
+}
+
+static inline bool scan_is_line(i8 c) {
+    return c != '\n' && c != '\r' && c != '\0';
+}
+
+static inline bool scan_is_not_newline(i8 c) {
+    return c != '\n';
+}
+
+static inline bool scan_is_block_comment(i8 c) {
+    return c != '*' && c != '/' && c != '\0';
+}
+
+#ifdef SCAN_VECTORIZED
+// Signed byte compares leave every byte >= 0x80 outside of the ASCII ranges below.
+
+static inline ScanVector scan_classify_whitespace(ScanVector v) {
+    ScanVector control = scan_and(scan_gt(v, '\t' - 1), scan_lt(v, '\r' + 1));
+    ScanVector space = scan_or(scan_eq(v, ' '), control);
+    return scan_or(space, scan_or(scan_eq(v, -62), scan_eq(v, -96)));
+}
+
+static inline ScanVector scan_classify_digit(ScanVector v) {
+    return scan_and(scan_gt(v, '0' - 1), scan_lt(v, '9' + 1));
+}
+
+static inline ScanVector scan_classify_identifier(ScanVector v) {
+    ScanVector lower = scan_or(v, scan_splat(0x20));
+    ScanVector alpha = scan_and(scan_gt(lower, 'a' - 1), scan_lt(lower, 'z' + 1));
+    return scan_or(alpha, scan_or(scan_classify_digit(v), scan_eq(v, '_')));
+}
+
+static inline ScanVector scan_classify_line(ScanVector v) {
+    return scan_or(scan_eq(v, '\n'), scan_or(scan_eq(v, '\r'), scan_eq(v, '\0')));
+}
+
+static inline ScanVector scan_classify_newline(ScanVector v) {
+    return scan_eq(v, '\n');
+}
+
+static inline ScanVector scan_classify_block_comment(ScanVector v) {
+    return scan_or(scan_eq(v, '*'), scan_or(scan_eq(v, '/'), scan_eq(v, '\0')));
+}
+
+// Most runs in real code are a few bytes long, so the first bytes are checked
+// one at a time and the vector loop only takes over for long runs.
+#define SCAN_SCALAR_PREFIX 8
+
+#define SCAN_PREFIX(scalar)                                    \
+    u64 prefix_end = offset + SCAN_SCALAR_PREFIX;              \
+    if (prefix_end > length)                                   \
+        prefix_end = length;                                   \
+    while (offset < prefix_end && scalar(data[offset]))        \
+        offset++;                                              \
+    if (offset < prefix_end || offset == length)               \
+        return offset
+
+// `inside` scanners continue while bytes are in the class, `until` scanners stop at the first byte in it.
+#define SCAN_INSIDE(classify, scalar)                                                       \
+    SCAN_PREFIX(scalar);                                                                    \
+    while (offset + SCAN_WIDTH <= length) {                                                 \
+        ScanMask outside = ~scan_mask(classify(scan_load(data + offset))) & SCAN_FULL_MASK; \
+        if (outside)                                                                        \
+            return offset + __builtin_ctz(outside);                                         \
+        offset += SCAN_WIDTH;                                                               \
+    }                                                                                       \
+    while (offset < length && scalar(data[offset]))                                         \
+        offset++;                                                                           \
+    return offset
+
+#define SCAN_UNTIL(classify, scalar)                                   \
+    SCAN_PREFIX(scalar);                                               \
+    while (offset + SCAN_WIDTH <= length) {                            \
+        ScanMask stop = scan_mask(classify(scan_load(data + offset))); \
+        if (stop)                                                      \
+            return offset + __builtin_ctz(stop);                       \
+        offset += SCAN_WIDTH;                                          \
+    }                                                                  \
+    while (offset < length && scalar(data[offset]))                    \
+        offset++;                                                      \
+    return offset
+#else
+#define SCAN_INSIDE(classify, scalar)               \
+    while (offset < length && scalar(data[offset])) \
+        offset++;                                   \
+    return offset
+
+#define SCAN_UNTIL(classify, scalar) SCAN_INSIDE(classify, scalar)
+#endif
+
+u64 scan_whitespace(const i8 *data, u64 offset, u64 length) {
+    SCAN_INSIDE(scan_classify_whitespace, scan_is_whitespace);
+}
+
+u64 scan_identifier(const i8 *data, u64 offset, u64 length) {
+    SCAN_INSIDE(scan_classify_identifier, scan_is_identifier);
+}
+
+u64 scan_digits(const i8 *data, u64 offset, u64 length) {
+    SCAN_INSIDE(scan_classify_digit, scan_is_digit);
+}
+
+u64 scan_line(const i8 *data, u64 offset, u64 length) {
+    SCAN_UNTIL(scan_classify_line, scan_is_line);
+}
+
+u64 scan_block_comment(const i8 *data, u64 offset, u64 length) {
+    SCAN_UNTIL(scan_classify_block_comment, scan_is_block_comment);
+}
+
+u64 scan_newline(const i8 *data, u64 offset, u64 length) {
+    SCAN_UNTIL(scan_classify_newline, scan_is_not_newline);
+}
+
+u64 scan_count_newlines(const i8 *data, u64 offset, u64 length) {
+    u64 newlines = 0;
+#ifdef SCAN_VECTORIZED
+    while (offset + SCAN_WIDTH <= length) {
+        newlines += scan_popcount(scan_mask(scan_eq(scan_load(data + offset), '\n')));
+        offset += SCAN_WIDTH;
+    }
+#endif
+    for (; offset < length; offset++)
+        newlines += data[offset] == '\n';
+    return newlines;
+}
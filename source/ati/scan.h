@@ -0,0 +1,23 @@
+#pragma once
+
+#include "basic.h"
+
+// Vectorized byte-class scanners. Each scanner returns the offset of the first
+// byte in [offset, length) that is not part of the run, or length if the run
+// reaches the end of the data. SSE2 and AVX2 are used when the compiler
+// targets them; everything else goes through the scalar loops.
+
+u64 scan_whitespace(const i8 *data, u64 offset, u64 length);
+u64 scan_identifier(const i8 *data, u64 offset, u64 length);
+u64 scan_digits(const i8 *data, u64 offset, u64 length);
+
+// Stops at '\n', '\r' or '\0'.
+u64 scan_line(const i8 *data, u64 offset, u64 length);
+
+// Stops at '*', '/' or '\0', the only bytes that can end or nest a block comment.
+u64 scan_block_comment(const i8 *data, u64 offset, u64 length);
+
+// Stops at '\n' only.
+u64 scan_newline(const i8 *data, u64 offset, u64 length);
+
+u64 scan_count_newlines(const i8 *data, u64 offset, u64 length);
@@ -31,21 +31,114 @@ bool string_match_cstring(string s1, cstring s2) {
 }
 
 bool string_to_f64(string s, f64 *value) {
-    cstring api = string_to_cstring(s);
-    cstring end = null;
-    *value = strtod(api, &end);
-    bool success = *end == 0;
-    free(api);
-    return success;
+    static const f64 powers_of_ten[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    u64 mantissa = 0;
+    u32 digits = 0;
+    i64 exponent = 0;
+    bool seen_digit = false, seen_dot = false, truncated = false;
+
+    u64 i = 0;
+    for (; i < s.length; i++) {
+        i8 c = s.data[i];
+        if (c == '.') {
+            if (seen_dot) return false;
+            seen_dot = true;
+            continue;
+        }
+
+        if (c < '0' || c > '9')
+            break;
+
+        seen_digit = true;
+        if (mantissa == 0 && c == '0') {
+            if (seen_dot) exponent--;
+        } else if (digits < 19) {
+            mantissa = mantissa * 10 + (c - '0');
+            digits++;
+            if (seen_dot) exponent--;
+        } else {
+            truncated = true;
+            if (!seen_dot) exponent++;
+        }
+    }
+
+    if (!seen_digit)
+        return false;
+
+    if (i < s.length && (s.data[i] == 'e' || s.data[i] == 'E')) {
+        bool negative = false;
+        if (++i < s.length && (s.data[i] == '+' || s.data[i] == '-'))
+            negative = s.data[i++] == '-';
+
+        if (i == s.length)
+            return false;
+
+        i64 exponent_value = 0;
+        for (; i < s.length && s.data[i] >= '0' && s.data[i] <= '9'; i++) {
+            if (exponent_value < 100000)
+                exponent_value = exponent_value * 10 + (s.data[i] - '0');
+        }
+
+        exponent += negative ? -exponent_value : exponent_value;
+    }
+
+    if (i != s.length)
+        return false;
+
+    // Clinger's fast path: both the mantissa and the power of ten are exact
+    // doubles, so a single correctly rounded multiply or divide is exact too.
+    if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        f64 result = (f64) mantissa;
+        *value = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+        return true;
+    }
+
+    // Everything else goes through strtod, which rounds correctly, on a stack copy.
+    char buffer[128];
+    if (s.length >= sizeof(buffer))
+        return false;
+
+    memcpy(buffer, s.data, s.length);
+    buffer[s.length] = '\0';
+    *value = strtod(buffer, null);
+    return true;
+}
+
+bool string_to_u64_radix(string s, u32 radix, u64 *value) {
+    if (s.length == 0)
+        return false;
+
+    u64 result = 0;
+    for (u64 i = 0; i < s.length; i++) {
+        u8 c = (u8) s.data[i];
+        u32 digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+            digit = (c | 0x20) - 'a' + 10;
+        else
+            return false;
+
+        if (digit >= radix)
+            return false;
+
+        // Reject literals that do not fit into 64 bits.
+        if (result > (UINT64_MAX - digit) / radix)
+            return false;
+
+        result = result * radix + digit;
+    }
+
+    *value = result;
+    return true;
 }
 
 bool string_to_u64(string s, u64 *value) {
-    cstring api = string_to_cstring(s);
-    cstring end = null;
-    *value = strtoull(api, &end, 10);
-    bool success = *end == 0;
-    free(api);
-    return success;
+    return string_to_u64_radix(s, 10, value);
 }
 
 string *string_split(string s, string delimiter, u64 *count) {
@@ -22,8 +22,10 @@ cstring string_to_cstring(string s);
 bool string_match(string s1, string s2);
 bool string_match_cstring(string str, cstring cstr);
 
+// Both parse without allocating and fail on trailing garbage or overflow.
 bool string_to_f64(string s, f64 *value);
 bool string_to_u64(string s, u64 *value);
+bool string_to_u64_radix(string s, u32 radix, u64 *value);
 
 string *string_split(string s, string delimiter, u64 *count);
 
@@ -107,8 +107,14 @@ bool string_table_remove(StringTable *table, string key) {
     return true;
 }
 
+static u64 pointer_hash(void *key) {
+    // Heap pointers share their low bits, multiply so the high bits pick the bucket too.
+    u64 hash = (u64) key * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
 static PointerTableEntry *pointer_table_find_entry(PointerTableEntry *entries, u32 capacity, void *key) {
-    u32 index = (u64) key & (capacity - 1);
+    u32 index = pointer_hash(key) & (capacity - 1);
 
     PointerTableEntry *tombstone = null;
     for (;;) {
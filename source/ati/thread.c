@@ -0,0 +1,119 @@
+#include "thread.h"
+#include "utils.h"
+#include <unistd.h>
+
+struct ThreadPool {
+    pthread_t *workers;
+    u32 worker_count;
+
+    Mutex mutex;
+    pthread_cond_t work_available;
+    pthread_cond_t work_finished;
+
+    // The batch being run, workers join it when `generation` changes.
+    ThreadJob job;
+    void *context;
+    u32 next;
+    u32 count;
+    u32 finished;
+    u64 generation;
+    bool stopping;
+};
+
+u32 thread_count_available(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32) count : 1;
+}
+
+// Takes jobs of the current batch until none are left. Called with the mutex held.
+static void pool_work(ThreadPool *pool) {
+    while (pool->next < pool->count) {
+        u32 index = pool->next++;
+        ThreadJob job = pool->job;
+        void *context = pool->context;
+
+        mutex_unlock(&pool->mutex);
+        job(context, index);
+        mutex_lock(&pool->mutex);
+
+        if (++pool->finished == pool->count)
+            pthread_cond_broadcast(&pool->work_finished);
+    }
+}
+
+static void *pool_worker(void *argument) {
+    ThreadPool *pool = argument;
+    u64 generation = 0;
+
+    mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->stopping && pool->generation == generation)
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+        if (pool->stopping)
+            break;
+
+        generation = pool->generation;
+        pool_work(pool);
+    }
+    mutex_unlock(&pool->mutex);
+
+    return null;
+}
+
+ThreadPool *pool_create(u32 threads) {
+    ThreadPool *pool = make(ThreadPool);
+    pthread_mutex_init(&pool->mutex, null);
+    pthread_cond_init(&pool->work_available, null);
+    pthread_cond_init(&pool->work_finished, null);
+
+    pool->worker_count = threads > 1 ? threads - 1 : 0;
+    pool->workers = make_n(pthread_t, pool->worker_count);
+    for (u32 i = 0; i < pool->worker_count; i++) {
+        if (pthread_create(&pool->workers[i], null, pool_worker, pool) != 0)
+            panic("failed to create worker thread %u", i);
+    }
+
+    return pool;
+}
+
+void pool_destroy(ThreadPool *pool) {
+    mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    mutex_unlock(&pool->mutex);
+
+    for (u32 i = 0; i < pool->worker_count; i++)
+        pthread_join(pool->workers[i], null);
+
+    pthread_cond_destroy(&pool->work_finished);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
+
+u32 pool_thread_count(ThreadPool *pool) {
+    return pool->worker_count + 1;
+}
+
+void pool_run(ThreadPool *pool, u32 count, ThreadJob job, void *context) {
+    if (pool->worker_count == 0 || count <= 1) {
+        for (u32 i = 0; i < count; i++)
+            job(context, i);
+        return;
+    }
+
+    mutex_lock(&pool->mutex);
+    pool->job = job;
+    pool->context = context;
+    pool->next = 0;
+    pool->count = count;
+    pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_available);
+
+    pool_work(pool);
+    while (pool->finished < pool->count)
+        pthread_cond_wait(&pool->work_finished, &pool->mutex);
+    mutex_unlock(&pool->mutex);
+}
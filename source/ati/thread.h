@@ -0,0 +1,34 @@
+#pragma once
+
+#include "basic.h"
+#include <pthread.h>
+
+typedef pthread_mutex_t Mutex;
+
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+
+static inline void mutex_lock(Mutex *mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void mutex_unlock(Mutex *mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+// Number of processors that are online, at least 1.
+u32 thread_count_available(void);
+
+typedef struct ThreadPool ThreadPool;
+
+// Called once for every index of a pool_run.
+typedef void (*ThreadJob)(void *context, u32 index);
+
+// Creates a pool that runs jobs on `threads` threads in total, the thread that
+// calls pool_run being one of them. A pool of one thread runs everything inline.
+ThreadPool *pool_create(u32 threads);
+void pool_destroy(ThreadPool *pool);
+u32 pool_thread_count(ThreadPool *pool);
+
+// Runs job(context, i) for every i below `count` and returns when all of them
+// have finished. Jobs are handed out in index order but finish in any order.
+void pool_run(ThreadPool *pool, u32 count, ThreadJob job, void *context);
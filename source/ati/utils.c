@@ -1,6 +1,9 @@
 #include "utils.h"
 #include <execinfo.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 void *vector_create_sized(u32 item_size, u32 capacity) {
@@ -29,26 +32,69 @@ void *vector_grow_sized(void *vector, u32 increment, u32 item_size) {
     return header + 1;
 }
 
-Buffer read_file(string path) {
+static Buffer read_file_descriptor(i32 descriptor) {
     Buffer buffer = {0};
-    cstring cpath = string_to_cstring(path);
-    FILE *handle = fopen(cpath, "rb");
-    free(cpath);
+    u64 capacity = 64 * 1024;
+    buffer.data = (i8 *) malloc(capacity);
 
-    if (handle == NULL)
-        return buffer;
+    for (;;) {
+        if (buffer.length == capacity) {
+            capacity *= 2;
+            buffer.data = (i8 *) realloc(buffer.data, capacity);
+        }
 
-    fseek(handle, 0, SEEK_END);
-    buffer.length = ftell(handle);
-    fseek(handle, 0, SEEK_SET);
+        ssize_t count = read(descriptor, buffer.data + buffer.length, capacity - buffer.length);
+        if (count < 0) {
+            free(buffer.data);
+            return (Buffer){0};
+        }
 
-    buffer.data = (i8 *) malloc(buffer.length);
-    fread(buffer.data, 1, buffer.length, handle);
-    fclose(handle);
+        if (count == 0)
+            break;
+
+        buffer.length += count;
+    }
+
+    return buffer;
+}
+
+Buffer read_file(string path) {
+    cstring cpath = string_to_cstring(path);
+    i32 descriptor = open(cpath, O_RDONLY);
+    free(cpath);
 
+    if (descriptor < 0)
+        return (Buffer){0};
+
+    // Regular files are mapped straight from the page cache; pipes, devices
+    // and empty files (which cannot be mapped) are read into the heap.
+    struct stat info;
+    if (fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        i32 flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+
+        void *data = mmap(null, info.st_size, PROT_READ, flags, descriptor, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            close(descriptor);
+            return (Buffer){.data = (i8 *) data, .length = info.st_size, .is_mapped = true};
+        }
+    }
+
+    Buffer buffer = read_file_descriptor(descriptor);
+    close(descriptor);
     return buffer;
 }
 
+void buffer_free(Buffer buffer) {
+    if (buffer.is_mapped)
+        munmap(buffer.data, buffer.length);
+    else
+        free(buffer.data);
+}
+
 bool write_file(string path, Buffer *buffer) {
     cstring cpath = string_to_cstring(path);
     FILE *handle = fopen(cpath, "wb");
@@ -27,7 +27,7 @@ typedef struct VectorHeader {
 #define vector_last(vector) ((vector)[vector_length(vector) - 1])
 
 #define vector_free(vector) \
-    do { free(vector_header(vector)) } while (0)
+    do { free(vector_header(vector)); } while (0)
 
 #define vector_needs_grow(vector, n) (vector_header(vector)->length + (n) >= vector_header(vector)->capacity)
 #define vector_ensure_length(vector, length) (vector_needs_grow(vector, (length)) ? vector_grow(vector, length) : 0)
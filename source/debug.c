@@ -177,7 +177,7 @@ static void *write_node_dot(ASTNode *node, FILE *f) {
             }
 
             void *rettype = write_node_dot(node->function_return_type, f);
-            void *body = write_node_dot(node->function_body, f);
+            void *body = write_node_dot(parse_function_body(node, stderr), f);
 
             if (rettype) fprintf(f, "\"%p\" -> \"%p\" [label=\"return type\"]\n", node, rettype);
             if (body) fprintf(f, "\"%p\" -> \"%p\" [label=\"body\"]\n", node, body);
@@ -135,42 +135,48 @@ static void bc_dump_value(BCValue value, FILE *f) {
 
 }
 
-void bc_dump_code(BCCode code, FILE *f) {
+#define reg(name) bc_code_value(function, code->reg##name)
+#define regA reg(A)
+#define regB reg(B)
+#define regC reg(C)
+#define regD reg(D)
+
+void bc_dump_code(BCFunction function, BCCode code, FILE *f) {
 #define ARITH_CASE(opcode, value)     \
     case opcode:                      \
-        bc_dump_value(code->regD, f); \
+        bc_dump_value(regD, f); \
         fprintf(f, " = ");            \
-        bc_dump_value(code->regA, f); \
+        bc_dump_value(regA, f); \
         fprintf(f, " " value " ");    \
-        bc_dump_value(code->regB, f); \
+        bc_dump_value(regB, f); \
         break;
 
     switch (code->opcode) {
         case BC_OP_NOP: fprintf(f, "nop"); break;
         case BC_OP_LOAD:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = load ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_GET_FIELD:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = ");
-            bc_dump_value(code->regA, f);
-            fprintf(f, "[field %llu]", code->regB->storage);
+            bc_dump_value(regA, f);
+            fprintf(f, "[field %llu]", regB->storage);
             break;
         case BC_OP_GET_INDEX:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             fprintf(f, "[");
-            bc_dump_value(code->regB, f);
+            bc_dump_value(regB, f);
             fprintf(f, "]");
             break;
         case BC_OP_STORE:
             fprintf(f, "store ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             fprintf(f, " to ");
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             break;
 
             ARITH_CASE(BC_OP_ADD, "+");
@@ -193,36 +199,38 @@ void bc_dump_code(BCCode code, FILE *f) {
             ARITH_CASE(BC_OP_GE, ">=");
 
         case BC_OP_JUMP:
-            fprintf(f, "jump to block%llu", code->bbT->serial);
-            if (code->regC) {
+            fprintf(f, "jump to block%u", code->bbT);
+            if (regC) {
                 fprintf(f, " with ");
-                bc_dump_value(code->regC, f);
+                bc_dump_value(regC, f);
             }
             break;
         case BC_OP_JUMP_IF:
             fprintf(f, "jump_if ");
-            bc_dump_value(code->regA, f);
-            fprintf(f, " to block%llu else block%llu", code->bbT->serial, code->bbF->serial);
+            bc_dump_value(regA, f);
+            fprintf(f, " to block%u else block%u", code->bbT, code->bbF);
             break;
-        case BC_OP_PHI:
-            bc_dump_value(code->phi_value->phi_result, f);
+        case BC_OP_PHI: {
+            BCValue phi = bc_code_value(function, code->phi_value);
+            bc_dump_value(phi->phi_result, f);
             fprintf(f, " = phi(");
-            for (u32 i = 0; i < code->phi_value->num_incoming_phi_values; i++) {
-                fprintf(f, "block%llu: ", code->phi_value->phi_blocks[i]->serial);
-                bc_dump_value(code->phi_value->phi_values[i], f);
+            for (u32 i = 0; i < phi->num_incoming_phi_values; i++) {
+                fprintf(f, "block%llu: ", phi->phi_blocks[i]->serial);
+                bc_dump_value(phi->phi_values[i], f);
 
-                if (i < code->phi_value->num_incoming_phi_values - 1)
+                if (i < phi->num_incoming_phi_values - 1)
                     fprintf(f, ", ");
             }
             fprintf(f, ")");
             break;
+        }
         case BC_OP_CALL: {
-            bc_dump_value(code->result, f);
+            bc_dump_value(bc_code_value(function, code->result), f);
             fprintf(f, " = ");
-            bc_dump_value(code->target, f);
+            bc_dump_value(bc_code_value(function, code->target), f);
             fprintf(f, "(");
             for (u32 i = 0; i < code->num_args; i++) {
-                bc_dump_value(code->args[i], f);
+                bc_dump_value(bc_code_argument(function, code, i), f);
                 if (i < code->num_args - 1)
                     fprintf(f, ", ");
             }
@@ -231,73 +239,79 @@ void bc_dump_code(BCCode code, FILE *f) {
         }
         case BC_OP_RETURN:
             fprintf(f, "return ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_BITWISE:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = bitwise ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_INT_TO_PTR:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = to ptr ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_PTR_TO_INT:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = to int ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_INT_TRUNC:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = itrunc ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_INT_ZEXT:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = zext ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_INT_SEXT:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = sext ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_FP_EXTEND:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = fpext ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_FP_TRUNC:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = fptrunc ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_FP_TO_SINT:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = fp to sint ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_FP_TO_UINT:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = fp to uint ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_SINT_TO_FP:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = sint to fp ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         case BC_OP_CAST_UINT_TO_FP:
-            bc_dump_value(code->regD, f);
+            bc_dump_value(regD, f);
             fprintf(f, " = uint to fp ");
-            bc_dump_value(code->regA, f);
+            bc_dump_value(regA, f);
             break;
         default: assert(!"unimplemented opcode"); break;
     }
 #undef ARITH_CASE
 }
 
+#undef regD
+#undef regC
+#undef regB
+#undef regA
+#undef reg
+
 void bc_dump_function(BCFunction function, FILE *f) {
     fprintf(f, "---- func %.*s ", (i32) function->name.length, function->name.data);
     bc_dump_type(function->signature, f);
@@ -306,9 +320,9 @@ void bc_dump_function(BCFunction function, FILE *f) {
     for (BCBlock block = function->first_block; block; block = block->next) {
         fprintf(f, "  ---- block%llu:\n", block->serial);
 
-        vector_foreach(BCCode, code_ptr, block->code) {
+        bc_block_foreach_code(function, block, code) {
             fprintf(f, "    ");
-            bc_dump_code(*code_ptr, f);
+            bc_dump_code(function, code, f);
             fprintf(f, "\n");
         }
     }
@@ -1,559 +1,1100 @@
-#include "bytecode.h"
-#include <string.h>
-
-#include "atcc.h"
-#include "ati/utils.h"
-
-#ifdef _WIN32
-#include <stdlib.h>
-#define bswap_16(x) _byteswap_ushort(x)
-#define bswap_32(x) _byteswap_ulong(x)
-#define bswap_64(x) _byteswap_uint64(x)
-#else
-#define bswap_16(x) __builtin_bswap16(x)
-#define bswap_32(x) __builtin_bswap32(x)
-#define bswap_64(x) __builtin_bswap64(x)
-#endif
-
-BCValue bc_value_make(BCFunction function, BCType type) {
-    BCValue value = make(struct SBCValue);
-
-    value->type = type;
-    value->kind = BC_VALUE_TEMPORARY;
-    value->storage = function->last_temporary++;
-
-    return value;
-}
-
-BCValue bc_value_make_consti(BCType type, u64 value) {
-    BCValue constant = make(struct SBCValue);
-
-    assert(type != bc_type_void);
-    assert(!type->is_floating);
-
-    constant->type = type;
-    constant->kind = BC_VALUE_CONSTANT;
-    constant->storage = value;
-    return constant;
-}
-
-BCValue bc_value_make_constf(BCType type, f64 value) {
-    BCValue constant = make(struct SBCValue);
-
-    assert(type != bc_type_void);
-    assert(type->is_floating);
-
-    constant->type = type;
-    constant->kind = BC_VALUE_CONSTANT;
-    constant->floating = value;
-    return constant;
-}
-
-BCValue bc_value_make_string(BCContext context, BCType type, string string) {
-    BCValue constant = make(struct SBCValue);
-
-    constant->type = bc_type_pointer(type);
-    constant->kind = BC_VALUE_STRING;
-    constant->string = string;
-    constant->string_index = vector_length(context->strings);
-
-    vector_push(context->strings, constant);
-
-    return constant;
-}
-
-BCValue bc_value_make_phi(BCFunction function, BCType type) {
-    BCValue phi = make(struct SBCValue);
-
-    phi->type = type;
-    phi->kind = BC_VALUE_PHI;
-
-    phi->phi_result = bc_value_make(function, type);
-    phi->phi_values = vector_create(BCValue);
-    phi->phi_blocks = vector_create(BCBlock);
-    phi->num_incoming_phi_values = 0;
-
-    return phi;
-}
-
-BCValue bc_value_get_parameter(BCFunction function, u32 index) {
-    if (!function->params) {
-        function->params = make_n(struct SBCValue, function->signature->num_params);
-        for (u64 i = 0; i < function->signature->num_params; i++) {
-            BCValue param = &function->params[i];
-
-            param->kind = BC_VALUE_PARAMETER;
-            param->type = function->signature->params[i];
-            param->storage = i;
-        }
-    }
-
-    return &function->params[index];
-}
-
-
-#define BASE_TYPE(_size, _is_signed, ...) \
-    &(struct SBCType) { .kind = BC_TYPE_BASE, .size = _size, .alignment = _size, .is_signed = _is_signed, __VA_ARGS__ }
-
-BCType bc_type_void = BASE_TYPE(0, false);
-BCType bc_type_i8 = BASE_TYPE(1, true), bc_type_u8 = BASE_TYPE(1, false);
-BCType bc_type_i16 = BASE_TYPE(2, true), bc_type_u16 = BASE_TYPE(2, false);
-BCType bc_type_i32 = BASE_TYPE(4, true), bc_type_u32 = BASE_TYPE(4, false);
-BCType bc_type_i64 = BASE_TYPE(8, true), bc_type_u64 = BASE_TYPE(8, false);
-BCType bc_type_f32 = BASE_TYPE(4, true, .is_floating = true),
-        bc_type_f64 = BASE_TYPE(8, true, .is_floating = true);
-
-#undef BASE_TYPE
-
-BCType bc_type_pointer(BCType type) {
-    BCType pointer = make(struct SBCType);
-    pointer->kind = BC_TYPE_POINTER;
-    pointer->size = pointer->alignment = POINTER_SIZE;
-    pointer->base = type;
-    return pointer;
-}
-
-BCType bc_type_array(BCContext context, BCType type, BCValue size, bool is_dynamic) {
-    BCType array = make(struct SBCType);
-    array->kind = BC_TYPE_ARRAY;
-
-    if (!is_dynamic && size && size->kind == BC_VALUE_CONSTANT)
-        array->size = array->alignment = type->size * (u32) size->storage + POINTER_SIZE; // TODO: Better alignment.
-
-    if (is_dynamic || !size)
-        array->size = array->alignment = POINTER_SIZE * 2; // TODO: Better alignment.
-
-    array->element = type;
-    array->count = size;
-    array->is_dynamic = is_dynamic;
-    array->emit_index = (u32) vector_length(context->arrays);
-
-    vector_push(context->arrays, array);
-    return array;
-}
-
-BCType bc_type_function(BCType result, BCType *params, u32 num_params) {
-    BCType function = make(struct SBCType);
-    function->kind = BC_TYPE_FUNCTION;
-    function->size = function->alignment = POINTER_SIZE;
-    function->result = result;
-    function->params = params;
-    function->num_params = num_params;
-    return function;
-}
-
-BCType bc_type_aggregate(BCContext context, string name) {
-    BCType aggregate = make(struct SBCType);
-    aggregate->kind = BC_TYPE_AGGREGATE;
-    aggregate->name = name;
-
-    vector_push(context->aggregates, aggregate);
-    return aggregate;
-}
-
-void bc_type_aggregate_set_body(BCType aggregate, BCAggregate *members, u32 num_members) {
-    aggregate->members = members;
-    aggregate->num_members = num_members;
-
-    // TODO: Better alignment/union calculation.
-    u32 total_size = 0;
-    for (u32 i = 0; i < num_members; i++) {
-        BCAggregate *member = &members[i];
-        total_size += member->type->size;
-    }
-
-    aggregate->size = aggregate->alignment = total_size;
-}
-
-bool bc_type_is_integer(BCType type) {
-    return type == bc_type_i8 || type == bc_type_i16 || type == bc_type_i32 || type == bc_type_i64 ||
-           type == bc_type_u8 || type == bc_type_u16 || type == bc_type_u32 || type == bc_type_u64;
-}
-
-BCContext bc_context_initialize() {
-    BCContext context = make(struct SBCContext);
-
-    context->arrays = vector_create(BCType);
-    context->aggregates = vector_create(BCType);
-    context->strings = vector_create(BCValue);
-
-    context->functions = vector_create(BCFunction);
-
-    return context;
-}
-
-BCFunction bc_function_create(BCContext context, BCType signature, string name) {
-    BCFunction function = make(struct SBCFunction);
-
-    function->signature = signature;
-    function->name = name;
-
-    BCBlock initial_block = bc_block_make(function);
-    function->first_block = function->last_block = function->current_block = initial_block;
-
-    function->locals = vector_create(BCValue);
-
-    vector_push(context->functions, function);
-
-    return function;
-}
-
-BCBlock bc_function_set_block(BCFunction function, BCBlock block) {
-    BCBlock last_block = function->current_block;
-    function->current_block = block;
-    return last_block;
-}
-
-BCBlock bc_function_get_block(BCFunction function) {
-    return function->current_block;
-}
-
-BCValue bc_function_define(BCFunction function, BCType type) {
-    BCValue value = make(struct SBCValue);
-    value->kind = BC_VALUE_LOCAL;
-    value->type = bc_type_pointer(type);
-    value->storage = function->stack_size;
-    function->stack_size += type->size;
-    vector_push(function->locals, value);
-    return value;
-}
-
-BCBlock bc_block_make(BCFunction function) {
-    BCBlock block = make(struct SBCBlock);
-    block->serial = function->last_block_serial++;
-
-    if (function->last_block) {
-        function->last_block->next = block;
-        block->prev = function->last_block;
-        function->last_block = block;
-    }
-
-    block->code = vector_create(BCCode);
-
-    return block;
-}
-
-bool bc_block_is_terminated(BCBlock block) {
-    if (!vector_length(block->code)) return false;
-    BCCode last_insn = vector_last(block->code);
-    return last_insn->opcode == BC_OP_RETURN ||
-           last_insn->opcode == BC_OP_JUMP ||
-           last_insn->opcode == BC_OP_JUMP_IF;
-}
-
-BCCode bc_insn_make(BCBlock block) {
-    BCCode code = make(struct SBCCode);
-
-    code->block = block;
-
-    vector_push(block->code, code);
-    return code;
-}
-
-static BCBlock bc_insn_current_block(BCFunction function) {
-    if (!function->current_block)
-        return bc_function_get_block(function);
-    return function->current_block;
-}
-
-static BCCode bc_insn_of(BCFunction function) {
-    BCBlock block = bc_insn_current_block(function);
-    return bc_insn_make(block);
-}
-
-#define BC_TODO()                \
-    assert(!"UNIMPLEMENTED BC"); \
-    return null;
-
-BCValue bc_insn_nop(BCFunction function) {
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_NOP;
-    return null;
-}
-
-BCValue bc_insn_load(BCFunction function, BCValue source) {
-    if (source->kind == BC_VALUE_CONSTANT)
-        return source;
-    assert(source->type->kind == BC_TYPE_POINTER);
-
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_LOAD;
-    insn->regA = source;
-    insn->regD = bc_value_make(function, source->type->base);
-
-    return insn->regD;
-}
-
-BCValue bc_insn_store(BCFunction function, BCValue dest, BCValue source) {
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_STORE;
-    insn->regA = source;
-    insn->regD = dest;
-
-    return insn->regD;
-}
-
-BCValue bc_insn_get_field(BCFunction function, BCValue source, BCType type, u64 field) {
-    BCCode insn = bc_insn_of(function);
-
-    assert(source->type->kind == BC_TYPE_POINTER);
-
-    insn->opcode = BC_OP_GET_FIELD;
-    insn->regA = source;
-    insn->regB = bc_value_make_consti(bc_type_u64, field);
-    insn->regD = bc_value_make(function, bc_type_pointer(type));
-
-    return insn->regD;
-}
-
-BCValue bc_insn_get_index(BCFunction function, BCValue source, BCType type, BCValue index) {
-    BCCode insn = bc_insn_of(function);
-
-    insn->opcode = BC_OP_GET_INDEX;
-    insn->regA = source;
-    insn->regB = index;
-    insn->regD = bc_value_make(function, bc_type_pointer(type));
-
-    return insn->regD;
-}
-
-BCCode bc_insn_jump(BCFunction function, BCBlock block) {
-    // TODO: Terminate the current block and start a new one.
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_JUMP;
-    insn->bbT = block;
-
-    return insn;
-}
-
-BCCode bc_insn_jump_if(BCFunction function, BCValue cond, BCBlock block_true, BCBlock block_false) {
-    // TODO: Terminate the current block and start a new one.
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_JUMP_IF;
-    insn->regC = cond;
-    insn->bbT = block_true;
-    insn->bbF = block_false;
-
-    return insn;
-}
-
-BCValue bc_insn_phi(BCFunction function, BCType type) {
-    BCCode insn = bc_insn_of(function);
-
-    insn->opcode = BC_OP_PHI;
-    insn->phi_value = bc_value_make_phi(function, type);
-
-    return insn->phi_value;
-}
-
-void bc_insn_phi_add_incoming(BCValue phi, BCValue *values, BCBlock *blocks, u32 num_incoming) {
-    assert(phi->kind == BC_VALUE_PHI);
-    assert(num_incoming > 0);
-
-    for (u32 i = 0; i < num_incoming; i++) {
-        vector_push(phi->phi_values, values[i]);
-        vector_push(phi->phi_blocks, blocks[i]);
-
-        BCCode last_insn = vector_last(blocks[i]->code);
-        last_insn->regC = values[i];
-    }
-
-    phi->num_incoming_phi_values += num_incoming;
-}
-
-static BCValue bc_insn_arith(BCFunction function, BCOpcode opcode, BCValue arg1, BCValue arg2) {
-    // TODO: Check if the value is constant, return a constant.
-    // TODO: Better type equality check.
-    // assert(arg1->type == arg2->type);
-
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = opcode;
-    insn->regA = arg1;
-    insn->regB = arg2;
-    insn->regD = bc_value_make(function, arg1->type);
-
-    return insn->regD;
-}
-
-BCValue bc_insn_add(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_ADD, arg1, arg2); }
-BCValue bc_insn_sub(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_SUB, arg1, arg2); }
-BCValue bc_insn_mul(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_MUL, arg1, arg2); }
-BCValue bc_insn_div(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_DIV, arg1, arg2); }
-BCValue bc_insn_mod(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_MOD, arg1, arg2); }
-BCValue bc_insn_neg(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_NEG, arg1, arg2); }
-BCValue bc_insn_not(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_NOT, arg1, arg2); }
-BCValue bc_insn_and(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_AND, arg1, arg2); }
-BCValue bc_insn_or(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_OR, arg1, arg2); }
-BCValue bc_insn_xor(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_XOR, arg1, arg2); }
-BCValue bc_insn_shl(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_SHL, arg1, arg2); }
-BCValue bc_insn_shr(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_SHR, arg1, arg2); }
-BCValue bc_insn_eq(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_EQ, arg1, arg2); }
-BCValue bc_insn_ne(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_NE, arg1, arg2); }
-BCValue bc_insn_lt(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_LT, arg1, arg2); }
-BCValue bc_insn_gt(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_GT, arg1, arg2); }
-BCValue bc_insn_le(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_LE, arg1, arg2); }
-BCValue bc_insn_ge(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_GE, arg1, arg2); }
-
-BCValue bc_insn_call(BCFunction function, BCValue target, BCValue *args, u32 num_args) {
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_CALL;
-
-    insn->target = target;
-    insn->result = bc_value_make(function, target->type->result);
-    insn->args = args;
-    insn->num_args = num_args;
-
-    return insn->result;
-}
-
-BCValue bc_insn_return(BCFunction function, BCValue value) {
-    // TODO: Terminate the current block and start a new one.
-    // TODO: Check if the return type is null, or if it's of a void type.
-
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = BC_OP_RETURN;
-    insn->regA = value;
-
-    return null;
-}
-
-BCValue bc_insn_cast(BCFunction function, BCOpcode opcode, BCValue source, BCType target) {
-    BCCode insn = bc_insn_of(function);
-    insn->opcode = opcode;
-    insn->regA = source;
-    insn->regD = bc_value_make(function, target);
-
-    return insn->regD;
-}
-
-BCBuffer *bc_buffer_create(u64 initial_capacity) {
-    BCBuffer *buffer = make(BCBuffer);
-
-    buffer->data = malloc(initial_capacity);
-    buffer->size = 0;
-    buffer->capacity = initial_capacity;
-
-    return buffer;
-}
-
-void bc_buffer_destroy(BCBuffer *buffer) {
-    free(buffer->data);
-    free(buffer);
-}
-
-// We should grow less linearly, but should be fine for now.
-static void bc_buffer_ensure(BCBuffer *buffer, u64 size) {
-    if (buffer->size + size > buffer->capacity) {
-        buffer->capacity *= 2;
-        buffer->data = realloc(buffer->data, buffer->capacity);
-    }
-}
-
-
-u64 bc_emit_u8(BCBuffer *buffer, u8 value) {
-    bc_buffer_ensure(buffer, 1);
-
-    buffer->data[buffer->size++] = value;
-
-    return buffer->size - 1;
-}
-
-u64 bc_emit_u16(BCBuffer *buffer, u16 value) {
-    bc_buffer_ensure(buffer, 2);
-
-    value = bswap_16(value);
-
-    buffer->data[buffer->size++] = (value >> 8) & 0xFF;
-    buffer->data[buffer->size++] = value & 0xFF;
-
-    return buffer->size - 2;
-}
-
-u64 bc_emit_u32(BCBuffer *buffer, u32 value) {
-    bc_buffer_ensure(buffer, 4);
-
-    value = bswap_32(value);
-
-    buffer->data[buffer->size++] = (value >> 24) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 16) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 8) & 0xFF;
-    buffer->data[buffer->size++] = value & 0xFF;
-
-    return buffer->size - 4;
-}
-
-u64 bc_emit_u64(BCBuffer *buffer, u64 value) {
-    bc_buffer_ensure(buffer, 8);
-
-    value = bswap_64(value);
-
-    buffer->data[buffer->size++] = (value >> 56) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 48) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 40) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 32) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 24) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 16) & 0xFF;
-    buffer->data[buffer->size++] = (value >> 8) & 0xFF;
-    buffer->data[buffer->size++] = value & 0xFF;
-
-    return buffer->size - 8;
-}
-
-u64 bc_emit_f32(BCBuffer *buffer, f32 value) {
-    return bc_emit_u32(buffer, *(u32 *) &value);
-}
-
-u64 bc_emit_f64(BCBuffer *buffer, f64 value) {
-    return bc_emit_u64(buffer, *(u64 *) &value);
-}
-
-u64 bc_emit_data(BCBuffer *buffer, u8 *data, u64 size) {
-    bc_buffer_ensure(buffer, size);
-
-    memcpy(buffer->data + buffer->size, data, size);
-    buffer->size += size;
-
-    return buffer->size - size;
-}
-
-void bc_patch_u8(BCBuffer *buffer, u64 offset, u8 value) {
-    buffer->data[offset] = value;
-}
-
-void bc_patch_u16(BCBuffer *buffer, u64 offset, u16 value) {
-    value = bswap_16(value);
-
-    buffer->data[offset + 0] = (value >> 8) & 0xFF;
-    buffer->data[offset + 1] = value & 0xFF;
-}
-
-void bc_patch_u32(BCBuffer *buffer, u64 offset, u32 value) {
-    value = bswap_32(value);
-
-    buffer->data[offset + 0] = (value >> 24) & 0xFF;
-    buffer->data[offset + 1] = (value >> 16) & 0xFF;
-    buffer->data[offset + 2] = (value >> 8) & 0xFF;
-    buffer->data[offset + 3] = value & 0xFF;
-}
-
-void bc_patch_u64(BCBuffer *buffer, u64 offset, u64 value) {
-    value = bswap_64(value);
-
-    buffer->data[offset + 0] = (value >> 56) & 0xFF;
-    buffer->data[offset + 1] = (value >> 48) & 0xFF;
-    buffer->data[offset + 2] = (value >> 40) & 0xFF;
-    buffer->data[offset + 3] = (value >> 32) & 0xFF;
-    buffer->data[offset + 4] = (value >> 24) & 0xFF;
-    buffer->data[offset + 5] = (value >> 16) & 0xFF;
-    buffer->data[offset + 6] = (value >> 8) & 0xFF;
-    buffer->data[offset + 7] = value & 0xFF;
-}
-
-void bc_patch_f32(BCBuffer *buffer, u64 offset, f32 value) {
-    bc_patch_u32(buffer, offset, *(u32 *) &value);
-}
-
-void bc_patch_f64(BCBuffer *buffer, u64 offset, f64 value) {
-    bc_patch_u64(buffer, offset, *(u64 *) &value);
-}
-
+#include "bytecode.h"
+#include <math.h>
+#include <string.h>
+
+#include "atcc.h"
+#include "ati/utils.h"
+
+#ifdef _WIN32
+#include <stdlib.h>
+#define bswap_16(x) _byteswap_ushort(x)
+#define bswap_32(x) _byteswap_ulong(x)
+#define bswap_64(x) _byteswap_uint64(x)
+#else
+#define bswap_16(x) __builtin_bswap16(x)
+#define bswap_32(x) __builtin_bswap32(x)
+#define bswap_64(x) __builtin_bswap64(x)
+#endif
+
+// Allocates a value and gives it the next slot of the value table.
+static BCValue bc_value_allocate(BCContext context, Arena *arena) {
+    BCValue value = arena_make(arena, struct SBCValue);
+    value->index = (u32) vector_length(context->values);
+    vector_push(context->values, value);
+    return value;
+}
+
+BCValue bc_value_make(BCFunction function, BCType type) {
+    BCValue value = bc_value_allocate(function->context, &function->arena);
+
+    value->type = type;
+    value->kind = BC_VALUE_TEMPORARY;
+    value->storage = function->last_temporary++;
+
+    return value;
+}
+
+// Position of an integer type in SBCContext.shared_constants, or -1 for every other type.
+static i32 bc_type_shared_index(BCType type) {
+    if (!bc_type_is_integer(type))
+        return -1;
+
+    switch (type->size) {
+        case 1: return 0 + !type->is_signed;
+        case 2: return 2 + !type->is_signed;
+        case 4: return 4 + !type->is_signed;
+        default: return 6 + !type->is_signed;
+    }
+}
+
+BCValue bc_value_make_consti(BCContext context, BCType type, u64 value) {
+    assert(type != bc_type_void);
+    assert(!type->is_floating);
+
+    // Constants are never modified after creation, so small ones can be handed out more than once.
+    i32 shared = bc_type_shared_index(type);
+    if (shared >= 0 && value < BC_SHARED_CONSTANTS && context->shared_constants[shared][value])
+        return context->shared_constants[shared][value];
+
+    BCValue constant = bc_value_allocate(context, &context->arena);
+    constant->type = type;
+    constant->kind = BC_VALUE_CONSTANT;
+    constant->storage = value;
+
+    if (shared >= 0 && value < BC_SHARED_CONSTANTS)
+        context->shared_constants[shared][value] = constant;
+
+    return constant;
+}
+
+BCValue bc_value_make_constf(BCContext context, BCType type, f64 value) {
+    BCValue constant = bc_value_allocate(context, &context->arena);
+
+    assert(type != bc_type_void);
+    assert(type->is_floating);
+
+    constant->type = type;
+    constant->kind = BC_VALUE_CONSTANT;
+    constant->floating = value;
+    return constant;
+}
+
+BCValue bc_value_make_string(BCContext context, BCType type, string string) {
+    BCValue constant = bc_value_allocate(context, &context->arena);
+
+    constant->type = bc_type_pointer(context, type);
+    constant->kind = BC_VALUE_STRING;
+    constant->string = string;
+    constant->string_index = vector_length(context->strings);
+
+    vector_push(context->strings, constant);
+
+    return constant;
+}
+
+BCValue bc_value_make_function(BCContext context, BCFunction function) {
+    BCValue value = bc_value_allocate(context, &context->arena);
+
+    value->type = function->signature;
+    value->kind = BC_VALUE_FUNCTION;
+    value->storage = (u64) function;
+    return value;
+}
+
+BCValue bc_value_make_phi(BCFunction function, BCType type) {
+    BCValue phi = bc_value_allocate(function->context, &function->arena);
+
+    phi->type = type;
+    phi->kind = BC_VALUE_PHI;
+
+    // The incoming values are allocated once they are known, see bc_insn_phi_add_incoming.
+    phi->phi_result = bc_value_make(function, type);
+    phi->phi_function = function;
+
+    return phi;
+}
+
+BCValue bc_value_get_parameter(BCFunction function, u32 index) {
+    if (!function->params) {
+        function->params = arena_alloc(&function->arena, sizeof(struct SBCValue) * function->signature->num_params);
+        for (u64 i = 0; i < function->signature->num_params; i++) {
+            BCValue param = &function->params[i];
+
+            param->index = (u32) vector_length(function->context->values);
+            vector_push(function->context->values, param);
+
+            param->kind = BC_VALUE_PARAMETER;
+            param->type = function->signature->params[i];
+            param->storage = i;
+        }
+    }
+
+    return &function->params[index];
+}
+
+
+#define BASE_TYPE(_size, _is_signed, ...) \
+    &(struct SBCType) { .kind = BC_TYPE_BASE, .size = _size, .alignment = _size, .is_signed = _is_signed, __VA_ARGS__ }
+
+BCType bc_type_void = BASE_TYPE(0, false);
+BCType bc_type_i8 = BASE_TYPE(1, true), bc_type_u8 = BASE_TYPE(1, false);
+BCType bc_type_i16 = BASE_TYPE(2, true), bc_type_u16 = BASE_TYPE(2, false);
+BCType bc_type_i32 = BASE_TYPE(4, true), bc_type_u32 = BASE_TYPE(4, false);
+BCType bc_type_i64 = BASE_TYPE(8, true), bc_type_u64 = BASE_TYPE(8, false);
+BCType bc_type_f32 = BASE_TYPE(4, true, .is_floating = true),
+        bc_type_f64 = BASE_TYPE(8, true, .is_floating = true);
+
+#undef BASE_TYPE
+
+static u64 bc_type_hash_mix(u64 hash, u64 value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+// Array lengths are constants, two arrays of the same length share a type even if the constants differ.
+static u64 bc_type_array_length(BCType type) {
+    if (!type->count)
+        return (u64) -1;
+
+    assert(type->count->kind == BC_VALUE_CONSTANT);
+    return type->count->storage;
+}
+
+static u64 bc_type_hash(BCType type) {
+    u64 hash = bc_type_hash_mix(0, type->kind);
+    switch (type->kind) {
+        case BC_TYPE_POINTER: return bc_type_hash_mix(hash, (u64) type->base);
+        case BC_TYPE_ARRAY: {
+            hash = bc_type_hash_mix(hash, (u64) type->element);
+            hash = bc_type_hash_mix(hash, bc_type_array_length(type));
+            return bc_type_hash_mix(hash, type->is_dynamic);
+        }
+        case BC_TYPE_FUNCTION: {
+            for (u32 i = 0; i < type->num_params; i++)
+                hash = bc_type_hash_mix(hash, (u64) type->params[i]);
+            hash = bc_type_hash_mix(hash, (u64) type->result);
+            return bc_type_hash_mix(hash, type->is_variadic);
+        }
+        default: break;
+    }
+
+    panic("ICE: bytecode type of kind %d is not hash-consed", type->kind);
+}
+
+static bool bc_type_same_structure(BCType a, BCType b) {
+    if (a->kind != b->kind)
+        return false;
+
+    switch (a->kind) {
+        case BC_TYPE_POINTER: return a->base == b->base;
+        case BC_TYPE_ARRAY:
+            return a->element == b->element && a->is_dynamic == b->is_dynamic &&
+                   bc_type_array_length(a) == bc_type_array_length(b);
+        case BC_TYPE_FUNCTION: {
+            if (a->result != b->result || a->is_variadic != b->is_variadic || a->num_params != b->num_params)
+                return false;
+
+            for (u32 i = 0; i < a->num_params; i++) {
+                if (a->params[i] != b->params[i])
+                    return false;
+            }
+            return true;
+        }
+        default: return false;
+    }
+}
+
+static BCType *bc_type_table_find(BCType *table, u32 capacity, BCType type) {
+    u32 index = (u32) bc_type_hash(type) & (capacity - 1);
+    while (table[index] && !bc_type_same_structure(table[index], type))
+        index = (index + 1) & (capacity - 1);
+    return &table[index];
+}
+
+static void bc_type_table_grow(BCContext context) {
+    u32 capacity = context->types_capacity ? context->types_capacity * 2 : 256;
+    BCType *table = make_n(BCType, capacity);
+
+    for (u32 i = 0; i < context->types_capacity; i++) {
+        if (context->types[i])
+            *bc_type_table_find(table, capacity, context->types[i]) = context->types[i];
+    }
+
+    free(context->types);
+    context->types = table;
+    context->types_capacity = capacity;
+}
+
+// Returns the type with the structure of `key`, which is copied into the context the first time.
+static BCType bc_type_intern(BCContext context, BCType key, bool *created) {
+    if ((context->types_length + 1) * 4 > context->types_capacity * 3)
+        bc_type_table_grow(context);
+
+    BCType *slot = bc_type_table_find(context->types, context->types_capacity, key);
+    *created = *slot == null;
+    if (*created) {
+        BCType type = arena_make(&context->arena, struct SBCType);
+        *type = *key;
+
+        *slot = type;
+        context->types_length++;
+    }
+
+    return *slot;
+}
+
+BCType bc_type_pointer(BCContext context, BCType type) {
+    struct SBCType key = {.kind = BC_TYPE_POINTER, .size = POINTER_SIZE, .alignment = POINTER_SIZE, .base = type};
+    bool created;
+    return bc_type_intern(context, &key, &created);
+}
+
+BCType bc_type_array(BCContext context, BCType type, BCValue size, bool is_dynamic) {
+    struct SBCType key = {.kind = BC_TYPE_ARRAY, .element = type, .count = size, .is_dynamic = is_dynamic};
+
+    if (!is_dynamic && size && size->kind == BC_VALUE_CONSTANT)
+        key.size = key.alignment = type->size * (u32) size->storage + POINTER_SIZE; // TODO: Better alignment.
+
+    if (is_dynamic || !size)
+        key.size = key.alignment = POINTER_SIZE * 2; // TODO: Better alignment.
+
+    bool created;
+    BCType array = bc_type_intern(context, &key, &created);
+    if (created) {
+        array->emit_index = (u32) vector_length(context->arrays);
+        vector_push(context->arrays, array);
+    }
+
+    return array;
+}
+
+BCType bc_type_function(BCContext context, BCType result, BCType *params, u32 num_params, bool is_variadic) {
+    struct SBCType key = {
+            .kind = BC_TYPE_FUNCTION,
+            .size = POINTER_SIZE,
+            .alignment = POINTER_SIZE,
+            .result = result,
+            .params = params,
+            .num_params = num_params,
+            .is_variadic = is_variadic,
+    };
+
+    bool created;
+    BCType function = bc_type_intern(context, &key, &created);
+    if (created && num_params) {
+        function->params = arena_alloc(&context->arena, sizeof(BCType) * num_params);
+        memcpy(function->params, params, sizeof(BCType) * num_params);
+    }
+
+    return function;
+}
+
+BCType bc_type_aggregate(BCContext context, string name) {
+    BCType aggregate = arena_make(&context->arena, struct SBCType);
+    aggregate->kind = BC_TYPE_AGGREGATE;
+    aggregate->name = name;
+
+    vector_push(context->aggregates, aggregate);
+    return aggregate;
+}
+
+void bc_type_aggregate_set_body(BCType aggregate, BCAggregate *members, u32 num_members) {
+    aggregate->members = members;
+    aggregate->num_members = num_members;
+
+    // TODO: Better alignment/union calculation.
+    u32 total_size = 0;
+    for (u32 i = 0; i < num_members; i++) {
+        BCAggregate *member = &members[i];
+        total_size += member->type->size;
+    }
+
+    aggregate->size = aggregate->alignment = total_size;
+}
+
+bool bc_type_is_integer(BCType type) {
+    return type == bc_type_i8 || type == bc_type_i16 || type == bc_type_i32 || type == bc_type_i64 ||
+           type == bc_type_u8 || type == bc_type_u16 || type == bc_type_u32 || type == bc_type_u64;
+}
+
+BCContext bc_context_initialize() {
+    BCContext context = make(struct SBCContext);
+    arena_initialize(&context->arena);
+
+    // Index 0 stands for a missing operand.
+    context->values = vector_create(BCValue);
+    vector_push(context->values, null);
+
+    context->arrays = vector_create(BCType);
+    context->aggregates = vector_create(BCType);
+    context->strings = vector_create(BCValue);
+
+    context->functions = vector_create(BCFunction);
+
+    return context;
+}
+
+void bc_context_destroy(BCContext context) {
+    vector_foreach(BCFunction, function_ptr, context->functions) {
+        BCFunction function = *function_ptr;
+        if (function->code)
+            vector_free(function->code);
+        if (function->operands)
+            vector_free(function->operands);
+        arena_free(&function->arena);
+    }
+
+    free(context->types);
+    vector_free(context->values);
+    vector_free(context->arrays);
+    vector_free(context->aggregates);
+    vector_free(context->strings);
+    vector_free(context->functions);
+
+    arena_free(&context->arena);
+    free(context);
+}
+
+BCValue bc_context_define(BCContext context, BCType type) {
+    BCValue value = bc_value_allocate(context, &context->arena);
+    value->kind = BC_VALUE_GLOBAL;
+    value->type = bc_type_pointer(context, type);
+    value->storage = context->global_size;
+    context->global_size += type->size;
+    return value;
+}
+
+BCFunction bc_function_create(BCContext context, BCType signature, string name) {
+    BCFunction function = arena_make(&context->arena, struct SBCFunction);
+    arena_initialize(&function->arena);
+
+    function->context = context;
+    function->signature = signature;
+    function->name = name;
+
+    function->blocks = vector_empty;
+
+    BCBlock initial_block = bc_block_make(function);
+    function->first_block = function->last_block = function->current_block = initial_block;
+
+    function->locals = vector_empty;
+
+    vector_push(context->functions, function);
+
+    return function;
+}
+
+BCBlock bc_function_set_block(BCFunction function, BCBlock block) {
+    BCBlock last_block = function->current_block;
+    function->current_block = block;
+    return last_block;
+}
+
+BCBlock bc_function_get_block(BCFunction function) {
+    return function->current_block;
+}
+
+BCValue bc_function_define(BCFunction function, BCType type) {
+    BCValue value = bc_value_allocate(function->context, &function->arena);
+    value->kind = BC_VALUE_LOCAL;
+    value->type = bc_type_pointer(function->context, type);
+    value->storage = function->stack_size;
+    function->stack_size += type->size;
+    arena_vector_push(&function->arena, function->locals, value);
+    return value;
+}
+
+void bc_function_compact(BCFunction function) {
+    if (!function->code)
+        return;
+
+    BCCode code = vector_create_n(struct SBCCode, vector_length(function->code));
+
+    u32 position = 0;
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        u32 first = position;
+        bc_block_foreach_code(function, block, insn) {
+            code[position] = *insn;
+            code[position].next = position + 1;
+            position++;
+        }
+
+        block->num_code = position - first;
+        if (!block->num_code) {
+            block->first_code = block->last_code = BC_NO_INDEX;
+            continue;
+        }
+
+        code[position - 1].next = BC_NO_INDEX;
+        block->first_code = first;
+        block->last_code = position - 1;
+    }
+
+    // Instructions of blocks that were unlinked from the function are dropped.
+    vector_length(code) = position;
+    vector_free(function->code);
+    function->code = code;
+}
+
+BCBlock bc_block_make(BCFunction function) {
+    BCBlock block = arena_make(&function->arena, struct SBCBlock);
+    block->serial = function->last_block_serial++;
+    block->first_code = block->last_code = BC_NO_INDEX;
+
+    if (function->last_block) {
+        function->last_block->next = block;
+        block->prev = function->last_block;
+        function->last_block = block;
+    }
+
+    arena_vector_push(&function->arena, function->blocks, block);
+
+    return block;
+}
+
+bool bc_block_is_terminated(BCFunction function, BCBlock block) {
+    BCCode last_insn = bc_code_at(function, block->last_code);
+    if (!last_insn) return false;
+    return last_insn->opcode == BC_OP_RETURN ||
+           last_insn->opcode == BC_OP_JUMP ||
+           last_insn->opcode == BC_OP_JUMP_IF;
+}
+
+BCCode bc_insn_make(BCFunction function, BCBlock block) {
+    if (!function->code)
+        function->code = vector_create_n(struct SBCCode, 16);
+
+    u32 index = (u32) vector_length(function->code);
+    vector_push(function->code, ((struct SBCCode){.next = BC_NO_INDEX}));
+
+    if (block->last_code == BC_NO_INDEX)
+        block->first_code = index;
+    else
+        function->code[block->last_code].next = index;
+
+    block->last_code = index;
+    block->num_code++;
+
+    return &function->code[index];
+}
+
+static BCBlock bc_insn_current_block(BCFunction function) {
+    if (!function->current_block)
+        return bc_function_get_block(function);
+    return function->current_block;
+}
+
+static BCCode bc_insn_of(BCFunction function) {
+    BCBlock block = bc_insn_current_block(function);
+    return bc_insn_make(function, block);
+}
+
+#define BC_TODO()                \
+    assert(!"UNIMPLEMENTED BC"); \
+    return null;
+
+static u32 bc_index(BCValue value) {
+    return value ? value->index : 0;
+}
+
+BCValue bc_insn_nop(BCFunction function) {
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_NOP;
+    return null;
+}
+
+BCValue bc_insn_load(BCFunction function, BCValue source) {
+    if (source->kind == BC_VALUE_CONSTANT)
+        return source;
+    assert(source->type->kind == BC_TYPE_POINTER);
+
+    BCValue result = bc_value_make(function, source->type->base);
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_LOAD;
+    insn->regA = source->index;
+    insn->regD = result->index;
+
+    return result;
+}
+
+BCValue bc_insn_store(BCFunction function, BCValue dest, BCValue source) {
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_STORE;
+    insn->regA = source->index;
+    insn->regD = dest->index;
+
+    return dest;
+}
+
+BCValue bc_insn_get_field(BCFunction function, BCValue source, BCType type, u64 field) {
+    assert(source->type->kind == BC_TYPE_POINTER);
+
+    BCValue index = bc_value_make_consti(function->context, bc_type_u64, field);
+    BCValue result = bc_value_make(function, bc_type_pointer(function->context, type));
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_GET_FIELD;
+    insn->regA = source->index;
+    insn->regB = index->index;
+    insn->regD = result->index;
+
+    return result;
+}
+
+BCValue bc_insn_get_index(BCFunction function, BCValue source, BCType type, BCValue index) {
+    BCValue result = bc_value_make(function, bc_type_pointer(function->context, type));
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_GET_INDEX;
+    insn->regA = source->index;
+    insn->regB = index->index;
+    insn->regD = result->index;
+
+    return result;
+}
+
+BCCode bc_insn_jump(BCFunction function, BCBlock block) {
+    // TODO: Terminate the current block and start a new one.
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_JUMP;
+    insn->bbT = (u32) block->serial;
+
+    return insn;
+}
+
+BCCode bc_insn_jump_if(BCFunction function, BCValue cond, BCBlock block_true, BCBlock block_false) {
+    // TODO: Terminate the current block and start a new one.
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_JUMP_IF;
+    insn->regC = cond->index;
+    insn->bbT = (u32) block_true->serial;
+    insn->bbF = (u32) block_false->serial;
+
+    return insn;
+}
+
+BCValue bc_insn_phi(BCFunction function, BCType type) {
+    BCValue phi = bc_value_make_phi(function, type);
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_PHI;
+    insn->phi_value = phi->index;
+
+    return phi;
+}
+
+void bc_insn_phi_add_incoming(BCValue phi, BCValue *values, BCBlock *blocks, u32 num_incoming) {
+    assert(phi->kind == BC_VALUE_PHI);
+    assert(num_incoming > 0);
+
+    BCFunction function = phi->phi_function;
+    u32 old_count = phi->num_incoming_phi_values;
+    u32 new_count = old_count + num_incoming;
+
+    BCValue *phi_values = arena_alloc(&function->arena, sizeof(BCValue) * new_count);
+    BCBlock *phi_blocks = arena_alloc(&function->arena, sizeof(BCBlock) * new_count);
+    if (old_count) {
+        memcpy(phi_values, phi->phi_values, sizeof(BCValue) * old_count);
+        memcpy(phi_blocks, phi->phi_blocks, sizeof(BCBlock) * old_count);
+    }
+
+    for (u32 i = 0; i < num_incoming; i++) {
+        phi_values[old_count + i] = values[i];
+        phi_blocks[old_count + i] = blocks[i];
+
+        BCCode last_insn = bc_code_at(function, blocks[i]->last_code);
+        last_insn->regC = values[i]->index;
+    }
+
+    phi->phi_values = phi_values;
+    phi->phi_blocks = phi_blocks;
+    phi->num_incoming_phi_values = new_count;
+}
+
+// Truncates `value` to the width of `type` and extends it back according to the signedness of the type.
+static u64 bc_value_normalize(BCType type, u64 value) {
+    if (type->size >= 8)
+        return value;
+
+    u32 bits = type->size * 8;
+    u64 mask = ((u64) 1 << bits) - 1;
+
+    value &= mask;
+    if (type->is_signed && (value >> (bits - 1)) & 1)
+        value |= ~mask;
+
+    return value;
+}
+
+static bool bc_value_is_integer(BCValue value, u64 expected) {
+    if (!value || value->kind != BC_VALUE_CONSTANT || !bc_type_is_integer(value->type))
+        return false;
+
+    return bc_value_normalize(value->type, value->storage) == bc_value_normalize(value->type, expected);
+}
+
+// Compares two integer constants in the type C's usual arithmetic conversions would bring them to.
+static bool bc_value_compare_integers(BCOpcode opcode, BCType type1, u64 a, BCType type2, u64 b) {
+    // Anything narrower than int is promoted to int first.
+    u32 size1 = type1->size < 4 ? 4 : type1->size;
+    u32 size2 = type2->size < 4 ? 4 : type2->size;
+    bool signed1 = type1->size < 4 || type1->is_signed;
+    bool signed2 = type2->size < 4 || type2->is_signed;
+
+    u32 size = size1 > size2 ? size1 : size2;
+    bool is_signed = signed1 && signed2;
+    if (signed1 != signed2) {
+        // The signed side only wins when it is wider than the unsigned one.
+        u32 signed_size = signed1 ? size1 : size2;
+        u32 unsigned_size = signed1 ? size2 : size1;
+        is_signed = signed_size > unsigned_size;
+    }
+
+    // The operands are already extended to 64 bits from their own types, so this is the conversion.
+    if (!is_signed && size < 8) {
+        a &= 0xFFFFFFFF;
+        b &= 0xFFFFFFFF;
+    }
+
+    i64 sa = (i64) a, sb = (i64) b;
+    switch (opcode) {
+        case BC_OP_EQ: return a == b;
+        case BC_OP_NE: return a != b;
+        case BC_OP_LT: return is_signed ? sa < sb : a < b;
+        case BC_OP_GT: return is_signed ? sa > sb : a > b;
+        case BC_OP_LE: return is_signed ? sa <= sb : a <= b;
+        case BC_OP_GE: return is_signed ? sa >= sb : a >= b;
+        default: panic("ICE: Not a comparison");
+    }
+}
+
+// Folds integer arithmetic the way the generated C would compute it, or returns null when that is undefined.
+static BCValue bc_insn_fold_integer(BCContext context, BCOpcode opcode, BCValue arg1, BCValue arg2) {
+    BCType type = arg1->type;
+    u64 a = bc_value_normalize(type, arg1->storage);
+
+    if (!arg2) {
+        switch (opcode) {
+            case BC_OP_SUB: return bc_value_make_consti(context, type, bc_value_normalize(type, -a));
+            case BC_OP_NEG: return bc_value_make_consti(context, type, bc_value_normalize(type, ~a));
+            case BC_OP_NOT: return bc_value_make_consti(context, type, a == 0);
+            default: return null;
+        }
+    }
+
+    u64 b = bc_value_normalize(arg2->type, arg2->storage);
+
+    // The low bits of these only depend on the low bits of the operands, so the operand types do not matter.
+    u64 result;
+    switch (opcode) {
+        case BC_OP_ADD: result = a + b; break;
+        case BC_OP_SUB: result = a - b; break;
+        case BC_OP_MUL: result = a * b; break;
+        case BC_OP_AND: result = a & b; break;
+        case BC_OP_OR: result = a | b; break;
+        case BC_OP_XOR: result = a ^ b; break;
+        case BC_OP_SHL:
+            if (b >= type->size * 8)
+                return null;
+            result = a << b;
+            break;
+        case BC_OP_EQ:
+        case BC_OP_NE:
+        case BC_OP_LT:
+        case BC_OP_GT:
+        case BC_OP_LE:
+        case BC_OP_GE: result = bc_value_compare_integers(opcode, type, a, arg2->type, b); break;
+        default: {
+            if (arg2->type != type)
+                return null;
+
+            i64 sa = (i64) a, sb = (i64) b;
+            bool is_signed = type->is_signed;
+            switch (opcode) {
+                case BC_OP_DIV:
+                case BC_OP_MOD:
+                    if (b == 0 || (is_signed && sb == -1))
+                        return null;
+                    if (opcode == BC_OP_DIV)
+                        result = is_signed ? (u64) (sa / sb) : a / b;
+                    else
+                        result = is_signed ? (u64) (sa % sb) : a % b;
+                    break;
+                case BC_OP_SHR:
+                    if (b >= type->size * 8)
+                        return null;
+                    result = is_signed ? (u64) (sa >> b) : a >> b;
+                    break;
+                default: return null;
+            }
+        }
+    }
+
+    return bc_value_make_consti(context, type, bc_value_normalize(type, result));
+}
+
+static BCValue bc_insn_fold_floating(BCContext context, BCOpcode opcode, BCValue arg1, BCValue arg2) {
+    BCType type = arg1->type;
+    f64 a = arg1->floating;
+
+    f64 result;
+    if (!arg2) {
+        switch (opcode) {
+            case BC_OP_SUB: result = -a; break;
+            case BC_OP_NOT: result = a == 0; break;
+            default: return null;
+        }
+    } else {
+        if (arg2->type != type)
+            return null;
+
+        f64 b = arg2->floating;
+        switch (opcode) {
+            case BC_OP_ADD: result = a + b; break;
+            case BC_OP_SUB: result = a - b; break;
+            case BC_OP_MUL: result = a * b; break;
+            case BC_OP_DIV: result = a / b; break;
+            case BC_OP_EQ: result = a == b; break;
+            case BC_OP_NE: result = a != b; break;
+            case BC_OP_LT: result = a < b; break;
+            case BC_OP_GT: result = a > b; break;
+            case BC_OP_LE: result = a <= b; break;
+            case BC_OP_GE: result = a >= b; break;
+            default: return null;
+        }
+    }
+
+    if (type == bc_type_f32)
+        result = (f32) result;
+
+    // The backends spell constants as literals, and infinities and NaNs have none.
+    if (!isfinite(result))
+        return null;
+
+    return bc_value_make_constf(context, type, result);
+}
+
+// Returns the value `arg1 op arg2` is known to be without emitting anything, or null if it needs an instruction.
+static BCValue bc_insn_simplify(BCFunction function, BCOpcode opcode, BCValue arg1, BCValue arg2) {
+    BCType type = arg1->type;
+    if (arg1->kind == BC_VALUE_CONSTANT && (!arg2 || arg2->kind == BC_VALUE_CONSTANT) && type->kind == BC_TYPE_BASE) {
+        if (bc_type_is_integer(type) && (!arg2 || bc_type_is_integer(arg2->type)))
+            return bc_insn_fold_integer(function->context, opcode, arg1, arg2);
+        if (type->is_floating && (!arg2 || arg2->type->is_floating))
+            return bc_insn_fold_floating(function->context, opcode, arg1, arg2);
+        return null;
+    }
+
+    // Identities are only sound for integers, x + 0 is not x for floating point -0.
+    if (!arg2 || !bc_type_is_integer(type) || !bc_type_is_integer(arg2->type))
+        return null;
+
+    switch (opcode) {
+        case BC_OP_ADD:
+        case BC_OP_SUB:
+        case BC_OP_OR:
+        case BC_OP_XOR:
+        case BC_OP_SHL:
+        case BC_OP_SHR:
+            if (bc_value_is_integer(arg2, 0))
+                return arg1;
+            break;
+        case BC_OP_MUL:
+        case BC_OP_DIV:
+            if (bc_value_is_integer(arg2, 1))
+                return arg1;
+            break;
+        case BC_OP_AND:
+            if (arg2->type == type && bc_value_is_integer(arg2, ~(u64) 0))
+                return arg1;
+            break;
+        default: break;
+    }
+
+    if ((opcode == BC_OP_MUL || opcode == BC_OP_AND) && (bc_value_is_integer(arg1, 0) || bc_value_is_integer(arg2, 0)))
+        return bc_value_make_consti(function->context, type, 0);
+
+    // The constant is on the left, the other operand can only stand in for the result if it has the same type.
+    if (arg2->type != type)
+        return null;
+
+    switch (opcode) {
+        case BC_OP_ADD:
+        case BC_OP_OR:
+        case BC_OP_XOR: return bc_value_is_integer(arg1, 0) ? arg2 : null;
+        case BC_OP_MUL: return bc_value_is_integer(arg1, 1) ? arg2 : null;
+        case BC_OP_AND: return bc_value_is_integer(arg1, ~(u64) 0) ? arg2 : null;
+        default: return null;
+    }
+}
+
+static BCValue bc_insn_arith(BCFunction function, BCOpcode opcode, BCValue arg1, BCValue arg2) {
+    // assert(arg1->type == arg2->type);
+
+    BCValue simplified = bc_insn_simplify(function, opcode, arg1, arg2);
+    if (simplified)
+        return simplified;
+
+    BCValue result = bc_value_make(function, arg1->type);
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = opcode;
+    insn->regA = arg1->index;
+    insn->regB = bc_index(arg2);
+    insn->regD = result->index;
+
+    return result;
+}
+
+BCValue bc_insn_add(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_ADD, arg1, arg2); }
+BCValue bc_insn_sub(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_SUB, arg1, arg2); }
+BCValue bc_insn_mul(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_MUL, arg1, arg2); }
+BCValue bc_insn_div(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_DIV, arg1, arg2); }
+BCValue bc_insn_mod(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_MOD, arg1, arg2); }
+BCValue bc_insn_neg(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_NEG, arg1, arg2); }
+BCValue bc_insn_not(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_NOT, arg1, arg2); }
+BCValue bc_insn_and(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_AND, arg1, arg2); }
+BCValue bc_insn_or(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_OR, arg1, arg2); }
+BCValue bc_insn_xor(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_XOR, arg1, arg2); }
+BCValue bc_insn_shl(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_SHL, arg1, arg2); }
+BCValue bc_insn_shr(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_SHR, arg1, arg2); }
+BCValue bc_insn_eq(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_EQ, arg1, arg2); }
+BCValue bc_insn_ne(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_NE, arg1, arg2); }
+BCValue bc_insn_lt(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_LT, arg1, arg2); }
+BCValue bc_insn_gt(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_GT, arg1, arg2); }
+BCValue bc_insn_le(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_LE, arg1, arg2); }
+BCValue bc_insn_ge(BCFunction function, BCValue arg1, BCValue arg2) { return bc_insn_arith(function, BC_OP_GE, arg1, arg2); }
+
+BCValue bc_insn_call(BCFunction function, BCValue target, BCValue *args, u32 num_args) {
+    BCValue result = bc_value_make(function, target->type->result);
+
+    if (!function->operands)
+        function->operands = vector_create_n(u32, 16);
+
+    u32 first_arg = (u32) vector_length(function->operands);
+    for (u32 i = 0; i < num_args; i++)
+        vector_push(function->operands, args[i]->index);
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_CALL;
+    insn->target = target->index;
+    insn->result = result->index;
+    insn->args = first_arg;
+    insn->num_args = num_args;
+
+    return result;
+}
+
+BCValue bc_insn_return(BCFunction function, BCValue value) {
+    // TODO: Terminate the current block and start a new one.
+    // TODO: Check if the return type is null, or if it's of a void type.
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = BC_OP_RETURN;
+    insn->regA = bc_index(value);
+
+    return null;
+}
+
+static BCValue bc_insn_fold_cast(BCContext context, BCOpcode opcode, BCValue source, BCType target) {
+    BCType type = source->type;
+    if (source->kind != BC_VALUE_CONSTANT || type->kind != BC_TYPE_BASE || target->kind != BC_TYPE_BASE)
+        return null;
+
+    switch (opcode) {
+        case BC_OP_CAST_INT_TRUNC:
+        case BC_OP_CAST_INT_ZEXT:
+        case BC_OP_CAST_INT_SEXT: {
+            if (!bc_type_is_integer(type) || !bc_type_is_integer(target))
+                return null;
+
+            u64 value = bc_value_normalize(type, source->storage);
+            return bc_value_make_consti(context, target, bc_value_normalize(target, value));
+        }
+        case BC_OP_CAST_FP_EXTEND:
+        case BC_OP_CAST_FP_TRUNC: {
+            if (!type->is_floating || !target->is_floating)
+                return null;
+
+            f64 value = source->floating;
+            return bc_value_make_constf(context, target, target == bc_type_f32 ? (f32) value : value);
+        }
+        case BC_OP_CAST_FP_TO_SINT:
+        case BC_OP_CAST_FP_TO_UINT: {
+            if (!type->is_floating || !bc_type_is_integer(target))
+                return null;
+
+            // Converting a value that does not fit is undefined, so it is left to run on the target.
+            f64 value = source->floating;
+            f64 limit = ldexp(1.0, (i32) (target->size * 8 - target->is_signed));
+            if (!(value > (target->is_signed ? -limit - 1.0 : -1.0) && value < limit))
+                return null;
+
+            u64 result = target->is_signed ? (u64) (i64) value : (u64) value;
+            return bc_value_make_consti(context, target, bc_value_normalize(target, result));
+        }
+        case BC_OP_CAST_SINT_TO_FP:
+        case BC_OP_CAST_UINT_TO_FP: {
+            if (!bc_type_is_integer(type) || !target->is_floating)
+                return null;
+
+            // Like C, the source type decides the signedness of the conversion.
+            u64 value = bc_value_normalize(type, source->storage);
+            if (target == bc_type_f32)
+                return bc_value_make_constf(context, target, type->is_signed ? (f32) (i64) value : (f32) value);
+            return bc_value_make_constf(context, target, type->is_signed ? (f64) (i64) value : (f64) value);
+        }
+        default: return null;
+    }
+}
+
+BCValue bc_insn_cast(BCFunction function, BCOpcode opcode, BCValue source, BCType target) {
+    if (source->type == target)
+        return source;
+
+    BCValue folded = bc_insn_fold_cast(function->context, opcode, source, target);
+    if (folded)
+        return folded;
+
+    BCValue result = bc_value_make(function, target);
+
+    BCCode insn = bc_insn_of(function);
+    insn->opcode = opcode;
+    insn->regA = source->index;
+    insn->regD = result->index;
+
+    return result;
+}
+
+BCBuffer *bc_buffer_create(u64 initial_capacity) {
+    BCBuffer *buffer = make(BCBuffer);
+
+    buffer->data = malloc(initial_capacity);
+    buffer->size = 0;
+    buffer->capacity = initial_capacity;
+
+    return buffer;
+}
+
+void bc_buffer_destroy(BCBuffer *buffer) {
+    free(buffer->data);
+    free(buffer);
+}
+
+// We should grow less linearly, but should be fine for now.
+static void bc_buffer_ensure(BCBuffer *buffer, u64 size) {
+    if (buffer->size + size > buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+}
+
+
+u64 bc_emit_u8(BCBuffer *buffer, u8 value) {
+    bc_buffer_ensure(buffer, 1);
+
+    buffer->data[buffer->size++] = value;
+
+    return buffer->size - 1;
+}
+
+u64 bc_emit_u16(BCBuffer *buffer, u16 value) {
+    bc_buffer_ensure(buffer, 2);
+
+    value = bswap_16(value);
+
+    buffer->data[buffer->size++] = (value >> 8) & 0xFF;
+    buffer->data[buffer->size++] = value & 0xFF;
+
+    return buffer->size - 2;
+}
+
+u64 bc_emit_u32(BCBuffer *buffer, u32 value) {
+    bc_buffer_ensure(buffer, 4);
+
+    value = bswap_32(value);
+
+    buffer->data[buffer->size++] = (value >> 24) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 16) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 8) & 0xFF;
+    buffer->data[buffer->size++] = value & 0xFF;
+
+    return buffer->size - 4;
+}
+
+u64 bc_emit_u64(BCBuffer *buffer, u64 value) {
+    bc_buffer_ensure(buffer, 8);
+
+    value = bswap_64(value);
+
+    buffer->data[buffer->size++] = (value >> 56) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 48) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 40) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 32) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 24) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 16) & 0xFF;
+    buffer->data[buffer->size++] = (value >> 8) & 0xFF;
+    buffer->data[buffer->size++] = value & 0xFF;
+
+    return buffer->size - 8;
+}
+
+u64 bc_emit_f32(BCBuffer *buffer, f32 value) {
+    return bc_emit_u32(buffer, *(u32 *) &value);
+}
+
+u64 bc_emit_f64(BCBuffer *buffer, f64 value) {
+    return bc_emit_u64(buffer, *(u64 *) &value);
+}
+
+u64 bc_emit_data(BCBuffer *buffer, u8 *data, u64 size) {
+    bc_buffer_ensure(buffer, size);
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+
+    return buffer->size - size;
+}
+
+void bc_patch_u8(BCBuffer *buffer, u64 offset, u8 value) {
+    buffer->data[offset] = value;
+}
+
+void bc_patch_u16(BCBuffer *buffer, u64 offset, u16 value) {
+    value = bswap_16(value);
+
+    buffer->data[offset + 0] = (value >> 8) & 0xFF;
+    buffer->data[offset + 1] = value & 0xFF;
+}
+
+void bc_patch_u32(BCBuffer *buffer, u64 offset, u32 value) {
+    value = bswap_32(value);
+
+    buffer->data[offset + 0] = (value >> 24) & 0xFF;
+    buffer->data[offset + 1] = (value >> 16) & 0xFF;
+    buffer->data[offset + 2] = (value >> 8) & 0xFF;
+    buffer->data[offset + 3] = value & 0xFF;
+}
+
+void bc_patch_u64(BCBuffer *buffer, u64 offset, u64 value) {
+    value = bswap_64(value);
+
+    buffer->data[offset + 0] = (value >> 56) & 0xFF;
+    buffer->data[offset + 1] = (value >> 48) & 0xFF;
+    buffer->data[offset + 2] = (value >> 40) & 0xFF;
+    buffer->data[offset + 3] = (value >> 32) & 0xFF;
+    buffer->data[offset + 4] = (value >> 24) & 0xFF;
+    buffer->data[offset + 5] = (value >> 16) & 0xFF;
+    buffer->data[offset + 6] = (value >> 8) & 0xFF;
+    buffer->data[offset + 7] = value & 0xFF;
+}
+
+void bc_patch_f32(BCBuffer *buffer, u64 offset, f32 value) {
+    bc_patch_u32(buffer, offset, *(u32 *) &value);
+}
+
+void bc_patch_f64(BCBuffer *buffer, u64 offset, f64 value) {
+    bc_patch_u64(buffer, offset, *(u64 *) &value);
+}
+
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "ati/arena.h"
 #include "ati/basic.h"
 #include "ati/string.h"
 
@@ -23,6 +24,8 @@ typedef enum BCValueKind {
 
 struct SBCValue {
     BCValueKind kind;
+    // Position in the value table of the context, which is how instructions refer to the value.
+    u32 index;
     BCType type;
     void *backend_data;
     union {
@@ -38,16 +41,18 @@ struct SBCValue {
             BCValue *phi_values;
             BCBlock *phi_blocks;
             u32 num_incoming_phi_values;
+            BCFunction phi_function;
         };
     };
 };
 
 BCValue bc_value_make(BCFunction function, BCType type);
 
-BCValue bc_value_make_consti(BCType type, u64 value);
-BCValue bc_value_make_constf(BCType type, f64 value);
+BCValue bc_value_make_consti(BCContext context, BCType type, u64 value);
+BCValue bc_value_make_constf(BCContext context, BCType type, f64 value);
 
 BCValue bc_value_make_string(BCContext context, BCType type, string string);
+BCValue bc_value_make_function(BCContext context, BCFunction function);
 
 BCValue bc_value_make_phi(BCFunction function, BCType type);
 
@@ -106,9 +111,10 @@ extern BCType bc_type_i32, bc_type_u32;
 extern BCType bc_type_i64, bc_type_u64;
 extern BCType bc_type_f32, bc_type_f64;
 
-BCType bc_type_pointer(BCType type);
+// Pointer, array and function types are hash-consed per context, so equal types are the same object.
+BCType bc_type_pointer(BCContext context, BCType type);
 BCType bc_type_array(BCContext context, BCType type, BCValue size, bool is_dynamic);
-BCType bc_type_function(BCType result, BCType *params, u32 num_params);
+BCType bc_type_function(BCContext context, BCType result, BCType *params, u32 num_params, bool is_variadic);
 BCType bc_type_aggregate(BCContext context, string name);
 void bc_type_aggregate_set_body(BCType aggregate, BCAggregate *members, u32 num_members);
 
@@ -163,44 +169,61 @@ typedef enum {
     BC_OP_CAST_UINT_TO_FP,
 } BCOpcode;
 
+#define BC_NO_INDEX ((u32) -1)
+
+// Instructions are stored by value in one array per function. Operands are indices into the
+// value table of the context, where 0 means no value, and blocks are indices into the block
+// table of the function. Use bc_code_value and bc_code_block to resolve them.
 struct SBCCode {
-    BCBlock block;
-    BCOpcode opcode;
-    u32 flags;
+    u16 opcode;
+    u16 flags;
+
+    // The next instruction of the same block, or BC_NO_INDEX.
+    u32 next;
 
     union {
         struct {
-            BCValue regA;
-            BCValue regB;
-            BCValue regD;
+            u32 regA;
+            u32 regB;
+            u32 regD;
         };
         struct {
-            BCValue regC;
-            BCBlock bbT;
-            BCBlock bbF;
+            u32 regC;
+            u32 bbT;
+            u32 bbF;
         };
         struct {
-            BCValue target;
-            BCValue result;
-            BCValue *args;
+            u32 target;
+            u32 result;
+            // The arguments are `num_args` entries of the operand array of the function.
+            u32 args;
             u32 num_args;
         };
         struct {
-            BCValue phi_value;
+            u32 phi_value;
         };
     };
 };
 
 struct SBCBlock {
+    // Position in the block table of the function.
     u64 serial;
     BCBlock prev, next;
 
-    BCCode *code;
+    u32 first_code;
+    u32 last_code;
+    u32 num_code;
+
     BCValue input;
     void *backend_data;
 };
 
+// Values and blocks of a function live in its arena, everything shared between functions
+// lives in the arena of the context. Both go away in bc_context_destroy.
 struct SBCFunction {
+    BCContext context;
+    Arena arena;
+
     BCType signature;
     string name;
 
@@ -212,6 +235,12 @@ struct SBCFunction {
 
     BCBlock current_block;
 
+    // Instructions in the order they were built, null until the first one. bc_function_compact
+    // lays out every block contiguously, in block order, so that walking the blocks walks the array.
+    BCCode code;
+    BCBlock *blocks;
+    u32 *operands;
+
     BCValue params;
     BCValue *locals;
     u32 last_temporary;
@@ -221,7 +250,22 @@ struct SBCFunction {
     void *backend_data;
 };
 
+#define BC_SHARED_CONSTANTS 16
+
 struct SBCContext {
+    Arena arena;
+
+    // Every value of the module, instructions refer to them by index.
+    BCValue *values;
+
+    // Open-addressed table of every pointer, array and function type of the module.
+    BCType *types;
+    u32 types_capacity;
+    u32 types_length;
+
+    // The constants 0 to BC_SHARED_CONSTANTS - 1 of every integer type, created on first use.
+    BCValue shared_constants[8][BC_SHARED_CONSTANTS];
+
     BCType *arrays;
     BCType *aggregates;
     BCValue *strings;
@@ -231,16 +275,39 @@ struct SBCContext {
 };
 
 BCContext bc_context_initialize(void);
+void bc_context_destroy(BCContext context);
+BCValue bc_context_define(BCContext context, BCType type);
 
 BCFunction bc_function_create(BCContext context, BCType signature, string name);
 BCBlock bc_function_set_block(BCFunction function, BCBlock block);
 BCBlock bc_function_get_block(BCFunction function);
 BCValue bc_function_define(BCFunction function, BCType type);
+void bc_function_compact(BCFunction function);
 
 BCBlock bc_block_make(BCFunction function);
-bool bc_block_is_terminated(BCBlock block);
+bool bc_block_is_terminated(BCFunction function, BCBlock block);
 
-BCCode bc_insn_make(BCBlock block);
+// The returned instruction points into the code array, it moves when the next one is added.
+BCCode bc_insn_make(BCFunction function, BCBlock block);
+
+static inline BCValue bc_code_value(BCFunction function, u32 index) {
+    return function->context->values[index];
+}
+
+static inline BCBlock bc_code_block(BCFunction function, u32 index) {
+    return function->blocks[index];
+}
+
+static inline BCValue bc_code_argument(BCFunction function, BCCode code, u32 index) {
+    return function->context->values[function->operands[code->args + index]];
+}
+
+static inline BCCode bc_code_at(BCFunction function, u32 index) {
+    return index == BC_NO_INDEX ? null : &function->code[index];
+}
+
+#define bc_block_foreach_code(function, block, name) \
+    for (BCCode name = bc_code_at((function), (block)->first_code); name; name = bc_code_at((function), name->next))
 
 BCValue bc_insn_nop(BCFunction function);
 
@@ -329,6 +396,45 @@ typedef struct BCBinaryFile {
     BCSection *sections;
 } BCBinaryFile;
 
+typedef void (*BCOperandVisitor)(void *state, u32 operand);
+
+// Calls `visit` with every value `code` reads, including the index 0 of missing operands.
+void bc_code_visit_operands(BCFunction function, BCCode code, BCOperandVisitor visit, void *state);
+
+typedef enum BCPassKind {
+    BC_PASS_UNREACHABLE_BLOCKS,
+    BC_PASS_DEAD_CODE,
+    BC_PASS_COMPACT,
+    BC_PASS_COUNT,
+} BCPassKind;
+
+typedef struct BCPass {
+    string name;
+    // The lowest optimization level that runs the pass.
+    u32 level;
+    // Returns how many things the pass changed, which is what -time-passes reports.
+    u64 (*run)(BCContext context);
+} BCPass;
+
+// Passes run in the order of BCPassKind, each one over every function of the context.
+extern BCPass bc_passes[BC_PASS_COUNT];
+
+typedef struct BCPassOptions {
+    u32 level;
+    // Force a pass on or off whatever the level is.
+    bool enabled[BC_PASS_COUNT];
+    bool disabled[BC_PASS_COUNT];
+    bool timing;
+    // Verify the bytecode before the first pass and after every pass, always on in debug builds.
+    bool verify;
+} BCPassOptions;
+
+bool bc_pass_find(string name, BCPassKind *kind);
+void bc_optimize(BCContext context, BCPassOptions *options);
+
+// Prints what is wrong with the bytecode to `f` and returns false if anything is.
+bool bc_verify(BCContext context, FILE *f);
+
 bool bc_generate_amd64(BCContext context, BCObjectKind object_kind, FILE *f);
 bool bc_generate_arm64(BCContext context, BCObjectKind object_kind, FILE *f);
 bool bc_generate_source(BCContext context, FILE *f);
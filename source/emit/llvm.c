@@ -22,6 +22,7 @@ typedef struct {
     LLVMContextRef llvm;
     LLVMModuleRef module;
     LLVMValueRef function;
+    BCFunction bc_function;
     LLVMBuilderRef builder;
 
     LLVMBasicBlockRef break_target;
@@ -141,7 +142,7 @@ static LLVMTypeRef bc_convert_type(LLVMContext *context, BCType type) {
     }
 }
 
-#define reg(name) code->reg##name
+#define reg(name) bc_code_value(context->bc_function, code->reg##name)
 
 #define regA reg(A)
 #define regB reg(B)
@@ -169,7 +170,7 @@ static LLVMValueRef bc_generate_value(LLVMContext *context, BCValue value) {
             cstring string_value = string_to_cstring(value->string);
 
             LLVMValueRef string = LLVMBuildGlobalStringPtr(context->builder, string_value, "string");
-            LLVMValueRef string_length = LLVMConstInt(LLVMInt32TypeInContext(context->llvm), value->string.length - 1, 0);
+            LLVMValueRef string_length = LLVMConstInt(LLVMInt32TypeInContext(context->llvm), value->string.length, 0);
 
             LLVMValueRef aggregate = LLVMGetUndef(bc_convert_type(context, value->type->base));
 
@@ -358,15 +359,15 @@ static LLVMValueRef bc_generate_comparison(LLVMContext *context, BCCode code, in
 }
 
 static LLVMValueRef bc_generate_jump(LLVMContext *context, BCCode code) {
-    LLVMBasicBlockRef target = code->bbT->backend_data;
+    LLVMBasicBlockRef target = bc_code_block(context->bc_function, code->bbT)->backend_data;
 
     return LLVMBuildBr(context->builder, target);
 }
 
 static LLVMValueRef bc_generate_jump_if(LLVMContext *context, BCCode code) {
-    LLVMValueRef condition = bc_generate_value(context, code->regC);
-    LLVMBasicBlockRef block_then = code->bbT->backend_data;
-    LLVMBasicBlockRef block_else = code->bbF->backend_data;
+    LLVMValueRef condition = bc_generate_value(context, bc_code_value(context->bc_function, code->regC));
+    LLVMBasicBlockRef block_then = bc_code_block(context->bc_function, code->bbT)->backend_data;
+    LLVMBasicBlockRef block_else = bc_code_block(context->bc_function, code->bbF)->backend_data;
 
     // TODO: This is a hack to get around LLVM's requirement that the condition be an i1
     condition = LLVMBuildICmp(context->builder, LLVMIntNE, condition, LLVMConstNull(LLVMTypeOf(condition)), "v");
@@ -375,35 +376,37 @@ static LLVMValueRef bc_generate_jump_if(LLVMContext *context, BCCode code) {
 }
 
 static LLVMValueRef bc_generate_phi(LLVMContext *context, BCCode code) {
-    LLVMTypeRef type = bc_convert_type(context, code->phi_value->type);
+    BCValue phi = bc_code_value(context->bc_function, code->phi_value);
+    LLVMTypeRef type = bc_convert_type(context, phi->type);
     LLVMValueRef result = LLVMBuildPhi(context->builder, type, "v");
 
-    LLVMValueRef *values = make_n(LLVMValueRef, code->phi_value->num_incoming_phi_values);
-    LLVMBasicBlockRef *blocks = make_n(LLVMBasicBlockRef, code->phi_value->num_incoming_phi_values);
+    LLVMValueRef *values = make_n(LLVMValueRef, phi->num_incoming_phi_values);
+    LLVMBasicBlockRef *blocks = make_n(LLVMBasicBlockRef, phi->num_incoming_phi_values);
 
-    for (u32 i = 0; i < code->phi_value->num_incoming_phi_values; i++) {
-        values[i] = bc_generate_value(context, code->phi_value->phi_values[i]);
-        blocks[i] = code->phi_value->phi_blocks[i]->backend_data;
+    for (u32 i = 0; i < phi->num_incoming_phi_values; i++) {
+        values[i] = bc_generate_value(context, phi->phi_values[i]);
+        blocks[i] = phi->phi_blocks[i]->backend_data;
     }
 
-    LLVMAddIncoming(result, values, blocks, code->phi_value->num_incoming_phi_values);
+    LLVMAddIncoming(result, values, blocks, phi->num_incoming_phi_values);
 
-    return code->phi_value->phi_result->backend_data = result;
+    return phi->phi_result->backend_data = result;
 }
 
 static LLVMValueRef bc_generate_call(LLVMContext *context, BCCode code) {
-    LLVMValueRef target = bc_generate_value(context, code->target);
-    LLVMTypeRef type = bc_convert_type(context, code->target->type);
+    BCValue callee = bc_code_value(context->bc_function, code->target);
+    LLVMValueRef target = bc_generate_value(context, callee);
+    LLVMTypeRef type = bc_convert_type(context, callee->type);
     if (!LLVMIsAFunction(target))
         target = LLVMBuildLoad2(context->builder, type, target, "v");
 
     LLVMValueRef *args = make_n(LLVMValueRef, code->num_args);
     for (u32 i = 0; i < code->num_args; i++)
-        args[i] = bc_generate_value(context, code->args[i]);
+        args[i] = bc_generate_value(context, bc_code_argument(context->bc_function, code, i));
 
     LLVMValueRef result = LLVMBuildCall2(context->builder, type, target, args, code->num_args, "");
 
-    return code->result->backend_data = result;
+    return bc_code_value(context->bc_function, code->result)->backend_data = result;
 }
 
 static LLVMValueRef bc_generate_return(LLVMContext *context, BCCode code) {
@@ -505,7 +508,7 @@ static void bc_generate_function_type(LLVMContext *context, BCFunction function)
     function->backend_data = function_value;
 }
 
-void bc_dump_code(BCCode code, FILE *f);
+void bc_dump_code(BCFunction function, BCCode code, FILE *f);
 
 static void bc_generate_function(LLVMContext *context, BCFunction function) {
     LLVMValueRef function_value = function->backend_data;
@@ -514,6 +517,7 @@ static void bc_generate_function(LLVMContext *context, BCFunction function) {
         block->backend_data = LLVMCreateBasicBlockInContext(context->llvm, "block");
 
     context->function = function_value;
+    context->bc_function = function;
     context->break_target = null;
     context->continue_target = null;
 
@@ -529,19 +533,19 @@ static void bc_generate_function(LLVMContext *context, BCFunction function) {
         LLVMAppendExistingBasicBlock(function_value, block->backend_data);
         LLVMPositionBuilderAtEnd(context->builder, block->backend_data);
 
-        vector_foreach(BCCode, code, block->code) {
+        bc_block_foreach_code(function, block, code) {
 #if 0
-            bc_dump_code(*code, stdout);
+            bc_dump_code(function, code, stdout);
             printf("\n");
             fflush(stdout);
 #endif
 #if 0
-            LLVMDumpValue(bc_generate_code(context, *code));
+            LLVMDumpValue(bc_generate_code(context, code));
             printf("\n");
             fflush(stdout);
 #endif
 #if 1
-            bc_generate_code(context, *code);
+            bc_generate_code(context, code);
 #endif
         }
     }
@@ -0,0 +1,482 @@
+#include "atcc.h"
+#include "ati/utils.h"
+#include "bytecode.h"
+#include <string.h>
+#include <time.h>
+
+static u64 bc_pass_unreachable_blocks(BCContext context);
+static u64 bc_pass_dead_code(BCContext context);
+static u64 bc_pass_compact(BCContext context);
+
+BCPass bc_passes[BC_PASS_COUNT] = {
+        [BC_PASS_UNREACHABLE_BLOCKS] = {str("unreachable-blocks"), 1, bc_pass_unreachable_blocks},
+        [BC_PASS_DEAD_CODE] = {str("dead-code"), 1, bc_pass_dead_code},
+        [BC_PASS_COMPACT] = {str("compact"), 1, bc_pass_compact},
+};
+
+bool bc_pass_find(string name, BCPassKind *kind) {
+    for (u32 i = 0; i < BC_PASS_COUNT; i++) {
+        if (string_match(bc_passes[i].name, name)) {
+            *kind = (BCPassKind) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Removes the instructions `remove` returns true for from the block, walking the chain once.
+static u64 bc_block_unlink_code(BCFunction function, BCBlock block, bool (*remove)(BCCode)) {
+    u64 removed = 0;
+    u32 previous = BC_NO_INDEX;
+    for (u32 index = block->first_code; index != BC_NO_INDEX; index = function->code[index].next) {
+        if (!remove(&function->code[index])) {
+            previous = index;
+            continue;
+        }
+
+        if (previous == BC_NO_INDEX)
+            block->first_code = function->code[index].next;
+        else
+            function->code[previous].next = function->code[index].next;
+
+        block->num_code--;
+        removed++;
+    }
+
+    block->last_code = previous;
+    return removed;
+}
+
+static bool bc_code_is_nop(BCCode code) {
+    return code->opcode == BC_OP_NOP;
+}
+
+static bool bc_value_is_true(BCValue value, bool *result) {
+    if (value->kind != BC_VALUE_CONSTANT || value->type->kind != BC_TYPE_BASE)
+        return false;
+
+    if (value->type->is_floating) {
+        *result = value->floating != 0;
+    } else {
+        u64 mask = value->type->size < 8 ? ((u64) 1 << (value->type->size * 8)) - 1 : (u64) -1;
+        *result = (value->storage & mask) != 0;
+    }
+
+    return true;
+}
+
+// Conditions lowering folded to a constant only ever take one edge, the jump becomes unconditional.
+static bool bc_code_fold_branch(BCFunction function, BCCode code) {
+    bool taken = true;
+    if (code->bbT != code->bbF && !bc_value_is_true(bc_code_value(function, code->regC), &taken))
+        return false;
+
+    code->opcode = BC_OP_JUMP;
+    code->bbT = taken ? code->bbT : code->bbF;
+    code->bbF = 0;
+    code->regC = 0;
+    return true;
+}
+
+static u64 bc_function_remove_unreachable_blocks(BCFunction function, u8 *reachable, u32 *worklist) {
+    u64 changes = 0;
+
+    u32 num_blocks = (u32) vector_length(function->blocks);
+    memset(reachable, 0, num_blocks);
+
+    // Every jump counts as an edge, not only the last one, in case a block goes on after a terminator.
+    u32 pending = 0;
+    reachable[function->first_block->serial] = true;
+    worklist[pending++] = (u32) function->first_block->serial;
+    while (pending) {
+        BCBlock block = function->blocks[worklist[--pending]];
+        bc_block_foreach_code(function, block, code) {
+            if (code->opcode == BC_OP_JUMP_IF && bc_code_fold_branch(function, code))
+                changes++;
+
+            u32 targets[] = {code->bbT, code->bbF};
+            u32 num_targets = code->opcode == BC_OP_JUMP_IF ? 2 : code->opcode == BC_OP_JUMP ? 1 : 0;
+            for (u32 i = 0; i < num_targets; i++) {
+                if (reachable[targets[i]])
+                    continue;
+                reachable[targets[i]] = true;
+                worklist[pending++] = targets[i];
+            }
+        }
+    }
+
+    u64 removed = 0;
+    for (BCBlock block = function->first_block->next; block; block = block->next) {
+        if (reachable[block->serial])
+            continue;
+
+        block->prev->next = block->next;
+        if (block->next)
+            block->next->prev = block->prev;
+        else
+            function->last_block = block->prev;
+        removed++;
+    }
+
+    if (!removed)
+        return changes;
+
+    // Phis forget the edges of the blocks that are gone.
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) {
+            if (code->opcode != BC_OP_PHI)
+                continue;
+
+            BCValue phi = bc_code_value(function, code->phi_value);
+            u32 kept = 0;
+            for (u32 i = 0; i < phi->num_incoming_phi_values; i++) {
+                if (!reachable[phi->phi_blocks[i]->serial])
+                    continue;
+                phi->phi_values[kept] = phi->phi_values[i];
+                phi->phi_blocks[kept] = phi->phi_blocks[i];
+                kept++;
+            }
+            phi->num_incoming_phi_values = kept;
+        }
+    }
+
+    return changes + removed;
+}
+
+static u64 bc_pass_unreachable_blocks(BCContext context) {
+    u32 max_blocks = 0;
+    vector_foreach(BCFunction, function, context->functions) {
+        if (vector_length((*function)->blocks) > max_blocks)
+            max_blocks = (u32) vector_length((*function)->blocks);
+    }
+
+    u8 *reachable = make_n(u8, max_blocks);
+    u32 *worklist = make_n(u32, max_blocks);
+
+    u64 changes = 0;
+    vector_foreach(BCFunction, function, context->functions)
+        changes += bc_function_remove_unreachable_blocks(*function, reachable, worklist);
+
+    free(reachable);
+    free(worklist);
+    return changes;
+}
+
+// Instructions that only compute their result, they can go once nothing reads it.
+static bool bc_code_is_pure(BCCode code) {
+    switch (code->opcode) {
+        case BC_OP_LOAD:
+        case BC_OP_GET_FIELD:
+        case BC_OP_GET_INDEX: return true;
+        default: return (code->opcode >= BC_OP_ADD && code->opcode <= BC_OP_GE) ||
+                        (code->opcode >= BC_OP_CAST_BITWISE && code->opcode <= BC_OP_CAST_UINT_TO_FP);
+    }
+}
+
+void bc_code_visit_operands(BCFunction function, BCCode code, BCOperandVisitor visit, void *state) {
+    switch (code->opcode) {
+        case BC_OP_NOP: break;
+        case BC_OP_PHI: {
+            BCValue phi = bc_code_value(function, code->phi_value);
+            for (u32 i = 0; i < phi->num_incoming_phi_values; i++)
+                visit(state, phi->phi_values[i]->index);
+            break;
+        }
+        case BC_OP_STORE:
+            visit(state, code->regA);
+            visit(state, code->regD);
+            break;
+        case BC_OP_JUMP:
+        case BC_OP_JUMP_IF: visit(state, code->regC); break;
+        case BC_OP_CALL:
+            visit(state, code->target);
+            for (u32 i = 0; i < code->num_args; i++)
+                visit(state, function->operands[code->args + i]);
+            break;
+        case BC_OP_RETURN: visit(state, code->regA); break;
+        default:
+            visit(state, code->regA);
+            visit(state, code->regB);
+            break;
+    }
+}
+
+typedef struct {
+    // Both are indexed by value, `defs` holds the defining instruction plus one.
+    u32 *uses;
+    u32 *defs;
+    u32 *worklist;
+} BCDeadCode;
+
+static void bc_dead_code_use(void *state, u32 operand) {
+    ((BCDeadCode *) state)->uses[operand]++;
+}
+
+static void bc_dead_code_release(void *state, u32 operand) {
+    BCDeadCode *dead_code = state;
+    if (operand && --dead_code->uses[operand] == 0 && dead_code->defs[operand])
+        vector_push(dead_code->worklist, dead_code->defs[operand] - 1);
+}
+
+static u64 bc_function_remove_dead_code(BCDeadCode *state, BCFunction function) {
+    u64 changes = 0;
+    vector_length(state->worklist) = 0;
+
+    // Temporaries belong to one function, so the counts of other functions never get in the way.
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        for (u32 index = block->first_code; index != BC_NO_INDEX; index = function->code[index].next) {
+            BCCode code = &function->code[index];
+            bc_code_visit_operands(function, code, bc_dead_code_use, state);
+            if (bc_code_is_pure(code))
+                state->defs[code->regD] = index + 1;
+        }
+    }
+
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        for (u32 index = block->first_code; index != BC_NO_INDEX; index = function->code[index].next) {
+            BCCode code = &function->code[index];
+            if (bc_code_is_pure(code) && state->uses[code->regD] == 0)
+                vector_push(state->worklist, index);
+        }
+    }
+
+    // Removing an instruction releases its operands, which can leave their definitions unused in turn.
+    while (vector_length(state->worklist)) {
+        BCCode code = &function->code[state->worklist[--vector_length(state->worklist)]];
+        if (!bc_code_is_pure(code))
+            continue;
+
+        bc_code_visit_operands(function, code, bc_dead_code_release, state);
+        code->opcode = BC_OP_NOP;
+    }
+
+    for (BCBlock block = function->first_block; block; block = block->next)
+        changes += bc_block_unlink_code(function, block, bc_code_is_nop);
+
+    return changes;
+}
+
+static u64 bc_pass_dead_code(BCContext context) {
+    u32 num_values = (u32) vector_length(context->values);
+
+    BCDeadCode state = {
+            .uses = make_n(u32, num_values),
+            .defs = make_n(u32, num_values),
+            .worklist = vector_create(u32),
+    };
+
+    u64 changes = 0;
+    vector_foreach(BCFunction, function, context->functions) {
+        if ((*function)->code)
+            changes += bc_function_remove_dead_code(&state, *function);
+    }
+
+    free(state.uses);
+    free(state.defs);
+    vector_free(state.worklist);
+    return changes;
+}
+
+static u64 bc_pass_compact(BCContext context) {
+    u64 changes = 0;
+    vector_foreach(BCFunction, function, context->functions) {
+        if (!(*function)->code)
+            continue;
+
+        // Lowering already compacted every function, only the ones earlier passes removed code from need it again.
+        u64 linked = 0;
+        for (BCBlock block = (*function)->first_block; block; block = block->next)
+            linked += block->num_code;
+        if (linked == vector_length((*function)->code))
+            continue;
+
+        u64 before = vector_length((*function)->code);
+        bc_function_compact(*function);
+        changes += before - vector_length((*function)->code);
+    }
+
+    return changes;
+}
+
+typedef struct {
+    BCFunction function;
+    FILE *f;
+    bool valid;
+
+    // Indexed by value and by block, they hold the stamp of the function being verified.
+    u32 *defined;
+    u32 *linked;
+    u32 stamp;
+} BCVerifier;
+
+static void bc_verify_error(BCVerifier *verifier, BCBlock block, cstring message, u32 index) {
+    fprintf(verifier->f, "bytecode: %.*s, block%llu: %s (%u)\n", strp(verifier->function->name),
+            block ? block->serial : 0, message, index);
+    verifier->valid = false;
+}
+
+static void bc_verify_define(BCVerifier *verifier, BCBlock block, u32 index) {
+    BCContext context = verifier->function->context;
+    if (index == 0 || index >= vector_length(context->values)) {
+        bc_verify_error(verifier, block, "instruction defines a value outside of the value table", index);
+        return;
+    }
+
+    BCValueKind kind = context->values[index]->kind;
+    if (kind != BC_VALUE_TEMPORARY && kind != BC_VALUE_PHI)
+        bc_verify_error(verifier, block, "instruction defines a value that is not a temporary", index);
+    else if (verifier->defined[index] == verifier->stamp)
+        bc_verify_error(verifier, block, "value is defined twice", index);
+
+    verifier->defined[index] = verifier->stamp;
+}
+
+static void bc_verify_block_index(BCVerifier *verifier, BCBlock block, u32 index) {
+    if (index >= vector_length(verifier->function->blocks) || verifier->linked[index] != verifier->stamp)
+        bc_verify_error(verifier, block, "jump to a block that is not part of the function", index);
+}
+
+// Used as the operand visitor, so the block of the error is not known.
+static void bc_verify_use(void *state, u32 index) {
+    BCVerifier *verifier = state;
+    BCContext context = verifier->function->context;
+    if (index >= vector_length(context->values)) {
+        bc_verify_error(verifier, null, "operand is outside of the value table", index);
+        return;
+    }
+
+    BCValue value = context->values[index];
+    if (value && (value->kind == BC_VALUE_TEMPORARY || value->kind == BC_VALUE_PHI) &&
+        verifier->defined[index] != verifier->stamp)
+        bc_verify_error(verifier, null, "operand is never defined", index);
+}
+
+static void bc_verify_function(BCVerifier *verifier) {
+    BCFunction function = verifier->function;
+    u32 num_blocks = (u32) vector_length(function->blocks);
+    u32 num_code = function->code ? (u32) vector_length(function->code) : 0;
+
+    u32 seen_blocks = 0;
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        if (++seen_blocks > num_blocks) {
+            bc_verify_error(verifier, block, "the blocks form a cycle", seen_blocks);
+            return;
+        }
+
+        if (block->serial >= num_blocks || function->blocks[block->serial] != block)
+            bc_verify_error(verifier, block, "block is not in the block table", (u32) block->serial);
+        if (block->next ? block->next->prev != block : function->last_block != block)
+            bc_verify_error(verifier, block, "block links are inconsistent", (u32) block->serial);
+
+        u32 seen_code = 0, last = BC_NO_INDEX;
+        for (u32 index = block->first_code; index != BC_NO_INDEX; index = function->code[index].next) {
+            if (index >= num_code || ++seen_code > num_code) {
+                bc_verify_error(verifier, block, "instruction chain leaves the code array", index);
+                return;
+            }
+            last = index;
+        }
+
+        if (seen_code != block->num_code || last != block->last_code)
+            bc_verify_error(verifier, block, "instruction count or last instruction is stale", seen_code);
+
+        verifier->linked[block->serial] = verifier->stamp;
+    }
+
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) {
+            if (code->opcode > BC_OP_CAST_UINT_TO_FP)
+                bc_verify_error(verifier, block, "unknown opcode", code->opcode);
+            else if (code->opcode == BC_OP_CALL)
+                bc_verify_define(verifier, block, code->result);
+            else if (code->opcode == BC_OP_PHI) {
+                bc_verify_define(verifier, block, code->phi_value);
+                bc_verify_define(verifier, block, bc_code_value(function, code->phi_value)->phi_result->index);
+            } else if (bc_code_is_pure(code))
+                bc_verify_define(verifier, block, code->regD);
+        }
+    }
+
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) {
+            bc_code_visit_operands(function, code, bc_verify_use, verifier);
+
+            if (code->opcode == BC_OP_JUMP || code->opcode == BC_OP_JUMP_IF)
+                bc_verify_block_index(verifier, block, code->bbT);
+            if (code->opcode == BC_OP_JUMP_IF) {
+                bc_verify_block_index(verifier, block, code->bbF);
+                if (!code->regC)
+                    bc_verify_error(verifier, block, "conditional jump without a condition", code->bbT);
+            }
+
+            if (code->opcode == BC_OP_PHI) {
+                BCValue phi = bc_code_value(function, code->phi_value);
+                for (u32 i = 0; i < phi->num_incoming_phi_values; i++)
+                    bc_verify_block_index(verifier, block, (u32) phi->phi_blocks[i]->serial);
+            }
+
+            if ((bc_code_is_pure(code) || code->opcode == BC_OP_STORE) && !code->regA)
+                bc_verify_error(verifier, block, "instruction is missing its first operand", code->opcode);
+        }
+    }
+}
+
+bool bc_verify(BCContext context, FILE *f) {
+    u32 max_blocks = 0;
+    vector_foreach(BCFunction, function, context->functions) {
+        if (vector_length((*function)->blocks) > max_blocks)
+            max_blocks = (u32) vector_length((*function)->blocks);
+    }
+
+    BCVerifier verifier = {
+            .f = f,
+            .valid = true,
+            .defined = make_n(u32, vector_length(context->values)),
+            .linked = make_n(u32, max_blocks),
+    };
+
+    vector_foreach(BCFunction, function, context->functions) {
+        verifier.function = *function;
+        verifier.stamp++;
+        bc_verify_function(&verifier);
+    }
+
+    free(verifier.defined);
+    free(verifier.linked);
+    return verifier.valid;
+}
+
+static void bc_optimize_verify(BCContext context, string after) {
+    if (!bc_verify(context, stderr))
+        panic("ICE: bytecode does not verify after %.*s", strp(after));
+}
+
+void bc_optimize(BCContext context, BCPassOptions *options) {
+    bool verify = options->verify;
+    debug verify = true;
+
+    if (verify)
+        bc_optimize_verify(context, str("lowering"));
+
+    if (options->timing)
+        fprintf(stderr, "Bytecode passes (-O%u):\n", options->level);
+
+    for (u32 i = 0; i < BC_PASS_COUNT; i++) {
+        BCPass *pass = &bc_passes[i];
+        bool enabled = options->enabled[i] || (options->level >= pass->level && !options->disabled[i]);
+        if (!enabled)
+            continue;
+
+        clock_t start = clock();
+        u64 changes = pass->run(context);
+        f64 elapsed = (f64) (clock() - start) / CLOCKS_PER_SEC;
+
+        if (options->timing)
+            fprintf(stderr, "  %-20.*s %8.2f ms %10llu changes\n", strp(pass->name), elapsed * 1000.0,
+                    (unsigned long long) changes);
+
+        if (verify)
+            bc_optimize_verify(context, pass->name);
+    }
+}
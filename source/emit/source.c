@@ -67,7 +67,7 @@ static void bc_generate_type(BCType type, FILE *f) {
 
 static void bc_generate_base_value(BCValue value, FILE *f) {
     if (value->type == bc_type_f32 || value->type == bc_type_f64) {
-        fprintf(f, "%g", value->floating);
+        fprintf(f, "%.17g", value->floating);
         return;
     }
 
@@ -127,51 +127,57 @@ static void bc_generate_value(BCValue value, FILE *f) {
     }
 }
 
-static void bc_generate_binary_arith(BCCode code, cstring fmt, FILE *f) {
-    bc_generate_type(code->regD->type, f);
+#define reg(name) bc_code_value(function, code->reg##name)
+#define regA reg(A)
+#define regB reg(B)
+#define regC reg(C)
+#define regD reg(D)
+
+static void bc_generate_binary_arith(BCFunction function, BCCode code, cstring fmt, FILE *f) {
+    bc_generate_type(regD->type, f);
     fprintf(f, " ");
-    bc_generate_value(code->regD, f);
+    bc_generate_value(regD, f);
     fprintf(f, " = ");
-    if (code->regB) {
-        bc_generate_value(code->regA, f);
+    if (regB) {
+        bc_generate_value(regA, f);
         fprintf(f, "%s", fmt);
-        bc_generate_value(code->regB, f);
+        bc_generate_value(regB, f);
     } else {
         fprintf(f, "%s", fmt);
-        bc_generate_value(code->regA, f);
+        bc_generate_value(regA, f);
     }
     fprintf(f, ";");
 }
 
-static void bc_generate_code(BCCode code, FILE *f) {
+static void bc_generate_code(BCFunction function, BCCode code, FILE *f) {
     switch (code->opcode) {
         case BC_OP_NOP: fprintf(f, "; // nop"); break;
         case BC_OP_LOAD:
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, " ");
-            bc_generate_value(code->regD, f);
+            bc_generate_value(regD, f);
             fprintf(f, " = *");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regA, f);
             fprintf(f, ";");
             break;
         case BC_OP_GET_INDEX:
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, " ");
-            bc_generate_value(code->regD, f);
+            bc_generate_value(regD, f);
             fprintf(f, " = &((");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regA, f);
             fprintf(f, ")[");
-            bc_generate_value(code->regB, f);
+            bc_generate_value(regB, f);
             fprintf(f, "]);");
             break;
         case BC_OP_GET_FIELD:
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, " ");
-            bc_generate_value(code->regD, f);
+            bc_generate_value(regD, f);
             fprintf(f, " = &(");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regA, f);
             {
-                BCType type = code->regA->type;
+                BCType type = regA->type;
                 if (type->kind == BC_TYPE_POINTER) {
                     type = type->base;
                     fprintf(f, "->");
@@ -181,9 +187,9 @@ static void bc_generate_code(BCCode code, FILE *f) {
                 }
 
                 if (type->kind == BC_TYPE_ARRAY)
-                    fprintf(f, "%s", code->regB->storage == 0 ? "length" : "data");
+                    fprintf(f, "%s", regB->storage == 0 ? "length" : "data");
                 else
-                    fprintf(f, "%.*s", strp(type->members[code->regB->storage].name));
+                    fprintf(f, "%.*s", strp(type->members[regB->storage].name));
 
                 fprintf(f, ");");
             }
@@ -191,73 +197,74 @@ static void bc_generate_code(BCCode code, FILE *f) {
             break;
         case BC_OP_STORE:
             fprintf(f, "*");
-            bc_generate_value(code->regD, f);
+            bc_generate_value(regD, f);
             fprintf(f, " = ");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regA, f);
             fprintf(f, ";");
             break;
-        case BC_OP_ADD: bc_generate_binary_arith(code, " + ", f); break;
-        case BC_OP_SUB: bc_generate_binary_arith(code, " - ", f); break;
-        case BC_OP_MUL: bc_generate_binary_arith(code, " * ", f); break;
-        case BC_OP_DIV: bc_generate_binary_arith(code, " / ", f); break;
-        case BC_OP_MOD: bc_generate_binary_arith(code, " % ", f); break;
+        case BC_OP_ADD: bc_generate_binary_arith(function, code, " + ", f); break;
+        case BC_OP_SUB: bc_generate_binary_arith(function, code, " - ", f); break;
+        case BC_OP_MUL: bc_generate_binary_arith(function, code, " * ", f); break;
+        case BC_OP_DIV: bc_generate_binary_arith(function, code, " / ", f); break;
+        case BC_OP_MOD: bc_generate_binary_arith(function, code, " % ", f); break;
         case BC_OP_NEG:
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, " ");
-            bc_generate_value(code->regD, f);
-            fprintf(f, " = -");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regD, f);
+            fprintf(f, " = ~");
+            bc_generate_value(regA, f);
             fprintf(f, ";");
             break;
         case BC_OP_NOT:
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, " ");
-            bc_generate_value(code->regD, f);
+            bc_generate_value(regD, f);
             fprintf(f, " = !");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regA, f);
             fprintf(f, ";");
             break;
-        case BC_OP_AND: bc_generate_binary_arith(code, " & ", f); break;
-        case BC_OP_OR: bc_generate_binary_arith(code, " | ", f); break;
-        case BC_OP_XOR: bc_generate_binary_arith(code, " ^ ", f); break;
-        case BC_OP_SHL: bc_generate_binary_arith(code, " << ", f); break;
-        case BC_OP_SHR: bc_generate_binary_arith(code, " >> ", f); break;
-        case BC_OP_EQ: bc_generate_binary_arith(code, " == ", f); break;
-        case BC_OP_NE: bc_generate_binary_arith(code, " != ", f); break;
-        case BC_OP_LT: bc_generate_binary_arith(code, " < ", f); break;
-        case BC_OP_GT: bc_generate_binary_arith(code, " > ", f); break;
-        case BC_OP_LE: bc_generate_binary_arith(code, " <= ", f); break;
-        case BC_OP_GE: bc_generate_binary_arith(code, " >= ", f); break;
+        case BC_OP_AND: bc_generate_binary_arith(function, code, " & ", f); break;
+        case BC_OP_OR: bc_generate_binary_arith(function, code, " | ", f); break;
+        case BC_OP_XOR: bc_generate_binary_arith(function, code, " ^ ", f); break;
+        case BC_OP_SHL: bc_generate_binary_arith(function, code, " << ", f); break;
+        case BC_OP_SHR: bc_generate_binary_arith(function, code, " >> ", f); break;
+        case BC_OP_EQ: bc_generate_binary_arith(function, code, " == ", f); break;
+        case BC_OP_NE: bc_generate_binary_arith(function, code, " != ", f); break;
+        case BC_OP_LT: bc_generate_binary_arith(function, code, " < ", f); break;
+        case BC_OP_GT: bc_generate_binary_arith(function, code, " > ", f); break;
+        case BC_OP_LE: bc_generate_binary_arith(function, code, " <= ", f); break;
+        case BC_OP_GE: bc_generate_binary_arith(function, code, " >= ", f); break;
         case BC_OP_JUMP:
-            if (code->regC) {
-                bc_generate_value(code->bbT->input, f);
+            if (regC) {
+                bc_generate_value(bc_code_block(function, code->bbT)->input, f);
                 fprintf(f, " = ");
-                bc_generate_value(code->regC, f);
+                bc_generate_value(regC, f);
                 fprintf(f, "; ");
             }
 
-            fprintf(f, "goto __block%llu;", code->bbT->serial);
+            fprintf(f, "goto __block%u;", code->bbT);
             break;
         case BC_OP_JUMP_IF:
             fprintf(f, "if (");
-            bc_generate_value(code->regC, f);
-            fprintf(f, ") goto __block%llu; else goto __block%llu;", code->bbT->serial, code->bbF->serial);
+            bc_generate_value(regC, f);
+            fprintf(f, ") goto __block%u; else goto __block%u;", code->bbT, code->bbF);
             break;
         case BC_OP_PHI:
             fprintf(f, "// Phi is resolved here.");
             break;
         case BC_OP_CALL: {
-            if (code->result->type != bc_type_void) {
-                bc_generate_type(code->result->type, f);
+            BCValue result = bc_code_value(function, code->result);
+            if (result->type != bc_type_void) {
+                bc_generate_type(result->type, f);
                 fprintf(f, " ");
-                bc_generate_value(code->result, f);
+                bc_generate_value(result, f);
                 fprintf(f, " = ");
             }
 
-            bc_generate_value(code->target, f);
+            bc_generate_value(bc_code_value(function, code->target), f);
             fprintf(f, "(");
             for (u32 i = 0; i < code->num_args; i++) {
-                bc_generate_value(code->args[i], f);
+                bc_generate_value(bc_code_argument(function, code, i), f);
                 if (i < code->num_args - 1)
                     fprintf(f, ", ");
             }
@@ -266,7 +273,7 @@ static void bc_generate_code(BCCode code, FILE *f) {
         }
         case BC_OP_RETURN:
             fprintf(f, "return ");
-            if (code->regA) bc_generate_value(code->regA, f);
+            if (regA) bc_generate_value(regA, f);
             fprintf(f, ";");
             break;
         case BC_OP_CAST_BITWISE:
@@ -283,19 +290,25 @@ static void bc_generate_code(BCCode code, FILE *f) {
         case BC_OP_CAST_FP_TO_UINT:
         case BC_OP_CAST_SINT_TO_FP:
         case BC_OP_CAST_UINT_TO_FP:
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, " ");
-            bc_generate_value(code->regD, f);
+            bc_generate_value(regD, f);
             fprintf(f, " = (");
-            bc_generate_type(code->regD->type, f);
+            bc_generate_type(regD->type, f);
             fprintf(f, ") ");
-            bc_generate_value(code->regA, f);
+            bc_generate_value(regA, f);
             fprintf(f, ";");
             break;
         default: assert(!"unimplemented opcode"); break;
     }
 }
 
+#undef regD
+#undef regC
+#undef regB
+#undef regA
+#undef reg
+
 static void bc_generate_function_type(BCFunction function, FILE *f) {
     bc_generate_type(function->signature->result, f);
     fprintf(f, " ");
@@ -347,9 +360,9 @@ static void bc_generate_function(BCFunction function, FILE *f) {
 
     for (BCBlock block = function->first_block; block; block = block->next) {
         fprintf(f, "__block%llu: ;\n", block->serial);
-        vector_foreach(BCCode, code, block->code) {
+        bc_block_foreach_code(function, block, code) {
             fprintf(f, "    ");
-            bc_generate_code(*code, f);
+            bc_generate_code(function, code, f);
             fprintf(f, "\n");
         }
     }
@@ -403,11 +416,7 @@ bool bc_generate_source(BCContext context, FILE *f) {
     vector_foreach(BCValue, string_ptr, context->strings) {
         BCValue string = *string_ptr;
         fprintf(f, "static string __string_%llu = {", string->string_index);
-        u64 length = string->string.length;
-        if (length > 0)
-            length--;
-
-        fprintf(f, ".length = %llu, .data = (u8*)\"", length);
+        fprintf(f, ".length = %llu, .data = (u8*)\"", string->string.length);
 
         for (u32 i = 0; i < string->string.length; i++) {
             u8 character = string->string.data[i];
@@ -1,103 +1,316 @@
 #include "atcc.h"
 #include "ati/basic.h"
+#include "ati/utils.h"
+#include <string.h>
 
-static Variant eval_unary(ASTNode *node) {
-    Variant target = eval_expression(node->unary_target);
+// Compile-time evaluation runs the analyzed AST directly. Values are Variants: aggregates
+// and arrays are VARIANT_ARRAYs of their fields and elements, and every variable owns
+// its copy, so nothing a function does can be seen outside of it except its result.
+// Anything that would need memory or the outside world, like pointers, globals that are
+// not constant or functions without a body, makes the evaluation fail instead.
 
+// Limits of a single evaluation, so that a runaway constant fails to compile instead of hanging.
+#define EVAL_STEP_BUDGET (1 << 22)
+#define EVAL_MAX_DEPTH 256
+
+typedef enum {
+    EVAL_NEXT,
+    EVAL_BREAK,
+    EVAL_CONTINUE,
+    EVAL_RETURN,
+    EVAL_FAILED,
+} EvalFlow;
+
+typedef struct {
+    ASTNode *declaration; // The parameter or init statement that identifiers refer to.
+    Variant value;
+} EvalLocal;
+
+typedef struct {
+    EvalLocal *locals;
+    u32 frame; // First local of the function being run.
+    Variant result;
+
+    u64 steps;
+    u32 depth;
+
+    bool failed;
+    EvalError *error;
+} EvalState;
+
+// Arrays outlive the evaluation that built them, as constants and memoized results.
+static Arena eval_arena;
+
+static Variant eval_node(EvalState *state, ASTNode *node);
+static EvalFlow eval_statement(EvalState *state, ASTNode *statement);
+
+static Variant eval_fail(EvalState *state, ASTNode *node, cstring reason) {
+    if (!state->failed && state->error) {
+        state->error->node = node;
+        state->error->reason = reason;
+    }
+
+    state->failed = true;
+    return variant_none();
+}
+
+static bool eval_is_signed(Variant value) {
+    return value.kind == VARIANT_I8 || value.kind == VARIANT_I16 || value.kind == VARIANT_I32 || value.kind == VARIANT_I64;
+}
+
+static bool eval_is_float(Variant value) { return value.kind == VARIANT_F32 || value.kind == VARIANT_F64; }
+
+static i64 eval_as_i64(Variant value) {
+    switch (value.kind) {
+        case VARIANT_I8: return value.i8;
+        case VARIANT_U8: return value.u8;
+        case VARIANT_I16: return value.i16;
+        case VARIANT_U16: return value.u16;
+        case VARIANT_I32: return value.i32;
+        case VARIANT_U32: return value.u32;
+        case VARIANT_I64: return value.i64;
+        case VARIANT_U64: return (i64) value.u64;
+        case VARIANT_F32: return (i64) value.f32;
+        case VARIANT_F64: return (i64) value.f64;
+        default: return 0;
+    }
+}
+
+static f64 eval_as_f64(Variant value) {
+    switch (value.kind) {
+        case VARIANT_F32: return value.f32;
+        case VARIANT_F64: return value.f64;
+        case VARIANT_U64: return (f64) value.u64;
+        default: return (f64) eval_as_i64(value);
+    }
+}
+
+static bool eval_is_true(Variant value) { return eval_is_float(value) ? eval_as_f64(value) != 0 : eval_as_i64(value) != 0; }
+
+static Variant eval_copy(Variant value) {
+    if (value.kind != VARIANT_ARRAY || value.array.length == 0)
+        return value;
+
+    Variant *data = arena_alloc(&eval_arena, sizeof(Variant) * value.array.length);
+    for (u64 i = 0; i < value.array.length; i++)
+        data[i] = eval_copy(value.array.data[i]);
+    return variant_array(data, value.array.length);
+}
+
+static Variant eval_convert(EvalState *state, ASTNode *node, Variant value, Type *type) {
+    if (value.kind == VARIANT_NONE)
+        return value;
+
+    if (type_is_arithmetic(type) && value.kind > VARIANT_NONE && value.kind <= VARIANT_F64) {
+        i64 integer = eval_as_i64(value);
+        switch (type->kind) {
+            case TYPE_I8: return variant_i8((i8) integer);
+            case TYPE_U8: return variant_u8((u8) integer);
+            case TYPE_I16: return variant_i16((i16) integer);
+            case TYPE_U16: return variant_u16((u16) integer);
+            case TYPE_I32: return variant_i32((i32) integer);
+            case TYPE_U32: return variant_u32((u32) integer);
+            case TYPE_I64: return variant_i64(integer);
+            case TYPE_U64: return variant_u64(eval_is_float(value) ? (u64) eval_as_f64(value) : (u64) integer);
+            case TYPE_F32: return variant_f32((f32) eval_as_f64(value));
+            case TYPE_F64: return variant_f64(eval_as_f64(value));
+            default: break;
+        }
+    }
+
+    if (type->kind == TYPE_STRING && value.kind == VARIANT_STRING)
+        return value;
+    if ((type->kind == TYPE_ARRAY || type->kind == TYPE_AGGREGATE) && value.kind == VARIANT_ARRAY)
+        return value;
+
+    return eval_fail(state, node, "needs a value that only exists at run time");
+}
+
+// Values that variables start out with, before anything is stored into them.
+static Variant eval_zero(EvalState *state, ASTNode *node, Type *type) {
+    if (type_is_arithmetic(type))
+        return eval_convert(state, node, variant_u64(0), type);
+
+    switch (type->kind) {
+        case TYPE_STRING: return variant_string(null, 0);
+        case TYPE_ARRAY: {
+            if (type->array_is_dynamic || !type->array_size)
+                return variant_array(null, 0);
+
+            Variant *elements = arena_alloc(&eval_arena, sizeof(Variant) * type->array_size);
+            for (u32 i = 0; i < type->array_size && !state->failed; i++)
+                elements[i] = eval_zero(state, node, type->array_base);
+            return variant_array(elements, type->array_size);
+        }
+        case TYPE_AGGREGATE: {
+            u32 count = vector_length(type->fields);
+            Variant *fields = arena_alloc(&eval_arena, sizeof(Variant) * (count ? count : 1));
+            for (u32 i = 0; i < count && !state->failed; i++) {
+                // The fields of a union share their storage, which a Variant cannot express.
+                if (type->fields[i].address_only)
+                    return eval_fail(state, node, "uses a union");
+                fields[i] = eval_zero(state, node, type->fields[i].type);
+            }
+            return variant_array(fields, count);
+        }
+        default: return eval_fail(state, node, "uses pointers");
+    }
+}
+
+static i32 eval_field_index(Type *aggregate, string name) {
+    for (u32 i = 0; i < vector_length(aggregate->fields); i++) {
+        if (intern_match(aggregate->fields[i].name, name))
+            return (i32) i;
+    }
+    return -1;
+}
+
+static Variant eval_arithmetic(EvalState *state, ASTNode *node, TokenKind operator, Type *type, Variant left, Variant right) {
+    if (type->kind == TYPE_F32 || type->kind == TYPE_F64) {
+        f64 a = eval_as_f64(left), b = eval_as_f64(right);
+        switch (operator) {
+            case TOKEN_PLUS: return eval_convert(state, node, variant_f64(a + b), type);
+            case TOKEN_MINUS: return eval_convert(state, node, variant_f64(a - b), type);
+            case TOKEN_STAR: return eval_convert(state, node, variant_f64(a * b), type);
+            case TOKEN_SLASH: return eval_convert(state, node, variant_f64(a / b), type);
+            case TOKEN_EQUAL_EQUAL: return variant_i32(a == b);
+            case TOKEN_EXCLAMATION_EQUAL: return variant_i32(a != b);
+            case TOKEN_LESS: return variant_i32(a < b);
+            case TOKEN_LESS_EQUAL: return variant_i32(a <= b);
+            case TOKEN_GREATER: return variant_i32(a > b);
+            case TOKEN_GREATER_EQUAL: return variant_i32(a >= b);
+            default: return eval_fail(state, node, "uses an operator that does not apply to floats");
+        }
+    }
+
+    if (type->kind == TYPE_STRING) {
+        bool equal = variant_equals(&left, &right);
+        switch (operator) {
+            case TOKEN_EQUAL_EQUAL: return variant_i32(equal);
+            case TOKEN_EXCLAMATION_EQUAL: return variant_i32(!equal);
+            default: return eval_fail(state, node, "uses an operator that does not apply to strings");
+        }
+    }
+
+    if (!type_is_integer(type))
+        return eval_fail(state, node, "uses pointers");
+
+    // Integers are computed on 64 bits, in the signedness of their type, and truncated back.
+    bool is_signed = eval_is_signed(left);
+    u64 a = (u64) eval_as_i64(left), b = (u64) eval_as_i64(right);
+    u64 bits = type->size * 8;
+    switch (operator) {
+        case TOKEN_PLUS: return eval_convert(state, node, variant_u64(a + b), type);
+        case TOKEN_MINUS: return eval_convert(state, node, variant_u64(a - b), type);
+        case TOKEN_STAR: return eval_convert(state, node, variant_u64(a * b), type);
+        case TOKEN_AMPERSAND: return eval_convert(state, node, variant_u64(a & b), type);
+        case TOKEN_PIPE: return eval_convert(state, node, variant_u64(a | b), type);
+        case TOKEN_CARET: return eval_convert(state, node, variant_u64(a ^ b), type);
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT: {
+            if (b == 0)
+                return eval_fail(state, node, "divides by zero");
+
+            // The one quotient that does not fit, the host would trap on it for 64 bits.
+            if (is_signed && (i64) b == -1 && (i64) a == (i64) ((u64) -1 << (bits - 1)))
+                return eval_fail(state, node, "overflows");
+
+            bool divide = operator == TOKEN_SLASH;
+            if (is_signed)
+                return eval_convert(state, node, variant_i64(divide ? (i64) a / (i64) b : (i64) a % (i64) b), type);
+            return eval_convert(state, node, variant_u64(divide ? a / b : a % b), type);
+        }
+        case TOKEN_LEFT_SHIFT:
+        case TOKEN_RIGHT_SHIFT: {
+            if (b >= bits)
+                return eval_fail(state, node, "shifts by more than the width of its type");
+
+            if (operator == TOKEN_LEFT_SHIFT)
+                return eval_convert(state, node, variant_u64(a << b), type);
+            if (is_signed)
+                return eval_convert(state, node, variant_i64((i64) a >> b), type);
+            return eval_convert(state, node, variant_u64(a >> b), type);
+        }
+        case TOKEN_EQUAL_EQUAL: return variant_i32(a == b);
+        case TOKEN_EXCLAMATION_EQUAL: return variant_i32(a != b);
+        case TOKEN_LESS: return variant_i32(is_signed ? (i64) a < (i64) b : a < b);
+        case TOKEN_LESS_EQUAL: return variant_i32(is_signed ? (i64) a <= (i64) b : a <= b);
+        case TOKEN_GREATER: return variant_i32(is_signed ? (i64) a > (i64) b : a > b);
+        case TOKEN_GREATER_EQUAL: return variant_i32(is_signed ? (i64) a >= (i64) b : a >= b);
+        default: return eval_fail(state, node, "uses an unsupported operator");
+    }
+}
+
+// Operands are computed in the type of the left one, like the lowered instructions are,
+// unless only the right one is a float. Sema's conversions are not applied to them for the same reason.
+static Type *eval_operand_type(ASTNode *left, ASTNode *right) {
+    bool left_float = left->base_type->kind == TYPE_F32 || left->base_type->kind == TYPE_F64;
+    bool right_float = right->base_type->kind == TYPE_F32 || right->base_type->kind == TYPE_F64;
+    return right_float && !left_float ? right->base_type : left->base_type;
+}
+
+static Variant eval_binary_values(EvalState *state, ASTNode *node, TokenKind operator, Type *type, Variant left, Variant right) {
+    if (operator == TOKEN_AMPERSAND_AMPERSAND)
+        return variant_i32(eval_is_true(left) && eval_is_true(right));
+    if (operator == TOKEN_PIPE_PIPE)
+        return variant_i32(eval_is_true(left) || eval_is_true(right));
+
+    left = eval_convert(state, node, left, type);
+    right = eval_convert(state, node, right, type);
+    if (state->failed)
+        return variant_none();
+
+    return eval_arithmetic(state, node, operator, type, left, right);
+}
+
+static Variant eval_unary(EvalState *state, ASTNode *node) {
+    if (node->unary_operator == TOKEN_AMPERSAND || node->unary_operator == TOKEN_STAR)
+        return eval_fail(state, node, "uses pointers");
+
+    Variant target = eval_node(state, node->unary_target);
+    if (state->failed)
+        return variant_none();
+
+    Type *type = node->base_type;
     switch (node->unary_operator) {
         case TOKEN_PLUS: return target;
-        case TOKEN_MINUS: return variant_i32(-target.i32);
-        case TOKEN_EXCLAMATION: return variant_i32(!target.i32);
-        case TOKEN_TILDE: return variant_i32(~target.i32);
-        default: assert(!"unreachable"); return variant_i32(0);
-    }
-}
-
-#define make_eval_binary(T)                                                      \
-    static Variant eval_binary_##T(ASTNode *node) {                              \
-        Variant left = eval_expression(node->binary_left);                       \
-        Variant right = eval_expression(node->binary_right);                     \
-                                                                                 \
-        switch (node->binary_operator) {                                         \
-            case TOKEN_PLUS: return variant_##T(left.T + right.T);               \
-            case TOKEN_MINUS: return variant_##T(left.T - right.T);              \
-            case TOKEN_STAR: return variant_##T(left.T * right.T);               \
-            case TOKEN_SLASH: return variant_##T(left.T / right.T);              \
-            case TOKEN_PERCENT: return variant_##T(left.T % right.T);            \
-            case TOKEN_AMPERSAND: return variant_##T(left.T & right.T);          \
-            case TOKEN_PIPE: return variant_##T(left.T | right.T);               \
-            case TOKEN_CARET: return variant_##T(left.T ^ right.T);              \
-            case TOKEN_EQUAL_EQUAL: return variant_##T(left.T == right.T);       \
-            case TOKEN_EXCLAMATION_EQUAL: return variant_##T(left.T != right.T); \
-            case TOKEN_LESS: return variant_##T(left.T < right.T);               \
-            case TOKEN_LESS_EQUAL: return variant_##T(left.T <= right.T);        \
-            case TOKEN_GREATER: return variant_##T(left.T > right.T);            \
-            case TOKEN_GREATER_EQUAL: return variant_##T(left.T >= right.T);     \
-            case TOKEN_LEFT_SHIFT: return variant_##T(left.T << right.T);        \
-            case TOKEN_RIGHT_SHIFT: return variant_##T(left.T >> right.T);       \
-                                                                                 \
-            default: assert(!"unreachable"); return variant_none();              \
-        }                                                                        \
-    }
-
-
-#define make_eval_binary_float(T)                                                \
-    static Variant eval_binary_##T(ASTNode *node) {                              \
-        Variant left = eval_expression(node->binary_left);                       \
-        Variant right = eval_expression(node->binary_right);                     \
-                                                                                 \
-        switch (node->binary_operator) {                                         \
-            case TOKEN_PLUS: return variant_##T(left.T + right.T);               \
-            case TOKEN_MINUS: return variant_##T(left.T - right.T);              \
-            case TOKEN_STAR: return variant_##T(left.T * right.T);               \
-            case TOKEN_SLASH: return variant_##T(left.T / right.T);              \
-            case TOKEN_EQUAL_EQUAL: return variant_i32(left.T == right.T);       \
-            case TOKEN_EXCLAMATION_EQUAL: return variant_i32(left.T != right.T); \
-            case TOKEN_LESS: return variant_i32(left.T < right.T);               \
-            case TOKEN_LESS_EQUAL: return variant_i32(left.T <= right.T);        \
-            case TOKEN_GREATER: return variant_i32(left.T > right.T);            \
-            case TOKEN_GREATER_EQUAL: return variant_i32(left.T >= right.T);     \
-            default: assert(!"unreachable"); return variant_none();              \
-        }                                                                        \
-    }
-
-make_eval_binary(u8);
-make_eval_binary(i8);
-make_eval_binary(u16);
-make_eval_binary(i16);
-make_eval_binary(u32);
-make_eval_binary(i32);
-make_eval_binary(u64);
-make_eval_binary(i64);
-make_eval_binary_float(f32);
-make_eval_binary_float(f64);
-
-static Variant eval_binary(ASTNode *node) {
-    switch (node_type(node)->kind) {
-        case TYPE_U8: return eval_binary_u8(node);
-        case TYPE_I8: return eval_binary_i8(node);
-        case TYPE_U16: return eval_binary_u16(node);
-        case TYPE_I16: return eval_binary_i16(node);
-        case TYPE_U32: return eval_binary_u32(node);
-        case TYPE_I32: return eval_binary_i32(node);
-        case TYPE_U64: return eval_binary_u64(node);
-        case TYPE_I64: return eval_binary_i64(node);
-        case TYPE_F32: return eval_binary_f32(node);
-        case TYPE_F64: return eval_binary_f64(node);
-        default: assert(!"unreachable"); return variant_none();
-    }
-}
-
-static Variant eval_ternary(ASTNode *node) {
-    Variant condition = eval_expression(node->ternary_condition);
-    if (condition.u8)
-        return eval_expression(node->ternary_true);
-    else
-        return eval_expression(node->ternary_false);
-}
-
-static Variant eval_literal(ASTNode *node) {
-    Type *type = node_type(node);
+        case TOKEN_MINUS: {
+            if (eval_is_float(target))
+                return eval_convert(state, node, variant_f64(-eval_as_f64(target)), type);
+            return eval_convert(state, node, variant_u64(-(u64) eval_as_i64(target)), type);
+        }
+        case TOKEN_EXCLAMATION: return eval_convert(state, node, variant_i32(!eval_is_true(target)), type);
+        case TOKEN_TILDE: {
+            if (eval_is_float(target))
+                return eval_fail(state, node, "uses an operator that does not apply to floats");
+            return eval_convert(state, node, variant_u64(~(u64) eval_as_i64(target)), type);
+        }
+        default: return eval_fail(state, node, "uses an unsupported operator");
+    }
+}
+
+static Variant eval_binary(EvalState *state, ASTNode *node) {
+    Variant left = eval_node(state, node->binary_left);
+    if (state->failed)
+        return variant_none();
+
+    // The logical operators only look at their right side when they have to.
+    if (node->binary_operator == TOKEN_AMPERSAND_AMPERSAND && !eval_is_true(left))
+        return eval_convert(state, node, variant_i32(0), node->base_type);
+    if (node->binary_operator == TOKEN_PIPE_PIPE && eval_is_true(left))
+        return eval_convert(state, node, variant_i32(1), node->base_type);
+
+    Variant right = eval_node(state, node->binary_right);
+    if (state->failed)
+        return variant_none();
+
+    Type *type = eval_operand_type(node->binary_left, node->binary_right);
+    Variant result = eval_binary_values(state, node, node->binary_operator, type, left, right);
+    return eval_convert(state, node, result, node->base_type);
+}
+
+static Variant eval_literal(EvalState *state, ASTNode *node) {
+    Type *type = node->base_type;
     switch (type->kind) {
         case TYPE_I8: return variant_i8((i8) node->literal_as_i64);
         case TYPE_U8: return variant_u8((u8) node->literal_as_u64);
@@ -110,52 +323,650 @@ static Variant eval_literal(ASTNode *node) {
         case TYPE_F32: return variant_f32((f32) node->literal_as_f64);
         case TYPE_F64: return variant_f64((f64) node->literal_as_f64);
         case TYPE_STRING: return variant_string(node->literal_value.data, node->literal_value.length);
-        case TYPE_ARRAY:
-        default: assert(!"unimplemented"); return variant_none();
+        default: return eval_fail(state, node, "uses an unsupported literal");
     }
 }
 
-static Variant eval_cast(ASTNode *node) {
-    Variant target = eval_expression(node->cast_target);
-    Type *type = node_type(node);
-    switch (type->kind) {
-        case TYPE_I8: return variant_i8((i8) target.i64);
-        case TYPE_U8: return variant_u8((u8) target.u64);
-        case TYPE_I16: return variant_i16((i16) target.i64);
-        case TYPE_U16: return variant_u16((u16) target.u64);
-        case TYPE_I32: return variant_i32((i32) target.i64);
-        case TYPE_U32: return variant_u32((u32) target.u64);
-        case TYPE_I64: return variant_i64((i64) target.i64);
-        case TYPE_U64: return variant_u64((u64) target.u64);
-        case TYPE_F32: return variant_f32((f32) target.f64);
-        case TYPE_F64: return variant_f64((f64) target.f64);
-        default: assert(!"unimplemented"); return variant_none();
+static EvalLocal *eval_find_local(EvalState *state, ASTNode *declaration) {
+    for (u32 i = vector_length(state->locals); i > state->frame; i--) {
+        if (state->locals[i - 1].declaration == declaration)
+            return &state->locals[i - 1];
+    }
+    return null;
+}
+
+static void eval_push_local(EvalState *state, ASTNode *declaration, Variant value) {
+    EvalLocal local = {declaration, eval_copy(value)};
+    vector_push(state->locals, local);
+}
+
+// Constants are evaluated the first time they are referenced and remembered on their declaration.
+static Variant eval_constant(EvalState *state, ASTNode *node, ASTNode *declaration) {
+    if (declaration->flags & AST_FLAG_CONSTANT)
+        return ast_constant(declaration);
+
+    if (!declaration->variable_initializer || state->depth >= EVAL_MAX_DEPTH)
+        return eval_fail(state, node, "refers to a constant that cannot be evaluated");
+
+    // The initializer cannot see the locals of whoever refers to the constant.
+    u32 frame = state->frame;
+    state->frame = vector_length(state->locals);
+    state->depth++;
+
+    Variant value = eval_node(state, declaration->variable_initializer);
+
+    state->depth--;
+    state->frame = frame;
+
+    if (state->failed)
+        return variant_none();
+
+    ast_set_constant(declaration, value);
+    return value;
+}
+
+static Variant eval_identifier(EvalState *state, ASTNode *node) {
+    ASTNode *declaration = node->identifier_declaration;
+    if (!declaration)
+        return eval_fail(state, node, "refers to a type");
+
+    switch (declaration->kind) {
+        case AST_DECLARATION_FUNCTION_PARAMETER:
+        case AST_STATEMENT_INIT: {
+            EvalLocal *local = eval_find_local(state, declaration);
+            if (!local)
+                return eval_fail(state, node, "refers to a variable outside of the evaluation");
+            return local->value;
+        }
+        case AST_DECLARATION_VARIABLE: {
+            if (!declaration->variable_is_const)
+                return eval_fail(state, node, "reads a global variable");
+            return eval_constant(state, node, declaration);
+        }
+        default: return eval_fail(state, node, "uses a function as a value");
+    }
+}
+
+// Results of earlier calls, looked up by the function and the values of its arguments.
+typedef struct {
+    ASTNode *function;
+    Variant *arguments;
+    u32 argument_count;
+    u64 hash;
+    Variant result;
+} EvalMemo;
+
+static EvalMemo **eval_memo_table;
+static u32 eval_memo_capacity;
+static u32 eval_memo_length;
+
+static u64 eval_hash_mix(u64 hash, u64 value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+static u64 eval_hash_variant(u64 hash, Variant *value) {
+    hash = eval_hash_mix(hash, value->kind);
+    switch (value->kind) {
+        case VARIANT_NONE: return hash;
+        case VARIANT_F32:
+        case VARIANT_F64: {
+            f64 floating = eval_as_f64(*value);
+            u64 bits;
+            memcpy(&bits, &floating, sizeof(bits));
+            return eval_hash_mix(hash, bits);
+        }
+        case VARIANT_STRING: {
+            for (u64 i = 0; i < value->string.length; i++)
+                hash = eval_hash_mix(hash, (u8) value->string.data[i]);
+            return eval_hash_mix(hash, value->string.length);
+        }
+        case VARIANT_ARRAY: {
+            for (u64 i = 0; i < value->array.length; i++)
+                hash = eval_hash_variant(hash, &value->array.data[i]);
+            return eval_hash_mix(hash, value->array.length);
+        }
+        default: return eval_hash_mix(hash, (u64) eval_as_i64(*value));
+    }
+}
+
+static u64 eval_hash_call(ASTNode *function, Variant *arguments, u32 count) {
+    u64 hash = eval_hash_mix(0, (u64) function);
+    for (u32 i = 0; i < count; i++)
+        hash = eval_hash_variant(hash, &arguments[i]);
+    return hash;
+}
+
+static bool eval_memo_matches(EvalMemo *memo, ASTNode *function, u64 hash, Variant *arguments, u32 count) {
+    if (memo->hash != hash || memo->function != function || memo->argument_count != count)
+        return false;
+
+    for (u32 i = 0; i < count; i++) {
+        if (!variant_equals(&memo->arguments[i], &arguments[i]))
+            return false;
+    }
+    return true;
+}
+
+static EvalMemo **eval_memo_find(EvalMemo **table, u32 capacity, ASTNode *function, u64 hash, Variant *arguments, u32 count) {
+    u32 index = (u32) hash & (capacity - 1);
+    while (table[index] && !eval_memo_matches(table[index], function, hash, arguments, count))
+        index = (index + 1) & (capacity - 1);
+    return &table[index];
+}
+
+static void eval_memo_grow(void) {
+    u32 capacity = eval_memo_capacity ? eval_memo_capacity * 2 : 256;
+    EvalMemo **table = make_n(EvalMemo *, capacity);
+
+    for (u32 i = 0; i < eval_memo_capacity; i++) {
+        EvalMemo *memo = eval_memo_table[i];
+        if (memo)
+            *eval_memo_find(table, capacity, memo->function, memo->hash, memo->arguments, memo->argument_count) = memo;
+    }
+
+    free(eval_memo_table);
+    eval_memo_table = table;
+    eval_memo_capacity = capacity;
+}
+
+static EvalMemo **eval_memo_slot(ASTNode *function, u64 hash, Variant *arguments, u32 count) {
+    if ((eval_memo_length + 1) * 4 > eval_memo_capacity * 3)
+        eval_memo_grow();
+    return eval_memo_find(eval_memo_table, eval_memo_capacity, function, hash, arguments, count);
+}
+
+static Variant eval_call(EvalState *state, ASTNode *node) {
+    ASTNode *target = node->call_target;
+    ASTNode *function = target->kind == AST_EXPRESSION_IDENTIFIER ? target->identifier_declaration : null;
+    if (!function || function->kind != AST_DECLARATION_FUNCTION)
+        return eval_fail(state, node, "calls something other than a named function");
+
+    ASTNode *body = parse_function_body(function, stderr);
+    if (!body || function->function_is_variadic)
+        return eval_fail(state, node, "calls a function that is not written in the language");
+
+    Type *type = node_type(function);
+    u32 count = vector_length(node->call_arguments);
+    Variant *arguments = vector_create(Variant);
+    for (u32 i = 0; i < count; i++) {
+        Variant argument = eval_node(state, node->call_arguments[i]);
+        argument = eval_convert(state, node->call_arguments[i], argument, type->function_parameters[i]);
+        if (state->failed) {
+            vector_free(arguments);
+            return variant_none();
+        }
+        vector_push(arguments, argument);
+    }
+
+    // Only functions that returned are ever remembered, and they can only have computed their result.
+    u64 hash = eval_hash_call(function, arguments, count);
+    EvalMemo **slot = eval_memo_slot(function, hash, arguments, count);
+    if (*slot) {
+        vector_free(arguments);
+        return (*slot)->result;
+    }
+
+    if (state->depth >= EVAL_MAX_DEPTH) {
+        vector_free(arguments);
+        return eval_fail(state, node, "recurses too deeply");
     }
+
+    u32 frame = state->frame;
+    state->frame = vector_length(state->locals);
+    state->depth++;
+
+    for (u32 i = 0; i < count; i++)
+        eval_push_local(state, function->function_parameters[i], arguments[i]);
+
+    state->result = variant_none();
+    EvalFlow flow = eval_statement(state, body);
+    Variant result = state->result;
+    if (flow == EVAL_RETURN && type->function_return_type->kind != TYPE_VOID)
+        result = eval_convert(state, node, result, type->function_return_type);
+
+    vector_length(state->locals) = state->frame;
+    state->depth--;
+    state->frame = frame;
+
+    if (state->failed) {
+        vector_free(arguments);
+        return variant_none();
+    }
+
+    // The slot may have moved while the body ran, since it could have made calls of its own.
+    EvalMemo *memo = make(EvalMemo);
+    memo->function = function;
+    memo->arguments = arena_alloc(&eval_arena, sizeof(Variant) * (count ? count : 1));
+    for (u32 i = 0; i < count; i++)
+        memo->arguments[i] = eval_copy(arguments[i]);
+    memo->argument_count = count;
+    memo->hash = hash;
+    memo->result = result;
+
+    *eval_memo_slot(function, hash, arguments, count) = memo;
+    eval_memo_length++;
+
+    vector_free(arguments);
+    return result;
 }
 
-Variant eval_expression(ASTNode *node) {
+static Variant eval_field(EvalState *state, ASTNode *node) {
+    Type *type = node_type(node->field_target);
+    if (type->kind == TYPE_POINTER)
+        return eval_fail(state, node, "uses pointers");
+
+    Variant target = eval_node(state, node->field_target);
+    if (state->failed)
+        return variant_none();
+
+    if (type->kind == TYPE_ARRAY || type->kind == TYPE_STRING) {
+        if (!intern_match(node->field_name, symbols.length))
+            return eval_fail(state, node, "uses pointers");
+
+        u64 length = type->kind == TYPE_ARRAY ? target.array.length : target.string.length;
+        return eval_convert(state, node, variant_u64(length), node->base_type);
+    }
+
+    i32 index = eval_field_index(type, node->field_name);
+    if (index < 0 || (u64) index >= target.array.length)
+        return eval_fail(state, node, "uses an unknown field");
+    return target.array.data[index];
+}
+
+static Variant eval_index(EvalState *state, ASTNode *node) {
+    Type *type = node_type(node->index_target);
+    if (type->kind == TYPE_POINTER)
+        return eval_fail(state, node, "uses pointers");
+
+    Variant index = eval_node(state, node->index_index);
+    Variant target = eval_node(state, node->index_target);
+    if (state->failed)
+        return variant_none();
+
+    u64 position = (u64) eval_as_i64(index);
+    if (type->kind == TYPE_STRING) {
+        if (position >= target.string.length)
+            return eval_fail(state, node, "indexes out of bounds");
+        return eval_convert(state, node, variant_u8((u8) target.string.data[position]), node->base_type);
+    }
+
+    if (position >= target.array.length)
+        return eval_fail(state, node, "indexes out of bounds");
+    return target.array.data[position];
+}
+
+static Variant eval_compound(EvalState *state, ASTNode *node) {
+    Type *type = node->base_type;
+    if (type->kind != TYPE_AGGREGATE && (type->kind != TYPE_ARRAY || type->array_is_dynamic || !type->array_size))
+        return eval_fail(state, node, "builds a value that needs memory at run time");
+
+    Variant compound = eval_zero(state, node, type);
+
+    // Like in lowering, only the fields without a name or an index move the position along.
+    u64 position = 0;
+    vector_foreach_ptr(ASTNode, field_ptr, node->compound_fields) {
+        ASTNode *field = *field_ptr;
+        Variant value = eval_node(state, field->compound_field_target);
+        if (state->failed)
+            return variant_none();
+
+        u64 index = 0;
+        switch (field->kind) {
+            case AST_EXPRESSION_COMPOUND_FIELD: index = position++; break;
+            case AST_EXPRESSION_COMPOUND_FIELD_NAME: {
+                i32 named = type->kind == TYPE_AGGREGATE ? eval_field_index(type, field->compound_field_name) : -1;
+                if (named < 0)
+                    return eval_fail(state, field, "uses an unknown field");
+                index = (u64) named;
+                break;
+            }
+            case AST_EXPRESSION_COMPOUND_FIELD_INDEX: {
+                Variant at = eval_node(state, field->compound_field_index);
+                if (state->failed)
+                    return variant_none();
+                index = (u64) eval_as_i64(at);
+                break;
+            }
+            default: return eval_fail(state, field, "uses an unsupported compound literal");
+        }
+
+        if (index >= compound.array.length)
+            return eval_fail(state, field, "indexes out of bounds");
+
+        Type *element = type->kind == TYPE_AGGREGATE ? type->fields[index].type : type->array_base;
+        compound.array.data[index] = eval_copy(eval_convert(state, field, value, element));
+    }
+
+    return compound;
+}
+
+static Variant eval_expression_raw(EvalState *state, ASTNode *node) {
     switch (node->kind) {
-        case AST_EXPRESSION_PAREN: return eval_expression(node->parent);
-        case AST_EXPRESSION_UNARY: return eval_unary(node);
-        case AST_EXPRESSION_BINARY: return eval_binary(node);
-        case AST_EXPRESSION_TERNARY: return eval_ternary(node);
+        case AST_EXPRESSION_PAREN: return eval_node(state, node->parent);
+        case AST_EXPRESSION_UNARY: return eval_unary(state, node);
+        case AST_EXPRESSION_BINARY: return eval_binary(state, node);
+        case AST_EXPRESSION_TERNARY: {
+            Variant condition = eval_node(state, node->ternary_condition);
+            if (state->failed)
+                return variant_none();
+            return eval_node(state, eval_is_true(condition) ? node->ternary_true : node->ternary_false);
+        }
         case AST_EXPRESSION_LITERAL_NUMBER:
         case AST_EXPRESSION_LITERAL_CHAR:
-        case AST_EXPRESSION_LITERAL_STRING: return eval_literal(node);
-        case AST_EXPRESSION_IDENTIFIER: return node->constant; // Hack to make enums work.
-        case AST_EXPRESSION_SIZEOF:
-        case AST_EXPRESSION_ALIGNOF:
-        case AST_EXPRESSION_OFFSETOF:
-        case AST_EXPRESSION_CALL:
-        case AST_EXPRESSION_FIELD:
-        case AST_EXPRESSION_INDEX: break;
-        case AST_EXPRESSION_CAST: return eval_cast(node);
-        case AST_EXPRESSION_COMPOUND:
-        case AST_EXPRESSION_COMPOUND_FIELD:
-        case AST_EXPRESSION_COMPOUND_FIELD_NAME:
-        case AST_EXPRESSION_COMPOUND_FIELD_INDEX:
-        default: assert(!"unreachable");
+        case AST_EXPRESSION_LITERAL_STRING: return eval_literal(state, node);
+        case AST_EXPRESSION_IDENTIFIER: return eval_identifier(state, node);
+        case AST_EXPRESSION_CALL: return eval_call(state, node);
+        case AST_EXPRESSION_FIELD: return eval_field(state, node);
+        case AST_EXPRESSION_INDEX: return eval_index(state, node);
+        case AST_EXPRESSION_CAST: {
+            Variant target = eval_node(state, node->cast_target);
+            return eval_convert(state, node, target, node->base_type);
+        }
+        case AST_EXPRESSION_COMPOUND: return eval_compound(state, node);
+        default: return eval_fail(state, node, "uses an expression that is not supported at compile time");
     }
+}
 
-    return variant_none();
-}
\ No newline at end of file
+static Variant eval_node(EvalState *state, ASTNode *node) {
+    if (state->failed)
+        return variant_none();
+    if (++state->steps > EVAL_STEP_BUDGET)
+        return eval_fail(state, node, "runs for too long");
+
+    return eval_expression_raw(state, node);
+}
+
+// Where a value can be stored. The pointer is only valid until the next local is pushed,
+// so everything that the store needs is evaluated before the place is looked up.
+static Variant *eval_place(EvalState *state, ASTNode *node, Variant *index) {
+    switch (node->kind) {
+        case AST_EXPRESSION_PAREN: return eval_place(state, node->parent, index);
+        case AST_EXPRESSION_IDENTIFIER: {
+            EvalLocal *local = node->identifier_declaration ? eval_find_local(state, node->identifier_declaration) : null;
+            if (!local) {
+                eval_fail(state, node, "writes to a global variable");
+                return null;
+            }
+            return &local->value;
+        }
+        case AST_EXPRESSION_FIELD: {
+            Type *type = node_type(node->field_target);
+            if (type->kind != TYPE_AGGREGATE) {
+                eval_fail(state, node, "writes through a pointer");
+                return null;
+            }
+
+            Variant *target = eval_place(state, node->field_target, index + 1);
+            if (!target)
+                return null;
+
+            i32 field = eval_field_index(type, node->field_name);
+            if (field < 0 || (u64) field >= target->array.length) {
+                eval_fail(state, node, "uses an unknown field");
+                return null;
+            }
+            return &target->array.data[field];
+        }
+        case AST_EXPRESSION_INDEX: {
+            // Slices share their elements with whoever passed them, which copies cannot do.
+            Type *type = node_type(node->index_target);
+            if (type->kind != TYPE_ARRAY || type->array_is_dynamic || !type->array_size) {
+                eval_fail(state, node, "writes through a pointer or a slice");
+                return null;
+            }
+
+            Variant *target = eval_place(state, node->index_target, index + 1);
+            if (!target)
+                return null;
+
+            u64 position = (u64) eval_as_i64(*index);
+            if (position >= target->array.length) {
+                eval_fail(state, node, "indexes out of bounds");
+                return null;
+            }
+            return &target->array.data[position];
+        }
+        default: eval_fail(state, node, "writes to something that is not a variable"); return null;
+    }
+}
+
+// Evaluates the indices of a place from the outside in, see eval_place.
+static bool eval_place_indices(EvalState *state, ASTNode *node, Variant **indices) {
+    switch (node->kind) {
+        case AST_EXPRESSION_PAREN: return eval_place_indices(state, node->parent, indices);
+        case AST_EXPRESSION_FIELD: {
+            Variant none = variant_none();
+            vector_push(*indices, none);
+            return eval_place_indices(state, node->field_target, indices);
+        }
+        case AST_EXPRESSION_INDEX: {
+            Variant index = eval_node(state, node->index_index);
+            vector_push(*indices, index);
+            return !state->failed && eval_place_indices(state, node->index_target, indices);
+        }
+        default: return true;
+    }
+}
+
+static EvalFlow eval_assign(EvalState *state, ASTNode *statement) {
+    Variant value = eval_node(state, statement->assign_value);
+    Variant *indices = vector_create(Variant);
+    Variant *place = null;
+    if (!state->failed && eval_place_indices(state, statement->assign_target, &indices))
+        place = eval_place(state, statement->assign_target, indices);
+    vector_free(indices);
+    if (!place)
+        return EVAL_FAILED;
+
+    Type *type = node_type(statement->assign_target);
+    if (statement->assign_operator != TOKEN_EQUAL) {
+        TokenKind operator = TOKEN_PLUS;
+        switch (statement->assign_operator) {
+            case TOKEN_PLUS_EQUAL: operator = TOKEN_PLUS; break;
+            case TOKEN_MINUS_EQUAL: operator = TOKEN_MINUS; break;
+            case TOKEN_STAR_EQUAL: operator = TOKEN_STAR; break;
+            case TOKEN_SLASH_EQUAL: operator = TOKEN_SLASH; break;
+            case TOKEN_PERCENT_EQUAL: operator = TOKEN_PERCENT; break;
+            case TOKEN_AMPERSAND_EQUAL: operator = TOKEN_AMPERSAND; break;
+            case TOKEN_PIPE_EQUAL: operator = TOKEN_PIPE; break;
+            case TOKEN_CARET_EQUAL: operator = TOKEN_CARET; break;
+            case TOKEN_AMPERSAND_AMPERSAND_EQUAL: operator = TOKEN_AMPERSAND_AMPERSAND; break;
+            case TOKEN_PIPE_PIPE_EQUAL: operator = TOKEN_PIPE_PIPE; break;
+            case TOKEN_LEFT_SHIFT_EQUAL: operator = TOKEN_LEFT_SHIFT; break;
+            case TOKEN_RIGHT_SHIFT_EQUAL: operator = TOKEN_RIGHT_SHIFT; break;
+            default: eval_fail(state, statement, "uses an unsupported assignment"); return EVAL_FAILED;
+        }
+
+        Type *operands = eval_operand_type(statement->assign_target, statement->assign_value);
+        value = eval_binary_values(state, statement, operator, operands, *place, value);
+    }
+
+    value = eval_convert(state, statement, value, type);
+    if (state->failed)
+        return EVAL_FAILED;
+
+    *place = eval_copy(value);
+    return EVAL_NEXT;
+}
+
+static EvalFlow eval_init(EvalState *state, ASTNode *statement) {
+    Type *type = node_type(statement);
+    Variant value = statement->init_value ? eval_node(state, statement->init_value) : eval_zero(state, statement, type);
+    value = eval_convert(state, statement, value, type);
+    if (state->failed)
+        return EVAL_FAILED;
+
+    eval_push_local(state, statement, value);
+    return EVAL_NEXT;
+}
+
+static EvalFlow eval_condition(EvalState *state, ASTNode *condition, bool *result) {
+    Variant value = eval_node(state, condition);
+    *result = eval_is_true(value);
+    return state->failed ? EVAL_FAILED : EVAL_NEXT;
+}
+
+static EvalFlow eval_loop_body(EvalState *state, ASTNode *body, bool *done) {
+    EvalFlow flow = eval_statement(state, body);
+    *done = flow != EVAL_NEXT && flow != EVAL_CONTINUE;
+    return flow == EVAL_BREAK ? EVAL_NEXT : flow;
+}
+
+static EvalFlow eval_switch(EvalState *state, ASTNode *statement) {
+    Variant value = eval_node(state, statement->switch_expression);
+    if (state->failed)
+        return EVAL_FAILED;
+
+    vector_foreach_ptr(ASTNode, switch_case_ptr, statement->switch_cases) {
+        ASTNode *switch_case = *switch_case_ptr;
+
+        // A case without patterns is the default one, and is taken when it is reached.
+        bool matches = switch_case->switch_case_is_default || vector_length(switch_case->switch_case_patterns) == 0;
+        vector_foreach_ptr(ASTNode, pattern_ptr, switch_case->switch_case_patterns) {
+            ASTNode *pattern = *pattern_ptr;
+            Type *type = eval_operand_type(statement->switch_expression, pattern->switch_pattern_start);
+            Variant start = eval_node(state, pattern->switch_pattern_start);
+            if (pattern->switch_pattern_end) {
+                Variant end = eval_node(state, pattern->switch_pattern_end);
+                Variant above = eval_binary_values(state, pattern, TOKEN_GREATER_EQUAL, type, value, start);
+                Variant below = eval_binary_values(state, pattern, TOKEN_LESS_EQUAL, type, value, end);
+                matches |= eval_is_true(above) && eval_is_true(below);
+            } else {
+                matches |= eval_is_true(eval_binary_values(state, pattern, TOKEN_EQUAL_EQUAL, type, value, start));
+            }
+
+            if (state->failed)
+                return EVAL_FAILED;
+        }
+
+        if (!matches)
+            continue;
+
+        EvalFlow flow = eval_statement(state, switch_case->switch_case_body);
+        return flow == EVAL_BREAK ? EVAL_NEXT : flow;
+    }
+
+    return EVAL_NEXT;
+}
+
+static EvalFlow eval_statement_raw(EvalState *state, ASTNode *statement) {
+    switch (statement->kind) {
+        case AST_STATEMENT_BLOCK: {
+            vector_foreach_ptr(ASTNode, inner, statement->statements) {
+                EvalFlow flow = eval_statement(state, *inner);
+                if (flow != EVAL_NEXT)
+                    return flow;
+            }
+            return EVAL_NEXT;
+        }
+        case AST_STATEMENT_IF: {
+            bool condition = false;
+            if (statement->if_expression && eval_statement(state, statement->if_expression) != EVAL_NEXT)
+                return EVAL_FAILED;
+
+            if (statement->if_condition) {
+                if (eval_condition(state, statement->if_condition, &condition) != EVAL_NEXT)
+                    return EVAL_FAILED;
+            } else {
+                condition = eval_is_true(eval_find_local(state, statement->if_expression)->value);
+            }
+
+            if (condition)
+                return eval_statement(state, statement->if_true);
+            return statement->if_false ? eval_statement(state, statement->if_false) : EVAL_NEXT;
+        }
+        case AST_STATEMENT_WHILE: {
+            for (;;) {
+                bool condition = false, done = false;
+                if (eval_condition(state, statement->while_condition, &condition) != EVAL_NEXT)
+                    return EVAL_FAILED;
+                if (!condition)
+                    return EVAL_NEXT;
+
+                EvalFlow flow = eval_loop_body(state, statement->while_body, &done);
+                if (done)
+                    return flow;
+            }
+        }
+        case AST_STATEMENT_DO_WHILE: {
+            for (;;) {
+                bool condition = false, done = false;
+                EvalFlow flow = eval_loop_body(state, statement->while_body, &done);
+                if (done)
+                    return flow;
+
+                if (eval_condition(state, statement->while_condition, &condition) != EVAL_NEXT)
+                    return EVAL_FAILED;
+                if (!condition)
+                    return EVAL_NEXT;
+            }
+        }
+        case AST_STATEMENT_FOR: {
+            if (statement->for_initializer && eval_statement(state, statement->for_initializer) != EVAL_NEXT)
+                return EVAL_FAILED;
+
+            for (;;) {
+                bool condition = true, done = false;
+                if (statement->for_condition && eval_condition(state, statement->for_condition, &condition) != EVAL_NEXT)
+                    return EVAL_FAILED;
+                if (!condition)
+                    return EVAL_NEXT;
+
+                EvalFlow flow = eval_loop_body(state, statement->for_body, &done);
+                if (done)
+                    return flow;
+
+                if (statement->for_increment && eval_statement(state, statement->for_increment) != EVAL_NEXT)
+                    return EVAL_FAILED;
+            }
+        }
+        case AST_STATEMENT_SWITCH: return eval_switch(state, statement);
+        case AST_STATEMENT_BREAK: return EVAL_BREAK;
+        case AST_STATEMENT_CONTINUE: return EVAL_CONTINUE;
+        case AST_STATEMENT_RETURN: {
+            state->result = statement->parent ? eval_node(state, statement->parent) : variant_none();
+            return state->failed ? EVAL_FAILED : EVAL_RETURN;
+        }
+        case AST_STATEMENT_INIT: return eval_init(state, statement);
+        case AST_STATEMENT_EXPRESSION: {
+            eval_node(state, statement->parent);
+            return state->failed ? EVAL_FAILED : EVAL_NEXT;
+        }
+        case AST_STATEMENT_ASSIGN: return eval_assign(state, statement);
+        default: eval_fail(state, statement, "uses an unsupported statement"); return EVAL_FAILED;
+    }
+}
+
+// Statements drop the locals they declared, so that loops do not pile them up.
+static EvalFlow eval_statement(EvalState *state, ASTNode *statement) {
+    if (state->failed)
+        return EVAL_FAILED;
+    if (++state->steps > EVAL_STEP_BUDGET) {
+        eval_fail(state, statement, "runs for too long");
+        return EVAL_FAILED;
+    }
+
+    bool scoped = statement->kind != AST_STATEMENT_INIT;
+    u32 locals = vector_length(state->locals);
+    EvalFlow flow = eval_statement_raw(state, statement);
+    if (scoped)
+        vector_length(state->locals) = locals;
+    return state->failed ? EVAL_FAILED : flow;
+}
+
+Variant eval_expression(ASTNode *node, EvalError *error) {
+    EvalState state = {.locals = vector_create(EvalLocal), .error = error};
+    if (error)
+        *error = (EvalError){0};
+
+    // Only the conversion of the whole expression is applied, to the type of what it initializes.
+    Variant value = eval_node(&state, node);
+    if (node->flags & AST_FLAG_CONVERTED)
+        value = eval_convert(&state, node, value, ast_conversion(node));
+    if (value.kind == VARIANT_NONE)
+        eval_fail(&state, node, "has no value");
+
+    vector_free(state.locals);
+    return state.failed ? variant_none() : value;
+}
@@ -1,155 +1,241 @@
 #include "atcc.h"
+#include "ati/scan.h"
 #include "ati/utils.h"
 #include <ctype.h>
-
-typedef struct Lexer {
-    string filename;
-    Buffer source;
-    u64 offset;
-
-    i32 line;
-    i32 column;
-
-    Token *buffer;
-} Lexer;
+#include <string.h>
 
 static i8 lexer_read(Lexer *lexer) {
     if (lexer->offset >= lexer->source.length)
         return 0;
-    i8 character = lexer->source.data[lexer->offset++];
-    if (character == '\n') {
-        lexer->line++;
-        lexer->column = 1;
-    } else {
-        lexer->column++;
-    }
-    return character;
+    return lexer->source.data[lexer->offset++];
 }
 
-static i8 lexer_peek(Lexer *lexer) {
+static i8 lexer_peek_byte(Lexer *lexer) {
     if (lexer->offset >= lexer->source.length)
         return 0;
     return lexer->source.data[lexer->offset];
 }
 
-static i8 lexer_peek_next(Lexer *lexer) {
+static i8 lexer_peek_next_byte(Lexer *lexer) {
     if (lexer->offset + 1 >= lexer->source.length)
         return 0;
     return lexer->source.data[lexer->offset + 1];
 }
 
+TokenKind lexer_keyword_kind(string identifier) {
+    // Keywords are told apart by their length and one or two discriminating
+    // characters, so every identifier costs at most a single memcmp.
+#define KEYWORD(keyword, kind) \
+    return memcmp(identifier.data, keyword, sizeof(keyword) - 1) == 0 ? kind : TOKEN_IDENTIFIER
+
+    i8 *data = identifier.data;
+    switch (identifier.length) {
+        case 2:
+            switch (data[0]) {
+                case 'd': KEYWORD("do", TOKEN_KW_DO);
+                case 'i': KEYWORD("if", TOKEN_KW_IF);
+            }
+            break;
+        case 3:
+            switch (data[0]) {
+                case 'f':
+                    switch (data[1]) {
+                        case 'o': KEYWORD("for", TOKEN_KW_FOR);
+                        case 'u': KEYWORD("fun", TOKEN_KW_FUN);
+                    }
+                    break;
+                case 'v': KEYWORD("var", TOKEN_KW_VAR);
+            }
+            break;
+        case 4:
+            switch (data[0]) {
+                case 'c':
+                    switch (data[3]) {
+                        case 'e': KEYWORD("case", TOKEN_KW_CASE);
+                        case 't': KEYWORD("cast", TOKEN_KW_CAST);
+                    }
+                    break;
+                case 'e':
+                    switch (data[1]) {
+                        case 'l': KEYWORD("else", TOKEN_KW_ELSE);
+                        case 'n': KEYWORD("enum", TOKEN_KW_ENUM);
+                    }
+                    break;
+            }
+            break;
+        case 5:
+            switch (data[0]) {
+                case 'a': KEYWORD("alias", TOKEN_KW_ALIAS);
+                case 'b': KEYWORD("break", TOKEN_KW_BREAK);
+                case 'c': KEYWORD("const", TOKEN_KW_CONST);
+                case 'u': KEYWORD("union", TOKEN_KW_UNION);
+                case 'w': KEYWORD("while", TOKEN_KW_WHILE);
+            }
+            break;
+        case 6:
+            switch (data[0]) {
+                case 'r': KEYWORD("return", TOKEN_KW_RETURN);
+                case 's':
+                    switch (data[1]) {
+                        case 'i': KEYWORD("sizeof", TOKEN_KW_SIZEOF);
+                        case 't': KEYWORD("struct", TOKEN_KW_STRUCT);
+                        case 'w': KEYWORD("switch", TOKEN_KW_SWITCH);
+                    }
+                    break;
+            }
+            break;
+        case 7:
+            switch (data[0]) {
+                case 'a': KEYWORD("alignof", TOKEN_KW_ALIGNOF);
+                case 'd': KEYWORD("default", TOKEN_KW_DEFAULT);
+            }
+            break;
+        case 8:
+            switch (data[0]) {
+                case 'c': KEYWORD("continue", TOKEN_KW_CONTINUE);
+                case 'o': KEYWORD("offsetof", TOKEN_KW_OFFSETOF);
+            }
+            break;
+    }
+
+#undef KEYWORD
+    return TOKEN_IDENTIFIER;
+}
+
 static void lexer_build_identifier(Lexer *lexer, Token *token) {
-#define initstr(s) \
-    { .data = (i8 *) (s), .length = sizeof(s) - 1 }
-    static struct {
-        string ident;
-        TokenKind kind;
-    } keywords[] = {
-            {initstr("alias"), TOKEN_KW_ALIAS},
-            {initstr("alignof"), TOKEN_KW_ALIGNOF},
-            {initstr("break"), TOKEN_KW_BREAK},
-            {initstr("case"), TOKEN_KW_CASE},
-            {initstr("cast"), TOKEN_KW_CAST},
-            {initstr("const"), TOKEN_KW_CONST},
-            {initstr("continue"), TOKEN_KW_CONTINUE},
-            {initstr("default"), TOKEN_KW_DEFAULT},
-            {initstr("do"), TOKEN_KW_DO},
-            {initstr("else"), TOKEN_KW_ELSE},
-            {initstr("enum"), TOKEN_KW_ENUM},
-            {initstr("for"), TOKEN_KW_FOR},
-            {initstr("fun"), TOKEN_KW_FUN},
-            {initstr("if"), TOKEN_KW_IF},
-            {initstr("offsetof"), TOKEN_KW_OFFSETOF},
-            {initstr("return"), TOKEN_KW_RETURN},
-            {initstr("sizeof"), TOKEN_KW_SIZEOF},
-            {initstr("struct"), TOKEN_KW_STRUCT},
-            {initstr("switch"), TOKEN_KW_SWITCH},
-            {initstr("union"), TOKEN_KW_UNION},
-            {initstr("var"), TOKEN_KW_VAR},
-            {initstr("while"), TOKEN_KW_WHILE},
-    };
-#undef initstr
-
-    i8 *buffer = vector_create_n(i8, 32);
-    while (isalnum(lexer_peek(lexer)) || lexer_peek(lexer) == '_')
-        vector_push(buffer, lexer_read(lexer));
-
-    token->kind = TOKEN_IDENTIFIER;
-    token->value = rawstr(buffer, vector_length(buffer));
-    for (i32 i = 0; i < array_length(keywords); i++) {
-        if (string_match(token->value, keywords[i].ident)) {
-            token->kind = keywords[i].kind;
+    u64 start = lexer->offset;
+    lexer->offset = scan_identifier(lexer->source.data, lexer->offset, lexer->source.length);
+
+    token->value = rawstr(lexer->source.data + start, lexer->offset - start);
+    token->kind = lexer_keyword_kind(token->value);
+
+    // Names are compared by pointer from here on, see intern.h.
+    if (token->kind == TOKEN_IDENTIFIER)
+        token->value = intern(token->value);
+}
+
+static void lexer_build_number(Lexer *lexer, Token *token) {
+    u64 start = lexer->offset;
+    token->kind = TOKEN_NUMBER;
+
+    if (lexer_peek_byte(lexer) == '0') {
+        TokenFlag radix_flag = TOKEN_FLAG_NONE;
+        switch (lexer_peek_next_byte(lexer)) {
+            case 'x':
+            case 'X': radix_flag = TOKEN_FLAG_HEX; break;
+            case 'o':
+            case 'O': radix_flag = TOKEN_FLAG_OCT; break;
+            case 'b':
+            case 'B': radix_flag = TOKEN_FLAG_BIN; break;
+        }
+
+        if (radix_flag != TOKEN_FLAG_NONE) {
+            // Every alphanumeric character belongs to the literal, the parser rejects invalid digits.
+            lexer->offset = scan_identifier(lexer->source.data, lexer->offset + 2, lexer->source.length);
+            token->flags |= radix_flag;
+            token->value = rawstr(lexer->source.data + start, lexer->offset - start);
             return;
         }
     }
+
+    lexer->offset = scan_digits(lexer->source.data, lexer->offset, lexer->source.length);
+
+    // Only a single dot that is not the start of a `..` continues the number.
+    if (lexer_peek_byte(lexer) == '.' && lexer_peek_next_byte(lexer) != '.') {
+        lexer_read(lexer);
+        lexer->offset = scan_digits(lexer->source.data, lexer->offset, lexer->source.length);
+        token->flags |= TOKEN_FLAG_FLOAT;
+    }
+
+    if (lexer_peek_byte(lexer) == 'e' || lexer_peek_byte(lexer) == 'E') {
+        u64 exponent = lexer->offset + 1;
+        if (exponent < lexer->source.length && (lexer->source.data[exponent] == '+' || lexer->source.data[exponent] == '-'))
+            exponent++;
+
+        if (exponent < lexer->source.length && isdigit(lexer->source.data[exponent])) {
+            lexer->offset = scan_digits(lexer->source.data, exponent, lexer->source.length);
+            token->flags |= TOKEN_FLAG_FLOAT;
+        }
+    }
+
+    token->value = rawstr(lexer->source.data + start, lexer->offset - start);
 }
 
-static void lexer_build_number(Lexer *lexer, Token *token) {
-    i8 *buffer = vector_create_n(i8, 32);
-    bool seen_dot = 0;
-    while (isdigit(lexer_peek(lexer)) || lexer_peek(lexer) == '.') {
-        if (lexer_peek(lexer) == '.') {
-            if (!seen_dot)
-                seen_dot = true;
-            else {
-                token->kind = TOKEN_NUMBER;
-                token->value = rawstr(buffer, vector_length(buffer));
-                lexer->offset--;// Make sure .. lexes properly.
-                return;
+static u8 lexer_hex_value(u8 character) {
+    if (isdigit(character))
+        return character - '0';
+    return (character | 0x20) - 'a' + 10;
+}
+
+static string lexer_decode_escapes(string raw) {
+    // Decoding never makes a literal longer, so the raw length is enough.
+    i8 *buffer = malloc(raw.length);
+    u64 length = 0;
+
+    for (u64 i = 0; i < raw.length; i++) {
+        i8 character = raw.data[i];
+        if (character != '\\' || i + 1 >= raw.length) {
+            buffer[length++] = character;
+            continue;
+        }
+
+        i8 maybe_escape = raw.data[++i];
+        switch (maybe_escape) {
+            case 'n': buffer[length++] = '\n'; break;
+            case 'r': buffer[length++] = '\r'; break;
+            case 't': buffer[length++] = '\t'; break;
+            case '0': buffer[length++] = '\0'; break;
+            case '\\': buffer[length++] = '\\'; break;
+            case '\'': buffer[length++] = '\''; break;
+            case '"': buffer[length++] = '"'; break;
+            case 'x':
+            case 'X': {
+                u8 hex_digit = 0;
+                while (i + 1 < raw.length && isxdigit(raw.data[i + 1]))
+                    hex_digit = hex_digit * 16 + lexer_hex_value(raw.data[++i]);
+                buffer[length++] = hex_digit;
+                break;
             }
+            default:
+                buffer[length++] = character;
+                buffer[length++] = maybe_escape;
+                break;
         }
-        vector_push(buffer, lexer_read(lexer));
     }
 
-    token->kind = TOKEN_NUMBER;
-    token->value = rawstr(buffer, vector_length(buffer));
+    return rawstr(buffer, length);
 }
 
-static void lexer_build_string_or_char(Lexer *lexer, Token *token, i8 terminator) {
-    i8 *buffer = vector_create_n(i8, 32);
-    while (lexer_peek(lexer) != terminator) {
-        i8 character = lexer_read(lexer);
-        if (character == '\\') {
-            i8 maybe_escape = lexer_read(lexer);
-            switch (maybe_escape) {
-                case 'n': vector_push(buffer, '\n'); break;
-                case 'r': vector_push(buffer, '\r'); break;
-                case 't': vector_push(buffer, '\t'); break;
-                case '0': vector_push(buffer, '\0'); break;
-                case '\\': vector_push(buffer, '\\'); break;
-                case '\'': vector_push(buffer, '\''); break;
-                case '"': vector_push(buffer, '"'); break;
-                case 'x':
-                case 'X': {
-                    u8 hex_digit = 0;
-                    while (isxdigit(lexer_peek(lexer))) {
-                        u8 hex_character = lexer_read(lexer);
-                        u8 number = isdigit(hex_character) ? hex_character - '0' : hex_character - 'A' + 10;
-                        hex_digit = hex_digit * 16 + number;
-                    }
-                    vector_push(buffer, hex_digit);
-                    break;
-                }
-                default:
-                    vector_push(buffer, character);
-                    vector_push(buffer, maybe_escape);
-                    break;
-            }
-        } else {
-            vector_push(buffer, character);
+// Moves up to the terminator of a string or char literal, returns whether it contained escapes.
+static bool lexer_skip_quoted(Lexer *lexer, i8 terminator) {
+    bool has_escapes = false;
+    while (lexer_peek_byte(lexer) != terminator && lexer->offset < lexer->source.length) {
+        if (lexer_read(lexer) == '\\') {
+            has_escapes = true;
+            lexer_read(lexer);
         }
     }
+    return has_escapes;
+}
+
+static void lexer_build_string_or_char(Lexer *lexer, Token *token, i8 terminator) {
+    u64 start = lexer->offset;
+    bool has_escapes = lexer_skip_quoted(lexer, terminator);
 
+    string raw = rawstr(lexer->source.data + start, lexer->offset - start);
     lexer_read(lexer);
-    vector_push(buffer, '\0');
 
     token->kind = terminator == '"' ? TOKEN_STRING : TOKEN_CHAR;
-    token->value = rawstr(buffer, vector_length(buffer));
+    token->value = has_escapes ? lexer_decode_escapes(raw) : raw;
+
+    // Sema reads the first byte of a char literal, so '' and 'ab' never get that far.
+    if (token->kind == TOKEN_CHAR && token->value.length != 1)
+        token->flags |= TOKEN_FLAG_INVALID;
 }
 
 static void lexer_build_equal(Lexer *lexer, Token *token, TokenKind token1, TokenKind token2) {
     token->kind = token1;
-    if (lexer_peek(lexer) == '=') {
+    if (lexer_peek_byte(lexer) == '=') {
         lexer_read(lexer);
         token->kind = token2;
     }
@@ -157,12 +243,13 @@ static void lexer_build_equal(Lexer *lexer, Token *token, TokenKind token1, Toke
 
 static void lexer_skip_multiline_comment(Lexer *lexer) {
     int level = 1;
-    while (lexer_peek(lexer) != 0 && level > 0) {
-        if (lexer_peek(lexer) == '/' && lexer_peek_next(lexer) == '*') {
+    while (lexer_peek_byte(lexer) != 0 && level > 0) {
+        lexer->offset = scan_block_comment(lexer->source.data, lexer->offset, lexer->source.length);
+        if (lexer_peek_byte(lexer) == '/' && lexer_peek_next_byte(lexer) == '*') {
             level++;
             lexer_read(lexer);
             lexer_read(lexer);
-        } else if (lexer_peek(lexer) == '*' && lexer_peek_next(lexer) == '/') {
+        } else if (lexer_peek_byte(lexer) == '*' && lexer_peek_next_byte(lexer) == '/') {
             level--;
             lexer_read(lexer);
             lexer_read(lexer);
@@ -172,161 +259,269 @@ static void lexer_skip_multiline_comment(Lexer *lexer) {
     }
 }
 
-Token *lexer_tokenize(string filename, Buffer data) {
-    Lexer lexer = {0};
-    lexer.filename = filename;
-    lexer.source = data;
-    lexer.line = 1;
-    lexer.column = 1;
-    lexer.buffer = vector_create(Token);
-
-    while (lexer_peek(&lexer) != 0) {
-        while (isspace(lexer_peek(&lexer)) || lexer_peek(&lexer) == -62 || lexer_peek(&lexer) == -96)
-            lexer_read(&lexer);
+static void lexer_skip_whitespace_and_comments(Lexer *lexer) {
+    for (;;) {
+        lexer->offset = scan_whitespace(lexer->source.data, lexer->offset, lexer->source.length);
 
-        vector_push(lexer.buffer, (Token){0});
-        Token *current = &vector_last(lexer.buffer);
-
-        current->kind = TOKEN_NONE;
-        current->flags = TOKEN_FLAG_NONE;
-        current->location = (Location){.file = lexer.filename, .line = lexer.line, .column = lexer.column};
-        current->value = str("");
-
-        if (lexer_peek(&lexer) == 0)
-            current->kind = TOKEN_EOF;
-
-        if (isalpha(lexer_peek(&lexer)) || lexer_peek(&lexer) == '_') {
-            lexer_build_identifier(&lexer, current);
+        if (lexer_peek_byte(lexer) == '/' && lexer_peek_next_byte(lexer) == '/') {
+            lexer->offset = scan_line(lexer->source.data, lexer->offset + 2, lexer->source.length);
             continue;
         }
 
-        if (isdigit(lexer_peek(&lexer))) {
-            lexer_build_number(&lexer, current);
+        if (lexer_peek_byte(lexer) == '/' && lexer_peek_next_byte(lexer) == '*') {
+            lexer->offset += 2;
+            lexer_skip_multiline_comment(lexer);
             continue;
         }
 
-        if (lexer_peek(&lexer) == '"' || lexer_peek(&lexer) == '\'') {
-            lexer_build_string_or_char(&lexer, current, lexer_read(&lexer));
-            continue;
-        }
+        return;
+    }
+}
 
-        i8 character = lexer_read(&lexer);
-        switch (character) {
-            case '\0': current->kind = TOKEN_EOF; break;
-            case '+': lexer_build_equal(&lexer, current, TOKEN_PLUS, TOKEN_PLUS_EQUAL); break;
-            case '-': lexer_build_equal(&lexer, current, TOKEN_MINUS, TOKEN_MINUS_EQUAL); break;
-            case '*': lexer_build_equal(&lexer, current, TOKEN_STAR, TOKEN_STAR_EQUAL); break;
-            case '%': lexer_build_equal(&lexer, current, TOKEN_PERCENT, TOKEN_PERCENT_EQUAL); break;
-            case '^': lexer_build_equal(&lexer, current, TOKEN_CARET, TOKEN_CARET_EQUAL); break;
-            case '~': lexer_build_equal(&lexer, current, TOKEN_TILDE, TOKEN_TILDE_EQUAL); break;
-            case '=': lexer_build_equal(&lexer, current, TOKEN_EQUAL, TOKEN_EQUAL_EQUAL); break;
-            case '!': lexer_build_equal(&lexer, current, TOKEN_EXCLAMATION, TOKEN_EXCLAMATION_EQUAL); break;
-            case ':': lexer_build_equal(&lexer, current, TOKEN_COLON, TOKEN_COLON_EQUAL); break;
-            case '.':
-                current->kind = TOKEN_DOT;
-                if (lexer_peek(&lexer) == '.') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_DOT_DOT;
-                }
-                break;
-            case ',': current->kind = TOKEN_COMMA; break;
-            case '?': current->kind = TOKEN_QUESTION; break;
-            case ';': current->kind = TOKEN_SEMICOLON; break;
-            case '(': current->kind = TOKEN_OPEN_PAREN; break;
-            case ')': current->kind = TOKEN_CLOSE_PAREN; break;
-            case '[': current->kind = TOKEN_OPEN_BRACKET; break;
-            case ']': current->kind = TOKEN_CLOSE_BRACKET; break;
-            case '{': current->kind = TOKEN_OPEN_BRACE; break;
-            case '}': current->kind = TOKEN_CLOSE_BRACE; break;
-            case '#': current->kind = TOKEN_HASH; break;
-            case '$': current->kind = TOKEN_DOLLAR; break;
-            case '@': current->kind = TOKEN_AT; break;
-            case '&': {
-                current->kind = TOKEN_AMPERSAND;
-                if (lexer_peek(&lexer) == '&') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_AMPERSAND_AMPERSAND;
-                    if (lexer_peek(&lexer) == '=') {
-                        lexer_read(&lexer);
-                        current->kind = TOKEN_AMPERSAND_AMPERSAND_EQUAL;
-                    }
-                } else if (lexer_peek(&lexer) == '=') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_AMPERSAND_EQUAL;
+static Token lexer_scan_token(Lexer *lexer) {
+    lexer_skip_whitespace_and_comments(lexer);
+
+    Token token = {0};
+    Token *current = &token;
+
+    current->kind = TOKEN_NONE;
+    current->flags = TOKEN_FLAG_NONE;
+    current->location = lexer->base + (Location) lexer->offset;
+    current->value = str("");
+
+    if (lexer_peek_byte(lexer) == 0) {
+        current->kind = TOKEN_EOF;
+        return token;
+    }
+
+    if (isalpha(lexer_peek_byte(lexer)) || lexer_peek_byte(lexer) == '_') {
+        lexer_build_identifier(lexer, current);
+        return token;
+    }
+
+    if (isdigit(lexer_peek_byte(lexer))) {
+        lexer_build_number(lexer, current);
+        return token;
+    }
+
+    if (lexer_peek_byte(lexer) == '"' || lexer_peek_byte(lexer) == '\'') {
+        lexer_build_string_or_char(lexer, current, lexer_read(lexer));
+        return token;
+    }
+
+    i8 character = lexer_read(lexer);
+    switch (character) {
+        case '+': lexer_build_equal(lexer, current, TOKEN_PLUS, TOKEN_PLUS_EQUAL); break;
+        case '-': lexer_build_equal(lexer, current, TOKEN_MINUS, TOKEN_MINUS_EQUAL); break;
+        case '*': lexer_build_equal(lexer, current, TOKEN_STAR, TOKEN_STAR_EQUAL); break;
+        case '%': lexer_build_equal(lexer, current, TOKEN_PERCENT, TOKEN_PERCENT_EQUAL); break;
+        case '^': lexer_build_equal(lexer, current, TOKEN_CARET, TOKEN_CARET_EQUAL); break;
+        case '~': lexer_build_equal(lexer, current, TOKEN_TILDE, TOKEN_TILDE_EQUAL); break;
+        case '=': lexer_build_equal(lexer, current, TOKEN_EQUAL, TOKEN_EQUAL_EQUAL); break;
+        case '!': lexer_build_equal(lexer, current, TOKEN_EXCLAMATION, TOKEN_EXCLAMATION_EQUAL); break;
+        case ':': lexer_build_equal(lexer, current, TOKEN_COLON, TOKEN_COLON_EQUAL); break;
+        case '.':
+            current->kind = TOKEN_DOT;
+            if (lexer_peek_byte(lexer) == '.') {
+                lexer_read(lexer);
+                current->kind = TOKEN_DOT_DOT;
+            }
+            break;
+        case ',': current->kind = TOKEN_COMMA; break;
+        case '?': current->kind = TOKEN_QUESTION; break;
+        case ';': current->kind = TOKEN_SEMICOLON; break;
+        case '(': current->kind = TOKEN_OPEN_PAREN; break;
+        case ')': current->kind = TOKEN_CLOSE_PAREN; break;
+        case '[': current->kind = TOKEN_OPEN_BRACKET; break;
+        case ']': current->kind = TOKEN_CLOSE_BRACKET; break;
+        case '{': current->kind = TOKEN_OPEN_BRACE; break;
+        case '}': current->kind = TOKEN_CLOSE_BRACE; break;
+        case '#': current->kind = TOKEN_HASH; break;
+        case '$': current->kind = TOKEN_DOLLAR; break;
+        case '@': current->kind = TOKEN_AT; break;
+        case '&': {
+            current->kind = TOKEN_AMPERSAND;
+            if (lexer_peek_byte(lexer) == '&') {
+                lexer_read(lexer);
+                current->kind = TOKEN_AMPERSAND_AMPERSAND;
+                if (lexer_peek_byte(lexer) == '=') {
+                    lexer_read(lexer);
+                    current->kind = TOKEN_AMPERSAND_AMPERSAND_EQUAL;
                 }
-                break;
+            } else if (lexer_peek_byte(lexer) == '=') {
+                lexer_read(lexer);
+                current->kind = TOKEN_AMPERSAND_EQUAL;
             }
-            case '|': {
-                current->kind = TOKEN_PIPE;
-                if (lexer_peek(&lexer) == '|') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_PIPE_PIPE;
-                    if (lexer_peek(&lexer) == '=') {
-                        lexer_read(&lexer);
-                        current->kind = TOKEN_PIPE_PIPE_EQUAL;
-                    }
-                } else if (lexer_peek(&lexer) == '=') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_PIPE_EQUAL;
+            break;
+        }
+        case '|': {
+            current->kind = TOKEN_PIPE;
+            if (lexer_peek_byte(lexer) == '|') {
+                lexer_read(lexer);
+                current->kind = TOKEN_PIPE_PIPE;
+                if (lexer_peek_byte(lexer) == '=') {
+                    lexer_read(lexer);
+                    current->kind = TOKEN_PIPE_PIPE_EQUAL;
                 }
-                break;
+            } else if (lexer_peek_byte(lexer) == '=') {
+                lexer_read(lexer);
+                current->kind = TOKEN_PIPE_EQUAL;
             }
-            case '<': {
-                current->kind = TOKEN_LESS;
-                if (lexer_peek(&lexer) == '<') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_LEFT_SHIFT;
-                    if (lexer_peek(&lexer) == '=') {
-                        lexer_read(&lexer);
-                        current->kind = TOKEN_LEFT_SHIFT_EQUAL;
-                    }
-                } else if (lexer_peek(&lexer) == '=') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_LESS_EQUAL;
+            break;
+        }
+        case '<': {
+            current->kind = TOKEN_LESS;
+            if (lexer_peek_byte(lexer) == '<') {
+                lexer_read(lexer);
+                current->kind = TOKEN_LEFT_SHIFT;
+                if (lexer_peek_byte(lexer) == '=') {
+                    lexer_read(lexer);
+                    current->kind = TOKEN_LEFT_SHIFT_EQUAL;
                 }
-                break;
+            } else if (lexer_peek_byte(lexer) == '=') {
+                lexer_read(lexer);
+                current->kind = TOKEN_LESS_EQUAL;
             }
-            case '>': {
-                current->kind = TOKEN_GREATER;
-                if (lexer_peek(&lexer) == '>') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_RIGHT_SHIFT;
-                    if (lexer_peek(&lexer) == '=') {
-                        lexer_read(&lexer);
-                        current->kind = TOKEN_RIGHT_SHIFT_EQUAL;
-                    }
-                } else if (lexer_peek(&lexer) == '=') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_GREATER_EQUAL;
+            break;
+        }
+        case '>': {
+            current->kind = TOKEN_GREATER;
+            if (lexer_peek_byte(lexer) == '>') {
+                lexer_read(lexer);
+                current->kind = TOKEN_RIGHT_SHIFT;
+                if (lexer_peek_byte(lexer) == '=') {
+                    lexer_read(lexer);
+                    current->kind = TOKEN_RIGHT_SHIFT_EQUAL;
                 }
+            } else if (lexer_peek_byte(lexer) == '=') {
+                lexer_read(lexer);
+                current->kind = TOKEN_GREATER_EQUAL;
+            }
+            break;
+        }
+        case '/': lexer_build_equal(lexer, current, TOKEN_SLASH, TOKEN_SLASH_EQUAL); break;
+        default:
+            printf("Character: '%c' (%u)\n", character, (u8) character);
+            break;
+    }
+
+    return token;
+}
+
+void lexer_initialize(Lexer *lexer, u32 file, bool batch) {
+    *lexer = (Lexer){0};
+    lexer->file = file;
+    lexer->source = source_file_data(file);
+    lexer->base = source_location(file, 0);
+
+    if (batch)
+        lexer->tokens = lexer_tokenize(file);
+}
+
+Token *lexer_tokenize(u32 file) {
+    Lexer lexer = {0};
+    lexer.file = file;
+    lexer.source = source_file_data(file);
+    lexer.base = source_location(file, 0);
+
+    Token *tokens = vector_create(Token);
+    do {
+        vector_push(tokens, lexer_scan_token(&lexer));
+    } while (vector_last(tokens).kind != TOKEN_EOF);
+
+    return tokens;
+}
+
+Token *lexer_peek(Lexer *lexer, u32 n) {
+    assert(n < LEXER_LOOKAHEAD);
+
+    if (lexer->tokens) {
+        u64 index = lexer->next_token + n;
+        u64 last = vector_length(lexer->tokens) - 1;
+        return &lexer->tokens[index < last ? index : last];
+    }
+
+    while (lexer->lookahead_count <= n) {
+        u32 slot = (lexer->lookahead_start + lexer->lookahead_count) % LEXER_LOOKAHEAD;
+        lexer->lookahead[slot] = lexer_scan_token(lexer);
+        lexer->lookahead_count++;
+    }
+
+    return &lexer->lookahead[(lexer->lookahead_start + n) % LEXER_LOOKAHEAD];
+}
+
+Token lexer_next(Lexer *lexer) {
+    if (lexer->tokens) {
+        Token token = *lexer_peek(lexer, 0);
+        if (token.kind != TOKEN_EOF)
+            lexer->next_token++;
+        return token;
+    }
+
+    if (lexer->lookahead_count == 0)
+        return lexer_scan_token(lexer);
+
+    Token token = lexer->lookahead[lexer->lookahead_start];
+    lexer->lookahead_start = (lexer->lookahead_start + 1) % LEXER_LOOKAHEAD;
+    lexer->lookahead_count--;
+    return token;
+}
+
+bool lexer_skip_block(Lexer *lexer) {
+    u32 depth = 1;
+
+    if (lexer->tokens) {
+        while (depth > 0) {
+            Token token = lexer_next(lexer);
+            if (token.kind == TOKEN_EOF) return false;
+            if (token.kind == TOKEN_OPEN_BRACE) depth++;
+            if (token.kind == TOKEN_CLOSE_BRACE) depth--;
+        }
+        return true;
+    }
+
+    // Tokens that were peeked at already are part of the block.
+    while (lexer->lookahead_count > 0 && depth > 0) {
+        Token token = lexer_next(lexer);
+        if (token.kind == TOKEN_EOF) return false;
+        if (token.kind == TOKEN_OPEN_BRACE) depth++;
+        if (token.kind == TOKEN_CLOSE_BRACE) depth--;
+    }
+
+    // The rest is matched on the raw bytes, only literals and comments can hide a brace.
+    while (depth > 0) {
+        if (lexer->offset >= lexer->source.length)
+            return false;
+
+        switch (lexer_read(lexer)) {
+            case '{': depth++; break;
+            case '}': depth--; break;
+            case '"':
+            case '\'': {
+                i8 terminator = lexer->source.data[lexer->offset - 1];
+                lexer_skip_quoted(lexer, terminator);
+                lexer_read(lexer);
                 break;
             }
             case '/': {
-                current->kind = TOKEN_SLASH;
-                if (lexer_peek(&lexer) == '=') {
-                    lexer_read(&lexer);
-                    current->kind = TOKEN_SLASH_EQUAL;
-                } else if (lexer_peek(&lexer) == '/') {// Single line comment
-                    lexer_read(&lexer);
-                    while (lexer_peek(&lexer) != '\0' && lexer_peek(&lexer) != '\r' && lexer_peek(&lexer) != '\n')
-                        lexer_read(&lexer);
-                    vector_header(lexer.buffer)->length--;// We don't want to emit the slash if we are in a comment
-                } else if (lexer_peek(&lexer) == '*') {   // Multi line comment
-                    lexer_read(&lexer);
-                    lexer_skip_multiline_comment(&lexer);
-                    vector_header(lexer.buffer)->length--;// We don't want to emit the slash if we are in a comment
+                if (lexer_peek_byte(lexer) == '/') {
+                    lexer->offset = scan_line(lexer->source.data, lexer->offset + 1, lexer->source.length);
+                } else if (lexer_peek_byte(lexer) == '*') {
+                    lexer->offset++;
+                    lexer_skip_multiline_comment(lexer);
                 }
                 break;
             }
-            default:
-                printf("Character: '%c' (%u)\n", character, (u8) character);
-                break;
+            default: break;
         }
     }
 
-    Token *eof_token = vector_add(lexer.buffer, 1);
-    eof_token->kind = TOKEN_EOF;
-    eof_token->location = (Location){.file = lexer.filename, .line = lexer.line, .column = lexer.column};
+    return true;
+}
 
-    return lexer.buffer;
+void lexer_seek(Lexer *lexer, Location location) {
+    assert(!lexer->tokens && location >= lexer->base && location - lexer->base <= lexer->source.length);
+    lexer->offset = location - lexer->base;
+    lexer->lookahead_start = 0;
+    lexer->lookahead_count = 0;
 }
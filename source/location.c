@@ -0,0 +1,110 @@
+#include "atcc.h"
+#include "ati/scan.h"
+#include "ati/thread.h"
+#include "ati/utils.h"
+
+typedef struct {
+    string name;
+    Buffer data;
+
+    // Location of the first byte; every file also owns the location one past its end.
+    Location base;
+
+    // Offsets of the first byte of every line, built on the first lookup.
+    u32 *line_starts;
+} SourceFile;
+
+static SourceFile *source_files = null;
+static u64 source_next_base = 0;
+
+// Diagnostics of one file can be reported from several threads.
+static Mutex source_lines_lock = MUTEX_INITIALIZER;
+
+u32 source_register(string filename, Buffer data) {
+    if (!source_files)
+        source_files = vector_create(SourceFile);
+
+    if (source_next_base + data.length + 1 > UINT32_MAX)
+        panic("%.*s: more than 4 GiB of source code is not supported", strp(filename));
+
+    SourceFile *file = vector_add(source_files, 1);
+    file->name = filename;
+    file->data = data;
+    file->base = (Location) source_next_base;
+    file->line_starts = null;
+
+    source_next_base += data.length + 1;
+
+    return (u32) vector_length(source_files) - 1;
+}
+
+string source_file_name(u32 file) {
+    return source_files[file].name;
+}
+
+Buffer source_file_data(u32 file) {
+    return source_files[file].data;
+}
+
+static void source_build_line_starts(SourceFile *file) {
+    u64 lines = scan_count_newlines(file->data.data, 0, file->data.length) + 1;
+    file->line_starts = vector_create_n(u32, lines);
+
+    u64 offset = 0;
+    vector_push(file->line_starts, 0);
+    while ((offset = scan_newline(file->data.data, offset, file->data.length)) < file->data.length)
+        vector_push(file->line_starts, (u32) ++offset);
+}
+
+Location source_location(u32 file, u64 offset) {
+    return source_files[file].base + (Location) offset;
+}
+
+u64 source_line_count(void) {
+    u64 lines = 0;
+    vector_foreach(SourceFile, file, source_files) {
+        Buffer data = file->data;
+        lines += scan_count_newlines(data.data, 0, data.length);
+        if (data.length > 0 && data.data[data.length - 1] != '\n')
+            lines++;
+    }
+    return lines;
+}
+
+u32 source_file_at(Location location) {
+    // The last file that starts at or before the location.
+    u64 low = 0, high = vector_length(source_files);
+    while (high - low > 1) {
+        u64 middle = low + (high - low) / 2;
+        if (source_files[middle].base <= location)
+            low = middle;
+        else
+            high = middle;
+    }
+    return (u32) low;
+}
+
+SourcePosition location_resolve(Location location) {
+    SourceFile *file = &source_files[source_file_at(location)];
+    mutex_lock(&source_lines_lock);
+    if (!file->line_starts)
+        source_build_line_starts(file);
+    mutex_unlock(&source_lines_lock);
+
+    // Then the last line of that file that starts at or before it.
+    u32 offset = location - file->base;
+    u64 low = 0, high = vector_length(file->line_starts);
+    while (high - low > 1) {
+        u64 middle = low + (high - low) / 2;
+        if (file->line_starts[middle] <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return (SourcePosition){
+            .file = file->name,
+            .line = (i32) low + 1,
+            .column = (i32) (offset - file->line_starts[low]) + 1,
+    };
+}
@@ -25,7 +25,7 @@ static BCType build_convert_type(BuildContext *context, Type *type) {
         case TYPE_F64: return bc_type_f64;
         case TYPE_POINTER: {
             BCType base_type = build_convert_type(context, type->base_type);
-            BCType pointer_type = bc_type_pointer(base_type);
+            BCType pointer_type = bc_type_pointer(context->bc, base_type);
 
             pointer_table_set(&context->types, type, pointer_type);
             return pointer_type;
@@ -38,8 +38,8 @@ static BCType build_convert_type(BuildContext *context, Type *type) {
                 vector_push(parameters, parameter);
             }
 
-            BCType function_type = bc_type_function(result, parameters, vector_length(parameters));
-            function_type->is_variadic = type->function_is_variadic;
+            BCType function_type = bc_type_function(context->bc, result, parameters, vector_length(parameters), type->function_is_variadic);
+            vector_free(parameters);
 
             pointer_table_set(&context->types, type, function_type);
             return function_type;
@@ -48,11 +48,11 @@ static BCType build_convert_type(BuildContext *context, Type *type) {
             if (!bc_type_string) {
                 BCAggregate *members = calloc(2, sizeof(BCAggregate));
 
-                members[0].name = str("length");
+                members[0].name = symbols.length;
                 members[0].type = bc_type_u32;
 
-                members[1].name = str("data");
-                members[1].type = bc_type_pointer(bc_type_u8);
+                members[1].name = symbols.data;
+                members[1].type = bc_type_pointer(context->bc, bc_type_u8);
                 members[1].offset = 4;
 
                 bc_type_string = bc_type_aggregate(context->bc, str("string"));
@@ -64,7 +64,7 @@ static BCType build_convert_type(BuildContext *context, Type *type) {
         case TYPE_ARRAY: {
             if (type->array_size) {
                 BCType base_type = build_convert_type(context, type->array_base);
-                BCValue size = bc_value_make_consti(bc_type_u32, type->array_size);
+                BCValue size = bc_value_make_consti(context->bc, bc_type_u32, type->array_size);
                 BCType array_type = bc_type_array(context->bc, base_type, size, false);
 
                 pointer_table_set(&context->types, type, array_type);
@@ -79,12 +79,12 @@ static BCType build_convert_type(BuildContext *context, Type *type) {
         }
         case TYPE_AGGREGATE: {
             string name = type->owner->aggregate_name;
-            BCType aggregate = string_table_get(&context->aggregates, name);
+            BCType aggregate = symbol_table_get(&context->aggregates, name);
 
             if (!type->is_complete) return aggregate;
             if (!aggregate) {
                 aggregate = bc_type_aggregate(context->bc, name);
-                string_table_set(&context->aggregates, name, aggregate);
+                symbol_table_set(&context->aggregates, name, aggregate);
 
                 BCAggregate *members = vector_create(BCAggregate);
                 u32 offset = 0;
@@ -110,11 +110,11 @@ static BCType build_convert_type(BuildContext *context, Type *type) {
 }
 
 static BCValue build_resolve_name(BuildContext *context, string name) {
-    BCValue resolved = string_table_get(&context->locals, name);
+    BCValue resolved = symbol_table_get(&context->locals, name);
     if (resolved) return resolved;
-    resolved = string_table_get(&context->globals, name);
+    resolved = symbol_table_get(&context->globals, name);
     if (resolved) return resolved;
-    return string_table_get(&context->functions, name);
+    return symbol_table_get(&context->functions, name);
 }
 
 static TokenKind build_get_assignment_operator(TokenKind kind) {
@@ -141,19 +141,14 @@ static BCValue build_expression_lvalue(BuildContext *context, ASTNode *expressio
 static void build_statement(BuildContext *context, ASTNode *statement);
 
 static BCValue build_string_equals(BuildContext *context, BCValue left, BCValue right) {
-    BCValue string_equals = string_table_get(&context->functions, str("__atcc_string_equals"));
-    BCValue *string_equals_args = make_n(BCValue, 2);
-    string_equals_args[0] = left;
-    string_equals_args[1] = right;
+    BCValue string_equals = symbol_table_get(&context->functions, symbols.string_equals);
+    BCValue string_equals_args[] = {left, right};
     return bc_insn_call(context->function, string_equals, string_equals_args, 2);
 }
 
 static BCValue build_memset(BuildContext *context, BCValue target, BCValue value, BCValue size) {
-    BCValue memset_function = string_table_get(&context->functions, str("__atcc_memset"));
-    BCValue *memset_args = make_n(BCValue, 3);
-    memset_args[0] = target;
-    memset_args[1] = value;
-    memset_args[2] = size;
+    BCValue memset_function = symbol_table_get(&context->functions, symbols.memset);
+    BCValue memset_args[] = {target, value, size};
     return bc_insn_call(context->function, memset_function, memset_args, 3);
 }
 
@@ -179,8 +174,8 @@ static BCValue build_expression_logical_and(BuildContext *context, ASTNode *expr
     BCBlock set1 = bc_block_make(context->function);
     BCBlock last = bc_block_make(context->function);
 
-    BCValue c0 = bc_value_make_consti(bc_type_i32, 0);
-    BCValue c1 = bc_value_make_consti(bc_type_i32, 1);
+    BCValue c0 = bc_value_make_consti(context->bc, bc_type_i32, 0);
+    BCValue c1 = bc_value_make_consti(context->bc, bc_type_i32, 1);
 
     BCValue binary_l = build_expression(context, expression->binary_left);
     BCValue comparison_l = bc_insn_ne(context->function, binary_l, c0);
@@ -211,8 +206,8 @@ static BCValue build_expression_logical_and(BuildContext *context, ASTNode *expr
 }
 
 static BCValue build_expression_logical_or(BuildContext *context, ASTNode *expression) {
-    BCValue c0 = bc_value_make_consti(bc_type_i32, 0);
-    BCValue c1 = bc_value_make_consti(bc_type_i32, 1);
+    BCValue c0 = bc_value_make_consti(context->bc, bc_type_i32, 0);
+    BCValue c1 = bc_value_make_consti(context->bc, bc_type_i32, 1);
 
     BCBlock eval_right = bc_block_make(context->function);
     BCBlock set0 = bc_block_make(context->function);
@@ -229,10 +224,10 @@ static BCValue build_expression_logical_or(BuildContext *context, ASTNode *expre
     bc_insn_jump_if(context->function, comparison, set1, set0);
 
     bc_function_set_block(context->function, set0);
-    bc_insn_jump(context->function, last)->regC = c0;
+    bc_insn_jump(context->function, last)->regC = c0->index;
 
     bc_function_set_block(context->function, set1);
-    bc_insn_jump(context->function, last)->regC = c1;
+    bc_insn_jump(context->function, last)->regC = c1->index;
 
     bc_function_set_block(context->function, last);
 
@@ -303,7 +298,7 @@ static BCValue build_expression_binary(BuildContext *context, ASTNode *expressio
 }
 
 static BCValue build_expression_ternary(BuildContext *context, ASTNode *expression) {
-    BCValue c0 = bc_value_make_consti(bc_type_u32, 0);
+    BCValue c0 = bc_value_make_consti(context->bc, bc_type_u32, 0);
 
     BCBlock cond_t = bc_block_make(context->function);
     BCBlock cond_f = bc_block_make(context->function);
@@ -374,12 +369,12 @@ static BCValue build_expression_compound(BuildContext *context, ASTNode *express
     if (base_type->kind == BC_TYPE_ARRAY && !base_type->is_dynamic && base_type->count) {
         // Do a memset to zero out the array.
         BCValue data_pointer = bc_insn_get_field(context->function, compound, base_type->element, 1);
-        BCValue data_size = bc_insn_mul(context->function, bc_value_make_consti(bc_type_u64, base_type->element->size),
+        BCValue data_size = bc_insn_mul(context->function, bc_value_make_consti(context->bc, bc_type_u64, base_type->element->size),
                                         base_type->count);
-        build_memset(context, data_pointer, bc_value_make_consti(bc_type_u8, 0), data_size);
+        build_memset(context, data_pointer, bc_value_make_consti(context->bc, bc_type_u8, 0), data_size);
     } else {
-        BCValue data_size = bc_value_make_consti(bc_type_u64, compound->type->size);
-        build_memset(context, compound, bc_value_make_consti(bc_type_u8, 0), data_size);
+        BCValue data_size = bc_value_make_consti(context->bc, bc_type_u64, compound->type->size);
+        build_memset(context, compound, bc_value_make_consti(context->bc, bc_type_u8, 0), data_size);
     }
 
     u64 current_default_index = 0;
@@ -395,7 +390,7 @@ static BCValue build_expression_compound(BuildContext *context, ASTNode *express
                 switch (ntype->kind) {
                     case TYPE_ARRAY:
                     case TYPE_STRING: {
-                        BCValue index = bc_value_make_consti(bc_type_u64, current_default_index++);
+                        BCValue index = bc_value_make_consti(context->bc, bc_type_u64, current_default_index++);
                         target = bc_insn_get_field(context->function, compound, field_type, 1);
 
                         target = bc_insn_get_index(context->function, target, field_type, index);
@@ -418,7 +413,7 @@ static BCValue build_expression_compound(BuildContext *context, ASTNode *express
 
                 for (u64 i = 0; i < vector_length(ntype->fields); i++) {
                     TypeField *type_field = &ntype->fields[i];
-                    if (string_match(type_field->name, field->compound_field_name)) {
+                    if (intern_match(type_field->name, field->compound_field_name)) {
                         target = bc_insn_get_field(context->function, compound, field_type, i);
                         break;
                     }
@@ -446,7 +441,7 @@ static BCValue build_expression_compound(BuildContext *context, ASTNode *express
 
     // Store the size of the array if it's statically sized.
     if (ntype->kind == TYPE_ARRAY && ntype->array_size != 0) {
-        BCValue size = bc_value_make_consti(bc_type_u32, ntype->array_size);
+        BCValue size = bc_value_make_consti(context->bc, bc_type_u32, ntype->array_size);
         BCValue target = bc_insn_get_field(context->function, compound, bc_type_u32, 0);
         bc_insn_store(context->function, target, size);
     }
@@ -455,7 +450,7 @@ static BCValue build_expression_compound(BuildContext *context, ASTNode *express
 }
 
 static BCValue build_expression(BuildContext *context, ASTNode *expression) {
-    // assert(!expression->conv_type);
+    // assert(!(expression->flags & AST_FLAG_CONVERTED));
 
     BCType type = build_convert_type(context, node_type(expression));
     switch (expression->kind) {
@@ -464,9 +459,9 @@ static BCValue build_expression(BuildContext *context, ASTNode *expression) {
         case AST_EXPRESSION_BINARY: return build_expression_binary(context, expression);
         case AST_EXPRESSION_TERNARY: return build_expression_ternary(context, expression);
         case AST_EXPRESSION_LITERAL_NUMBER: return type->is_floating
-                                                           ? bc_value_make_constf(type, expression->literal_as_f64)
-                                                           : bc_value_make_consti(type, expression->literal_as_u64);
-        case AST_EXPRESSION_LITERAL_CHAR: return bc_value_make_consti(type, expression->literal_as_u64);
+                                                           ? bc_value_make_constf(context->bc, type, expression->literal_as_f64)
+                                                           : bc_value_make_consti(context->bc, type, expression->literal_as_u64);
+        case AST_EXPRESSION_LITERAL_CHAR: return bc_value_make_consti(context->bc, type, expression->literal_as_u64);
         case AST_EXPRESSION_LITERAL_STRING: return bc_insn_load(context->function, build_expression_lvalue(context, expression));
         case AST_EXPRESSION_IDENTIFIER: {
             // TODO: Constant checks, string checks, pointer checks.
@@ -477,7 +472,7 @@ static BCValue build_expression(BuildContext *context, ASTNode *expression) {
         }
         case AST_EXPRESSION_SIZEOF: {
             BCType target_type = build_convert_type(context, node_type(expression->sizeof_type));
-            return bc_value_make_consti(bc_type_u64, target_type->size);
+            return bc_value_make_consti(context->bc, bc_type_u64, target_type->size);
         }
         case AST_EXPRESSION_ALIGNOF: assert(!"unimplemented"); break;
         case AST_EXPRESSION_OFFSETOF: assert(!"unimplemented"); break;
@@ -495,7 +490,9 @@ static BCValue build_expression(BuildContext *context, ASTNode *expression) {
                 vector_push(arguments, argument);
             }
 
-            return bc_insn_call(context->function, target, arguments, vector_length(arguments));
+            BCValue result = bc_insn_call(context->function, target, arguments, vector_length(arguments));
+            vector_free(arguments);
+            return result;
         }
         case AST_EXPRESSION_FIELD:
         case AST_EXPRESSION_INDEX: return bc_insn_load(context->function, build_expression_lvalue(context, expression));
@@ -551,7 +548,7 @@ static BCValue build_expression_lvalue(BuildContext *context, ASTNode *expressio
 
                 for (u32 i = 0; i < type->num_members; i++) {
                     BCAggregate *member = &type->members[i];
-                    if (string_match(expression->field_name, member->name)) {
+                    if (intern_match(expression->field_name, member->name)) {
                         field_type = member->type;
                         break;
                     }
@@ -565,14 +562,14 @@ static BCValue build_expression_lvalue(BuildContext *context, ASTNode *expressio
             if (type->kind == BC_TYPE_ARRAY) {
                 BCType field_type = null;
                 u64 field_index = 0;
-                if (string_match(expression->field_name, str("length"))) {
+                if (intern_match(expression->field_name, symbols.length)) {
                     field_index = 0;
                     field_type = bc_type_u32;
-                } else if (string_match(expression->field_name, str("data"))) {
+                } else if (intern_match(expression->field_name, symbols.data)) {
                     field_index = 1;
                     field_type = type->kind == TYPE_ARRAY
-                                         ? bc_type_pointer(type->element)
-                                         : bc_type_pointer(bc_type_u8);
+                                         ? bc_type_pointer(context->bc, type->element)
+                                         : bc_type_pointer(context->bc, bc_type_u8);
                 } else
                     assert(!"unreachable");
 
@@ -590,7 +587,7 @@ static BCValue build_expression_lvalue(BuildContext *context, ASTNode *expressio
             // For arrays and strings, we need to get the data pointer.
             if (type->kind != TYPE_POINTER) {
                 BCType element_type = type->kind == TYPE_ARRAY ? build_convert_type(context, type->array_base) : bc_type_u8;
-                BCType field_type = bc_type_pointer(element_type);
+                BCType field_type = bc_type_pointer(context->bc, element_type);
 
                 target = bc_insn_get_field(context->function, target, field_type, 1);
 
@@ -615,7 +612,7 @@ static BCValue build_expression_lvalue(BuildContext *context, ASTNode *expressio
             if (type->kind == TYPE_ARRAY) {
                 BCValue target = build_expression_lvalue(context, expression->index_target);
                 BCType element_type = build_convert_type(context, type->array_base);
-                BCType field_type = bc_type_pointer(element_type);
+                BCType field_type = bc_type_pointer(context->bc, element_type);
 
                 // Static arrays are stored inline if they are sized, so we can't get the data pointer,
                 // since a == &a for some reason in C.
@@ -633,7 +630,7 @@ static BCValue build_expression_lvalue(BuildContext *context, ASTNode *expressio
             else if (type->kind == TYPE_STRING) {
                 BCValue target = build_expression_lvalue(context, expression->index_target);
                 BCType element_type = bc_type_u8;
-                BCType field_type = bc_type_pointer(element_type);
+                BCType field_type = bc_type_pointer(context->bc, element_type);
 
                 target = bc_insn_get_field(context->function, target, field_type, 1);
 
@@ -664,21 +661,21 @@ static void build_statement_if(BuildContext *context, ASTNode *statement) {
     if (statement->if_expression)
         build_statement(context, statement->if_expression);
 
-    BCValue c0 = bc_value_make_consti(bc_type_u32, 0);
+    BCValue c0 = bc_value_make_consti(context->bc, bc_type_u32, 0);
 
     BCBlock cond_t = bc_block_make(context->function);
     BCBlock cond_f = bc_block_make(context->function);
     BCBlock last = null;
 
     BCValue condition = statement->if_condition ? build_expression(context, statement->if_condition)
-                                                : string_table_get(&context->locals, statement->init_name);
+                                                : symbol_table_get(&context->locals, statement->init_name);
     BCValue comparison = bc_insn_ne(context->function, condition, c0);
     bc_insn_jump_if(context->function, comparison, cond_t, cond_f);
 
     bc_function_set_block(context->function, cond_t);
     build_statement(context, statement->if_true);
     cond_t = bc_function_get_block(context->function);
-    if (!bc_block_is_terminated(cond_t)) {
+    if (!bc_block_is_terminated(context->function, cond_t)) {
         if (!last) last = bc_block_make(context->function);
         bc_insn_jump(context->function, last);
     }
@@ -686,7 +683,7 @@ static void build_statement_if(BuildContext *context, ASTNode *statement) {
     bc_function_set_block(context->function, cond_f);
     if (statement->if_false) build_statement(context, statement->if_false);
     cond_f = bc_function_get_block(context->function);
-    if (!bc_block_is_terminated(cond_f)) {
+    if (!bc_block_is_terminated(context->function, cond_f)) {
         if (!last) last = bc_block_make(context->function);
         bc_insn_jump(context->function, last);
     }
@@ -708,7 +705,7 @@ static void build_statement_while(BuildContext *context, ASTNode *statement) {
     bc_insn_jump(context->function, cond);
 
     bc_function_set_block(context->function, cond);
-    BCValue c0 = bc_value_make_consti(bc_type_u32, 0);
+    BCValue c0 = bc_value_make_consti(context->bc, bc_type_u32, 0);
     BCValue condition = build_expression(context, statement->while_condition);
     BCValue comparison = bc_insn_ne(context->function, condition, c0);
     bc_insn_jump_if(context->function, comparison, body, last);
@@ -742,11 +739,11 @@ static void build_statement_do_while(BuildContext *context, ASTNode *statement)
 
     build_statement(context, statement->while_body);
     body = bc_function_get_block(context->function);
-    if (!bc_block_is_terminated(body))
+    if (!bc_block_is_terminated(context->function, body))
         bc_insn_jump(context->function, cond);
 
     bc_function_set_block(context->function, cond);
-    BCValue c0 = bc_value_make_consti(bc_type_u32, 0);
+    BCValue c0 = bc_value_make_consti(context->bc, bc_type_u32, 0);
     BCValue condition = build_expression(context, statement->while_condition);
     BCValue comparison = bc_insn_ne(context->function, condition, c0);
     bc_insn_jump_if(context->function, comparison, body, last);
@@ -774,7 +771,7 @@ static void build_statement_for(BuildContext *context, ASTNode *statement) {
     bc_insn_jump(context->function, cond);
     bc_function_set_block(context->function, cond);
     if (statement->for_condition) {
-        BCValue c0 = bc_value_make_consti(bc_type_u32, 0);
+        BCValue c0 = bc_value_make_consti(context->bc, bc_type_u32, 0);
         BCValue condition = build_expression(context, statement->for_condition);
         BCValue comparison = bc_insn_ne(context->function, condition, c0);
         bc_insn_jump_if(context->function, comparison, body, last);
@@ -843,13 +840,13 @@ static void build_statement_switch(BuildContext *context, ASTNode *statement) {
 
         bc_function_set_block(context->function, case_block);
         build_statement(context, switch_case->switch_case_body);
-        if (!bc_block_is_terminated(bc_function_get_block(context->function)))
+        if (!bc_block_is_terminated(context->function, bc_function_get_block(context->function)))
             bc_insn_jump(context->function, break_target);
 
         bc_function_set_block(context->function, next_block);
     }
 
-    if (!bc_block_is_terminated(bc_function_get_block(context->function)))
+    if (!bc_block_is_terminated(context->function, bc_function_get_block(context->function)))
         bc_insn_jump(context->function, break_target);
 
     bc_function_set_block(context->function, break_target);
@@ -886,7 +883,7 @@ static void build_statement(BuildContext *context, ASTNode *statement) {
                 bc_insn_store(context->function, length, type->count);
             }
 
-            string_table_set(&context->locals, statement->init_name, variable);
+            symbol_table_set(&context->locals, statement->init_name, variable);
             break;
         }
         case AST_STATEMENT_EXPRESSION: build_expression(context, statement->parent); break;
@@ -913,16 +910,17 @@ static void build_statement(BuildContext *context, ASTNode *statement) {
 }
 
 static void build_function(BuildContext *context, ASTNode *function) {
-    if (string_match(function->function_name, str("__atcc_init_globals")))
+    if (intern_match(function->function_name, symbols.init_globals))
         return;
 
-    string_table_destroy(&context->locals);
+    symbol_table_destroy(&context->locals);
 
-    BCValue function_value = string_table_get(&context->functions, function->function_name);
+    BCValue function_value = symbol_table_get(&context->functions, function->function_name);
     context->function = (BCFunction) function_value->storage;
     context->function->is_variadic = function->function_is_variadic;
 
-    if (!function->function_body) {
+    ASTNode *body = parse_function_body(function, context->sema->diagnostics);
+    if (!body) {
         context->function->is_extern = true;
         return;
     }
@@ -933,10 +931,10 @@ static void build_function(BuildContext *context, ASTNode *function) {
         BCValue pointer = bc_function_define(context->function, value->type);
         bc_insn_store(context->function, pointer, value);
 
-        string_table_set(&context->locals, parameter->function_parameter_name, pointer);
+        symbol_table_set(&context->locals, parameter->function_parameter_name, pointer);
     }
 
-    build_statement(context, function->function_body);
+    build_statement(context, body);
 
     // TODO: For void return types, we should build the instruction on unterminated blocks.
 
@@ -947,17 +945,96 @@ static void build_function(BuildContext *context, ASTNode *function) {
     }
 }
 
+// Constants of these types are used as immediates, any other kind gets storage like a variable.
+static bool build_is_immediate(Type *type) {
+    return type_is_arithmetic(type) || type->kind == TYPE_STRING;
+}
+
+// Whether a value computed by eval can be written out as stores into memory of `type`.
+static bool build_can_store_constant(Type *type) {
+    switch (type->kind) {
+        case TYPE_ARRAY: return !type->array_is_dynamic && type->array_size && build_can_store_constant(type->array_base);
+        case TYPE_AGGREGATE: {
+            vector_foreach(TypeField, field, type->fields) {
+                if (field->address_only || !build_can_store_constant(field->type))
+                    return false;
+            }
+            return true;
+        }
+        default: return build_is_immediate(type);
+    }
+}
+
+static BCValue build_constant(BuildContext *context, Type *type, Variant value) {
+    BCType bc_type = build_convert_type(context, type);
+    switch (type->kind) {
+        case TYPE_I8: return bc_value_make_consti(context->bc, bc_type, (u64) value.i8);
+        case TYPE_U8: return bc_value_make_consti(context->bc, bc_type, value.u8);
+        case TYPE_I16: return bc_value_make_consti(context->bc, bc_type, (u64) value.i16);
+        case TYPE_U16: return bc_value_make_consti(context->bc, bc_type, value.u16);
+        case TYPE_I32: return bc_value_make_consti(context->bc, bc_type, (u64) value.i32);
+        case TYPE_U32: return bc_value_make_consti(context->bc, bc_type, value.u32);
+        case TYPE_I64: return bc_value_make_consti(context->bc, bc_type, (u64) value.i64);
+        case TYPE_U64: return bc_value_make_consti(context->bc, bc_type, value.u64);
+        case TYPE_F32: return bc_value_make_constf(context->bc, bc_type, value.f32);
+        case TYPE_F64: return bc_value_make_constf(context->bc, bc_type, value.f64);
+        case TYPE_STRING: return bc_value_make_string(context->bc, bc_type, rawstr(value.string.data, value.string.length));
+        default: assert(!"unimplemented"); return null;
+    }
+}
+
+// Writes a value computed at compile time into `target`, field by field and element by element.
+static void build_store_constant(BuildContext *context, BCValue target, Type *type, Variant value) {
+    switch (type->kind) {
+        case TYPE_STRING: {
+            BCValue string = build_constant(context, type, value);
+            bc_insn_store(context->function, target, bc_insn_load(context->function, string));
+            break;
+        }
+        case TYPE_ARRAY: {
+            BCType element_type = build_convert_type(context, type->array_base);
+            BCValue length = bc_insn_get_field(context->function, target, bc_type_u32, 0);
+            bc_insn_store(context->function, length, bc_value_make_consti(context->bc, bc_type_u32, type->array_size));
+
+            BCValue data = bc_insn_get_field(context->function, target, element_type, 1);
+            for (u32 i = 0; i < type->array_size; i++) {
+                BCValue index = bc_value_make_consti(context->bc, bc_type_u64, i);
+                BCValue element = bc_insn_get_index(context->function, data, element_type, index);
+                build_store_constant(context, element, type->array_base, value.array.data[i]);
+            }
+            break;
+        }
+        case TYPE_AGGREGATE: {
+            for (u32 i = 0; i < vector_length(type->fields); i++) {
+                BCType field_type = build_convert_type(context, type->fields[i].type);
+                BCValue field = bc_insn_get_field(context->function, target, field_type, i);
+                build_store_constant(context, field, type->fields[i].type, value.array.data[i]);
+            }
+            break;
+        }
+        default: bc_insn_store(context->function, target, build_constant(context, type, value)); break;
+    }
+}
+
 static void build_variable(BuildContext *context, ASTNode *variable) {
-    BCValue global = string_table_get(&context->globals, variable->variable_name);
+    BCValue global = symbol_table_get(&context->globals, variable->variable_name);
+    Type *type = node_type(variable);
 
-    if (variable->variable_is_const)
+    if (variable->variable_is_const && build_is_immediate(type))
         return;
 
     if (variable->variable_initializer) {
         context->function = context->initializer;
 
-        BCValue initializer = build_expression(context, variable->variable_initializer);
-        bc_insn_store(context->function, global, initializer);
+        // Initializers that only compute values are run by the compiler, which leaves
+        // the program with the stores of their result.
+        Variant value = variable->variable_is_const ? ast_constant(variable) : eval_expression(variable->variable_initializer, null);
+        if (value.kind != VARIANT_NONE && build_can_store_constant(type)) {
+            build_store_constant(context, global, type, value);
+        } else {
+            BCValue initializer = build_expression(context, variable->variable_initializer);
+            bc_insn_store(context->function, global, initializer);
+        }
 
         context->function = null;
     }
@@ -972,14 +1049,9 @@ static void build_declaration(BuildContext *context, ASTNode *declaration) {
 }
 
 static void build_preload_function(BuildContext *context, ASTNode *function) {
-    if (string_match(function->function_name, str("__atcc_init_globals"))) {
-        BCValue bc_function_value = null;
-        bc_function_value = make(struct SBCValue);
-        bc_function_value->kind = BC_VALUE_FUNCTION;
-        bc_function_value->type = context->initializer->signature;
-        bc_function_value->storage = (u64) context->initializer;
-
-        string_table_set(&context->functions, function->function_name, bc_function_value);
+    if (intern_match(function->function_name, symbols.init_globals)) {
+        BCValue bc_function_value = bc_value_make_function(context->bc, context->initializer);
+        symbol_table_set(&context->functions, function->function_name, bc_function_value);
 
         return;
     }
@@ -991,26 +1063,23 @@ static void build_preload_function(BuildContext *context, ASTNode *function) {
     for (u32 i = 0; i < num_params; i++)
         params[i] = build_convert_type(context, type->function_parameters[i]);
 
-    BCType function_type = bc_type_function(build_convert_type(context, type->function_return_type), params, num_params);
-    function_type->is_variadic = function->function_is_variadic;
+    BCType result = build_convert_type(context, type->function_return_type);
+    BCType function_type = bc_type_function(context->bc, result, params, num_params, function->function_is_variadic);
+    free(params);
 
     BCFunction bc_function = bc_function_create(context->bc, function_type, function->function_name);
-    BCValue bc_function_value = null;
-    bc_function_value = make(struct SBCValue);
-    bc_function_value->kind = BC_VALUE_FUNCTION;
-    bc_function_value->type = function_type;
-    bc_function_value->storage = (u64) bc_function;
+    BCValue bc_function_value = bc_value_make_function(context->bc, bc_function);
     bc_function->is_variadic = function->function_is_variadic;
 
-    string_table_set(&context->functions, function->function_name, bc_function_value);
+    symbol_table_set(&context->functions, function->function_name, bc_function_value);
 }
 
 static void build_preload_variable(BuildContext *context, ASTNode *variable) {
     Type *type = node_type(variable);
     BCType variable_type = build_convert_type(context, type);
 
-    if (variable->variable_is_const) {
-        Variant value = eval_expression(variable->variable_initializer);
+    if (variable->variable_is_const && build_is_immediate(type)) {
+        Variant value = ast_constant(variable);
 
         if (verbose & VERBOSE_BYTECODE) {
             printf("const %.*s = ", strp(variable->variable_name));
@@ -1018,41 +1087,10 @@ static void build_preload_variable(BuildContext *context, ASTNode *variable) {
             printf("\n");
         }
 
-        if (type->kind == TYPE_STRING) {
-            BCValue constant_value = bc_value_make_string(context->bc, variable_type, rawstr(value.string.data, value.string.length));
-            string_table_set(&context->globals, variable->variable_name, constant_value);
-            return;
-        }
-
-        BCValue constant_value = make(struct SBCValue);
-        constant_value->kind = BC_VALUE_CONSTANT;
-        constant_value->type = variable_type;
-
-        switch (type->kind) {
-            case TYPE_I8: constant_value->istorage = value.i8; break;
-            case TYPE_U8: constant_value->storage = value.u8; break;
-            case TYPE_I16: constant_value->istorage = value.i16; break;
-            case TYPE_U16: constant_value->storage = value.u16; break;
-            case TYPE_I32: constant_value->istorage = value.i32; break;
-            case TYPE_U32: constant_value->storage = value.u32; break;
-            case TYPE_I64: constant_value->istorage = value.i64; break;
-            case TYPE_U64: constant_value->storage = value.u64; break;
-            case TYPE_F32: constant_value->floating = value.f32; break;
-            case TYPE_F64: constant_value->floating = value.f64; break;
-            default: assert(!"unimplemented");
-        }
-
-        constant_value->storage = value.u64;// TODO: This is not correct for all types.
-
-        string_table_set(&context->globals, variable->variable_name, constant_value);
+        symbol_table_set(&context->globals, variable->variable_name, build_constant(context, type, value));
     } else {
-        BCValue global_value = make(struct SBCValue);
-        global_value->kind = BC_VALUE_GLOBAL;
-        global_value->type = bc_type_pointer(variable_type);
-        global_value->storage = context->bc->global_size;
-        context->bc->global_size += variable_type->size;
-
-        string_table_set(&context->globals, variable->variable_name, global_value);
+        BCValue global_value = bc_context_define(context->bc, variable_type);
+        symbol_table_set(&context->globals, variable->variable_name, global_value);
     }
 }
 
@@ -1068,30 +1106,42 @@ BuildContext *build_initialize(SemanticContext *sema) {
     BuildContext *context = make(BuildContext);
     context->sema = sema;
     context->bc = bc_context_initialize();
-    string_table_create(&context->aggregates);
-    string_table_create(&context->functions);
-    string_table_create(&context->globals);
-    string_table_create(&context->locals);
+    symbol_table_create(&context->aggregates);
+    symbol_table_create(&context->functions);
+    symbol_table_create(&context->globals);
+    symbol_table_create(&context->locals);
     pointer_table_create(&context->types);
 
-    BCType initializer_type = bc_type_function(bc_type_void, null, 0);
+    BCType initializer_type = bc_type_function(context->bc, bc_type_void, null, 0, false);
     context->initializer = bc_function_create(context->bc, initializer_type, str("__atcc_init_globals"));
 
     return context;
 }
 
+// Declarations sema did not reach are left out of the output, see SemanticContext.reachable_only.
+static bool build_is_reachable(BuildContext *context, ASTNode *declaration) {
+    return !context->sema->reachable_only || (declaration->flags & AST_FLAG_REACHABLE);
+}
+
 bool build_bytecode(BuildContext *context) {
     // Register globals/functions, so we can refer to them e.g in a call instruction.
     vector_foreach_ptr(ASTNode, program, context->sema->programs) {
         vector_foreach_ptr(ASTNode, declaration, (*program)->declarations) {
-            build_preload_declaration(context, *declaration);
+            if (build_is_reachable(context, *declaration))
+                build_preload_declaration(context, *declaration);
         }
     }
 
     vector_foreach_ptr(ASTNode, program, context->sema->programs) {
         vector_foreach_ptr(ASTNode, declaration, (*program)->declarations) {
-            build_declaration(context, *declaration);
+            if (build_is_reachable(context, *declaration))
+                build_declaration(context, *declaration);
         }
     }
+
+    // Lowering jumps between blocks while it emits, lay each function out in block order for the backends.
+    vector_foreach(BCFunction, function, context->bc->functions)
+        bc_function_compact(*function);
+
     return true;
 }
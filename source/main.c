@@ -1,15 +1,19 @@
 #include "atcc.h"
 #include "ati/config.h"
 #include "ati/table.h"
+#include "ati/thread.h"
 #include "ati/utest.h"
 #include "ati/utils.h"
 #include "emit/bytecode.h"
 #include <assert.h>
+#include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define PRELOAD_INCLUDED
 
 #include "preload.c"
+#include "preload-snapshot.c"
 
 #undef PRELOAD_INCLUDED
 
@@ -19,6 +23,21 @@ struct {
     string backend;
 
     bool write_dot;
+    bool batch_lexer;
+    bool lazy_bodies;
+    bool reachable_only;
+    bool stats;
+
+    BCPassOptions passes;
+
+    // Parse the preload and write its snapshot here instead of compiling.
+    string preload_snapshot_output;
+
+    // Threads used for parsing, 0 uses every processor.
+    u32 jobs;
+
+    // Directory of the parse cache, none if null.
+    string cache_directory;
 } settings;
 
 VerboseFlags verbose = 0;
@@ -28,27 +47,100 @@ bool parse_options(i32 argc, cstring argv[]) {
 
     for (i32 i = 1; i < argc; i++) {
         if (argv[i][0] == '-') {
-            if (argv[i][1] == 'o') {
+            if (argv[i][1] == 'o' && argv[i][2] == 0) {
                 if (i + 1 >= argc)
                     return false;
                 settings.output = string_from_cstring(argv[++i]);
                 continue;
             }
 
-            if (argv[i][1] == 'b') {
+            if (argv[i][1] == 'b' && argv[i][2] == 0) {
                 if (i + 1 >= argc)
                     return false;
                 settings.backend = string_from_cstring(argv[++i]);
                 continue;
             }
 
-            if (argv[i][1] == 'd') {
+            if (argv[i][1] == 'j' && argv[i][2] == 0) {
+                if (i + 1 >= argc)
+                    return false;
+                settings.jobs = (u32) atoi(argv[++i]);
+                continue;
+            }
+
+            if (argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '2' && argv[i][3] == 0) {
+                settings.passes.level = (u32) (argv[i][2] - '0');
+                continue;
+            }
+
+            if (argv[i][1] == 'd' && argv[i][2] == 0) {
                 if (i + 1 >= argc)
                     return false;
                 settings.write_dot = true;
                 continue;
             }
 
+            if (string_match_cstring(str("cache-dir"), argv[i] + 1)) {
+                if (i + 1 >= argc)
+                    return false;
+                settings.cache_directory = string_from_cstring(argv[++i]);
+                continue;
+            }
+
+            if (string_match_cstring(str("write-preload-snapshot"), argv[i] + 1)) {
+                if (i + 1 >= argc)
+                    return false;
+                settings.preload_snapshot_output = string_from_cstring(argv[++i]);
+                continue;
+            }
+
+            if (string_match_cstring(str("enable-pass"), argv[i] + 1) ||
+                string_match_cstring(str("disable-pass"), argv[i] + 1)) {
+                if (i + 1 >= argc)
+                    return false;
+
+                bool enable = argv[i][1] == 'e';
+                BCPassKind kind;
+                if (!bc_pass_find(string_from_cstring(argv[++i]), &kind)) {
+                    fprintf(stderr, "Unknown pass: '%s'\n", argv[i]);
+                    return false;
+                }
+
+                settings.passes.enabled[kind] = enable;
+                settings.passes.disabled[kind] = !enable;
+                continue;
+            }
+
+            if (string_match_cstring(str("time-passes"), argv[i] + 1)) {
+                settings.passes.timing = true;
+                continue;
+            }
+
+            if (string_match_cstring(str("verify-passes"), argv[i] + 1)) {
+                settings.passes.verify = true;
+                continue;
+            }
+
+            if (string_match_cstring(str("batch-lexer"), argv[i] + 1)) {
+                settings.batch_lexer = true;
+                continue;
+            }
+
+            if (string_match_cstring(str("lazy-bodies"), argv[i] + 1)) {
+                settings.lazy_bodies = true;
+                continue;
+            }
+
+            if (string_match_cstring(str("reachable-only"), argv[i] + 1)) {
+                settings.reachable_only = true;
+                continue;
+            }
+
+            if (string_match_cstring(str("stats"), argv[i] + 1)) {
+                settings.stats = true;
+                continue;
+            }
+
             if (string_match_cstring(str("verbose-lexer"), argv[i] + 1)) {
                 verbose |= VERBOSE_LEXER;
                 continue;
@@ -91,8 +183,9 @@ bool parse_options(i32 argc, cstring argv[]) {
 
 static void print_semantic_errors(SemanticError *errors) {
     vector_foreach(SemanticError, error, errors) {
+        SourcePosition position = location_resolve(error->location);
         fprintf(stderr, ANSI_FILE_PATH "%.*s(%d):" ANSI_RESET " ",
-                strp(error->location.file), error->location.line);
+                strp(position.file), position.line);
         fprintf(stderr, ANSI_MESSAGE "error: " ANSI_RESET "%.*s\n", strp(error->description));
     }
 }
@@ -104,6 +197,18 @@ static void print_help() {
     fprintf(stderr, "  -o <file> Set output file\n");
     fprintf(stderr, "  -b <b>    Set backend\n");
     fprintf(stderr, "  -d        Write dot files\n");
+    fprintf(stderr, "  -j <n>    Parse and analyze on n threads\n");
+    fprintf(stderr, "  -O<n>     Optimize the bytecode at level 0, 1 (default) or 2\n");
+    fprintf(stderr, "  -enable-pass <name>  Run a bytecode pass whatever the level is\n");
+    fprintf(stderr, "  -disable-pass <name> Skip a bytecode pass\n");
+    fprintf(stderr, "  -time-passes  Print the time and changes of every bytecode pass\n");
+    fprintf(stderr, "  -verify-passes  Verify the bytecode after every pass, always on in debug builds\n");
+    fprintf(stderr, "  -cache-dir <dir>  Reuse parse results of unchanged files\n");
+    fprintf(stderr, "  -batch-lexer  Tokenize whole files before parsing\n");
+    fprintf(stderr, "  -lazy-bodies  Parse function bodies when they are first needed\n");
+    fprintf(stderr, "  -reachable-only  Only analyze and build what Main can reach\n");
+    fprintf(stderr, "  -stats        Print AST memory statistics\n");
+    fprintf(stderr, "  -write-preload-snapshot <file>\n");
     fprintf(stderr, "  -verbose-lexer\n");
     fprintf(stderr, "  -verbose-parser\n");
     fprintf(stderr, "  -verbose-sema\n");
@@ -112,9 +217,45 @@ static void print_help() {
     fprintf(stderr, "  -verbose-all\n");
 }
 
-static i32 compiler_load_preload(SemanticContext *sema_context) {
-    Token *tokens = lexer_tokenize(str("preload.aa"), (Buffer){(i8 *) preload_source, preload_source_len});
-    ASTNode *program = parse_program(tokens);
+static void print_ast_statistics(u64 ast_bytes) {
+    u64 lines = source_line_count();
+    if (lines == 0)
+        lines = 1;
+
+    u64 fixed_bytes = ast_statistics.nodes * sizeof(ASTNode);
+    u64 list_bytes = ast_bytes - ast_statistics.node_bytes;
+
+    fprintf(stderr, "AST statistics:\n");
+    fprintf(stderr, "  source lines:     %llu\n", (unsigned long long) lines);
+    fprintf(stderr, "  nodes:            %llu (%.1f per line)\n",
+            (unsigned long long) ast_statistics.nodes, (f64) ast_statistics.nodes / lines);
+    fprintf(stderr, "  node bytes:       %llu (%.1f per line, %.1f per node)\n",
+            (unsigned long long) ast_statistics.node_bytes, (f64) ast_statistics.node_bytes / lines,
+            ast_statistics.nodes ? (f64) ast_statistics.node_bytes / ast_statistics.nodes : 0.0);
+    fprintf(stderr, "  list bytes:       %llu (%.1f per line)\n",
+            (unsigned long long) list_bytes, (f64) list_bytes / lines);
+    fprintf(stderr, "  AST bytes:        %llu (%.1f per line)\n",
+            (unsigned long long) ast_bytes, (f64) ast_bytes / lines);
+    fprintf(stderr, "  uniform nodes:    %llu (%.1f per line, %llu bytes each)\n",
+            (unsigned long long) fixed_bytes, (f64) fixed_bytes / lines, (unsigned long long) sizeof(ASTNode));
+}
+
+static u32 compiler_register_preload(void) {
+    return source_register(str("preload.aa"), (Buffer){.data = (i8 *) preload_source, .length = preload_source_len});
+}
+
+static ASTNode *compiler_parse_preload(u32 file, Arena *ast_arena) {
+    Lexer lexer;
+    lexer_initialize(&lexer, file, settings.batch_lexer);
+    return parse_program(&lexer, ast_arena, false, stderr);
+}
+
+static i32 compiler_load_preload(SemanticContext *sema_context, Arena *ast_arena) {
+    // The snapshot is skipped when it is stale, e.g. after preload.aa changed.
+    u32 file = compiler_register_preload();
+    ASTNode *program = snapshot_load(preload_snapshot, preload_snapshot_len, file, ast_arena);
+    if (!program)
+        program = compiler_parse_preload(file, ast_arena);
 
     if (!sema_register_program(sema_context, program)) {
         fprintf(stderr, "Registering declarations for preload failed: \n");
@@ -125,26 +266,89 @@ static i32 compiler_load_preload(SemanticContext *sema_context) {
     return 1;
 }
 
+typedef struct {
+    u32 file;
+    Arena arena;
+    ASTNode *program;
+
+    // Syntax errors of the file, printed once every file has been parsed.
+    char *diagnostics;
+    size_t diagnostics_length;
+} CompilerInput;
+
+static void compiler_parse_input(void *context, u32 index) {
+    CompilerInput *input = &((CompilerInput *) context)[index];
+    bool cached = settings.cache_directory.data != null;
+
+    if (cached) {
+        input->program = snapshot_cache_load(settings.cache_directory, input->file, &input->arena);
+        if (input->program)
+            return;
+    }
+
+    FILE *diagnostics = open_memstream(&input->diagnostics, &input->diagnostics_length);
+
+    // Cached programs are complete, so deferring bodies would only postpone the work.
+    Lexer lexer;
+    lexer_initialize(&lexer, input->file, settings.batch_lexer);
+    input->program = parse_program(&lexer, &input->arena, settings.lazy_bodies && !cached, diagnostics);
+
+    fclose(diagnostics);
+
+    // Files with syntax errors are not cached, so that their errors are reported again.
+    if (cached && input->diagnostics_length == 0)
+        snapshot_cache_store(settings.cache_directory, input->file, input->program);
+}
+
 static i32 compiler_main(string *inputs, string output, string backend, bool write_dot) {
     SemanticContext *sema_context = sema_initialize();
 
-    if (!compiler_load_preload(sema_context)) {
+    // The preload's AST lives in this arena, every input file gets its own.
+    Arena ast_arena;
+    arena_initialize(&ast_arena);
+
+    if (!compiler_load_preload(sema_context, &ast_arena)) {
         fprintf(stderr, "Failed to load preload\n");
         fflush(stderr);
         return 1;
     }
 
-    vector_foreach(string, filename, inputs) {
-        Buffer buffer = read_file(*filename);
+    // Files are registered before any parser starts, the parsers only read the file table.
+    u32 input_count = vector_length(inputs);
+    CompilerInput *compiler_inputs = make_n(CompilerInput, input_count);
+    for (u32 i = 0; i < input_count; i++) {
+        Buffer buffer = read_file(inputs[i]);
         if (!buffer.data) {
-            fprintf(stderr, "Failed to read file: %.*s\n", strp(*filename));
+            fprintf(stderr, "Failed to read file: %.*s\n", strp(inputs[i]));
             fflush(stderr);
             return 1;
         }
 
-        Token *tokens = lexer_tokenize(*filename, buffer);
-        ASTNode *program = parse_program(tokens);
+        compiler_inputs[i].file = source_register(inputs[i], buffer);
+        arena_initialize(&compiler_inputs[i].arena);
+    }
+
+    if (settings.cache_directory.data) {
+        cstring directory = string_to_cstring(settings.cache_directory);
+        if (mkdir(directory, 0777) != 0 && errno != EEXIST)
+            fprintf(stderr, "Failed to create cache directory: %s\n", directory);
+        free(directory);
+    }
+
+    // Parsing and the analysis of function bodies share the pool.
+    ThreadPool *pool = pool_create(settings.jobs ? settings.jobs : thread_count_available());
+    pool_run(pool, input_count, compiler_parse_input, compiler_inputs);
+
+    // Registration follows the command line, so neither symbols nor diagnostics depend on scheduling.
+    u64 ast_bytes = ast_arena.allocated;
+    for (u32 i = 0; i < input_count; i++) {
+        CompilerInput *input = &compiler_inputs[i];
+        fwrite(input->diagnostics, 1, input->diagnostics_length, stderr);
+        free(input->diagnostics);
+
+        ASTNode *program = input->program;
         assert(program->kind == AST_PROGRAM);
+        ast_bytes += input->arena.allocated;
 
         if (write_dot)
             write_program_dot(program, "hello.dot");
@@ -156,7 +360,14 @@ static i32 compiler_main(string *inputs, string output, string backend, bool wri
         }
     }
 
-    if (!sema_analyze(sema_context)) {
+    if (settings.stats)
+        print_ast_statistics(ast_bytes);
+
+    sema_context->reachable_only = settings.reachable_only;
+    bool analyzed = sema_analyze(sema_context, pool);
+    pool_destroy(pool);
+
+    if (!analyzed) {
         fprintf(stderr, "Semantic analysis failed: \n");
         print_semantic_errors(sema_context->errors);
         return 1;
@@ -170,7 +381,7 @@ static i32 compiler_main(string *inputs, string output, string backend, bool wri
         return 1;
     }
 
-    if (!string_table_get(&sema_context->global->entries, str("Main"))) {
+    if (!sema_get(sema_context, symbols.main)) {
         fprintf(stderr, "error: Main function not found.\n");
         return 1;
     }
@@ -181,6 +392,8 @@ static i32 compiler_main(string *inputs, string output, string backend, bool wri
         return 1;
     }
 
+    bc_optimize(build_context->bc, &settings.passes);
+
     if (string_match(backend, str("c"))) {
         string outpath = string_format(str("%.*s.c"), strp(output));
 
@@ -211,6 +424,43 @@ static i32 compiler_main(string *inputs, string output, string backend, bool wri
         return 1;
     }
 
+    bc_context_destroy(build_context->bc);
+    for (u32 i = 0; i < input_count; i++)
+        arena_free(&compiler_inputs[i].arena);
+    free(compiler_inputs);
+    arena_free(&ast_arena);
+    return 0;
+}
+
+static i32 write_preload_snapshot(string path) {
+    Arena ast_arena;
+    arena_initialize(&ast_arena);
+
+    u32 file = compiler_register_preload();
+    u8 *snapshot = snapshot_create(compiler_parse_preload(file, &ast_arena), file);
+
+    cstring output_path = string_to_cstring(path);
+    FILE *output = fopen(output_path, "wb");
+    free(output_path);
+    if (!output) {
+        fprintf(stderr, "Failed to open file: %.*s\n", strp(path));
+        return 1;
+    }
+
+    fprintf(output, "#include <stddef.h>\n\n");
+    fprintf(output, "#ifdef PRELOAD_INCLUDED\n");
+    fprintf(output, "extern const unsigned char preload_snapshot[];\n");
+    fprintf(output, "extern const size_t preload_snapshot_len;\n\n");
+    fprintf(output, "const unsigned char preload_snapshot[] = {");
+    for (u64 i = 0; i < vector_length(snapshot); i++)
+        fprintf(output, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", snapshot[i]);
+    fprintf(output, "\n};\n\n");
+    fprintf(output, "const size_t preload_snapshot_len = sizeof(preload_snapshot);\n");
+    fprintf(output, "#endif\n");
+    fclose(output);
+
+    vector_free(snapshot);
+    arena_free(&ast_arena);
     return 0;
 }
 
@@ -234,6 +484,7 @@ static i32 config_main(cstring config) {
     string backend;
 
     string write_dot_string;
+    string optimize_string;
     entry *verbose_entries;
 
     bool write_dot = false;
@@ -247,6 +498,14 @@ static i32 config_main(cstring config) {
     options_get_default(options, str("dot"), &write_dot_string, str("false"));
 
     write_dot = string_match(write_dot_string, str("true"));
+
+    options_get_default(options, str("optimize"), &optimize_string, str("1"));
+    if (optimize_string.length != 1 || optimize_string.data[0] < '0' || optimize_string.data[0] > '2') {
+        fprintf(stderr, "Unknown optimization level: %.*s\n", strp(optimize_string));
+        return 1;
+    }
+    settings.passes.level = (u32) (optimize_string.data[0] - '0');
+
     if (options_get_list(options, str("verbose"), &verbose_entries)) {
         vector_foreach(entry, entry, verbose_entries) {
             if (string_match(entry->value, str("lexer")))
@@ -277,6 +536,7 @@ static i32 config_main(cstring config) {
 static i32 standalone_main(i32 argc, cstring argv[]) {
     settings.output = str("generated");
     settings.backend = str("c");
+    settings.passes.level = 1;
 
     if (!parse_options(argc, argv)) {
         print_help();
@@ -288,6 +548,9 @@ static i32 standalone_main(i32 argc, cstring argv[]) {
         return 1;
     }
 
+    if (settings.preload_snapshot_output.data)
+        return write_preload_snapshot(settings.preload_snapshot_output);
+
     return compiler_main(settings.inputs, settings.output, settings.backend, settings.write_dot);
 }
 
@@ -295,6 +558,10 @@ i32 main(i32 argc, cstring argv[]) {
 #ifdef WITH_UTESTS
     if (argc > 1 && strcmp(argv[1], "--utest") == 0) {
         ati_register_utest();
+        lexer_register_utest();
+        parser_register_utest();
+        type_register_utest();
+        sema_register_utest();
         bc_register_utest();
 
         return utest_run();
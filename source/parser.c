@@ -1,32 +1,59 @@
 #include "atcc.h"
+#include "ati/thread.h"
 #include "ati/utils.h"
 #include <string.h>
 
+typedef struct {
+    Lexer *lexer;
+    Token current;
+    Token previous;
+
+    // Nodes and child lists are allocated from the arena. Lists are collected
+    // on the scratch stacks first and copied out once their length is known.
+    Arena *arena;
+    ASTNode **scratch;
+    string *scratch_names;
+    ASTStatistics statistics;
+
+    // Errors are written here, so parsers running in parallel can keep theirs apart.
+    FILE *diagnostics;
+    u32 errors;
+
+    // Skip function bodies and leave them to parse_function_body.
+    bool defer_bodies;
+} Parser;
 
-#define make_ast(kind) make_ast_at(parser->current->location, kind)
-static ASTNode *make_ast_at(Location location, ASTKind kind) {
-    ASTNode *node = make(ASTNode);
-    node->location = location;
-    node->kind = kind;
-    return node;
+#define make_ast(kind) make_ast_at(parser, parser->current.location, kind)
+static ASTNode *make_ast_at(Parser *parser, Location location, ASTKind kind) {
+    return ast_create(parser->arena, &parser->statistics, kind, location);
 }
 
-typedef struct {
-    Token *tokens;
-    Token *current;
-    Token *previous;
-} Parser;
+static u32 parser_list_begin(Parser *parser) {
+    return vector_length(parser->scratch);
+}
+
+static void parser_list_push(Parser *parser, ASTNode *node) {
+    vector_push(parser->scratch, node);
+}
+
+static ASTNode **parser_list_end(Parser *parser, u32 list) {
+    u32 length = vector_length(parser->scratch) - list;
+    ASTNode **nodes = arena_vector(parser->arena, parser->scratch + list, sizeof(ASTNode *), length);
+    vector_length(parser->scratch) = list;
+    return nodes;
+}
 
+// The returned token is only valid until the parser advances again.
 static Token *parser_advance(Parser *parser) {
     parser->previous = parser->current;
-    parser->current++;
-    return parser->previous;
+    parser->current = lexer_next(parser->lexer);
+    return &parser->previous;
 }
 
 static Token *parser_check(Parser *parser, TokenKind kind) {
-    if (parser->current->kind != kind)
+    if (parser->current.kind != kind)
         return null;
-    return parser->current;
+    return &parser->current;
 }
 
 static Token *parser_consume(Parser *parser, TokenKind kind) {
@@ -38,16 +65,24 @@ static Token *parser_consume(Parser *parser, TokenKind kind) {
 static ASTNode *make_error(Parser *parser, string message) {
     ASTNode *node = make_ast(AST_ERROR);
     node->value = message;
+    parser->errors++;
 
-    fprintf(stderr, "\x1b[94m%.*s:%d:%d:\x1b[0m ",
-            strp(node->location.file), node->location.line, node->location.column);
-    fprintf(stderr, "\033[31merror: \033[0m");
-    fprintf(stderr, "%.*s", strp(message));
-    fprintf(stderr, "\n");
+    SourcePosition position = location_resolve(node->location);
+    fprintf(parser->diagnostics, "\x1b[94m%.*s:%d:%d:\x1b[0m ",
+            strp(position.file), position.line, position.column);
+    fprintf(parser->diagnostics, "\033[31merror: \033[0m");
+    fprintf(parser->diagnostics, "%.*s", strp(message));
+    fprintf(parser->diagnostics, "\n");
 
     return node;
 }
 
+// Drops the children of a list that is abandoned because of an error.
+static ASTNode *make_list_error(Parser *parser, u32 list, string message) {
+    vector_length(parser->scratch) = list;
+    return make_error(parser, message);
+}
+
 static ASTNode *parse_typedecl(Parser *parser);
 static ASTNode *parse_expression(Parser *parser);
 static ASTNode *parse_statement_simple(Parser *parser);
@@ -56,54 +91,61 @@ static ASTNode *parse_statement_block(Parser *parser);
 static ASTNode *parse_declaration(Parser *parser);
 
 static bool parser_is_unary(Parser *parser) {
-    return parser->current->kind == TOKEN_PLUS ||
-           parser->current->kind == TOKEN_MINUS ||
-           parser->current->kind == TOKEN_STAR ||
-           parser->current->kind == TOKEN_AMPERSAND ||
-           parser->current->kind == TOKEN_EXCLAMATION ||
-           parser->current->kind == TOKEN_TILDE;
-}
-
-static bool parser_is_mul(Parser *parser) {
-    return parser->current->kind == TOKEN_STAR ||
-           parser->current->kind == TOKEN_SLASH ||
-           parser->current->kind == TOKEN_PERCENT ||
-           parser->current->kind == TOKEN_AMPERSAND ||
-           parser->current->kind == TOKEN_LEFT_SHIFT ||
-           parser->current->kind == TOKEN_RIGHT_SHIFT;
-}
-
-static bool parser_is_add(Parser *parser) {
-    return parser->current->kind == TOKEN_PLUS ||
-           parser->current->kind == TOKEN_MINUS ||
-           parser->current->kind == TOKEN_CARET ||
-           parser->current->kind == TOKEN_PIPE;
+    return parser->current.kind == TOKEN_PLUS ||
+           parser->current.kind == TOKEN_MINUS ||
+           parser->current.kind == TOKEN_STAR ||
+           parser->current.kind == TOKEN_AMPERSAND ||
+           parser->current.kind == TOKEN_EXCLAMATION ||
+           parser->current.kind == TOKEN_TILDE;
 }
 
-static bool parser_is_cmp(Parser *parser) {
-    return parser->current->kind == TOKEN_EQUAL_EQUAL ||
-           parser->current->kind == TOKEN_EXCLAMATION_EQUAL ||
-           parser->current->kind == TOKEN_GREATER ||
-           parser->current->kind == TOKEN_GREATER_EQUAL ||
-           parser->current->kind == TOKEN_LESS ||
-           parser->current->kind == TOKEN_LESS_EQUAL;
+// Binding power of every binary operator, higher binds tighter. Tokens that
+// are not binary operators are left at zero and end the expression.
+static const u8 parser_binary_precedence[] = {
+        [TOKEN_PIPE_PIPE] = 1,
+
+        [TOKEN_AMPERSAND_AMPERSAND] = 2,
+
+        [TOKEN_EQUAL_EQUAL] = 3,
+        [TOKEN_EXCLAMATION_EQUAL] = 3,
+        [TOKEN_GREATER] = 3,
+        [TOKEN_GREATER_EQUAL] = 3,
+        [TOKEN_LESS] = 3,
+        [TOKEN_LESS_EQUAL] = 3,
+
+        [TOKEN_PLUS] = 4,
+        [TOKEN_MINUS] = 4,
+        [TOKEN_CARET] = 4,
+        [TOKEN_PIPE] = 4,
+
+        [TOKEN_STAR] = 5,
+        [TOKEN_SLASH] = 5,
+        [TOKEN_PERCENT] = 5,
+        [TOKEN_AMPERSAND] = 5,
+        [TOKEN_LEFT_SHIFT] = 5,
+        [TOKEN_RIGHT_SHIFT] = 5,
+};
+
+static u8 parser_binary_precedence_of(Parser *parser) {
+    TokenKind kind = parser->current.kind;
+    return kind < array_length(parser_binary_precedence) ? parser_binary_precedence[kind] : 0;
 }
 
 static bool parser_is_assign(Parser *parser) {
-    return parser->current->kind == TOKEN_PLUS_EQUAL ||
-           parser->current->kind == TOKEN_MINUS_EQUAL ||
-           parser->current->kind == TOKEN_STAR_EQUAL ||
-           parser->current->kind == TOKEN_SLASH_EQUAL ||
-           parser->current->kind == TOKEN_PERCENT_EQUAL ||
-           parser->current->kind == TOKEN_AMPERSAND_EQUAL ||
-           parser->current->kind == TOKEN_PIPE_EQUAL ||
-           parser->current->kind == TOKEN_CARET_EQUAL ||
-           parser->current->kind == TOKEN_TILDE_EQUAL ||
-           parser->current->kind == TOKEN_AMPERSAND_AMPERSAND_EQUAL ||
-           parser->current->kind == TOKEN_PIPE_PIPE_EQUAL ||
-           parser->current->kind == TOKEN_LEFT_SHIFT_EQUAL ||
-           parser->current->kind == TOKEN_RIGHT_SHIFT_EQUAL ||
-           parser->current->kind == TOKEN_EQUAL;
+    return parser->current.kind == TOKEN_PLUS_EQUAL ||
+           parser->current.kind == TOKEN_MINUS_EQUAL ||
+           parser->current.kind == TOKEN_STAR_EQUAL ||
+           parser->current.kind == TOKEN_SLASH_EQUAL ||
+           parser->current.kind == TOKEN_PERCENT_EQUAL ||
+           parser->current.kind == TOKEN_AMPERSAND_EQUAL ||
+           parser->current.kind == TOKEN_PIPE_EQUAL ||
+           parser->current.kind == TOKEN_CARET_EQUAL ||
+           parser->current.kind == TOKEN_TILDE_EQUAL ||
+           parser->current.kind == TOKEN_AMPERSAND_AMPERSAND_EQUAL ||
+           parser->current.kind == TOKEN_PIPE_PIPE_EQUAL ||
+           parser->current.kind == TOKEN_LEFT_SHIFT_EQUAL ||
+           parser->current.kind == TOKEN_RIGHT_SHIFT_EQUAL ||
+           parser->current.kind == TOKEN_EQUAL;
 }
 
 static ASTNode *parse_expression_compound_field(Parser *parser) {
@@ -137,20 +179,33 @@ static ASTNode *parse_expression_compound_field(Parser *parser) {
 static ASTNode *parse_expression_compound(Parser *parser, ASTNode *type) {
     if (!parser_consume(parser, TOKEN_OPEN_BRACE))
         return make_error(parser, str("Expected '{' in compound expression"));
-	ASTNode **fields = vector_create(ASTNode *);
+    u32 fields = parser_list_begin(parser);
     while (!parser_check(parser, TOKEN_CLOSE_BRACE)) {
-        vector_push(fields, parse_expression_compound_field(parser));
+        parser_list_push(parser, parse_expression_compound_field(parser));
         if (!parser_consume(parser, TOKEN_COMMA))
             break;
     }
     if (!parser_consume(parser, TOKEN_CLOSE_BRACE))
-        return make_error(parser, str("Expected '}' after compound expression"));
+        return make_list_error(parser, fields, str("Expected '}' after compound expression"));
     ASTNode *node = make_ast(AST_EXPRESSION_COMPOUND);
     node->compound_type = type;
-    node->compound_fields = fields;
+    node->compound_fields = parser_list_end(parser, fields);
     return node;
 }
 
+// Number literals are converted once here, straight from the source slice.
+static bool parse_number_literal(ASTNode *node) {
+    string text = node->literal_value;
+    string digits = text.length > 2 ? rawstr(text.data + 2, text.length - 2) : str("");
+
+    if (node->literal_flags & TOKEN_FLAG_HEX) return string_to_u64_radix(digits, 16, &node->literal_as_u64);
+    if (node->literal_flags & TOKEN_FLAG_OCT) return string_to_u64_radix(digits, 8, &node->literal_as_u64);
+    if (node->literal_flags & TOKEN_FLAG_BIN) return string_to_u64_radix(digits, 2, &node->literal_as_u64);
+    if (node->literal_flags & TOKEN_FLAG_FLOAT) return string_to_f64(text, &node->literal_as_f64);
+
+    return string_to_u64(text, &node->literal_as_u64);
+}
+
 static ASTNode *parse_expression_unary(Parser *parser);
 static ASTNode *parse_expression_operand(Parser *parser) {
     if (parser_check(parser, TOKEN_NUMBER) || parser_check(parser, TOKEN_STRING) || parser_check(parser, TOKEN_CHAR)) {
@@ -160,6 +215,11 @@ static ASTNode *parse_expression_operand(Parser *parser) {
         ASTNode *node = make_ast(node_kind);
         node->literal_value = token->value;
         node->literal_flags = token->flags;
+
+        if (node_kind == AST_EXPRESSION_LITERAL_NUMBER && !parse_number_literal(node))
+            return make_error(parser, str("Invalid or out of range number literal."));
+        if (node_kind == AST_EXPRESSION_LITERAL_CHAR && (token->flags & TOKEN_FLAG_INVALID))
+            return make_error(parser, str("A character literal must hold exactly one character."));
         return node;
     }
 
@@ -209,7 +269,7 @@ static ASTNode *parse_expression_operand(Parser *parser) {
             return make_error(parser, str("Expected ',' after 'offsetof' type"));
         if (!parser_consume(parser, TOKEN_IDENTIFIER))
             return make_error(parser, str("Expected identifier after 'offsetof' type"));
-        string field = parser->previous->value;
+        string field = parser->previous.value;
 
         if (!parser_consume(parser, TOKEN_CLOSE_PAREN))
             return make_error(parser, str("Expected ')' after 'offsetof'"));
@@ -259,17 +319,17 @@ static ASTNode *parse_expression_base(Parser *parser) {
     ASTNode *node = parse_expression_operand(parser);
     while (parser_check(parser, TOKEN_OPEN_PAREN) || parser_check(parser, TOKEN_OPEN_BRACKET) || parser_check(parser, TOKEN_DOT)) {
         if (parser_consume(parser, TOKEN_OPEN_PAREN)) {
-            ASTNode **arguments = vector_create(ASTNode *);
+            u32 arguments = parser_list_begin(parser);
             if (!parser_check(parser, TOKEN_CLOSE_PAREN)) {
                 do {
-                    vector_push(arguments, parse_expression(parser));
+                    parser_list_push(parser, parse_expression(parser));
                 } while (parser_consume(parser, TOKEN_COMMA));
             }
             if (!parser_consume(parser, TOKEN_CLOSE_PAREN))
-                return make_error(parser, str("Expected ')' after function call."));
+                return make_list_error(parser, arguments, str("Expected ')' after function call."));
             ASTNode *new_node = make_ast(AST_EXPRESSION_CALL);
             new_node->call_target = node;
-            new_node->call_arguments = arguments;
+            new_node->call_arguments = parser_list_end(parser, arguments);
             node = new_node;
         } else if (parser_consume(parser, TOKEN_OPEN_BRACKET)) {
             ASTNode *array_index = parse_expression(parser);
@@ -284,7 +344,7 @@ static ASTNode *parse_expression_base(Parser *parser) {
                 return make_error(parser, str("Expected identifier after '.'"));
             ASTNode *new_node = make_ast(AST_EXPRESSION_FIELD);
             new_node->field_target = node;
-            new_node->field_name = parser->previous->value;
+            new_node->field_name = parser->previous.value;
             node = new_node;
         }
     }
@@ -302,71 +362,26 @@ static ASTNode *parse_expression_unary(Parser *parser) {
     return parse_expression_base(parser);
 }
 
-static ASTNode *parse_expression_mul(Parser *parser) {
+// Precedence climbing: parses operators that bind at least as tightly as
+// `minimum`. All binary operators associate to the left.
+static ASTNode *parse_expression_binary(Parser *parser, u8 minimum) {
     ASTNode *node = parse_expression_unary(parser);
-    while (parser_is_mul(parser)) {
-        TokenKind binop = parser_advance(parser)->kind;
-        ASTNode *new_node = make_ast(AST_EXPRESSION_BINARY);
-        new_node->binary_operator = binop;
-        new_node->binary_left = node;
-        new_node->binary_right = parse_expression_unary(parser);
-        node = new_node;
-    }
-    return node;
-}
 
-static ASTNode *parse_expression_add(Parser *parser) {
-    ASTNode *node = parse_expression_mul(parser);
-    while (parser_is_add(parser)) {
+    u8 precedence;
+    while ((precedence = parser_binary_precedence_of(parser)) >= minimum) {
         TokenKind binop = parser_advance(parser)->kind;
         ASTNode *new_node = make_ast(AST_EXPRESSION_BINARY);
         new_node->binary_operator = binop;
         new_node->binary_left = node;
-        new_node->binary_right = parse_expression_mul(parser);
+        new_node->binary_right = parse_expression_binary(parser, precedence + 1);
         node = new_node;
     }
-    return node;
-}
 
-static ASTNode *parse_expression_cmp(Parser *parser) {
-    ASTNode *node = parse_expression_add(parser);
-    while (parser_is_cmp(parser)) {
-        TokenKind binop = parser_advance(parser)->kind;
-        ASTNode *new_node = make_ast(AST_EXPRESSION_BINARY);
-        new_node->binary_operator = binop;
-        new_node->binary_left = node;
-        new_node->binary_right = parse_expression_add(parser);
-        node = new_node;
-    }
-    return node;
-}
-
-static ASTNode *parse_expression_and(Parser *parser) {
-    ASTNode *node = parse_expression_cmp(parser);
-    while (parser_consume(parser, TOKEN_AMPERSAND_AMPERSAND)) {
-        ASTNode *new_node = make_ast(AST_EXPRESSION_BINARY);
-        new_node->binary_operator = TOKEN_AMPERSAND_AMPERSAND;
-        new_node->binary_left = node;
-        new_node->binary_right = parse_expression_cmp(parser);
-        node = new_node;
-    }
-    return node;
-}
-
-static ASTNode *parse_expression_or(Parser *parser) {
-    ASTNode *node = parse_expression_and(parser);
-    while (parser_consume(parser, TOKEN_PIPE_PIPE)) {
-        ASTNode *new_node = make_ast(AST_EXPRESSION_BINARY);
-        new_node->binary_operator = TOKEN_PIPE_PIPE;
-        new_node->binary_left = node;
-        new_node->binary_right = parse_expression_and(parser);
-        node = new_node;
-    }
     return node;
 }
 
 ASTNode *parse_expression(Parser *parser) {
-    ASTNode *node = parse_expression_or(parser);
+    ASTNode *node = parse_expression_binary(parser, 1);
     if (parser_consume(parser, TOKEN_QUESTION)) {
         ASTNode *ternary_true = parse_expression(parser);
         if (!parser_consume(parser, TOKEN_COLON))
@@ -492,7 +507,7 @@ static ASTNode *parse_statement_for(Parser *parser) {
 }
 
 static ASTNode *parse_statement_switch_case(Parser *parser) {
-	ASTNode **switch_patterns = vector_create(ASTNode *);
+    u32 switch_patterns = parser_list_begin(parser);
     bool is_default = false;
     while (parser_check(parser, TOKEN_KW_CASE) || parser_check(parser, TOKEN_KW_DEFAULT)) {
         if (parser_consume(parser, TOKEN_KW_CASE)) {
@@ -501,25 +516,27 @@ static ASTNode *parse_statement_switch_case(Parser *parser) {
                 pattern->switch_pattern_start = parse_expression(parser);
                 if (parser_consume(parser, TOKEN_DOT_DOT))
                     pattern->switch_pattern_end = parse_expression(parser);
-                vector_push(switch_patterns, pattern);
+                parser_list_push(parser, pattern);
             } while (parser_consume(parser, TOKEN_COMMA));
         } else {
             parser_consume(parser, TOKEN_KW_DEFAULT);
-            if (is_default) return make_error(parser, str("Multiple default clauses."));
+            if (is_default) return make_list_error(parser, switch_patterns, str("Multiple default clauses."));
             is_default = true;
         }
 
         if (!parser_consume(parser, TOKEN_COLON))
-            return make_error(parser, str("Expected ':' after switch value(s)."));
+            return make_list_error(parser, switch_patterns, str("Expected ':' after switch value(s)."));
     }
 
     ASTNode *node = make_ast(AST_STATEMENT_SWITCH_CASE);
-    node->switch_case_patterns = switch_patterns;
+    node->switch_case_patterns = parser_list_end(parser, switch_patterns);
     node->switch_case_body = make_ast(AST_STATEMENT_BLOCK);
-	node->switch_case_body->statements = vector_create(ASTNode *);
     node->switch_case_is_default = is_default;
+
+    u32 statements = parser_list_begin(parser);
     while (!parser_check(parser, TOKEN_EOF) && !parser_check(parser, TOKEN_CLOSE_BRACE) && !parser_check(parser, TOKEN_KW_CASE) && !parser_check(parser, TOKEN_KW_DEFAULT))
-        vector_push(node->switch_case_body->statements, parse_statement(parser));
+        parser_list_push(parser, parse_statement(parser));
+    node->switch_case_body->statements = parser_list_end(parser, statements);
     return node;
 }
 
@@ -528,16 +545,16 @@ static ASTNode *parse_statement_switch(Parser *parser) {
     if (!parser_consume(parser, TOKEN_OPEN_BRACE))
         return make_error(parser, str("Expected '{' after 'switch'"));
 
-	ASTNode **switch_cases = vector_create(ASTNode *);
+    u32 switch_cases = parser_list_begin(parser);
     while (!parser_check(parser, TOKEN_CLOSE_BRACE) && !parser_check(parser, TOKEN_EOF))
-        vector_push(switch_cases, parse_statement_switch_case(parser));
+        parser_list_push(parser, parse_statement_switch_case(parser));
 
     if (!parser_consume(parser, TOKEN_CLOSE_BRACE))
-        return make_error(parser, str("Expected '}' after block"));
+        return make_list_error(parser, switch_cases, str("Expected '}' after block"));
 
     ASTNode *node = make_ast(AST_STATEMENT_SWITCH);
     node->switch_expression = expression;
-    node->switch_cases = switch_cases;
+    node->switch_cases = parser_list_end(parser, switch_cases);
 
     return node;
 }
@@ -609,11 +626,12 @@ static ASTNode *parse_statement(Parser *parser) {
 static ASTNode *parse_statement_block(Parser *parser) {
     if (parser_consume(parser, TOKEN_OPEN_BRACE)) {
         ASTNode *node = make_ast(AST_STATEMENT_BLOCK);
-        node->statements = vector_create(ASTNode *);
+        u32 statements = parser_list_begin(parser);
         while (!parser_check(parser, TOKEN_CLOSE_BRACE) && !parser_check(parser, TOKEN_EOF))
-            vector_push(node->statements, parse_statement(parser));
+            parser_list_push(parser, parse_statement(parser));
         if (!parser_consume(parser, TOKEN_CLOSE_BRACE))
-            return make_error(parser, str("Expected '}' after block"));
+            return make_list_error(parser, statements, str("Expected '}' after block"));
+        node->statements = parser_list_end(parser, statements);
         return node;
     }
     return parse_statement(parser);
@@ -637,31 +655,32 @@ static ASTNode *parse_typedecl_function(Parser *parser) {
     if (!parser_consume(parser, TOKEN_OPEN_PAREN))
         return make_error(parser, str("Expected '(' after 'fun'."));
 
-    ASTNode **parameters = null;
+    u32 parameters = parser_list_begin(parser);
     bool is_variadic = false;
     if (!parser_check(parser, TOKEN_CLOSE_PAREN)) {
         do {
             if (parser_check(parser, TOKEN_DOT_DOT)) {
                 if (is_variadic)
-                    return make_error(parser, str("Variadic arguments must be the last argument in the list."));
+                    return make_list_error(parser, parameters, str("Variadic arguments must be the last argument in the list."));
 
                 if (!is_variadic)
                     is_variadic = true;
             }
 
-            vector_push(parameters, parse_typedecl_argument(parser));
+            parser_list_push(parser, parse_typedecl_argument(parser));
         } while (parser_consume(parser, TOKEN_COMMA));
     }
 
     if (!parser_consume(parser, TOKEN_CLOSE_PAREN))
-        return make_error(parser, str("Expected ')' after function parameters."));
+        return make_list_error(parser, parameters, str("Expected ')' after function parameters."));
+    ASTNode **parameter_types = parser_list_end(parser, parameters);
 
     ASTNode *return_type = null;
     if (parser_check(parser, TOKEN_COLON))
         return_type = parse_typedecl(parser);
 
     ASTNode *typedecl = make_ast(AST_DECLARATION_TYPE_FUNCTION);
-    typedecl->function_parameters = parameters;
+    typedecl->function_parameters = parameter_types;
     typedecl->function_return_type = return_type;
     typedecl->function_is_variadic = is_variadic;
     return typedecl;
@@ -673,7 +692,7 @@ static ASTNode *parse_typedecl_base(Parser *parser) {
 
     if (parser_consume(parser, TOKEN_IDENTIFIER)) {
         ASTNode *identifier = make_ast(AST_DECLARATION_TYPE_NAME);
-        identifier->value = parser->previous->value;
+        identifier->value = parser->previous.value;
         return identifier;
     }
 
@@ -724,10 +743,11 @@ static ASTNode *parse_declaration_alias(Parser *parser) {
     Token *new_name = parser_consume(parser, TOKEN_IDENTIFIER);
     if (new_name == null)
         return null;
+    string alias_name = new_name->value;
     if (!parser_consume(parser, TOKEN_EQUAL))
         return make_error(parser, str("Expected '=' after 'alias name'."));
     ASTNode *node = make_ast(AST_DECLARATION_ALIAS);
-    node->alias_name = new_name->value;
+    node->alias_name = alias_name;
     node->alias_type = parse_typedecl(parser);
     if (!parser_consume(parser, TOKEN_SEMICOLON))
         return make_error(parser, str("Expected ';' after 'alias'."));
@@ -738,19 +758,27 @@ static ASTNode *parse_aggregate(Parser *parser, TokenKind kind);
 static ASTNode *parse_aggregate_item(Parser *parser) {
     if (parser_consume(parser, TOKEN_KW_STRUCT) || parser_consume(parser, TOKEN_KW_UNION)) {
         ASTNode *node = make_ast(AST_DECLARATION_AGGREGATE_CHILD);
-        node->aggregate_kind = parser->previous->kind;
-        vector_push(node->aggregate_items, parse_aggregate(parser, node->aggregate_kind));
+        node->aggregate_kind = parser->previous.kind;
+
+        ASTNode *aggregate = parse_aggregate(parser, node->aggregate_kind);
+        node->aggregate_items = arena_vector(parser->arena, &aggregate, sizeof(ASTNode *), 1);
         return node;
     }
 
     ASTNode *node = make_ast(AST_DECLARATION_AGGREGATE_FIELD);
-	node->aggregate_names = vector_create(string);
+    u32 names = vector_length(parser->scratch_names);
     do {
-        if (!parser_consume(parser, TOKEN_IDENTIFIER))
+        if (!parser_consume(parser, TOKEN_IDENTIFIER)) {
+            vector_length(parser->scratch_names) = names;
             return make_error(parser, str("Expected an identifier as a field name."));
-        vector_push(node->aggregate_names, parser->previous->value);
+        }
+        vector_push(parser->scratch_names, parser->previous.value);
     } while (parser_consume(parser, TOKEN_COMMA));
 
+    node->aggregate_names = arena_vector(parser->arena, parser->scratch_names + names, sizeof(string),
+                                         vector_length(parser->scratch_names) - names);
+    vector_length(parser->scratch_names) = names;
+
     if (!parser_consume(parser, TOKEN_COLON))
         return make_error(parser, str("Expected ':' after field names."));
 
@@ -768,35 +796,36 @@ static ASTNode *parse_aggregate(Parser *parser, TokenKind kind) {
 
     ASTNode *node = make_ast(AST_DECLARATION_AGGREGATE_CHILD);
     node->aggregate_kind = kind;
-	node->aggregate_items = vector_create(ASTNode*);
+    u32 items = parser_list_begin(parser);
     while (!parser_check(parser, TOKEN_EOF) && !parser_check(parser, TOKEN_CLOSE_BRACE))
-        vector_push(node->aggregate_items, parse_aggregate_item(parser));
+        parser_list_push(parser, parse_aggregate_item(parser));
 
     if (!parser_consume(parser, TOKEN_CLOSE_BRACE))
-        return make_error(parser, str("Expected '}' after aggregate."));
+        return make_list_error(parser, items, str("Expected '}' after aggregate."));
+    node->aggregate_items = parser_list_end(parser, items);
 
     return node;
 }
 
 static ASTNode *parse_declaration_aggregate(Parser *parser) {
-    TokenKind kind = parser->previous->kind;
+    TokenKind kind = parser->previous.kind;
     if (!parser_consume(parser, TOKEN_IDENTIFIER))
         return make_error(parser, str("Expected identifier after 'struct' or 'union'."));
 
     ASTNode *node = make_ast(AST_DECLARATION_AGGREGATE);
-    node->aggregate_name = parser->previous->value;
+    node->aggregate_name = parser->previous.value;
     node->aggregate = parse_aggregate(parser, kind);
 
     return node;
 }
 
 static ASTNode *parse_declaration_variable(Parser *parser) {
-    Token *variable_kind = parser->previous;
+    TokenKind variable_kind = parser->previous.kind;
     ASTNode *node = make_ast(AST_DECLARATION_VARIABLE);
-    node->variable_is_const = variable_kind->kind == TOKEN_KW_CONST;
+    node->variable_is_const = variable_kind == TOKEN_KW_CONST;
     if (!parser_consume(parser, TOKEN_IDENTIFIER))
         return make_error(parser, str("Expected identifier after 'var' or 'const'."));
-    node->variable_name = parser->previous->value;
+    node->variable_name = parser->previous.value;
 
     if (parser_consume(parser, TOKEN_COLON_EQUAL)) {
         node->variable_type = null;
@@ -817,7 +846,7 @@ static ASTNode *parse_declaration_function_parameter(Parser *parser) {
     ASTNode *node = make_ast(AST_DECLARATION_FUNCTION_PARAMETER);
     if (!parser_consume(parser, TOKEN_IDENTIFIER))
         return make_error(parser, str("Expected identifier for 'function parameter'."));
-    node->function_parameter_name = parser->previous->value;
+    node->function_parameter_name = parser->previous.value;
     if (!parser_consume(parser, TOKEN_COLON))
         return make_error(parser, str("Expected ':' after 'function parameter'."));
     node->function_parameter_type = parse_typedecl(parser);
@@ -831,40 +860,57 @@ static ASTNode *parse_declaration_function(Parser *parser) {
         if (name == null)
             return make_error(parser, str("Expected identifier or string after 'fun'."));
     }
+    string function_name = name->value;
     if (!parser_consume(parser, TOKEN_OPEN_PAREN))
         return make_error(parser, str("Expected '(' after function name."));
 
-    ASTNode **parameters = vector_create(ASTNode *);
+    u32 parameters = parser_list_begin(parser);
     bool is_variadic = false;
     if (!parser_check(parser, TOKEN_CLOSE_PAREN)) {
-        vector_push(parameters, parse_declaration_function_parameter(parser));
+        parser_list_push(parser, parse_declaration_function_parameter(parser));
         while (parser_consume(parser, TOKEN_COMMA)) {
             if (parser_consume(parser, TOKEN_DOT_DOT)) {
                 if (is_variadic)
-                    return make_error(parser, str("Variadic parameter can only be declared once."));
+                    return make_list_error(parser, parameters, str("Variadic parameter can only be declared once."));
                 is_variadic = true;
             } else {
                 if (is_variadic)
-                    return make_error(parser, str("Variadic parameter must be the last parameter."));
-                vector_push(parameters, parse_declaration_function_parameter(parser));
+                    return make_list_error(parser, parameters, str("Variadic parameter must be the last parameter."));
+                parser_list_push(parser, parse_declaration_function_parameter(parser));
             }
         }
     }
 
     if (!parser_consume(parser, TOKEN_CLOSE_PAREN))
-        return make_error(parser, str("Expected ')' after function parameters."));
+        return make_list_error(parser, parameters, str("Expected ')' after function parameters."));
+    ASTNode **function_parameters = parser_list_end(parser, parameters);
 
     ASTNode *return_type = null;
     if (parser_consume(parser, TOKEN_COLON))
         return_type = parse_typedecl(parser);
 
     ASTNode *node = make_ast(AST_DECLARATION_FUNCTION);
-    node->function_name = name->value;
-    node->function_parameters = parameters;
+    node->function_name = function_name;
+    node->function_parameters = function_parameters;
     node->function_return_type = return_type;
-    node->function_body = parser_consume(parser, TOKEN_SEMICOLON) ? null : parse_statement_block(parser);
     node->function_is_variadic = is_variadic;
 
+    if (parser_consume(parser, TOKEN_SEMICOLON)) {
+        node->function_body = null;
+    } else if (parser->defer_bodies && parser_check(parser, TOKEN_OPEN_BRACE)) {
+        node->flags |= AST_FLAG_DEFERRED;
+        node->function_body_location = parser->current.location;
+        node->function_body_arena = parser->arena;
+        if (!lexer_skip_block(parser->lexer))
+            return make_error(parser, str("Expected '}' after block"));
+        parser_advance(parser);
+    } else {
+        u32 errors = parser->errors;
+        node->function_body = parse_statement_block(parser);
+        if (parser->errors != errors)
+            node->flags |= AST_FLAG_MALFORMED;
+    }
+
     return node;
 }
 
@@ -873,7 +919,7 @@ static ASTNode *parse_declaration_enum(Parser *parser) {
         return make_error(parser, str("Expected identifier after 'enum'."));
 
     ASTNode *alias = make_ast(AST_DECLARATION_ALIAS);
-    alias->alias_name = parser->previous->value;
+    alias->alias_name = parser->previous.value;
 
     if (parser_consume(parser, TOKEN_COLON))
         alias->alias_type = parse_typedecl(parser);
@@ -881,17 +927,17 @@ static ASTNode *parse_declaration_enum(Parser *parser) {
     if (!parser_consume(parser, TOKEN_OPEN_BRACE))
         return make_error(parser, str("Expected '{' after 'enum'."));
 
-	ASTNode **items = vector_create(ASTNode*);
+    u32 items = parser_list_begin(parser);
     ASTNode *previous = null;
 
     while (!parser_check(parser, TOKEN_EOF) && !parser_check(parser, TOKEN_CLOSE_BRACE)) {
         if (!parser_consume(parser, TOKEN_IDENTIFIER))
-            return make_error(parser, str("Expected identifier in 'enum'."));
+            return make_list_error(parser, items, str("Expected identifier in 'enum'."));
 
         ASTNode *item = make_ast(AST_DECLARATION_VARIABLE);
-        item->variable_name = parser->previous->value;
+        item->variable_name = parser->previous.value;
 
-        ASTNode *item_type = make_ast_at(alias->location, AST_DECLARATION_TYPE_NAME);
+        ASTNode *item_type = make_ast_at(parser, alias->location, AST_DECLARATION_TYPE_NAME);
         item_type->value = alias->alias_name;
 
         item->variable_type = item_type;
@@ -899,17 +945,19 @@ static ASTNode *parse_declaration_enum(Parser *parser) {
         if (parser_consume(parser, TOKEN_EQUAL))
             item->variable_initializer = parse_expression(parser);
         else if (previous == null) {
-            ASTNode *zero = make_ast_at(item->location, AST_EXPRESSION_LITERAL_NUMBER);
+            ASTNode *zero = make_ast_at(parser, item->location, AST_EXPRESSION_LITERAL_NUMBER);
             zero->value = str("0");
+            zero->literal_as_u64 = 0;
             item->variable_initializer = zero;
         } else {
-            ASTNode *one = make_ast_at(item->location, AST_EXPRESSION_LITERAL_NUMBER);
+            ASTNode *one = make_ast_at(parser, item->location, AST_EXPRESSION_LITERAL_NUMBER);
             one->value = str("1");
+            one->literal_as_u64 = 1;
 
-            ASTNode *previous_identifier = make_ast_at(item->location, AST_EXPRESSION_IDENTIFIER);
+            ASTNode *previous_identifier = make_ast_at(parser, item->location, AST_EXPRESSION_IDENTIFIER);
             previous_identifier->value = previous->variable_name;
 
-            ASTNode *binary = make_ast_at(item->location, AST_EXPRESSION_BINARY);
+            ASTNode *binary = make_ast_at(parser, item->location, AST_EXPRESSION_BINARY);
             binary->binary_operator = TOKEN_PLUS;
             binary->binary_left = previous_identifier;
             binary->binary_right = one;
@@ -919,19 +967,19 @@ static ASTNode *parse_declaration_enum(Parser *parser) {
 
         item->variable_is_const = true;
 
-        vector_push(items, item);
-        previous = vector_last(items);
+        parser_list_push(parser, item);
+        previous = item;
 
         if (!parser_consume(parser, TOKEN_SEMICOLON))
-            return make_error(parser, str("Expected ';' after 'enum' item."));
+            return make_list_error(parser, items, str("Expected ';' after 'enum' item."));
     }
 
     if (!parser_consume(parser, TOKEN_CLOSE_BRACE))
-        return make_error(parser, str("Expected '}' after 'enum'."));
+        return make_list_error(parser, items, str("Expected '}' after 'enum'."));
 
     ASTNode *node = make_ast(AST_DECLARATION_ENUM_PLACEHOLDER);
     node->enum_alias = alias;
-    node->enum_items = items;
+    node->enum_items = parser_list_end(parser, items);
 
     return node;
 }
@@ -947,41 +995,97 @@ ASTNode *parse_declaration(Parser *parser) {
     return null;
 }
 
-ASTNode *parse_program(Token *tokens) {
-    Parser *parser = make(Parser);
-    parser->tokens = tokens;
-    parser->current = parser->tokens;
-    parser->previous = null;
+static void parser_initialize(Parser *parser, Lexer *lexer, Arena *arena, bool defer_bodies, FILE *diagnostics) {
+    *parser = (Parser){0};
+    parser->lexer = lexer;
+    parser->arena = arena;
+    parser->diagnostics = diagnostics;
+    parser->scratch = vector_create(ASTNode *);
+    parser->scratch_names = vector_create(string);
+    parser->defer_bodies = defer_bodies;
+    parser->current = lexer_next(lexer);
+}
+
+static void parser_free(Parser *parser) {
+    ast_statistics_add(&parser->statistics);
+    vector_free(parser->scratch);
+    vector_free(parser->scratch_names);
+}
+
+ASTNode *parse_program(Lexer *lexer, Arena *arena, bool defer_bodies, FILE *diagnostics) {
+    Parser parser_state;
+    Parser *parser = &parser_state;
+    parser_initialize(parser, lexer, arena, defer_bodies, diagnostics);
 
     ASTNode *program = make_ast(AST_PROGRAM);
-    program->location = parser->current->location;
-    program->declarations = vector_create(ASTNode *);
+    program->location = parser->current.location;
+    u32 declarations = parser_list_begin(parser);
 
     while (!parser_check(parser, TOKEN_EOF)) {
         ASTNode *declaration = parse_declaration(parser);
         if (!declaration) {
-            printf("Failed to parse declaration (Current is: %d '%.*s')\n", parser->current->kind, (i32) parser->current->value.length, parser->current->value.data);
+            fprintf(parser->diagnostics, "Failed to parse declaration (Current is: %d '%.*s')\n", parser->current.kind, (i32) parser->current.value.length, parser->current.value.data);
             parser_advance(parser);
             continue;
         }
 
         switch (declaration->kind) {
             case AST_ERROR: {
-                printf("Decl error: %.*s\n", strp(declaration->value));
+                fprintf(parser->diagnostics, "Decl error: %.*s\n", strp(declaration->value));
                 break;
             }
             case AST_DECLARATION_ENUM_PLACEHOLDER: {
-                vector_push(program->declarations, declaration->enum_alias);
+                parser_list_push(parser, declaration->enum_alias);
                 vector_foreach_ptr(ASTNode, item, declaration->enum_items)
-                        vector_push(program->declarations, *item);
+                        parser_list_push(parser, *item);
                 break;
             }
             default: {
-                vector_push(program->declarations, declaration);
+                parser_list_push(parser, declaration);
                 break;
             }
         }
     }
 
+    program->declarations = parser_list_end(parser, declarations);
+
+    parser_free(parser);
     return program;
 }
+
+// The deferred bodies of a file all go into its arena, so sema threads take
+// turns parsing bodies of the same file.
+#define PARSER_ARENA_LOCKS 16
+static Mutex parser_arena_locks[PARSER_ARENA_LOCKS] = {[0 ... PARSER_ARENA_LOCKS - 1] = MUTEX_INITIALIZER};
+
+ASTNode *parse_function_body(ASTNode *function, FILE *diagnostics) {
+    assert(function->kind == AST_DECLARATION_FUNCTION);
+
+    // Only deferred functions have an arena, and it never changes, so eager ones need no lock.
+    if (!function->function_body_arena)
+        return function->function_body;
+
+    // The flag is tested and cleared under the lock, so a body is parsed once even when
+    // several threads ask for it at the same time.
+    Mutex *lock = &parser_arena_locks[((usize) function->function_body_arena >> 4) % PARSER_ARENA_LOCKS];
+    mutex_lock(lock);
+
+    if (function->flags & AST_FLAG_DEFERRED) {
+        Lexer lexer;
+        lexer_initialize(&lexer, source_file_at(function->function_body_location), false);
+        lexer_seek(&lexer, function->function_body_location);
+
+        Parser parser;
+        parser_initialize(&parser, &lexer, function->function_body_arena, false, diagnostics);
+        function->function_body = parse_statement_block(&parser);
+        if (parser.errors > 0)
+            function->flags |= AST_FLAG_MALFORMED;
+        parser_free(&parser);
+
+        function->flags &= ~AST_FLAG_DEFERRED;
+    }
+
+    ASTNode *body = function->function_body;
+    mutex_unlock(lock);
+    return body;
+}
@@ -0,0 +1,88 @@
+#include <stddef.h>
+
+#ifdef PRELOAD_INCLUDED
+extern const unsigned char preload_snapshot[];
+extern const size_t preload_snapshot_len;
+
+const unsigned char preload_snapshot[] = {
+    0x41, 0x41, 0x53, 0x50, 0x03, 0x00, 0x00, 0x00, 0x8a, 0x6f, 0x45, 0xe7, 0x04, 0x88, 0xd2, 0xab,
+    0xbc, 0x53, 0x4b, 0xa8, 0xe4, 0x66, 0xff, 0x3b, 0xf3, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xd4, 0x00, 0x00, 0x00, 0x2f, 0x00, 0x00, 0x00, 0x03, 0x69, 0x33, 0x32, 0x04, 0x62, 0x6f, 0x6f,
+    0x6c, 0x01, 0x31, 0x04, 0x74, 0x72, 0x75, 0x65, 0x01, 0x30, 0x05, 0x66, 0x61, 0x6c, 0x73, 0x65,
+    0x04, 0x63, 0x6f, 0x64, 0x65, 0x04, 0x65, 0x78, 0x69, 0x74, 0x02, 0x75, 0x38, 0x03, 0x73, 0x74,
+    0x72, 0x04, 0x70, 0x75, 0x74, 0x73, 0x06, 0x73, 0x74, 0x72, 0x6c, 0x65, 0x6e, 0x04, 0x73, 0x69,
+    0x7a, 0x65, 0x02, 0x69, 0x38, 0x06, 0x6d, 0x61, 0x6c, 0x6c, 0x6f, 0x63, 0x04, 0x76, 0x6f, 0x69,
+    0x64, 0x02, 0x76, 0x31, 0x02, 0x76, 0x32, 0x03, 0x75, 0x33, 0x32, 0x03, 0x6c, 0x65, 0x6e, 0x06,
+    0x6d, 0x65, 0x6d, 0x63, 0x6d, 0x70, 0x03, 0x66, 0x6d, 0x74, 0x06, 0x70, 0x72, 0x69, 0x6e, 0x74,
+    0x66, 0x13, 0x5f, 0x5f, 0x61, 0x74, 0x63, 0x63, 0x5f, 0x69, 0x6e, 0x69, 0x74, 0x5f, 0x67, 0x6c,
+    0x6f, 0x62, 0x61, 0x6c, 0x73, 0x06, 0x73, 0x74, 0x72, 0x69, 0x6e, 0x67, 0x01, 0x61, 0x01, 0x62,
+    0x06, 0x6c, 0x65, 0x6e, 0x67, 0x74, 0x68, 0x04, 0x64, 0x61, 0x74, 0x61, 0x14, 0x5f, 0x5f, 0x61,
+    0x74, 0x63, 0x63, 0x5f, 0x73, 0x74, 0x72, 0x69, 0x6e, 0x67, 0x5f, 0x65, 0x71, 0x75, 0x61, 0x6c,
+    0x73, 0x03, 0x70, 0x74, 0x72, 0x05, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x03, 0x6e, 0x75, 0x6d, 0x05,
+    0x62, 0x79, 0x74, 0x65, 0x73, 0x01, 0x69, 0x0d, 0x5f, 0x5f, 0x61, 0x74, 0x63, 0x63, 0x5f, 0x6d,
+    0x65, 0x6d, 0x73, 0x65, 0x74, 0x04, 0x61, 0x72, 0x67, 0x63, 0x04, 0x61, 0x72, 0x67, 0x76, 0x04,
+    0x61, 0x72, 0x67, 0x73, 0x02, 0x31, 0x36, 0x03, 0x61, 0x72, 0x67, 0x04, 0x4d, 0x61, 0x69, 0x6e,
+    0x0c, 0x5f, 0x5f, 0x61, 0x74, 0x63, 0x63, 0x5f, 0x73, 0x74, 0x61, 0x72, 0x74, 0x09, 0x63, 0x6f,
+    0x6e, 0x64, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x07, 0x6d, 0x65, 0x73, 0x73, 0x61, 0x67, 0x65, 0x06,
+    0x61, 0x73, 0x73, 0x65, 0x72, 0x74, 0x05, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x03, 0x20, 0x01, 0x07,
+    0x05, 0x02, 0x01, 0x03, 0x3c, 0x02, 0x21, 0x06, 0x03, 0x00, 0x01, 0x2b, 0x01, 0x02, 0x01, 0x0b,
+    0x27, 0x04, 0x00, 0x01, 0x01, 0x03, 0x5e, 0x02, 0x21, 0x06, 0x05, 0x00, 0x00, 0x2b, 0x01, 0x02,
+    0x01, 0x0b, 0x27, 0x06, 0x00, 0x01, 0x01, 0x03, 0x54, 0x01, 0x0c, 0x11, 0x07, 0x01, 0x0d, 0x14,
+    0x08, 0x02, 0x01, 0x00, 0x00, 0x00, 0x03, 0x24, 0x09, 0x04, 0x02, 0x01, 0x0c, 0x0f, 0x0a, 0x01,
+    0x03, 0x1c, 0x01, 0x0d, 0x00, 0x0b, 0x02, 0x02, 0x01, 0x00, 0x00, 0x03, 0x28, 0x09, 0x04, 0x02,
+    0x01, 0x0c, 0x0f, 0x0a, 0x01, 0x03, 0x1c, 0x01, 0x0d, 0x00, 0x0c, 0x02, 0x02, 0x01, 0x00, 0x00,
+    0x03, 0x2c, 0x01, 0x0c, 0x11, 0x0d, 0x01, 0x03, 0x1c, 0x0e, 0x04, 0x02, 0x01, 0x0d, 0x00, 0x0f,
+    0x02, 0x03, 0x01, 0x00, 0x00, 0x03, 0x2a, 0x10, 0x04, 0x02, 0x01, 0x0c, 0x11, 0x11, 0x01, 0x03,
+    0x26, 0x10, 0x04, 0x02, 0x01, 0x0c, 0x11, 0x12, 0x01, 0x03, 0x26, 0x13, 0x0c, 0x0f, 0x14, 0x01,
+    0x03, 0x1c, 0x01, 0x0d, 0x00, 0x15, 0x04, 0x07, 0x04, 0x02, 0x01, 0x00, 0x00, 0x03, 0x28, 0x09,
+    0x04, 0x02, 0x01, 0x0c, 0x0f, 0x16, 0x01, 0x03, 0x24, 0x01, 0x0d, 0x00, 0x17, 0x02, 0x02, 0x01,
+    0x01, 0x00, 0x0d, 0x38, 0x18, 0x01, 0x00, 0x00, 0x00, 0x03, 0xcc, 0x01, 0x19, 0x0c, 0x11, 0x1a,
+    0x01, 0x03, 0x28, 0x19, 0x0c, 0x11, 0x1b, 0x01, 0x03, 0x20, 0x01, 0x24, 0x16, 0x1a, 0x29, 0x10,
+    0x01, 0x1c, 0x24, 0x08, 0x1b, 0x29, 0x0e, 0x01, 0x1c, 0x1f, 0x0f, 0x34, 0x03, 0x01, 0x21, 0x24,
+    0x05, 0x00, 0x00, 0x19, 0x01, 0x01, 0x10, 0x10, 0x00, 0x03, 0x01, 0x00, 0x24, 0x14, 0x15, 0x24,
+    0x04, 0x1a, 0x29, 0x0a, 0x01, 0x1d, 0x24, 0x06, 0x1b, 0x29, 0x0a, 0x01, 0x1d, 0x24, 0x06, 0x1a,
+    0x29, 0x0e, 0x01, 0x1c, 0x28, 0x04, 0x07, 0x04, 0x05, 0x03, 0x01, 0x21, 0x08, 0x05, 0x00, 0x00,
+    0x1f, 0x01, 0x33, 0x02, 0x01, 0x21, 0x26, 0x03, 0x00, 0x01, 0x19, 0x01, 0x01, 0x10, 0x10, 0x00,
+    0x03, 0x01, 0x00, 0x21, 0x10, 0x05, 0x00, 0x00, 0x19, 0x01, 0x01, 0x0f, 0xe3, 0x01, 0x04, 0x10,
+    0x03, 0x01, 0x0d, 0x0b, 0x1e, 0x03, 0x1c, 0x1a, 0x19, 0x00, 0x01, 0x03, 0xb2, 0x02, 0x10, 0x04,
+    0x02, 0x01, 0x0c, 0x13, 0x1f, 0x01, 0x03, 0x2c, 0x01, 0x0c, 0x13, 0x20, 0x01, 0x03, 0x28, 0x13,
+    0x0c, 0x0f, 0x21, 0x01, 0x03, 0x1e, 0x10, 0x04, 0x04, 0x01, 0x03, 0x2c, 0x09, 0x04, 0x02, 0x01,
+    0x24, 0x0a, 0x1f, 0x2b, 0x05, 0x02, 0x01, 0x1a, 0x13, 0x22, 0x00, 0x01, 0x00, 0x21, 0x3c, 0x05,
+    0x00, 0x00, 0x1a, 0x01, 0x23, 0x00, 0x01, 0x00, 0x24, 0x0a, 0x23, 0x24, 0x0a, 0x21, 0x1f, 0x05,
+    0x12, 0x02, 0x01, 0x24, 0x0e, 0x23, 0x21, 0x08, 0x03, 0x00, 0x01, 0x1c, 0x01, 0x26, 0x02, 0x01,
+    0x24, 0x20, 0x22, 0x24, 0x04, 0x23, 0x2a, 0x04, 0x02, 0x01, 0x03, 0x12, 0x09, 0x24, 0x0e, 0x20,
+    0x2b, 0x09, 0x02, 0x01, 0x1c, 0x11, 0x0f, 0x04, 0x01, 0x13, 0x15, 0x0e, 0x0b, 0x08, 0x01, 0x24,
+    0x52, 0x1f, 0x19, 0x05, 0x01, 0x0f, 0xcf, 0x01, 0x04, 0x13, 0x03, 0x01, 0x0d, 0x0b, 0x24, 0x04,
+    0x1f, 0x1d, 0x1b, 0x19, 0x00, 0x01, 0x03, 0xa0, 0x02, 0x01, 0x0c, 0x11, 0x25, 0x01, 0x03, 0x26,
+    0x09, 0x04, 0x02, 0x01, 0x04, 0x02, 0x01, 0x0c, 0x13, 0x26, 0x01, 0x03, 0x22, 0x01, 0x24, 0x32,
+    0x18, 0x28, 0x04, 0x01, 0x01, 0x1b, 0x00, 0x01, 0x03, 0x26, 0x19, 0x05, 0x06, 0x01, 0x00, 0x01,
+    0x1a, 0x11, 0x27, 0x01, 0x00, 0x00, 0x24, 0x26, 0x27, 0x29, 0x0c, 0x01, 0x1d, 0x03, 0x1a, 0x19,
+    0x04, 0x02, 0x01, 0x24, 0x10, 0x0f, 0x24, 0x0c, 0x25, 0x21, 0x08, 0x28, 0x00, 0x10, 0x1f, 0x03,
+    0x08, 0x02, 0x01, 0x28, 0x06, 0x04, 0x02, 0x01, 0x2b, 0x21, 0x06, 0x01, 0x1c, 0x1b, 0x0f, 0x09,
+    0x01, 0x24, 0x52, 0x27, 0x29, 0x10, 0x01, 0x1c, 0x03, 0x14, 0x13, 0x24, 0x0c, 0x25, 0x2b, 0x07,
+    0x02, 0x01, 0x1c, 0x13, 0x0f, 0x04, 0x01, 0x21, 0x40, 0x05, 0x00, 0x00, 0x1a, 0x01, 0x23, 0x00,
+    0x01, 0x00, 0x24, 0x0a, 0x23, 0x03, 0x14, 0x13, 0x24, 0x0c, 0x25, 0x2b, 0x07, 0x02, 0x01, 0x1f,
+    0x13, 0x12, 0x04, 0x01, 0x24, 0x24, 0x23, 0x21, 0x08, 0x03, 0x00, 0x01, 0x1c, 0x01, 0x26, 0x02,
+    0x01, 0x24, 0x32, 0x27, 0x24, 0x04, 0x23, 0x2a, 0x02, 0x02, 0x01, 0x1e, 0x0f, 0x0b, 0x01, 0x1a,
+    0x00, 0x29, 0x00, 0x01, 0x00, 0x24, 0x2c, 0x29, 0x29, 0x0c, 0x01, 0x1d, 0x24, 0x0c, 0x26, 0x24,
+    0x04, 0x23, 0x2a, 0x02, 0x02, 0x01, 0x1c, 0x0d, 0x0f, 0x04, 0x01, 0x24, 0x28, 0x29, 0x29, 0x10,
+    0x01, 0x1c, 0x03, 0x14, 0x13, 0x24, 0x10, 0x0c, 0x24, 0x0a, 0x26, 0x24, 0x04, 0x23, 0x2a, 0x02,
+    0x02, 0x01, 0x28, 0x02, 0x04, 0x02, 0x01, 0x2b, 0x1d, 0x06, 0x01, 0x1c, 0x13, 0x0f, 0x08, 0x01,
+    0x0f, 0x85, 0x01, 0x04, 0x11, 0x0b, 0x01, 0x13, 0x13, 0x1f, 0x1a, 0x17, 0x01, 0x24, 0xfc, 0x01,
+    0x2a, 0x24, 0x0a, 0x27, 0x28, 0x02, 0x02, 0x02, 0x01, 0x19, 0x13, 0x01, 0x0f, 0xcf, 0x04, 0x07,
+    0x3a, 0x37, 0x2c, 0x26, 0x05, 0x01, 0x0d, 0x0b, 0x2b, 0x03, 0x43, 0x3f, 0x3e, 0x00, 0x01, 0x03,
+    0xae, 0x05, 0x02, 0x0c, 0x1d, 0x2c, 0x01, 0x03, 0x40, 0x19, 0x0c, 0x1d, 0x2d, 0x01, 0x24, 0x4a,
+    0x2c, 0x1e, 0x13, 0x10, 0x01, 0x24, 0x34, 0x0b, 0x03, 0x10, 0x09, 0x04, 0x02, 0x01, 0x24, 0x12,
+    0x2d, 0x29, 0x0a, 0x01, 0x1d, 0x2b, 0x17, 0x03, 0x01, 0x28, 0x1a, 0x06, 0x02, 0x01, 0x1b, 0x00,
+    0x01, 0x24, 0x1c, 0x08, 0x21, 0x04, 0x03, 0x00, 0x01, 0x28, 0x02, 0x02, 0x02, 0x01, 0x1b, 0x00,
+    0x01, 0x0f, 0x59, 0x03, 0x05, 0x01, 0x10, 0x6a, 0x00, 0x0e, 0x01, 0x00, 0x0f, 0x9d, 0x01, 0x02,
+    0x01, 0x0d, 0x0b, 0x2e, 0x03, 0x14, 0x12, 0x00, 0x00, 0x01, 0x03, 0xe2, 0x01, 0x19, 0x0c, 0x1d,
+    0x2d, 0x01, 0x24, 0x36, 0x0b, 0x03, 0x10, 0x09, 0x04, 0x02, 0x01, 0x24, 0x12, 0x2d, 0x29, 0x0a,
+    0x01, 0x1d, 0x2b, 0x17, 0x03, 0x01, 0x28, 0x1a, 0x06, 0x02, 0x01, 0x1b, 0x00, 0x01, 0x0f, 0x37,
+    0x02, 0x01, 0x0d, 0x0b, 0x2f, 0x02, 0x0a, 0x00, 0x00, 0x01, 0x02, 0x9b, 0x13, 0x10, 0xd2, 0x01,
+    0xce, 0x01, 0xca, 0x01, 0xc7, 0x01, 0xc2, 0x01, 0xbd, 0x01, 0xb8, 0x01, 0xae, 0x01, 0xa9, 0x01,
+    0xa8, 0x01, 0x8a, 0x01, 0x68, 0x23, 0x0d, 0x01,
+};
+
+const size_t preload_snapshot_len = sizeof(preload_snapshot);
+#endif
@@ -1,4 +1,5 @@
 #include "atcc.h"
+#include "ati/thread.h"
 #include "ati/utils.h"
 #include <assert.h>
 #include <stdarg.h>
@@ -8,8 +9,9 @@ static SemanticError make_errorv(ASTNode *node, cstring msg, va_list args) {
     vsnprintf((char *) message.data, message.length, msg, args);
 
     if (verbose & VERBOSE_SEMANTIC) {
+        SourcePosition position = location_resolve(node->location);
         fprintf(stderr, "\x1b[94m%.*s:%d:%d:\x1b[0m ",
-                strp(node->location.file), node->location.line, node->location.column);
+                strp(position.file), position.line, position.column);
         fprintf(stderr, "\033[31merror: \033[0m");
         vfprintf(stderr, msg, args);
         fprintf(stderr, "\n");
@@ -30,17 +32,6 @@ static void sema_errorf(SemanticContext *context, ASTNode *node, cstring msg, ..
     va_end(args);
 }
 
-static SemanticScope *make_scope(SemanticScope *parent) {
-    SemanticScope *scope = make(SemanticScope);
-    string_table_create(&scope->entries);
-    scope->parent = parent;
-    if (parent) {
-        scope->can_break = parent->can_break;
-        scope->can_continue = parent->can_continue;
-    }
-    return scope;
-}
-
 static SemanticEntry *make_entry() {
     SemanticEntry *entry = make(SemanticEntry);
     entry->kind = SEMA_ENTRY_NONE;
@@ -58,26 +49,70 @@ static SemanticEntry *make_builtin(Type *type) {
     return entry;
 }
 
-static SemanticEntry *sema_get(SemanticScope *scope, string name) {
-    SemanticEntry *entry = string_table_get(&scope->entries, name);
-    if (entry) return entry;
-    if (scope->parent) return sema_get(scope->parent, name);
-    return null;
+// Enters a nested scope, which inherits whether break and continue are allowed.
+// Returns the enclosing scope, to be handed back to sema_leave_scope.
+static SemanticScope sema_enter_scope(SemanticContext *context) {
+    SemanticScope outer = context->scope;
+    context->scope.bindings = vector_length(context->bindings);
+    return outer;
+}
+
+static void sema_leave_scope(SemanticContext *context, SemanticScope outer) {
+    // Popped innermost first, so that every name gets back the binding it shadowed.
+    for (u32 i = vector_length(context->bindings); i > context->scope.bindings; i--) {
+        SemanticBinding *binding = &context->bindings[i - 1];
+        binding->symbol->binding = binding->shadowed;
+    }
+
+    vector_length(context->bindings) = context->scope.bindings;
+    context->scope = outer;
+}
+
+SemanticEntry *sema_get(SemanticContext *context, string name) {
+    SemanticSymbol *symbol = symbol_table_get(&context->symbols, name);
+    if (symbol && symbol->binding)
+        return context->bindings[symbol->binding - 1].entry;
+    return context->parent ? sema_get(context->parent, name) : null;
 }
 
-static bool sema_put(SemanticScope *scope, string name, SemanticEntry *entry) {
-    return string_table_set(&scope->entries, name, entry);
+static bool sema_put(SemanticContext *context, string name, SemanticEntry *entry) {
+    SemanticSymbol *symbol = symbol_table_get(&context->symbols, name);
+    if (!symbol) {
+        symbol = make(SemanticSymbol);
+        symbol_table_set(&context->symbols, name, symbol);
+    }
+
+    // A second binding in the same scope replaces the first one.
+    if (symbol->binding > context->scope.bindings) {
+        context->bindings[symbol->binding - 1].entry = entry;
+        return false;
+    }
+
+    SemanticBinding binding = {symbol, entry, symbol->binding};
+    vector_push(context->bindings, binding);
+    symbol->binding = vector_length(context->bindings);
+    return true;
 }
 
+Symbols symbols;
+
 SemanticContext *sema_initialize() {
+    symbols.main = intern(str("Main"));
+    symbols.start = intern(str("__atcc_start"));
+    symbols.length = intern(str("length"));
+    symbols.data = intern(str("data"));
+    symbols.init_globals = intern(str("__atcc_init_globals"));
+    symbols.string_equals = intern(str("__atcc_string_equals"));
+    symbols.memset = intern(str("__atcc_memset"));
+
     SemanticContext *context = make(SemanticContext);
     context->programs = vector_create(ASTNode *);
-    context->global = make_scope(null);
-    context->scope = context->global;
+    symbol_table_create(&context->symbols);
+    context->bindings = vector_create(SemanticBinding);
     context->errors = vector_create(SemanticError);
-
-    pointer_table_create(&context->array_types);
-    pointer_table_create(&context->pointer_types);
+    context->diagnostics = stderr;
+    context->references = vector_create(ASTNode *);
+    pointer_table_create(&context->initializer_references);
 
     context->type_void = make_type(TYPE_VOID, 1, 1);
     context->type_i8 = make_type(TYPE_I8, 1, 1);
@@ -91,17 +126,17 @@ SemanticContext *sema_initialize() {
     context->type_f32 = make_type(TYPE_F32, 4, 4);
     context->type_f64 = make_type(TYPE_F64, 8, 8);
 
-    string_table_set(&context->global->entries, str("void"), make_builtin(context->type_void));
-    string_table_set(&context->global->entries, str("i8"), make_builtin(context->type_i8));
-    string_table_set(&context->global->entries, str("u8"), make_builtin(context->type_u8));
-    string_table_set(&context->global->entries, str("i16"), make_builtin(context->type_i16));
-    string_table_set(&context->global->entries, str("u16"), make_builtin(context->type_u16));
-    string_table_set(&context->global->entries, str("i32"), make_builtin(context->type_i32));
-    string_table_set(&context->global->entries, str("u32"), make_builtin(context->type_u32));
-    string_table_set(&context->global->entries, str("i64"), make_builtin(context->type_i64));
-    string_table_set(&context->global->entries, str("u64"), make_builtin(context->type_u64));
-    string_table_set(&context->global->entries, str("f32"), make_builtin(context->type_f32));
-    string_table_set(&context->global->entries, str("f64"), make_builtin(context->type_f64));
+    sema_put(context, intern(str("void")), make_builtin(context->type_void));
+    sema_put(context, intern(str("i8")), make_builtin(context->type_i8));
+    sema_put(context, intern(str("u8")), make_builtin(context->type_u8));
+    sema_put(context, intern(str("i16")), make_builtin(context->type_i16));
+    sema_put(context, intern(str("u16")), make_builtin(context->type_u16));
+    sema_put(context, intern(str("i32")), make_builtin(context->type_i32));
+    sema_put(context, intern(str("u32")), make_builtin(context->type_u32));
+    sema_put(context, intern(str("i64")), make_builtin(context->type_i64));
+    sema_put(context, intern(str("u64")), make_builtin(context->type_u64));
+    sema_put(context, intern(str("f32")), make_builtin(context->type_f32));
+    sema_put(context, intern(str("f64")), make_builtin(context->type_f64));
 
     context->type_string = make_type(TYPE_STRING, 12, POINTER_SIZE);
     context->type_string->fields = vector_create_n(TypeField, 2);
@@ -109,16 +144,15 @@ SemanticContext *sema_initialize() {
     TypeField *type_string_length = &context->type_string->fields[0];
     TypeField *type_string_data = &context->type_string->fields[1];
 
-    type_string_length->name = str("length");
+    type_string_length->name = symbols.length;
     type_string_length->type = context->type_u32;
 
-    type_string_data->name = str("data");
-    type_string_data->type = make_type(TYPE_POINTER, POINTER_SIZE, POINTER_SIZE);
-    type_string_data->type->base_type = context->type_u8;
+    type_string_data->name = symbols.data;
+    type_string_data->type = type_pointer(context->type_u8);
 
     vector_header(context->type_string->fields)->length = 2;
 
-    string_table_set(&context->global->entries, str("string"), make_builtin(context->type_string));
+    sema_put(context, intern(str("string")), make_builtin(context->type_string));
 
     return context;
 }
@@ -128,7 +162,7 @@ static bool sema_register(SemanticContext *context, SemanticEntryKind kind, stri
     entry->kind = kind;
     entry->state = SEMA_STATE_UNRESOLVED;
     entry->node = node;
-    if (!string_table_set(&context->scope->entries, name, entry)) {
+    if (!sema_put(context, name, entry)) {
         sema_errorf(context, node, "redefinition of '%.*s'", (i32) name.length, name.data);
         return false;
     }
@@ -147,7 +181,7 @@ bool sema_register_program(SemanticContext *context, ASTNode *program) {
                 if (!succeeded)
                     break;
 
-                SemanticEntry *entry = sema_get(context->scope, node->aggregate_name);
+                SemanticEntry *entry = sema_get(context, node->aggregate_name);
                 entry->state = SEMA_STATE_RESOLVED;
                 entry->type = make_type(TYPE_AGGREGATE, 0, 0);
                 entry->type->owner = node;
@@ -176,7 +210,7 @@ static Type *sema_resolve_type(SemanticContext *context, ASTNode *node) {
 
     switch (node->kind) {
         case AST_DECLARATION_TYPE_NAME: {
-            SemanticEntry *entry = sema_get(context->scope, node->value);
+            SemanticEntry *entry = sema_get(context, node->value);
             if (entry && sema_resolve_entry(context, entry))
                 return entry->type;
 
@@ -185,53 +219,22 @@ static Type *sema_resolve_type(SemanticContext *context, ASTNode *node) {
         }
         case AST_DECLARATION_TYPE_POINTER: {
             Type *base_type = sema_resolve_type(context, node->parent);
-            Type *cached_type = pointer_table_get(&context->pointer_types, base_type);
-            if (cached_type) return cached_type;
-
-            Type *pointer = make_type(TYPE_POINTER, POINTER_SIZE, POINTER_SIZE);
-            pointer->base_type = base_type;
-
-            pointer_table_set(&context->pointer_types, base_type, pointer);
-            return pointer;
+            return base_type ? type_pointer(base_type) : null;
         }
         case AST_DECLARATION_TYPE_ARRAY: {
             Type *base_type = sema_resolve_type(context, node->array_base);
-            if (base_type->kind == TYPE_AGGREGATE && node->array_size) {
-                assert(base_type->is_complete);
-            }
+            if (!base_type) return null;
 
             if (node->array_size) {
+                if (base_type->kind == TYPE_AGGREGATE)
+                    assert(base_type->is_complete);
+
                 sema_analyze_expression(context, node->array_size);
                 assert(node->array_size->kind == AST_EXPRESSION_LITERAL_NUMBER);
-
-                u32 size = (u32) node->array_size->literal_as_u64 * base_type->size;
-
-                uint64_t type_hash = (uint64_t) base_type | (node->array_size->literal_as_u64 << 32);
-
-                Type *cached_type = pointer_table_get(&context->array_types, (void *) type_hash);
-                if (cached_type) return cached_type;
-
-                // +POINTER_SIZE for the length field (alignment)
-                Type *array = make_type(TYPE_ARRAY, size + POINTER_SIZE, POINTER_SIZE);
-                array->array_base = base_type;
-                array->array_size = (u32) node->array_size->literal_as_u64;
-
-                pointer_table_set(&context->array_types, (void *) type_hash, array);
-                return array;
-            } else {//if (!node->array_is_dynamic) {
-                uint64_t type_hash = (uint64_t) base_type | ((uint64_t) node->array_is_dynamic << 63);
-
-                Type *cached_type = pointer_table_get(&context->array_types, (void *) type_hash);
-                if (cached_type) return cached_type;
-
-                // +POINTER_SIZE for length field (alignment)
-                Type *array = make_type(TYPE_ARRAY, POINTER_SIZE * 2, POINTER_SIZE);
-                array->array_base = base_type;
-                array->array_is_dynamic = node->array_is_dynamic;
-
-                pointer_table_set(&context->array_types, (void *) type_hash, array);
-                return array;
+                return type_array(base_type, (u32) node->array_size->literal_as_u64, false);
             }
+
+            return type_array(base_type, 0, node->array_is_dynamic);
         }
         default: break;
     }
@@ -252,10 +255,7 @@ static Type *sema_resolve_function_type(SemanticContext *context, ASTNode *node)
     Type *return_type = sema_resolve_type(context, node->function_return_type);
     if (!return_type) return null;
 
-    node->base_type = make_type(TYPE_FUNCTION, POINTER_SIZE, POINTER_SIZE);
-    node->base_type->function_parameters = parameters;
-    node->base_type->function_return_type = return_type;
-    node->base_type->function_is_variadic = node->function_is_variadic;
+    node->base_type = type_function(parameters, return_type, node->function_is_variadic);
     return node->base_type;
 }
 
@@ -286,7 +286,16 @@ static bool sema_resolve_entry(SemanticContext *context, SemanticEntry *entry) {
             panic("ICE: unimplemented type in sema_resolve_entry: %d", entry->node->kind);
         }
         case SEMA_ENTRY_VARIABLE: {
+            ASTNode **references = context->references;
+            if (context->reachable_only)
+                context->references = vector_create(ASTNode *);
+
             entry->type = sema_analyze_initializer(context, entry->node->variable_type, entry->node->variable_initializer);
+
+            if (context->reachable_only) {
+                pointer_table_set(&context->initializer_references, entry->node, context->references);
+                context->references = references;
+            }
             break;
         }
         case SEMA_ENTRY_FUNCTION: entry->type = sema_resolve_function_type(context, entry->node); break;
@@ -297,7 +306,7 @@ static bool sema_resolve_entry(SemanticContext *context, SemanticEntry *entry) {
 }
 
 static SemanticEntry *sema_resolve_name(SemanticContext *context, string name) {
-    SemanticEntry *entry = sema_get(context->scope, name);
+    SemanticEntry *entry = sema_get(context, name);
     if (entry && sema_resolve_entry(context, entry))
         return entry;
     return null;
@@ -389,12 +398,9 @@ static bool sema_complete_aggregate(SemanticContext *context, Type *aggregate) {
 static bool sema_node_convert_implicit(ASTNode *node, Type *target) {
     Type *source = node_type(node);
     if (!source || !target) return false;
-    if (source == target) return true;
     if (type_match(source, target)) return true;
 
     if (source->kind == TYPE_POINTER && target->kind == TYPE_POINTER) {
-        if (source->base_type == target->base_type)
-            return true;
         if (source->base_type->kind == TYPE_VOID)
             return true;
         if (target->base_type->kind == TYPE_VOID)
@@ -447,45 +453,45 @@ static bool sema_node_convert_explicit(ASTNode *node, Type *target) {
 
 static void sema_unify_binary_operands(SemanticContext *context, ASTNode *left, ASTNode *right) {
     if (node_type(left) == node_type(right)) return;
-    if (node_type(left) == context->type_f64) right->conv_type = context->type_f64;
+    if (node_type(left) == context->type_f64) ast_set_conversion(right, context->type_f64);
     else if (node_type(right) == context->type_f64)
-        left->conv_type = context->type_f64;
+        ast_set_conversion(left, context->type_f64);
     else if (node_type(left) == context->type_f32)
-        right->conv_type = context->type_f32;
+        ast_set_conversion(right, context->type_f32);
     else if (node_type(right) == context->type_f32)
-        left->conv_type = context->type_f32;
+        ast_set_conversion(left, context->type_f32);
     else if (node_type(left) == context->type_i64)
-        right->conv_type = context->type_i64;
+        ast_set_conversion(right, context->type_i64);
     else if (node_type(right) == context->type_i64)
-        left->conv_type = context->type_i64;
+        ast_set_conversion(left, context->type_i64);
     else if (node_type(left) == context->type_i32)
-        right->conv_type = context->type_i32;
+        ast_set_conversion(right, context->type_i32);
     else if (node_type(right) == context->type_i32)
-        left->conv_type = context->type_i32;
+        ast_set_conversion(left, context->type_i32);
     else if (node_type(left) == context->type_i16)
-        right->conv_type = context->type_i16;
+        ast_set_conversion(right, context->type_i16);
     else if (node_type(right) == context->type_i16)
-        left->conv_type = context->type_i16;
+        ast_set_conversion(left, context->type_i16);
     else if (node_type(left) == context->type_i8)
-        right->conv_type = context->type_i8;
+        ast_set_conversion(right, context->type_i8);
     else if (node_type(right) == context->type_i8)
-        left->conv_type = context->type_i8;
+        ast_set_conversion(left, context->type_i8);
     else if (node_type(left) == context->type_u64)
-        right->conv_type = context->type_u64;
+        ast_set_conversion(right, context->type_u64);
     else if (node_type(right) == context->type_u64)
-        left->conv_type = context->type_u64;
+        ast_set_conversion(left, context->type_u64);
     else if (node_type(left) == context->type_u32)
-        right->conv_type = context->type_u32;
+        ast_set_conversion(right, context->type_u32);
     else if (node_type(right) == context->type_u32)
-        left->conv_type = context->type_u32;
+        ast_set_conversion(left, context->type_u32);
     else if (node_type(left) == context->type_u16)
-        right->conv_type = context->type_u16;
+        ast_set_conversion(right, context->type_u16);
     else if (node_type(right) == context->type_u16)
-        left->conv_type = context->type_u16;
+        ast_set_conversion(left, context->type_u16);
     else if (node_type(left) == context->type_u8)
-        right->conv_type = context->type_u8;
+        ast_set_conversion(right, context->type_u8);
     else if (node_type(right) == context->type_u8)
-        left->conv_type = context->type_u8;
+        ast_set_conversion(left, context->type_u8);
     else panic("ICE: cannot unify binary operands");
 }
 
@@ -576,7 +582,7 @@ static Type *sema_analyze_expression_compound(SemanticContext *context, ASTNode
 
                 bool found = false;
                 for (u64 i = 0; i < vector_length(type->fields); i++) {
-                    if (string_match(field->compound_field_name, type->fields[i].name)) {
+                    if (intern_match(field->compound_field_name, type->fields[i].name)) {
                         field->base_type = type->fields[i].type;
                         found = true;
                         break;
@@ -617,12 +623,7 @@ static Type *sema_analyze_expression_compound(SemanticContext *context, ASTNode
         // set the type of this compound literal, so we can set the length/data
         // properly.
 
-        u32 base_size = type->array_base->size;
-        Type *new_type = make_type(TYPE_ARRAY, base_size * current_default_index, POINTER_SIZE);
-
-        new_type->array_base = type->array_base;
-        new_type->array_size = current_default_index;
-
+        Type *new_type = type_array(type->array_base, current_default_index, false);
         expression->base_type = new_type;
         return new_type;
     }
@@ -653,10 +654,7 @@ static Type *sema_analyze_expression_expected(SemanticContext *context, ASTNode
 
             if (expression->unary_operator == TOKEN_AMPERSAND) {
                 // TODO: Check that the target is an lvalue
-                Type *pointer = make_type(TYPE_POINTER, POINTER_SIZE, POINTER_SIZE);
-                pointer->base_type = resolved;
-
-                pointer_table_set(&context->pointer_types, resolved, pointer);
+                Type *pointer = type_pointer(resolved);
                 expression->base_type = pointer;
                 return pointer;
             }
@@ -684,17 +682,15 @@ static Type *sema_analyze_expression_expected(SemanticContext *context, ASTNode
             return left;
         }
         case AST_EXPRESSION_LITERAL_NUMBER: {
-            // TODO: Properly handle floats, etc.
-            // TODO: Check for overflow.
-
-            if (string_to_u64(expression->literal_value, &expression->literal_as_u64)) {
+            // The parser already converted the literal, only its type is picked here.
+            if (expression->literal_flags & TOKEN_FLAG_FLOAT) {
+                expression->base_type = context->type_f64;
+            } else {
                 expression->base_type = context->type_i32;
                 if (expression->literal_as_u64 > 0x7FFFFFFF) expression->base_type = context->type_u32;
                 if (expression->literal_as_u64 > 0xFFFFFFFF) expression->base_type = context->type_i64;
                 if (expression->literal_as_u64 > 0x7FFFFFFFFFFFFFFF) expression->base_type = context->type_u64;
-            } else if (string_to_f64(expression->literal_value, &expression->literal_as_f64)) {
-                expression->base_type = context->type_f64;
-            } else panic("ICE: invalid number literal '%.*s'", strp(expression->literal_value));
+            }
 
             return expression->base_type;
         }
@@ -714,10 +710,10 @@ static Type *sema_analyze_expression_expected(SemanticContext *context, ASTNode
                 return null;
             }
 
-            if (entry->node->kind == AST_DECLARATION_VARIABLE && entry->node->variable_is_const) {
-                // Hack to make enums work.
-                expression->constant = eval_expression(entry->node->variable_initializer);
-            }
+            expression->identifier_declaration = entry->node;
+
+            if (context->reachable_only && (entry->kind == SEMA_ENTRY_FUNCTION || entry->kind == SEMA_ENTRY_VARIABLE))
+                vector_push(context->references, entry->node);
 
             if (entry->node->kind == AST_DECLARATION_AGGREGATE) {
                 if (!sema_complete_aggregate(context, entry->type)) {
@@ -805,14 +801,13 @@ static Type *sema_analyze_expression_expected(SemanticContext *context, ASTNode
             if (field_type->kind != TYPE_AGGREGATE && field_type->kind != TYPE_ARRAY && field_type->kind != TYPE_STRING)
                 sema_errorf(context, expression->field_target, "cannot get a field of a non-aggregate.");
             if (field_type->kind == TYPE_ARRAY) {
-                if (string_match(expression->field_name, str("length"))) {
+                if (intern_match(expression->field_name, symbols.length)) {
                     expression->base_type = context->type_u32;
                     return expression->base_type;
                 }
 
-                if (string_match(expression->field_name, str("data"))) {
-                    expression->base_type = make_type(TYPE_POINTER, POINTER_SIZE, POINTER_SIZE);
-                    expression->base_type->base_type = field_type->base_type;
+                if (intern_match(expression->field_name, symbols.data)) {
+                    expression->base_type = type_pointer(field_type->array_base);
 
                     return expression->base_type;
                 }
@@ -825,7 +820,7 @@ static Type *sema_analyze_expression_expected(SemanticContext *context, ASTNode
                 sema_errorf(context, expression, "cannot use incomplete type here");
 
             vector_foreach(TypeField, field, field_type->fields) {
-                if (string_match(field->name, expression->field_name)) {
+                if (intern_match(field->name, expression->field_name)) {
                     expression->base_type = field->type;
                     return field->type;
                 }
@@ -919,29 +914,31 @@ static bool sema_analyze_statement(SemanticContext *context, ASTNode *statement)
 static bool sema_analyze_statement_init(SemanticContext *context, ASTNode *statement);
 
 static bool sema_analyze_statement_block(SemanticContext *context, ASTNode *statement) {
-    SemanticScope *old_scope = context->scope;
-    context->scope = make_scope(old_scope);
+    SemanticScope outer = sema_enter_scope(context);
 
     bool returns = false;
     vector_foreach_ptr(ASTNode, child, statement->statements)
             returns = sema_analyze_statement(context, *child) || returns;
 
-    context->scope = old_scope;
+    sema_leave_scope(context, outer);
     return returns;
 }
 
 static bool sema_analyze_statement_if(SemanticContext *context, ASTNode *statement) {
-    SemanticScope *old_scope = context->scope;
-    context->scope = make_scope(old_scope);
+    SemanticScope outer = sema_enter_scope(context);
 
-    if (statement->if_expression && !sema_analyze_statement_init(context, statement->if_expression))
+    if (statement->if_expression && !sema_analyze_statement_init(context, statement->if_expression)) {
+        sema_leave_scope(context, outer);
         return false;
-    if (statement->if_condition && !sema_analyze_expression(context, statement->if_condition))
+    }
+    if (statement->if_condition && !sema_analyze_expression(context, statement->if_condition)) {
+        sema_leave_scope(context, outer);
         return false;
-    else if (statement->if_expression) {
+    } else if (statement->if_expression) {
         SemanticEntry *entry = sema_resolve_name(context, statement->if_expression->init_name);
         if (!type_is_scalar(entry->type)) {
             sema_errorf(context, statement->if_expression, "expression must be scalar");
+            sema_leave_scope(context, outer);
             return false;
         }
     }
@@ -952,45 +949,44 @@ static bool sema_analyze_statement_if(SemanticContext *context, ASTNode *stateme
     else
         returns = false;
 
-    context->scope = old_scope;
+    sema_leave_scope(context, outer);
     return returns;
 }
 
 static bool sema_analyze_statement_while(SemanticContext *context, ASTNode *statement) {
-    SemanticScope *old_scope = context->scope;
-    context->scope = make_scope(old_scope);
+    SemanticScope outer = sema_enter_scope(context);
 
     sema_analyze_expression(context, statement->while_condition);
 
-    context->scope->can_break = true;
-    context->scope->can_continue = true;
+    context->scope.can_break = true;
+    context->scope.can_continue = true;
 
     sema_analyze_statement(context, statement->while_body);
 
-    context->scope = old_scope;
+    sema_leave_scope(context, outer);
     return false;
 }
 
 static bool sema_analyze_statement_for(SemanticContext *context, ASTNode *statement) {
-    SemanticScope *old_scope = context->scope;
-    context->scope = make_scope(old_scope);
+    SemanticScope outer = sema_enter_scope(context);
 
     if (statement->for_initializer) sema_analyze_statement(context, statement->for_initializer);
     if (statement->for_condition) {
         Type *condition = sema_analyze_expression(context, statement->for_condition);
         if (!type_is_scalar(condition)) {
             sema_errorf(context, statement->for_condition, "condition must be scalar");
+            sema_leave_scope(context, outer);
             return false;
         }
     }
     if (statement->for_increment) sema_analyze_statement(context, statement->for_increment);
 
-    context->scope->can_break = true;
-    context->scope->can_continue = true;
+    context->scope.can_break = true;
+    context->scope.can_continue = true;
 
     sema_analyze_statement(context, statement->for_body);
 
-    context->scope = old_scope;
+    sema_leave_scope(context, outer);
     return false;
 }
 
@@ -1032,29 +1028,29 @@ static bool sema_analyze_statement_switch_case(SemanticContext *context, ASTNode
 }
 
 static bool sema_analyze_statement_switch(SemanticContext *context, ASTNode *statement) {
-    SemanticScope *old_scope = context->scope;
-    context->scope = make_scope(old_scope);
+    SemanticScope outer = sema_enter_scope(context);
 
     Type *expression_type = sema_analyze_expression(context, statement->switch_expression);
     if (!type_is_integer(expression_type) && expression_type != context->type_string) {
         sema_errorf(context, statement->switch_expression, "switch expression must be integer or string");
+        sema_leave_scope(context, outer);
         return false;
     }
 
-    context->scope->can_break = true;
+    context->scope.can_break = true;
 
     bool returns = true;
     bool has_default = false;
     vector_foreach_ptr(ASTNode, switch_case, statement->switch_cases)
             returns = sema_analyze_statement_switch_case(context, *switch_case, expression_type, &has_default) && returns;
 
-    context->scope = old_scope;
+    sema_leave_scope(context, outer);
     return returns;
 }
 
 static bool sema_analyze_statement_init(SemanticContext *context, ASTNode *statement) {
     Type *resolved = sema_analyze_initializer(context, statement->init_type, statement->init_value);
-    if (sema_get(context->scope, statement->init_name)) {
+    if (sema_get(context, statement->init_name)) {
         sema_errorf(context, statement, "redefinition of %.*s", strp(statement->init_name));
         return false;
     }
@@ -1064,7 +1060,7 @@ static bool sema_analyze_statement_init(SemanticContext *context, ASTNode *state
     entry->state = SEMA_STATE_RESOLVED;
     entry->node = statement;
     entry->type = resolved;
-    sema_put(context->scope, statement->init_name, entry);
+    sema_put(context, statement->init_name, entry);
     statement->base_type = resolved;
     return true;
 }
@@ -1097,11 +1093,11 @@ static bool sema_analyze_statement(SemanticContext *context, ASTNode *statement)
         case AST_STATEMENT_FOR: return sema_analyze_statement_for(context, statement);
         case AST_STATEMENT_SWITCH: return sema_analyze_statement_switch(context, statement);
         case AST_STATEMENT_BREAK:
-            if (!context->scope->can_break)
+            if (!context->scope.can_break)
                 sema_errorf(context, statement, "break is not allowed here");
             return false;
         case AST_STATEMENT_CONTINUE:
-            if (!context->scope->can_continue)
+            if (!context->scope.can_continue)
                 sema_errorf(context, statement, "continue is not allowed here");
             return false;
         case AST_STATEMENT_RETURN: {
@@ -1137,8 +1133,7 @@ static bool sema_analyze_function(SemanticContext *context, ASTNode *function) {
     Type *type = sema_resolve_function_type(context, function);
     if (!type) return false;
 
-    SemanticScope *old_scope = context->scope;
-    context->scope = make_scope(context->scope);
+    SemanticScope outer = sema_enter_scope(context);
 
     bool success = true;
     vector_foreach_ptr(ASTNode, parameter_ptr, function->function_parameters) {
@@ -1147,6 +1142,7 @@ static bool sema_analyze_function(SemanticContext *context, ASTNode *function) {
 
         if (parameter_type->kind == TYPE_AGGREGATE && !sema_complete_aggregate(context, parameter_type)) {
             sema_errorf(context, parameter, "cannot use incomplete aggregate here");
+            sema_leave_scope(context, outer);
             return false;
         }
 
@@ -1156,19 +1152,25 @@ static bool sema_analyze_function(SemanticContext *context, ASTNode *function) {
         entry->node = parameter;
         entry->type = parameter_type;
 
-        success &= sema_put(context->scope, parameter->function_parameter_name, entry);
+        success &= sema_put(context, parameter->function_parameter_name, entry);
     }
 
-    bool returns = function->function_body ? sema_analyze_statement(context, function->function_body) : true;
+    ASTNode *body = parse_function_body(function, context->diagnostics);
+    if (function->flags & AST_FLAG_MALFORMED) {
+        sema_leave_scope(context, outer);
+        return false;
+    }
+
+    bool returns = body ? sema_analyze_statement(context, body) : true;
     bool conforms = returns || type->function_return_type == context->type_void;
 
     if (!conforms) {
         sema_errorf(context, function, "not all control paths return a value");
-        context->scope = old_scope;
+        sema_leave_scope(context, outer);
         return false;
     }
 
-    context->scope = old_scope;
+    sema_leave_scope(context, outer);
     return true;
 }
 
@@ -1177,22 +1179,228 @@ static bool sema_analyze_declaration(SemanticContext *context, ASTNode *declarat
         case AST_DECLARATION_ALIAS:
         case AST_DECLARATION_AGGREGATE: return true;
         case AST_DECLARATION_VARIABLE: return sema_analyze_variable(context, declaration);
-        case AST_DECLARATION_FUNCTION: return sema_analyze_function(context, declaration);
         default: sema_errorf(context, declaration, "unsupported declaration"); return false;
     }
 }
 
-static bool sema_analyze_program(SemanticContext *context, ASTNode *program) {
+typedef struct {
+    SemanticContext *context;
+    ASTNode **functions;
+    u32 count;
+
+    // Per function, merged in order once every body is done.
+    bool *succeeded;
+    SemanticError **errors;
+    string *diagnostics;
+    ASTNode ***references;
+
+    Mutex lock;
+    u32 next;
+} SemanticBodies;
+
+static void sema_analyze_bodies(void *argument, u32 worker) {
+    (void) worker;
+    SemanticBodies *bodies = argument;
+
+    // Every worker has a scope stack of its own and finds the globals in the shared context.
+    SemanticContext context = *bodies->context;
+    context.parent = bodies->context;
+    context.scope = (SemanticScope){0};
+    context.bindings = vector_create(SemanticBinding);
+    context.errors = vector_create(SemanticError);
+    context.references = vector_create(ASTNode *);
+    symbol_table_create(&context.symbols);
+
+    for (;;) {
+        mutex_lock(&bodies->lock);
+        u32 index = bodies->next++;
+        mutex_unlock(&bodies->lock);
+        if (index >= bodies->count)
+            break;
+
+        // Syntax errors of deferred bodies are held back too, so they come out in the same order as eager ones.
+        char *diagnostics = null;
+        size_t diagnostics_length = 0;
+        context.diagnostics = open_memstream(&diagnostics, &diagnostics_length);
+        bodies->succeeded[index] = sema_analyze_function(&context, bodies->functions[index]);
+        fclose(context.diagnostics);
+
+        if (diagnostics_length > 0)
+            bodies->diagnostics[index] = rawstr((i8 *) diagnostics, diagnostics_length);
+        else
+            free(diagnostics);
+
+        if (vector_length(context.errors) > 0) {
+            bodies->errors[index] = context.errors;
+            context.errors = vector_create(SemanticError);
+        }
+
+        if (vector_length(context.references) > 0) {
+            bodies->references[index] = context.references;
+            context.references = vector_create(ASTNode *);
+        }
+    }
+
+    for (u32 i = 0; i < context.symbols.capacity; i++)
+        free(context.symbols.entries[i].value);
+    symbol_table_destroy(&context.symbols);
+    vector_free(context.bindings);
+    vector_free(context.errors);
+    vector_free(context.references);
+}
+
+// Analyzes the bodies of `count` functions on the threads of `pool`. Their errors and
+// references are appended to the context in the order of `functions`.
+static bool sema_analyze_functions(SemanticContext *context, ThreadPool *pool, ASTNode **functions, u32 count) {
+    SemanticBodies bodies = {
+            .context = context,
+            .functions = functions,
+            .count = count,
+            .succeeded = make_n(bool, count),
+            .errors = make_n(SemanticError *, count),
+            .diagnostics = make_n(string, count),
+            .references = make_n(ASTNode **, count),
+            .lock = MUTEX_INITIALIZER,
+    };
+
+    u32 workers = pool_thread_count(pool);
+    pool_run(pool, workers < count ? workers : count, sema_analyze_bodies, &bodies);
+
     bool succeeded = true;
-    vector_foreach_ptr(ASTNode, declaration, program->declarations)
-            succeeded &= sema_analyze_declaration(context, *declaration);
+    for (u32 i = 0; i < count; i++) {
+        succeeded &= bodies.succeeded[i];
+
+        if (bodies.diagnostics[i].data) {
+            fwrite(bodies.diagnostics[i].data, 1, bodies.diagnostics[i].length, context->diagnostics);
+            free(bodies.diagnostics[i].data);
+        }
+
+        if (bodies.errors[i]) {
+            vector_foreach(SemanticError, error, bodies.errors[i])
+                    vector_push(context->errors, *error);
+            vector_free(bodies.errors[i]);
+        }
+
+        if (bodies.references[i]) {
+            vector_foreach_ptr(ASTNode, reference, bodies.references[i])
+                    vector_push(context->references, *reference);
+            vector_free(bodies.references[i]);
+        }
+    }
+
+    free(bodies.succeeded);
+    free(bodies.errors);
+    free(bodies.diagnostics);
+    free(bodies.references);
     return succeeded;
 }
 
-bool sema_analyze(SemanticContext *context) {
+static void sema_evaluate_constants(SemanticContext *context) {
+    vector_foreach_ptr(ASTNode, program, context->programs) {
+        vector_foreach_ptr(ASTNode, declaration, (*program)->declarations) {
+            ASTNode *variable = *declaration;
+            if (variable->kind != AST_DECLARATION_VARIABLE || !variable->variable_is_const || !variable->variable_initializer)
+                continue;
+            if (context->reachable_only && !(variable->flags & AST_FLAG_REACHABLE))
+                continue;
+
+            // Constants that an earlier one referred to already have their value.
+            if (variable->flags & AST_FLAG_CONSTANT)
+                continue;
+
+            EvalError error;
+            Variant value = eval_expression(variable->variable_initializer, &error);
+            if (value.kind == VARIANT_NONE) {
+                sema_errorf(context, error.node, "'%.*s' is not constant, its initializer %s", strp(variable->variable_name), error.reason);
+                continue;
+            }
+
+            ast_set_constant(variable, value);
+        }
+    }
+}
+
+// Marks a global declaration as reachable, queueing the functions for analysis and
+// the globals that the initializer of a variable names.
+static void sema_reach(SemanticContext *context, ASTNode ***functions, ASTNode *declaration) {
+    if (declaration->flags & AST_FLAG_REACHABLE)
+        return;
+
+    declaration->flags |= AST_FLAG_REACHABLE;
+    if (declaration->kind == AST_DECLARATION_FUNCTION)
+        vector_push(*functions, declaration);
+
+    ASTNode **references = pointer_table_get(&context->initializer_references, declaration);
+    if (references) {
+        vector_foreach_ptr(ASTNode, reference, references)
+                vector_push(context->references, *reference);
+    }
+}
+
+static void sema_reach_symbol(SemanticContext *context, ASTNode ***functions, string name) {
+    SemanticEntry *entry = sema_get(context, name);
+    if (entry && entry->kind == SEMA_ENTRY_FUNCTION)
+        sema_reach(context, functions, entry->node);
+}
+
+bool sema_analyze(SemanticContext *context, ThreadPool *pool) {
     bool succeeded = true;
-    vector_foreach_ptr(ASTNode, program, context->programs)
-            succeeded &= sema_analyze_program(context, *program);
+
+    // Globals are all resolved before any body is looked at, so that the bodies
+    // only read them and can be analyzed in parallel.
+    for (u32 i = 0; i < vector_length(context->bindings); i++) {
+        SemanticEntry *entry = context->bindings[i].entry;
+        sema_resolve_entry(context, entry);
+        if (entry->kind == SEMA_ENTRY_TYPE && entry->type && entry->type->kind == TYPE_AGGREGATE)
+            sema_complete_aggregate(context, entry->type);
+    }
+
+    ASTNode **functions = vector_create(ASTNode *);
+    vector_foreach_ptr(ASTNode, program, context->programs) {
+        vector_foreach_ptr(ASTNode, declaration, (*program)->declarations) {
+            ASTNode *node = *declaration;
+            if (node->kind != AST_DECLARATION_FUNCTION) {
+                succeeded &= sema_analyze_declaration(context, node);
+
+                // The initializers of variables run at startup whether or not anything reads them.
+                if (context->reachable_only && node->kind == AST_DECLARATION_VARIABLE && !node->variable_is_const)
+                    sema_reach(context, &functions, node);
+            } else if (!context->reachable_only) {
+                vector_push(functions, node);
+            }
+        }
+    }
+
+    // Lowering calls the runtime helpers by itself, so they are always reachable.
+    if (context->reachable_only) {
+        sema_reach_symbol(context, &functions, symbols.start);
+        sema_reach_symbol(context, &functions, symbols.main);
+        sema_reach_symbol(context, &functions, symbols.init_globals);
+        sema_reach_symbol(context, &functions, symbols.string_equals);
+        sema_reach_symbol(context, &functions, symbols.memset);
+    }
+
+    // Without reachable_only this is a single round over every function. Otherwise each
+    // round analyzes the functions that the previous one referenced for the first time.
+    u32 analyzed = 0;
+    u32 reached = 0;
+    for (;;) {
+        for (; reached < vector_length(context->references); reached++)
+            sema_reach(context, &functions, context->references[reached]);
+
+        u32 count = vector_length(functions) - analyzed;
+        if (count == 0)
+            break;
+
+        succeeded &= sema_analyze_functions(context, pool, functions + analyzed, count);
+        analyzed += count;
+    }
+
+    // Constants can call functions, so they are only evaluated once every body has been analyzed.
+    if (succeeded && vector_length(context->errors) == 0)
+        sema_evaluate_constants(context);
+
+    vector_free(functions);
     fflush(stdout);
     return succeeded;
 }
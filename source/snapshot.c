@@ -0,0 +1,528 @@
+#include "atcc.h"
+#include "ati/utils.h"
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+// A snapshot is a compact encoding of a freshly parsed program. Nodes are
+// written in post-order as a kind, a location delta and their fields, all as
+// variable length integers. A child is referenced by how many nodes back it
+// was written, a string by its index in a table of distinct strings, so the
+// encoding is pointer-free and loading it is a single pass over the nodes.
+
+#define SNAPSHOT_MAGIC 0x50534141 // "AASP"
+#define SNAPSHOT_VERSION 3
+
+typedef enum {
+    SNAPSHOT_FIELD_NONE,
+    SNAPSHOT_FIELD_NODE,    // ASTNode *
+    SNAPSHOT_FIELD_LIST,    // ASTNode **, an arena vector
+    SNAPSHOT_FIELD_STRING,  // string
+    SNAPSHOT_FIELD_STRINGS, // string *, an arena vector
+    SNAPSHOT_FIELD_VALUE,   // bool, TokenKind, TokenFlag or u64
+} SnapshotFieldKind;
+
+typedef struct {
+    u8 kind;
+    u8 offset;
+    u8 size;
+} SnapshotField;
+
+#define FIELD(kind, field) {kind, offsetof(ASTNode, field), sizeof(((ASTNode *) 0)->field)}
+#define NODE(field) FIELD(SNAPSHOT_FIELD_NODE, field)
+#define LIST(field) FIELD(SNAPSHOT_FIELD_LIST, field)
+#define STRING(field) FIELD(SNAPSHOT_FIELD_STRING, field)
+#define STRINGS(field) FIELD(SNAPSHOT_FIELD_STRINGS, field)
+#define VALUE(field) FIELD(SNAPSHOT_FIELD_VALUE, field)
+
+#define SNAPSHOT_MAX_FIELDS 5
+
+// Every field the parser fills in, by kind. Anything not listed here is lost,
+// and fields that sema fills in are left out since a snapshot is always taken
+// before analysis.
+static const SnapshotField snapshot_fields[][SNAPSHOT_MAX_FIELDS] = {
+        [AST_ERROR] = {STRING(value)},
+        [AST_PROGRAM] = {LIST(declarations)},
+        [AST_DECLARATION_TYPE_NAME] = {STRING(value)},
+        [AST_DECLARATION_TYPE_POINTER] = {NODE(parent)},
+        [AST_DECLARATION_TYPE_ARRAY] = {NODE(array_base), NODE(array_size), VALUE(array_is_dynamic)},
+        [AST_DECLARATION_TYPE_FUNCTION] = {STRING(function_name), LIST(function_parameters), NODE(function_return_type), VALUE(function_is_variadic), NODE(function_body)},
+        [AST_DECLARATION_ALIAS] = {STRING(alias_name), NODE(alias_type)},
+        [AST_DECLARATION_AGGREGATE] = {STRING(aggregate_name), NODE(aggregate)},
+        [AST_DECLARATION_AGGREGATE_FIELD] = {STRINGS(aggregate_names), NODE(aggregate_type)},
+        [AST_DECLARATION_AGGREGATE_CHILD] = {VALUE(aggregate_kind), LIST(aggregate_items)},
+        [AST_DECLARATION_VARIABLE] = {STRING(variable_name), NODE(variable_type), NODE(variable_initializer), VALUE(variable_is_const)},
+        [AST_DECLARATION_FUNCTION_PARAMETER] = {STRING(function_parameter_name), NODE(function_parameter_type)},
+        [AST_DECLARATION_FUNCTION] = {STRING(function_name), LIST(function_parameters), NODE(function_return_type), VALUE(function_is_variadic), NODE(function_body)},
+        [AST_DECLARATION_ENUM_PLACEHOLDER] = {NODE(enum_alias), LIST(enum_items)},
+
+        [AST_STATEMENT_BLOCK] = {LIST(statements)},
+        [AST_STATEMENT_IF] = {NODE(if_expression), NODE(if_condition), NODE(if_true), NODE(if_false)},
+        [AST_STATEMENT_WHILE] = {NODE(while_condition), NODE(while_body)},
+        [AST_STATEMENT_DO_WHILE] = {NODE(while_condition), NODE(while_body)},
+        [AST_STATEMENT_FOR] = {NODE(for_initializer), NODE(for_condition), NODE(for_increment), NODE(for_body)},
+        [AST_STATEMENT_SWITCH] = {NODE(switch_expression), LIST(switch_cases)},
+        [AST_STATEMENT_SWITCH_CASE] = {LIST(switch_case_patterns), NODE(switch_case_body), VALUE(switch_case_is_default)},
+        [AST_STATEMENT_SWITCH_PATTERN] = {NODE(switch_pattern_start), NODE(switch_pattern_end)},
+        [AST_STATEMENT_BREAK] = {{SNAPSHOT_FIELD_NONE}},
+        [AST_STATEMENT_CONTINUE] = {{SNAPSHOT_FIELD_NONE}},
+        [AST_STATEMENT_RETURN] = {NODE(parent)},
+        [AST_STATEMENT_INIT] = {STRING(init_name), NODE(init_type), NODE(init_value), VALUE(init_is_nothing)},
+        [AST_STATEMENT_EXPRESSION] = {NODE(parent)},
+        [AST_STATEMENT_ASSIGN] = {VALUE(assign_operator), NODE(assign_target), NODE(assign_value)},
+
+        [AST_EXPRESSION_PAREN] = {NODE(parent)},
+        [AST_EXPRESSION_UNARY] = {VALUE(unary_operator), NODE(unary_target)},
+        [AST_EXPRESSION_BINARY] = {VALUE(binary_operator), NODE(binary_left), NODE(binary_right)},
+        [AST_EXPRESSION_TERNARY] = {NODE(ternary_condition), NODE(ternary_true), NODE(ternary_false)},
+        [AST_EXPRESSION_LITERAL_NUMBER] = {STRING(literal_value), VALUE(literal_flags), VALUE(literal_as_u64)},
+        [AST_EXPRESSION_LITERAL_CHAR] = {STRING(literal_value), VALUE(literal_flags), VALUE(literal_as_u64)},
+        [AST_EXPRESSION_LITERAL_STRING] = {STRING(literal_value), VALUE(literal_flags), VALUE(literal_as_u64)},
+        [AST_EXPRESSION_IDENTIFIER] = {STRING(value)},
+        [AST_EXPRESSION_SIZEOF] = {NODE(sizeof_type)},
+        [AST_EXPRESSION_ALIGNOF] = {NODE(alignof_type)},
+        [AST_EXPRESSION_OFFSETOF] = {NODE(offsetof_type), STRING(offsetof_field)},
+        [AST_EXPRESSION_CALL] = {NODE(call_target), LIST(call_arguments)},
+        [AST_EXPRESSION_FIELD] = {NODE(field_target), STRING(field_name)},
+        [AST_EXPRESSION_INDEX] = {NODE(index_target), NODE(index_index)},
+        [AST_EXPRESSION_CAST] = {NODE(cast_type), NODE(cast_target)},
+        [AST_EXPRESSION_COMPOUND] = {NODE(compound_type), LIST(compound_fields)},
+        [AST_EXPRESSION_COMPOUND_FIELD] = {STRING(compound_field_name), NODE(compound_field_index), NODE(compound_field_target)},
+        [AST_EXPRESSION_COMPOUND_FIELD_NAME] = {STRING(compound_field_name), NODE(compound_field_index), NODE(compound_field_target)},
+        [AST_EXPRESSION_COMPOUND_FIELD_INDEX] = {STRING(compound_field_name), NODE(compound_field_index), NODE(compound_field_target)},
+};
+
+#undef FIELD
+#undef NODE
+#undef LIST
+#undef STRING
+#undef STRINGS
+#undef VALUE
+
+typedef struct {
+    u32 magic;
+    u32 version;
+
+    // A snapshot is only valid for the fields it was written with and the source it was made from.
+    u64 layout_hash;
+    u64 source_hash;
+    u64 source_length;
+
+    u32 node_count;
+    u32 symbol_count;
+} SnapshotHeader;
+
+// Followed by the distinct strings, each as its length and bytes, and then the nodes.
+
+// Hashes whole source files, so it consumes eight bytes per step.
+static u64 snapshot_hash(u64 hash, const void *data, u64 length) {
+    const u8 *bytes = data;
+    u64 i = 0;
+    for (; i + 8 <= length; i += 8) {
+        u64 word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash = ((hash << 29) | (hash >> 35)) * 0x9E3779B97F4A7C15ull;
+    }
+    for (; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    hash ^= length;
+    hash ^= hash >> 31;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    return hash ^ (hash >> 29);
+}
+
+static u64 snapshot_source_hash(Buffer source) {
+    return snapshot_hash(0xcbf29ce484222325ull, source.data, source.length);
+}
+
+static u64 snapshot_layout_hash(void) {
+    // Only what the encoding depends on: the kinds and the fields of each, not where they live in memory.
+    u8 encoding[array_length(snapshot_fields)][SNAPSHOT_MAX_FIELDS][2];
+    for (u32 kind = 0; kind < array_length(snapshot_fields); kind++) {
+        for (u32 i = 0; i < SNAPSHOT_MAX_FIELDS; i++) {
+            encoding[kind][i][0] = snapshot_fields[kind][i].kind;
+            encoding[kind][i][1] = snapshot_fields[kind][i].kind == SNAPSHOT_FIELD_VALUE ? snapshot_fields[kind][i].size : 0;
+        }
+    }
+
+    return snapshot_hash(0xcbf29ce484222325ull, encoding, sizeof(encoding));
+}
+
+typedef struct {
+    Location base;
+    Location location;
+    u32 node_count;
+    u8 *nodes;
+
+    // Child references of the nodes being written, as index + 1 and 0 for null.
+    u32 *children;
+
+    // Every distinct string is stored and interned once, mapped to its index + 1.
+    StringTable symbol_indices;
+    u32 symbol_count;
+    u8 *symbols;
+} SnapshotWriter;
+
+static void snapshot_put(u8 **stream, u64 value) {
+    while (value >= 0x80) {
+        vector_push(*stream, (u8) (value | 0x80));
+        value >>= 7;
+    }
+    vector_push(*stream, (u8) value);
+}
+
+static u32 snapshot_symbol(SnapshotWriter *writer, string value) {
+    if (!value.data)
+        return 0;
+
+    usize index = (usize) string_table_get(&writer->symbol_indices, value);
+    if (index == 0) {
+        snapshot_put(&writer->symbols, value.length);
+        memcpy(vector_add(writer->symbols, value.length), value.data, value.length);
+
+        index = ++writer->symbol_count;
+        string_table_set(&writer->symbol_indices, value, (void *) index);
+    }
+
+    return (u32) index;
+}
+
+static u32 snapshot_write_node(SnapshotWriter *writer, ASTNode *node) {
+    if (node->kind == AST_NONE || node->kind >= array_length(snapshot_fields))
+        panic("ICE: cannot snapshot node of kind %d", node->kind);
+    if (node->flags || node->base_type)
+        panic("ICE: only unanalyzed programs can be snapshotted");
+
+    if (node->location < writer->base)
+        panic("ICE: snapshotted node is not part of the snapshotted file");
+
+    const SnapshotField *fields = snapshot_fields[node->kind];
+
+    // Children are written first, so that the node only ever refers back.
+    u32 mark = vector_length(writer->children);
+    for (u32 i = 0; i < SNAPSHOT_MAX_FIELDS && fields[i].kind; i++) {
+        void *value = (i8 *) node + fields[i].offset;
+
+        // Writing a child grows the vector, so it has to happen before the push.
+        if (fields[i].kind == SNAPSHOT_FIELD_NODE) {
+            ASTNode *child = *(ASTNode **) value;
+            u32 reference = child ? snapshot_write_node(writer, child) + 1 : 0;
+            vector_push(writer->children, reference);
+        } else if (fields[i].kind == SNAPSHOT_FIELD_LIST) {
+            ASTNode **list = *(ASTNode ***) value;
+            vector_push(writer->children, list ? vector_length(list) + 1 : 0);
+            for (u32 j = 0; list && j < vector_length(list); j++) {
+                u32 reference = list[j] ? snapshot_write_node(writer, list[j]) + 1 : 0;
+                vector_push(writer->children, reference);
+            }
+        }
+    }
+
+    u32 index = writer->node_count++;
+    if (writer->node_count == UINT32_MAX)
+        panic("ICE: snapshot has too many nodes");
+
+    // Locations are zigzag encoded deltas from the previous node.
+    i64 delta = (i64) node->location - (i64) writer->location;
+    writer->location = node->location;
+
+    snapshot_put(&writer->nodes, node->kind);
+    snapshot_put(&writer->nodes, ((u64) delta << 1) ^ (u64) (delta >> 63));
+
+    u32 *children = writer->children + mark;
+    for (u32 i = 0; i < SNAPSHOT_MAX_FIELDS && fields[i].kind; i++) {
+        void *value = (i8 *) node + fields[i].offset;
+
+        switch (fields[i].kind) {
+            case SNAPSHOT_FIELD_NODE: {
+                u32 child = *children++;
+                snapshot_put(&writer->nodes, child ? index + 1 - child : 0);
+                break;
+            }
+            case SNAPSHOT_FIELD_LIST: {
+                u32 length = *children++;
+                snapshot_put(&writer->nodes, length);
+                for (u32 j = 1; j < length; j++) {
+                    u32 child = *children++;
+                    snapshot_put(&writer->nodes, child ? index + 1 - child : 0);
+                }
+                break;
+            }
+            case SNAPSHOT_FIELD_STRING: {
+                snapshot_put(&writer->nodes, snapshot_symbol(writer, *(string *) value));
+                break;
+            }
+            case SNAPSHOT_FIELD_STRINGS: {
+                string *list = *(string **) value;
+                snapshot_put(&writer->nodes, list ? vector_length(list) + 1 : 0);
+                for (u32 j = 0; list && j < vector_length(list); j++)
+                    snapshot_put(&writer->nodes, snapshot_symbol(writer, list[j]));
+                break;
+            }
+            case SNAPSHOT_FIELD_VALUE: {
+                u64 stored = fields[i].size == sizeof(u64) ? *(u64 *) value : *(u32 *) value;
+                snapshot_put(&writer->nodes, stored);
+                break;
+            }
+        }
+    }
+
+    vector_length(writer->children) = mark;
+    return index;
+}
+
+u8 *snapshot_create(ASTNode *program, u32 file) {
+    SnapshotWriter writer = {
+            .base = source_location(file, 0),
+            .location = source_location(file, 0),
+            .nodes = vector_create(u8),
+            .children = vector_create(u32),
+            .symbols = vector_create(u8),
+    };
+    string_table_create(&writer.symbol_indices);
+
+    // The root is written last, which is where the loader picks it up.
+    snapshot_write_node(&writer, program);
+
+    Buffer source = source_file_data(file);
+    SnapshotHeader header = {
+            .magic = SNAPSHOT_MAGIC,
+            .version = SNAPSHOT_VERSION,
+            .layout_hash = snapshot_layout_hash(),
+            .source_hash = snapshot_source_hash(source),
+            .source_length = source.length,
+            .node_count = writer.node_count,
+            .symbol_count = writer.symbol_count,
+    };
+
+    u8 *snapshot = vector_create(u8);
+    memcpy(vector_add(snapshot, sizeof(header)), &header, sizeof(header));
+    memcpy(vector_add(snapshot, vector_length(writer.symbols)), writer.symbols, vector_length(writer.symbols));
+    memcpy(vector_add(snapshot, vector_length(writer.nodes)), writer.nodes, vector_length(writer.nodes));
+
+    vector_free(writer.nodes);
+    vector_free(writer.children);
+    vector_free(writer.symbols);
+    string_table_destroy(&writer.symbol_indices);
+    return snapshot;
+}
+
+typedef struct {
+    const u8 *cursor;
+    const u8 *end;
+    bool failed;
+} SnapshotReader;
+
+static u64 snapshot_get(SnapshotReader *reader) {
+    // Most values fit in a single byte.
+    if (reader->cursor < reader->end && *reader->cursor < 0x80)
+        return *reader->cursor++;
+
+    u64 value = 0;
+    for (u32 shift = 0; shift < 64 && reader->cursor < reader->end; shift += 7) {
+        u8 byte = *reader->cursor++;
+        value |= (u64) (byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return value;
+    }
+
+    reader->failed = true;
+    return 0;
+}
+
+// Snapshots may come from disk, so everything read is checked before it is used.
+static bool snapshot_read_nodes(SnapshotReader *reader, SnapshotHeader *header, string *symbols, ASTNode **nodes,
+                                Location base, Arena *arena, u64 *node_bytes) {
+    Location location = base;
+
+    for (u32 index = 0; index < header->node_count; index++) {
+        u64 kind = snapshot_get(reader);
+        if (kind == AST_NONE || kind >= array_length(snapshot_fields))
+            return false;
+
+        u32 size = ast_size((ASTKind) kind);
+        ASTNode *node = arena_alloc(arena, size);
+        *node_bytes += size;
+
+        u64 delta = snapshot_get(reader);
+        location += (Location) ((delta >> 1) ^ -(delta & 1));
+        if (location - base > header->source_length)
+            return false;
+
+        node->kind = (u8) kind;
+        node->location = location;
+
+        const SnapshotField *fields = snapshot_fields[kind];
+        for (u32 i = 0; i < SNAPSHOT_MAX_FIELDS && fields[i].kind; i++) {
+            void *value = (i8 *) node + fields[i].offset;
+
+            switch (fields[i].kind) {
+                case SNAPSHOT_FIELD_NODE: {
+                    u64 back = snapshot_get(reader);
+                    if (back > index)
+                        return false;
+                    *(ASTNode **) value = back ? nodes[index - back] : null;
+                    break;
+                }
+                case SNAPSHOT_FIELD_LIST: {
+                    u64 length = snapshot_get(reader);
+                    if (length == 0)
+                        break;
+                    if (length - 1 > (u64) (reader->end - reader->cursor))
+                        return false;
+
+                    VectorHeader *list = arena_alloc(arena, sizeof(VectorHeader) + (length - 1) * sizeof(ASTNode *));
+                    list->length = list->capacity = length - 1;
+
+                    ASTNode **items = (ASTNode **) (list + 1);
+                    for (u64 j = 0; j < length - 1; j++) {
+                        u64 back = snapshot_get(reader);
+                        if (back > index)
+                            return false;
+                        items[j] = back ? nodes[index - back] : null;
+                    }
+                    *(ASTNode ***) value = items;
+                    break;
+                }
+                case SNAPSHOT_FIELD_STRING: {
+                    u64 symbol = snapshot_get(reader);
+                    if (symbol > header->symbol_count)
+                        return false;
+                    if (symbol)
+                        *(string *) value = symbols[symbol - 1];
+                    break;
+                }
+                case SNAPSHOT_FIELD_STRINGS: {
+                    u64 length = snapshot_get(reader);
+                    if (length == 0)
+                        break;
+                    if (length - 1 > (u64) (reader->end - reader->cursor))
+                        return false;
+
+                    VectorHeader *list = arena_alloc(arena, sizeof(VectorHeader) + (length - 1) * sizeof(string));
+                    list->length = list->capacity = length - 1;
+
+                    string *items = (string *) (list + 1);
+                    for (u64 j = 0; j < length - 1; j++) {
+                        u64 symbol = snapshot_get(reader);
+                        if (symbol > header->symbol_count)
+                            return false;
+                        items[j] = symbol ? symbols[symbol - 1] : (string){0};
+                    }
+                    *(string **) value = items;
+                    break;
+                }
+                case SNAPSHOT_FIELD_VALUE: {
+                    u64 stored = snapshot_get(reader);
+                    if (fields[i].size == sizeof(u64))
+                        *(u64 *) value = stored;
+                    else
+                        *(u32 *) value = (u32) stored;
+                    break;
+                }
+            }
+        }
+
+        if (reader->failed)
+            return false;
+        nodes[index] = node;
+    }
+
+    return reader->cursor == reader->end;
+}
+
+static ASTNode *snapshot_load_hashed(const u8 *snapshot, u64 length, u32 file, u64 source_hash, Arena *arena) {
+    SnapshotHeader header;
+    if (length < sizeof(header))
+        return null;
+    memcpy(&header, snapshot, sizeof(header));
+
+    if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION)
+        return null;
+    if (header.layout_hash != snapshot_layout_hash())
+        return null;
+
+    if (header.source_length != source_file_data(file).length || header.source_hash != source_hash)
+        return null;
+
+    // Every node and every symbol takes at least one byte.
+    u64 remaining = length - sizeof(header);
+    if (header.node_count == 0 || header.node_count > remaining || header.symbol_count > remaining)
+        return null;
+
+    SnapshotReader reader = {.cursor = snapshot + sizeof(header), .end = snapshot + length};
+
+    // Identifiers are compared by address, so every string goes through the interner.
+    string *symbols = make_n(string, header.symbol_count + 1);
+    for (u32 i = 0; i < header.symbol_count && !reader.failed; i++) {
+        u64 symbol_length = snapshot_get(&reader);
+        if (symbol_length > (u64) (reader.end - reader.cursor)) {
+            reader.failed = true;
+            break;
+        }
+
+        symbols[i] = intern(rawstr((i8 *) reader.cursor, symbol_length));
+        reader.cursor += symbol_length;
+    }
+
+    ASTNode **nodes = make_n(ASTNode *, header.node_count);
+    u64 node_bytes = 0;
+    bool loaded = !reader.failed && snapshot_read_nodes(&reader, &header, symbols, nodes, source_location(file, 0), arena, &node_bytes);
+    ASTNode *program = loaded ? nodes[header.node_count - 1] : null;
+
+    free(nodes);
+    free(symbols);
+
+    if (!program || program->kind != AST_PROGRAM)
+        return null;
+
+    ASTStatistics statistics = {header.node_count, node_bytes};
+    ast_statistics_add(&statistics);
+    return program;
+}
+
+ASTNode *snapshot_load(const u8 *snapshot, u64 length, u32 file, Arena *arena) {
+    return snapshot_load_hashed(snapshot, length, file, snapshot_source_hash(source_file_data(file)), arena);
+}
+
+static string snapshot_cache_path(string directory, u64 source_hash, u64 length) {
+    return string_format(str("%.*s/%016llx-%llx.aast"), strp(directory),
+                         (unsigned long long) source_hash, (unsigned long long) length);
+}
+
+ASTNode *snapshot_cache_load(string directory, u32 file, Arena *arena) {
+    Buffer source = source_file_data(file);
+    u64 source_hash = snapshot_source_hash(source);
+
+    string path = snapshot_cache_path(directory, source_hash, source.length);
+    Buffer cached = read_file(path);
+    free(path.data);
+    if (!cached.data)
+        return null;
+
+    ASTNode *program = snapshot_load_hashed((u8 *) cached.data, cached.length, file, source_hash, arena);
+    buffer_free(cached);
+    return program;
+}
+
+void snapshot_cache_store(string directory, u32 file, ASTNode *program) {
+    Buffer source = source_file_data(file);
+    string path = snapshot_cache_path(directory, snapshot_source_hash(source), source.length);
+
+    // Written under a private name first, so that nobody ever reads a half written entry.
+    string temporary = string_format(str("%s.%d-%u.tmp"), path.data, (i32) getpid(), file);
+    u8 *snapshot = snapshot_create(program, file);
+    Buffer buffer = {.data = (i8 *) snapshot, .length = vector_length(snapshot)};
+
+    // string_format leaves both paths terminated.
+    if (write_file(temporary, &buffer) && rename((cstring) temporary.data, (cstring) path.data) != 0)
+        remove((cstring) temporary.data);
+
+    vector_free(snapshot);
+    free(temporary.data);
+    free(path.data);
+}
@@ -1,5 +1,8 @@
+#include "ati/arena.h"
 #include "ati/basic.h"
 #include "ati/config.h"
+#include "ati/intern.h"
+#include "ati/thread.h"
 #include "ati/utest.h"
 #include "ati/utils.h"
 
@@ -110,10 +113,136 @@ static int ati_test_config_parses_and_loads_values(void) {
     return UTEST_PASS;
 }
 
+static int ati_test_string_number_conversion(void) {
+    u64 integer;
+    UASSERT(string_to_u64(str("0"), &integer) && integer == 0);
+    UASSERT(string_to_u64(str("18446744073709551615"), &integer) && integer == UINT64_MAX);
+    UASSERT(!string_to_u64(str("18446744073709551616"), &integer));
+    UASSERT(!string_to_u64(str("12a"), &integer));
+    UASSERT(!string_to_u64(str(""), &integer));
+
+    UASSERT(string_to_u64_radix(str("ff"), 16, &integer) && integer == 255);
+    UASSERT(string_to_u64_radix(str("DEADBEEF"), 16, &integer) && integer == 0xDEADBEEF);
+    UASSERT(string_to_u64_radix(str("777"), 8, &integer) && integer == 511);
+    UASSERT(!string_to_u64_radix(str("8"), 8, &integer));
+    UASSERT(string_to_u64_radix(str("1011"), 2, &integer) && integer == 11);
+    UASSERT(!string_to_u64_radix(str("102"), 2, &integer));
+
+    f64 floating;
+    UASSERT(string_to_f64(str("1.5"), &floating) && floating == 1.5);
+    UASSERT(string_to_f64(str("0.1"), &floating) && floating == 0.1);
+    UASSERT(string_to_f64(str("1."), &floating) && floating == 1.0);
+    UASSERT(string_to_f64(str("2.5e-3"), &floating) && floating == 2.5e-3);
+    UASSERT(string_to_f64(str("1e22"), &floating) && floating == 1e22);
+    UASSERT(string_to_f64(str("1e23"), &floating) && floating == 1e23);
+    UASSERT(string_to_f64(str("123456789012345678901234567890"), &floating) && floating == 123456789012345678901234567890.0);
+    UASSERT(string_to_f64(str("0.000000000000000000000000000001"), &floating) && floating == 1e-30);
+    UASSERT(!string_to_f64(str("1.2.3"), &floating));
+    UASSERT(!string_to_f64(str("1e"), &floating));
+
+    return UTEST_PASS;
+}
+
+static int ati_test_intern_shares_storage(void) {
+    i8 buffer[] = "length";
+    string first = intern(str("length"));
+    string second = intern(rawstr(buffer, 6));
+
+    UASSERT(intern_match(first, second));
+    UASSERT(first.data != buffer && first.length == 6 && first.data[6] == 0);
+    UASSERT(!intern_match(first, intern(str("lengths"))));
+    UASSERT(!intern_match(first, intern(str("len"))));
+    UASSERT(intern(str("")).length == 0);
+
+    SymbolTable table;
+    symbol_table_create(&table);
+    symbol_table_set(&table, first, &buffer);
+    UASSERT(symbol_table_get(&table, second) == &buffer);
+    UASSERT(symbol_table_get(&table, intern(str("data"))) == null);
+    symbol_table_destroy(&table);
+
+    return UTEST_PASS;
+}
+
+#define ATI_TEST_POOL_JOBS 64
+#define ATI_TEST_POOL_NAMES 512
+
+typedef struct {
+    u32 runs[ATI_TEST_POOL_JOBS];
+    i8 *names[ATI_TEST_POOL_JOBS][ATI_TEST_POOL_NAMES];
+} AtiTestPoolState;
+
+static void ati_test_pool_job(void *context, u32 index) {
+    AtiTestPoolState *state = context;
+    state->runs[index]++;
+
+    // Every job interns the same names, starting at a different one.
+    for (u32 i = 0; i < ATI_TEST_POOL_NAMES; i++) {
+        u32 name = (i + index * 7) % ATI_TEST_POOL_NAMES;
+        i8 buffer[32];
+        i32 length = snprintf((char *) buffer, sizeof(buffer), "pool_name_%u", name);
+        state->names[index][name] = intern(rawstr(buffer, length)).data;
+    }
+}
+
+static int ati_test_thread_pool(void) {
+    AtiTestPoolState *state = make(AtiTestPoolState);
+    ThreadPool *pool = pool_create(4);
+
+    for (u32 round = 0; round < 3; round++)
+        pool_run(pool, ATI_TEST_POOL_JOBS, ati_test_pool_job, state);
+    pool_destroy(pool);
+
+    for (u32 job = 0; job < ATI_TEST_POOL_JOBS; job++) {
+        UASSERT(state->runs[job] == 3);
+        for (u32 name = 0; name < ATI_TEST_POOL_NAMES; name++)
+            UASSERT(state->names[job][name] == state->names[0][name]);
+    }
+
+    free(state);
+    return UTEST_PASS;
+}
+
+static int ati_test_arena_allocations(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    for (u32 i = 0; i < 100000; i++) {
+        u64 *value = arena_alloc(&arena, 24);
+        UASSERT(((u64) value & 7) == 0);
+        UASSERT(value[0] == 0 && value[1] == 0 && value[2] == 0);
+        value[0] = value[1] = value[2] = i;
+    }
+
+    u8 *large = arena_alloc(&arena, 4 * 1024 * 1024);
+    UASSERT(large[0] == 0 && large[4 * 1024 * 1024 - 1] == 0);
+
+    u32 items[] = {1, 2, 3};
+    u32 *vector = arena_vector(&arena, items, sizeof(u32), 3);
+    UASSERT(vector_length(vector) == 3 && vector_capacity(vector) == 3);
+    UASSERT(vector[0] == 1 && vector[2] == 3);
+
+    u32 *grown = vector_empty;
+    for (u32 i = 0; i < 100; i++)
+        arena_vector_push(&arena, grown, i);
+    UASSERT(vector_length(grown) == 100 && vector_capacity(grown) >= 100);
+    UASSERT(grown[0] == 0 && grown[99] == 99);
+    UASSERT(vector_length(vector_empty) == 0);
+
+    arena_free(&arena);
+    UASSERT(arena.blocks == null);
+
+    return UTEST_PASS;
+}
+
 void ati_register_utest(void) {
 	UTest tests[] = {
 		{ str("variant equality"), ati_test_variant_equality },
 		{ str("config parses and loads values"), ati_test_config_parses_and_loads_values },
+		{ str("string number conversion"), ati_test_string_number_conversion },
+		{ str("intern shares storage"), ati_test_intern_shares_storage },
+		{ str("arena allocations"), ati_test_arena_allocations },
+		{ str("thread pool"), ati_test_thread_pool },
 	};
 
 	utest_register(str("ati"), tests, array_length(tests));
@@ -1,16 +1,427 @@
+#include "atcc.h"
 #include "ati/utest.h"
 #include "ati/utils.h"
 #include "emit/bytecode.h"
+#include <string.h>
 
 static int bc_test_initialization(void) {
     BCContext context = bc_context_initialize();
 
+    bc_context_destroy(context);
+    return UTEST_PASS;
+}
+
+static int bc_test_arena_function(void) {
+    BCContext context = bc_context_initialize();
+
+    BCType params[] = {bc_type_i32, bc_type_i32};
+    BCFunction function = bc_function_create(context, bc_type_function(context, bc_type_i32, params, 2, false), str("Select"));
+    BCValue callee = bc_value_make_function(context, function);
+
+    BCBlock then_block = bc_block_make(function);
+    BCBlock else_block = bc_block_make(function);
+    BCBlock last = bc_block_make(function);
+
+    BCValue left = bc_value_get_parameter(function, 0);
+    BCValue right = bc_value_get_parameter(function, 1);
+    BCValue local = bc_function_define(function, bc_type_i32);
+    bc_insn_store(function, local, left);
+    bc_insn_jump_if(function, bc_insn_lt(function, left, right), then_block, else_block);
+
+    bc_function_set_block(function, then_block);
+    for (u32 i = 0; i < 100; i++)
+        left = bc_insn_add(function, left, bc_value_make_consti(context, bc_type_i32, i + 1));
+    bc_insn_jump(function, last);
+
+    bc_function_set_block(function, else_block);
+    BCValue args[] = {right, left};
+    BCValue call = bc_insn_call(function, callee, args, 2);
+    args[0] = args[1] = null;
+    bc_insn_jump(function, last);
+
+    bc_function_set_block(function, last);
+    BCValue phi = bc_insn_phi(function, bc_type_i32);
+    BCValue phi_values[] = {left, call};
+    BCBlock phi_blocks[] = {then_block, else_block};
+    bc_insn_phi_add_incoming(phi, phi_values, phi_blocks, 2);
+    bc_insn_return(function, phi->phi_result);
+
+    UASSERT(then_block->num_code == 101 && vector_length(function->locals) == 1);
+    UASSERT(phi->num_incoming_phi_values == 2 && phi->phi_values[1] == call);
+    UASSERT(bc_block_is_terminated(function, function->first_block) && bc_block_is_terminated(function, last));
+
+    // Call arguments are copied into the function, the caller's array can be reused.
+    BCCode call_insn = bc_code_at(function, else_block->first_code);
+    UASSERT(call_insn->opcode == BC_OP_CALL && call_insn->num_args == 2);
+    UASSERT(bc_code_argument(function, call_insn, 0) == right);
+
+    bc_context_destroy(context);
+    return UTEST_PASS;
+}
+
+static int bc_test_compact_layout(void) {
+    BCContext context = bc_context_initialize();
+    BCFunction function = bc_function_create(context, bc_type_function(context, bc_type_void, null, 0, false), str("Layout"));
+
+    BCBlock first = function->first_block;
+    BCBlock second = bc_block_make(function);
+    BCValue local = bc_function_define(function, bc_type_i32);
+
+    // Interleave the two blocks, the way lowering does when it comes back to an earlier block.
+    for (u32 i = 0; i < 10; i++) {
+        bc_function_set_block(function, i % 2 ? second : first);
+        bc_insn_store(function, local, bc_value_make_consti(context, bc_type_i32, i));
+    }
+    bc_function_set_block(function, first);
+    bc_insn_jump(function, second);
+    bc_function_set_block(function, second);
+    bc_insn_return(function, null);
+
+    UASSERT(first->num_code == 6 && second->num_code == 6);
+    bc_function_compact(function);
+
+    // Each block is now one contiguous run of the code array, in block order.
+    UASSERT(first->first_code == 0 && first->last_code == 5);
+    UASSERT(second->first_code == 6 && second->last_code == 11);
+
+    u32 expected = 0, position = 0;
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) {
+            UASSERT(code == &function->code[position++]);
+            if (code->opcode == BC_OP_STORE) {
+                BCValue stored = bc_code_value(function, code->regA);
+                UASSERT(stored->storage == expected);
+                expected += 2;
+                if (expected == 10) expected = 1;
+            }
+        }
+    }
+
+    UASSERT(position == 12 && vector_length(function->code) == 12);
+    UASSERT(bc_code_block(function, function->code[5].bbT) == second);
+    UASSERT(bc_block_is_terminated(function, first) && bc_block_is_terminated(function, second));
+
+    bc_context_destroy(context);
+    return UTEST_PASS;
+}
+
+static int bc_test_interned_types(void) {
+    BCContext context = bc_context_initialize();
+
+    BCType pointer = bc_type_pointer(context, bc_type_i32);
+    UASSERT(pointer == bc_type_pointer(context, bc_type_i32) && pointer != bc_type_pointer(context, bc_type_u32));
+    UASSERT(bc_type_pointer(context, pointer) == bc_type_pointer(context, bc_type_pointer(context, bc_type_i32)));
+
+    // Arrays of the same length share a type even when the length comes from different constants.
+    BCType array = bc_type_array(context, bc_type_i32, bc_value_make_consti(context, bc_type_u32, 4), false);
+    UASSERT(array == bc_type_array(context, bc_type_i32, bc_value_make_consti(context, bc_type_u32, 4), false));
+    UASSERT(array != bc_type_array(context, bc_type_i32, bc_value_make_consti(context, bc_type_u32, 5), false));
+    UASSERT(bc_type_array(context, bc_type_i32, null, true) == bc_type_array(context, bc_type_i32, null, true));
+    UASSERT(bc_type_array(context, bc_type_i32, null, true) != bc_type_array(context, bc_type_i32, null, false));
+    UASSERT(vector_length(context->arrays) == 4 && context->arrays[array->emit_index] == array);
+
+    // The parameters are copied, so the caller's array can be reused for the next lookup.
+    BCType params[] = {pointer, bc_type_i64};
+    BCType function = bc_type_function(context, bc_type_void, params, 2, false);
+    params[1] = bc_type_f64;
+    UASSERT(function->params != params && function->params[1] == bc_type_i64);
+    UASSERT(function != bc_type_function(context, bc_type_void, params, 2, false));
+    params[1] = bc_type_i64;
+    UASSERT(function == bc_type_function(context, bc_type_void, params, 2, false));
+    UASSERT(function != bc_type_function(context, bc_type_void, params, 2, true));
+    UASSERT(function != bc_type_function(context, bc_type_void, params, 1, false));
+
+    // Enough types to grow the table a few times.
+    BCType chain = bc_type_u8;
+    for (u32 i = 0; i < 1000; i++)
+        chain = bc_type_pointer(context, chain);
+    for (u32 i = 0; i < 1000; i++) {
+        UASSERT(chain->kind == BC_TYPE_POINTER);
+        chain = chain->base;
+    }
+    UASSERT(chain == bc_type_u8 && pointer == bc_type_pointer(context, bc_type_i32));
+
+    BCContext other = bc_context_initialize();
+    UASSERT(bc_type_pointer(other, bc_type_i32) != pointer);
+    bc_context_destroy(other);
+
+    bc_context_destroy(context);
+    return UTEST_PASS;
+}
+
+static int bc_test_constant_folding(void) {
+    BCContext context = bc_context_initialize();
+    BCFunction function = bc_function_create(context, bc_type_function(context, bc_type_i32, &bc_type_i32, 1, false), str("Fold"));
+    BCValue x = bc_value_get_parameter(function, 0);
+
+    // Small constants are shared, larger ones are not.
+    UASSERT(bc_value_make_consti(context, bc_type_i32, 3) == bc_value_make_consti(context, bc_type_i32, 3));
+    UASSERT(bc_value_make_consti(context, bc_type_i32, 3) != bc_value_make_consti(context, bc_type_u32, 3));
+    UASSERT(bc_value_make_consti(context, bc_type_i32, 300) != bc_value_make_consti(context, bc_type_i32, 300));
+
+    BCValue minus_nine = bc_value_make_consti(context, bc_type_i32, (u64) -9);
+    BCValue two = bc_value_make_consti(context, bc_type_i32, 2);
+    UASSERT(bc_insn_div(function, minus_nine, two)->istorage == -4);
+    UASSERT(bc_insn_mod(function, minus_nine, two)->istorage == -1);
+    UASSERT(bc_insn_shr(function, minus_nine, two)->istorage == -3);
+    UASSERT(bc_insn_lt(function, minus_nine, two)->storage == 1);
+    UASSERT(bc_insn_neg(function, two, null)->istorage == -3);
+    UASSERT(bc_insn_sub(function, two, null)->istorage == -2);
+
+    // Results wrap at the width of the type.
+    BCValue u8_200 = bc_value_make_consti(context, bc_type_u8, 200);
+    UASSERT(bc_insn_add(function, u8_200, u8_200)->storage == 144);
+    UASSERT(bc_insn_cast(function, BC_OP_CAST_INT_SEXT, u8_200, bc_type_i64)->storage == 200);
+    UASSERT(bc_insn_cast(function, BC_OP_CAST_INT_TRUNC, minus_nine, bc_type_u8)->storage == 247);
+
+    // Mixed comparisons convert like C does, -1 only stays below 0 when the common type is signed.
+    BCValue minus_one = bc_value_make_consti(context, bc_type_i32, (u64) -1);
+    UASSERT(bc_insn_lt(function, minus_one, bc_value_make_consti(context, bc_type_u32, 0))->storage == 0);
+    UASSERT(bc_insn_lt(function, minus_one, bc_value_make_consti(context, bc_type_u8, 0))->storage == 1);
+    UASSERT(bc_insn_lt(function, bc_value_make_consti(context, bc_type_i64, (u64) -1), bc_value_make_consti(context, bc_type_u32, 0))->storage == 1);
+    UASSERT(bc_insn_ne(function, bc_value_make_consti(context, bc_type_u8, 0), bc_value_make_consti(context, bc_type_u32, 0))->storage == 0);
+
+    BCValue half = bc_value_make_constf(context, bc_type_f64, 0.5);
+    UASSERT(bc_insn_mul(function, half, half)->floating == 0.25);
+    UASSERT(bc_insn_cast(function, BC_OP_CAST_FP_TO_SINT, half, bc_type_i32)->storage == 0);
+
+    UASSERT(function->code == null);
+
+    // Undefined results are left to the target.
+    BCValue zero = bc_value_make_consti(context, bc_type_i32, 0);
+    UASSERT(bc_insn_div(function, two, zero)->kind == BC_VALUE_TEMPORARY);
+    UASSERT(bc_insn_shl(function, two, bc_value_make_consti(context, bc_type_i32, 40))->kind == BC_VALUE_TEMPORARY);
+    UASSERT(bc_insn_div(function, half, bc_value_make_constf(context, bc_type_f64, 0))->kind == BC_VALUE_TEMPORARY);
+    UASSERT(vector_length(function->code) == 3);
+
+    UASSERT(bc_insn_add(function, x, zero) == x && bc_insn_add(function, zero, x) == x);
+    UASSERT(bc_insn_mul(function, x, bc_value_make_consti(context, bc_type_i32, 1)) == x);
+    UASSERT(bc_insn_and(function, x, bc_value_make_consti(context, bc_type_i32, (u64) -1)) == x);
+    UASSERT(bc_insn_shl(function, x, zero) == x && bc_insn_mul(function, zero, x) == zero);
+    UASSERT(bc_insn_cast(function, BC_OP_CAST_INT_SEXT, x, bc_type_i32) == x);
+
+    // All ones in a narrower type is not all ones once it is widened.
+    BCValue u64_x = bc_insn_cast(function, BC_OP_CAST_INT_ZEXT, x, bc_type_u64);
+    BCValue u32_ones = bc_value_make_consti(context, bc_type_u32, 0xFFFFFFFF);
+    UASSERT(bc_insn_and(function, u64_x, u32_ones) != u64_x);
+    UASSERT(vector_length(function->code) == 5);
+
+    bc_context_destroy(context);
+    return UTEST_PASS;
+}
+
+// Lowers real source, so the tests see the shapes the compiler builds and not only hand-made ones.
+static BuildContext *bc_test_lower(Arena *arena, string source) {
+    Lexer lexer;
+    lexer_initialize(&lexer, source_register(str("<utest>"), (Buffer){.data = source.data, .length = source.length}), false);
+
+    SemanticContext *sema = sema_initialize();
+    if (!sema_register_program(sema, parse_program(&lexer, arena, false, stderr)))
+        return null;
+
+    ThreadPool *pool = pool_create(2);
+    bool analyzed = sema_analyze(sema, pool);
+    pool_destroy(pool);
+    if (!analyzed || vector_length(sema->errors) > 0)
+        return null;
+
+    BuildContext *build = build_initialize(sema);
+    return build_bytecode(build) ? build : null;
+}
+
+static BCFunction bc_test_find_function(BCContext context, cstring name) {
+    for (u64 i = 0; i < vector_length(context->functions); i++) {
+        if (string_match(context->functions[i]->name, string_from_cstring(name)))
+            return context->functions[i];
+    }
+
+    return null;
+}
+
+static u32 bc_test_count_opcode(BCFunction function, BCOpcode opcode) {
+    u32 count = 0;
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) count += code->opcode == opcode;
+    }
+
+    return count;
+}
+
+// Conditions that are constants in the source, with one that is not in between.
+static BuildContext *bc_test_lower_branches(Arena *arena) {
+    return bc_test_lower(arena, str("fun Branches(n: i32): i32 {\n"
+                                    "    while (1) { n += 1; if (n > 10) { break; } }\n"
+                                    "    if (0) { n = 5; }\n"
+                                    "    if (cast(u8) 0) { n = 6; }\n"
+                                    "    return n;\n"
+                                    "}\n"));
+}
+
+static int bc_test_lowered_conditions(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    BuildContext *build = bc_test_lower_branches(&arena);
+    UASSERT(build);
+    BCFunction function = bc_test_find_function(build->bc, "Branches");
+    UASSERT(function);
+
+    // Only `n > 10` is left to decide at run time, the other conditions are constants that branch one way.
+    u32 constant = 0, variable = 0;
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) {
+            if (code->opcode != BC_OP_JUMP_IF)
+                continue;
+            if (bc_code_value(function, code->regC)->kind == BC_VALUE_CONSTANT)
+                constant++;
+            else
+                variable++;
+        }
+    }
+    UASSERT(constant == 3 && variable == 1);
+
+    bc_context_destroy(build->bc);
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static BCFunction bc_test_branchy_function(BCContext context) {
+    BCFunction function = bc_function_create(context, bc_type_function(context, bc_type_i32, &bc_type_i32, 1, false), str("Branchy"));
+    BCValue x = bc_value_get_parameter(function, 0);
+
+    BCBlock taken = bc_block_make(function);
+    BCBlock skipped = bc_block_make(function);
+    bc_block_make(function);
+
+    // Nothing reads these, and the second one keeps the first one alive until it goes.
+    BCValue unused = bc_insn_load(function, bc_function_define(function, bc_type_i32));
+    bc_insn_mul(function, bc_insn_add(function, unused, x), x);
+    bc_insn_jump_if(function, bc_value_make_consti(context, bc_type_i32, 1), taken, skipped);
+
+    bc_function_set_block(function, taken);
+    bc_insn_return(function, x);
+
+    bc_function_set_block(function, skipped);
+    bc_insn_return(function, bc_insn_add(function, x, x));
+
+    bc_function_compact(function);
+    return function;
+}
+
+static int bc_test_passes(void) {
+    BCContext context = bc_context_initialize();
+    BCFunction function = bc_test_branchy_function(context);
+    UASSERT(vector_length(function->code) == 7 && bc_verify(context, stderr));
+
+    BCPassOptions options = {.level = 1, .verify = true};
+    options.disabled[BC_PASS_DEAD_CODE] = true;
+    bc_optimize(context, &options);
+
+    // The constant condition became a jump, and the blocks it never took are gone.
+    BCBlock first = function->first_block;
+    UASSERT(first->next == function->last_block && first->next == function->blocks[1]);
+    UASSERT(bc_code_at(function, first->last_code)->opcode == BC_OP_JUMP);
+    UASSERT(vector_length(function->code) == 5 && first->num_code == 4);
+
+    options.disabled[BC_PASS_DEAD_CODE] = false;
+    options.enabled[BC_PASS_COMPACT] = true;
+    options.level = 0;
+    bc_optimize(context, &options);
+    UASSERT(vector_length(function->code) == 5);
+
+    options.level = 1;
+    bc_optimize(context, &options);
+    UASSERT(vector_length(function->code) == 2 && first->num_code == 1);
+    UASSERT(first->first_code == 0 && first->next->first_code == 1);
+
+    bc_context_destroy(context);
+    return UTEST_PASS;
+}
+
+static u32 bc_test_count_stores_of(BCFunction function, u64 constant) {
+    u32 count = 0;
+    for (BCBlock block = function->first_block; block; block = block->next) {
+        bc_block_foreach_code(function, block, code) {
+            BCValue source = code->opcode == BC_OP_STORE ? bc_code_value(function, code->regA) : null;
+            count += source && source->kind == BC_VALUE_CONSTANT && source->storage == constant;
+        }
+    }
+
+    return count;
+}
+
+static int bc_test_lowered_passes(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    BuildContext *build = bc_test_lower_branches(&arena);
+    UASSERT(build);
+    BCFunction function = bc_test_find_function(build->bc, "Branches");
+    UASSERT(function && bc_test_count_stores_of(function, 5) == 1 && bc_test_count_stores_of(function, 6) == 1);
+
+    u32 blocks_before = 0;
+    for (BCBlock block = function->first_block; block; block = block->next)
+        blocks_before++;
+
+    BCPassOptions options = {.level = 1, .verify = true};
+    bc_optimize(build->bc, &options);
+    UASSERT(bc_verify(build->bc, stderr));
+
+    // The bodies of `if (0)` and `if (cast(u8) 0)` are gone, the loop and its exit are not.
+    u32 blocks_after = 0;
+    for (BCBlock block = function->first_block; block; block = block->next)
+        blocks_after++;
+    UASSERT(blocks_after < blocks_before);
+    UASSERT(bc_test_count_stores_of(function, 5) == 0 && bc_test_count_stores_of(function, 6) == 0);
+    UASSERT(bc_test_count_opcode(function, BC_OP_JUMP_IF) == 1 && bc_test_count_opcode(function, BC_OP_RETURN) == 1);
+
+    bc_context_destroy(build->bc);
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int bc_test_verifier(void) {
+    BCContext context = bc_context_initialize();
+    BCFunction function = bc_test_branchy_function(context);
+
+    char *errors = null;
+    size_t errors_length = 0;
+    FILE *f = open_memstream(&errors, &errors_length);
+
+    // Dropping the definition of a value that is still read is what a broken pass would do.
+    function->code[1].opcode = BC_OP_NOP;
+    UASSERT(!bc_verify(context, f));
+    function->code[1].opcode = BC_OP_ADD;
+    UASSERT(bc_verify(context, f));
+
+    function->first_block->num_code++;
+    UASSERT(!bc_verify(context, f));
+    function->first_block->num_code--;
+
+    BCBlock skipped = function->blocks[2];
+    skipped->prev->next = skipped->next;
+    skipped->next->prev = skipped->prev;
+    UASSERT(!bc_verify(context, f));
+
+    fclose(f);
+    UASSERT(strstr(errors, "operand is never defined") && strstr(errors, "jump to a block that is not part of the function"));
+    free(errors);
+
+    bc_context_destroy(context);
     return UTEST_PASS;
 }
 
 void bc_register_utest(void) {
 	UTest tests[] = {
 		{ str("initialization"), bc_test_initialization },
+		{ str("arena function"), bc_test_arena_function },
+		{ str("compact layout"), bc_test_compact_layout },
+		{ str("interned types"), bc_test_interned_types },
+		{ str("constant folding"), bc_test_constant_folding },
+		{ str("lowered conditions"), bc_test_lowered_conditions },
+		{ str("passes"), bc_test_passes },
+		{ str("lowered passes"), bc_test_lowered_passes },
+		{ str("verifier"), bc_test_verifier },
 	};
 
 	utest_register(str("bytecode"), tests, array_length(tests));
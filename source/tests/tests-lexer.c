@@ -0,0 +1,77 @@
+#include "atcc.h"
+#include "ati/utest.h"
+#include "ati/utils.h"
+
+#define initstr(s) \
+    { .data = (i8 *) (s), .length = sizeof(s) - 1 }
+
+static struct {
+    string keyword;
+    TokenKind kind;
+} lexer_test_keywords[] = {
+        {initstr("alias"), TOKEN_KW_ALIAS},
+        {initstr("alignof"), TOKEN_KW_ALIGNOF},
+        {initstr("break"), TOKEN_KW_BREAK},
+        {initstr("case"), TOKEN_KW_CASE},
+        {initstr("cast"), TOKEN_KW_CAST},
+        {initstr("const"), TOKEN_KW_CONST},
+        {initstr("continue"), TOKEN_KW_CONTINUE},
+        {initstr("default"), TOKEN_KW_DEFAULT},
+        {initstr("do"), TOKEN_KW_DO},
+        {initstr("else"), TOKEN_KW_ELSE},
+        {initstr("enum"), TOKEN_KW_ENUM},
+        {initstr("for"), TOKEN_KW_FOR},
+        {initstr("fun"), TOKEN_KW_FUN},
+        {initstr("if"), TOKEN_KW_IF},
+        {initstr("offsetof"), TOKEN_KW_OFFSETOF},
+        {initstr("return"), TOKEN_KW_RETURN},
+        {initstr("sizeof"), TOKEN_KW_SIZEOF},
+        {initstr("struct"), TOKEN_KW_STRUCT},
+        {initstr("switch"), TOKEN_KW_SWITCH},
+        {initstr("union"), TOKEN_KW_UNION},
+        {initstr("var"), TOKEN_KW_VAR},
+        {initstr("while"), TOKEN_KW_WHILE},
+};
+#undef initstr
+
+static int lexer_test_keyword_lookup(void) {
+    for (i32 i = 0; i < array_length(lexer_test_keywords); i++)
+        UASSERT(lexer_keyword_kind(lexer_test_keywords[i].keyword) == lexer_test_keywords[i].kind);
+
+    string identifiers[] = {
+            str("a"), str("dx"), str("fan"), str("forx"), str("cash"), str("casting"), str("els"),
+            str("Alias"), str("breaks"), str("structs"), str("swatch"), str("alignas"), str("continues"),
+            str("offset"), str("returns"), str("unions"), str("whilst"), str("variable"), str("iff"),
+    };
+
+    for (i32 i = 0; i < array_length(identifiers); i++)
+        UASSERT(lexer_keyword_kind(identifiers[i]) == TOKEN_IDENTIFIER);
+
+    return UTEST_PASS;
+}
+
+static int lexer_test_char_literals(void) {
+    string source = str("'a' '' 'ab' '\\n' '\\x41' '\\q'");
+    Lexer lexer;
+    lexer_initialize(&lexer, source_register(str("<utest>"), (Buffer){.data = source.data, .length = source.length}), false);
+
+    // Escapes count as the one character they decode to.
+    bool invalid[] = {false, true, true, false, false, true};
+    for (u32 i = 0; i < array_length(invalid); i++) {
+        Token token = lexer_next(&lexer);
+        UASSERT(token.kind == TOKEN_CHAR);
+        UASSERT(((token.flags & TOKEN_FLAG_INVALID) != 0) == invalid[i]);
+    }
+
+    UASSERT(lexer_next(&lexer).kind == TOKEN_EOF);
+    return UTEST_PASS;
+}
+
+void lexer_register_utest(void) {
+    UTest tests[] = {
+            {str("keyword lookup"), lexer_test_keyword_lookup},
+            {str("char literals"), lexer_test_char_literals},
+    };
+
+    utest_register(str("lexer"), tests, array_length(tests));
+}
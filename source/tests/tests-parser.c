@@ -0,0 +1,324 @@
+#include "atcc.h"
+#include "ati/utest.h"
+#include "ati/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+static u32 parser_test_register(string source) {
+    return source_register(str("<utest>"), (Buffer){.data = source.data, .length = source.length});
+}
+
+static ASTNode *parser_test_parse_with(Arena *arena, string source, bool batch, bool defer_bodies) {
+    Lexer lexer;
+    lexer_initialize(&lexer, parser_test_register(source), batch);
+    return parse_program(&lexer, arena, defer_bodies, stderr);
+}
+
+static ASTNode *parser_test_parse(Arena *arena, string source) {
+    return parser_test_parse_with(arena, source, false, false);
+}
+
+// Returns the expression of the first statement of the first function, which is expected to be a return.
+static ASTNode *parser_test_parse_return(Arena *arena, string source) {
+    ASTNode *program = parser_test_parse(arena, source);
+    ASTNode *function = program->declarations[0];
+    ASTNode *statement = function->function_body->statements[0];
+    return statement->kind == AST_STATEMENT_RETURN ? statement->parent : null;
+}
+
+static bool parser_test_is_binary(ASTNode *node, TokenKind operator) {
+    return node && node->kind == AST_EXPRESSION_BINARY && node->binary_operator == operator;
+}
+
+static bool parser_test_is_name(ASTNode *node, string name) {
+    return node && node->kind == AST_EXPRESSION_IDENTIFIER && string_match(node->value, name);
+}
+
+static int parser_test_binary_precedence(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    // a || (b && (c == ((d + (e * f)) - g)))
+    ASTNode *expression = parser_test_parse_return(&arena, str("fun F(): i32 { return a || b && c == d + e * f - g; }"));
+    UASSERT(parser_test_is_binary(expression, TOKEN_PIPE_PIPE));
+    UASSERT(parser_test_is_name(expression->binary_left, str("a")));
+
+    ASTNode *and = expression->binary_right;
+    UASSERT(parser_test_is_binary(and, TOKEN_AMPERSAND_AMPERSAND));
+    UASSERT(parser_test_is_name(and->binary_left, str("b")));
+
+    ASTNode *equal = and->binary_right;
+    UASSERT(parser_test_is_binary(equal, TOKEN_EQUAL_EQUAL));
+    UASSERT(parser_test_is_name(equal->binary_left, str("c")));
+
+    ASTNode *minus = equal->binary_right;
+    UASSERT(parser_test_is_binary(minus, TOKEN_MINUS));
+    UASSERT(parser_test_is_name(minus->binary_right, str("g")));
+
+    ASTNode *plus = minus->binary_left;
+    UASSERT(parser_test_is_binary(plus, TOKEN_PLUS));
+    UASSERT(parser_test_is_name(plus->binary_left, str("d")));
+    UASSERT(parser_test_is_binary(plus->binary_right, TOKEN_STAR));
+
+    // Operators of the same level associate to the left: (a - b) - (c << d)
+    expression = parser_test_parse_return(&arena, str("fun F(): i32 { return a - b - c << d; }"));
+    UASSERT(parser_test_is_binary(expression, TOKEN_MINUS));
+    UASSERT(parser_test_is_binary(expression->binary_left, TOKEN_MINUS));
+    UASSERT(parser_test_is_binary(expression->binary_right, TOKEN_LEFT_SHIFT));
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int parser_test_ternary(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    // a ? b : (c ? d : e), with the condition binding looser than `||`.
+    ASTNode *expression = parser_test_parse_return(&arena, str("fun F(): i32 { return a || x ? b : c ? d : e; }"));
+    UASSERT(expression && expression->kind == AST_EXPRESSION_TERNARY);
+    UASSERT(parser_test_is_binary(expression->ternary_condition, TOKEN_PIPE_PIPE));
+    UASSERT(parser_test_is_name(expression->ternary_true, str("b")));
+    UASSERT(expression->ternary_false->kind == AST_EXPRESSION_TERNARY);
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int parser_test_deferred_bodies(void) {
+    // Braces inside literals and comments must not end the skipped body early.
+    string source = str(
+            "fun A(x: i32): i32 {\n"
+            "    if (x) { x = 1; }\n"
+            "    s := \"}}\\\"}\"; c := '}'; d := '\\'';\n"
+            "    // }\n"
+            "    /* } /* } */ } */\n"
+            "    return x;\n"
+            "}\n"
+            "fun B(): i32;\n"
+            "fun C(): i32 { return 2; }\n");
+
+    for (u32 batch = 0; batch < 2; batch++) {
+        Arena arena;
+        arena_initialize(&arena);
+
+        ASTNode *program = parser_test_parse_with(&arena, source, batch, true);
+        UASSERT(vector_length(program->declarations) == 3);
+
+        ASTNode *a = program->declarations[0];
+        ASTNode *b = program->declarations[1];
+        ASTNode *c = program->declarations[2];
+        UASSERT(a->kind == AST_DECLARATION_FUNCTION && (a->flags & AST_FLAG_DEFERRED) && !a->function_body);
+        UASSERT(b->kind == AST_DECLARATION_FUNCTION && !(b->flags & AST_FLAG_DEFERRED) && !b->function_body);
+        UASSERT(c->kind == AST_DECLARATION_FUNCTION && string_match(c->function_name, str("C")));
+
+        ASTNode *body = parse_function_body(a, stderr);
+        UASSERT(body && body->kind == AST_STATEMENT_BLOCK && !(a->flags & AST_FLAG_DEFERRED));
+        UASSERT(vector_length(body->statements) == 5);
+        UASSERT(vector_last(body->statements)->kind == AST_STATEMENT_RETURN);
+        UASSERT(parse_function_body(a, stderr) == body);
+        UASSERT(parse_function_body(b, stderr) == null);
+
+        body = parse_function_body(c, stderr);
+        UASSERT(body && vector_length(body->statements) == 1);
+
+        arena_free(&arena);
+    }
+
+    return UTEST_PASS;
+}
+
+// Both are defined in main.c, which embeds the generated preload sources.
+extern const char preload_source[];
+extern const size_t preload_source_len;
+extern const unsigned char preload_snapshot[];
+extern const size_t preload_snapshot_len;
+
+static int parser_test_deferred_diagnostics(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    ASTNode *program = parser_test_parse_with(&arena, str("fun A(): u8 { return ''; }\n"), false, true);
+    ASTNode *a = program->declarations[0];
+    UASSERT(a->flags & AST_FLAG_DEFERRED);
+
+    // The errors of a deferred body go where its first caller says, and only once.
+    char *errors = null;
+    size_t errors_length = 0;
+    FILE *f = open_memstream(&errors, &errors_length);
+    parse_function_body(a, f);
+    fflush(f);
+    UASSERT(strstr(errors, "exactly one character"));
+
+    u64 length = errors_length;
+    parse_function_body(a, f);
+    fclose(f);
+    UASSERT(errors_length == length);
+    free(errors);
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int parser_test_snapshot_round_trip(void) {
+    string source = str(
+            "enum Kind : i32 { KindA; KindB = 4; }\n"
+            "struct Value { kind: Kind; union { integer: i64; floating: f64; } struct { x, y: i32; } }\n"
+            "alias Handle = Value*;\n"
+            "fun F(value: Value*, items: i32[4]): i32 {\n"
+            "    switch (value.kind) { case 0 .. 3: return 1; default: break; }\n"
+            "    while (value.x > 0) { value.x -= 1; continue; }\n"
+            "    do { items[0] = -sizeof(Value) + offsetof(Value, y); } while (false);\n"
+            "    array: i32[2] = { [1] = 'c' };\n"
+            "    point := cast(i64) (value.x ? 2.5 : \"}\".length);\n"
+            "    return F(value, items) * 2;\n"
+            "}\n");
+
+    Arena arena;
+    arena_initialize(&arena);
+
+    Lexer lexer;
+    u32 file = parser_test_register(source);
+    lexer_initialize(&lexer, file, false);
+    ASTNode *program = parse_program(&lexer, &arena, false, stderr);
+    u8 *snapshot = snapshot_create(program, file);
+
+    // The copy starts at a different location, so locations have to be relocated too.
+    u32 copy = parser_test_register(source);
+    ASTNode *loaded = snapshot_load(snapshot, vector_length(snapshot), copy, &arena);
+    UASSERT(loaded && loaded->kind == AST_PROGRAM);
+    UASSERT(vector_length(loaded->declarations) == vector_length(program->declarations));
+
+    ASTNode *function = vector_last(loaded->declarations);
+    UASSERT(function->kind == AST_DECLARATION_FUNCTION);
+    UASSERT(intern_match(function->function_name, intern(str("F"))));
+    UASSERT(function->location - source_location(copy, 0) == vector_last(program->declarations)->location - source_location(file, 0));
+
+    // Snapshotting the loaded program again must give back the same bytes.
+    u8 *again = snapshot_create(loaded, copy);
+    UASSERT(vector_length(again) == vector_length(snapshot));
+    UASSERT(memcmp(again, snapshot, vector_length(snapshot)) == 0);
+
+    // A snapshot does not apply to different source, even of the same length.
+    string changed = make_string(source.length);
+    memcpy(changed.data, source.data, source.length);
+    changed.data[4] = 'X';
+    UASSERT(snapshot_load(snapshot, vector_length(snapshot), parser_test_register(changed), &arena) == null);
+
+    vector_free(again);
+    vector_free(snapshot);
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int parser_test_snapshot_cache(void) {
+    string source = str("fun F(a: i32): i32 { if (a) { return a * 2; } return -1; }\n");
+    u32 file = parser_test_register(source);
+
+    Arena arena;
+    arena_initialize(&arena);
+
+    char directory[] = "/tmp/atcc-utest-XXXXXX";
+    UASSERT(mkdtemp(directory));
+    string cache = string_from_cstring(directory);
+
+    UASSERT(snapshot_cache_load(cache, file, &arena) == null);
+    Lexer lexer;
+    lexer_initialize(&lexer, file, false);
+    snapshot_cache_store(cache, file, parse_program(&lexer, &arena, false, stderr));
+
+    // Any file with the same contents hits the entry.
+    ASTNode *loaded = snapshot_cache_load(cache, parser_test_register(source), &arena);
+    UASSERT(loaded && vector_length(loaded->declarations) == 1);
+    UASSERT(vector_last(loaded->declarations)->function_body->statements[1]->kind == AST_STATEMENT_RETURN);
+
+    // Damaged snapshots are rejected rather than trusted, however they were cut or changed.
+    u8 *snapshot = snapshot_create(loaded, file);
+    u64 length = vector_length(snapshot);
+    for (u64 cut = 0; cut < length; cut++)
+        UASSERT(snapshot_load(snapshot, cut, file, &arena) == null);
+
+    for (u64 i = length - 16; i < length; i++) {
+        snapshot[i] ^= 0xff;
+        ASTNode *damaged = snapshot_load(snapshot, length, file, &arena);
+        UASSERT(damaged == null || damaged->kind == AST_PROGRAM);
+        snapshot[i] ^= 0xff;
+    }
+
+    string path = string_format(str("rm -rf %s"), directory);
+    UASSERT(system((cstring) path.data) == 0);
+
+    free(path.data);
+    vector_free(snapshot);
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int parser_test_preload_snapshot(void) {
+    // Fails when the snapshotted fields or preload.aa changed without regenerating the
+    // snapshot, see `please generate-preload`.
+    Arena arena;
+    arena_initialize(&arena);
+
+    u32 file = parser_test_register(rawstr((i8 *) preload_source, preload_source_len));
+    ASTNode *program = snapshot_load(preload_snapshot, preload_snapshot_len, file, &arena);
+    UASSERT(program && program->kind == AST_PROGRAM);
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static int parser_test_mixed_operators(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    // ((((a + b * c - d / e) << 2) | (f & g)) ^ (h % i)) == j || (k && (l != (m + (-n * *o))))
+    ASTNode *expression = parser_test_parse_return(
+            &arena, str("fun F(): i32 { return (a + b * c - d / e) << 2 | f & g ^ h % i == j || k && l != m + -n * *o; }"));
+    UASSERT(parser_test_is_binary(expression, TOKEN_PIPE_PIPE));
+
+    ASTNode *equal = expression->binary_left;
+    UASSERT(parser_test_is_binary(equal, TOKEN_EQUAL_EQUAL));
+    UASSERT(parser_test_is_name(equal->binary_right, str("j")));
+
+    ASTNode *caret = equal->binary_left;
+    UASSERT(parser_test_is_binary(caret, TOKEN_CARET));
+    UASSERT(parser_test_is_binary(caret->binary_right, TOKEN_PERCENT));
+
+    ASTNode *pipe = caret->binary_left;
+    UASSERT(parser_test_is_binary(pipe, TOKEN_PIPE));
+    UASSERT(parser_test_is_binary(pipe->binary_right, TOKEN_AMPERSAND));
+
+    ASTNode *shift = pipe->binary_left;
+    UASSERT(parser_test_is_binary(shift, TOKEN_LEFT_SHIFT));
+    UASSERT(shift->binary_left->kind == AST_EXPRESSION_PAREN);
+    UASSERT(parser_test_is_binary(shift->binary_left->parent, TOKEN_MINUS));
+    UASSERT(parser_test_is_binary(shift->binary_left->parent->binary_left, TOKEN_PLUS));
+
+    ASTNode *and = expression->binary_right;
+    UASSERT(parser_test_is_binary(and, TOKEN_AMPERSAND_AMPERSAND));
+    UASSERT(parser_test_is_name(and->binary_left, str("k")));
+
+    ASTNode *not_equal = and->binary_right;
+    UASSERT(parser_test_is_binary(not_equal, TOKEN_EXCLAMATION_EQUAL));
+    UASSERT(parser_test_is_binary(not_equal->binary_right, TOKEN_PLUS));
+    UASSERT(parser_test_is_binary(not_equal->binary_right->binary_right, TOKEN_STAR));
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+void parser_register_utest(void) {
+    UTest tests[] = {
+            {str("binary precedence"), parser_test_binary_precedence},
+            {str("ternary"), parser_test_ternary},
+            {str("deferred bodies"), parser_test_deferred_bodies},
+            {str("deferred diagnostics"), parser_test_deferred_diagnostics},
+            {str("snapshot round trip"), parser_test_snapshot_round_trip},
+            {str("snapshot cache"), parser_test_snapshot_cache},
+            {str("preload snapshot"), parser_test_preload_snapshot},
+            {str("mixed operators"), parser_test_mixed_operators},
+    };
+
+    utest_register(str("parser"), tests, array_length(tests));
+}
@@ -0,0 +1,127 @@
+#include "atcc.h"
+#include "ati/utest.h"
+#include "ati/utils.h"
+#include <string.h>
+
+static SemanticContext *sema_test_analyze(Arena *arena, string source, bool reachable_only) {
+    Lexer lexer;
+    lexer_initialize(&lexer, source_register(str("<utest>"), (Buffer){.data = source.data, .length = source.length}), false);
+
+    SemanticContext *context = sema_initialize();
+    context->reachable_only = reachable_only;
+    if (!sema_register_program(context, parse_program(&lexer, arena, false, stderr)))
+        return null;
+
+    ThreadPool *pool = pool_create(2);
+    sema_analyze(context, pool);
+    pool_destroy(pool);
+    return context;
+}
+
+static bool sema_test_reached(SemanticContext *context, cstring name) {
+    SemanticEntry *entry = sema_get(context, intern(string_from_cstring(name)));
+    return entry && (entry->node->flags & AST_FLAG_REACHABLE);
+}
+
+static Variant sema_test_constant(SemanticContext *context, cstring name) {
+    SemanticEntry *entry = sema_get(context, intern(string_from_cstring(name)));
+    return entry ? ast_constant(entry->node) : variant_none();
+}
+
+static int sema_test_reachable_only(void) {
+    string source = str("const Size: i32 = Four();\n"
+                        "const Unused: i32 = Seven();\n"
+                        "fun Four(): i32 { return 4; }\n"
+                        "fun Seven(): i32 { return 7; }\n"
+                        "var counter: i32 = Start();\n"
+                        "fun Start(): i32 { return 1; }\n"
+                        "fun Leaf(): i32 { return Size; }\n"
+                        "fun Middle(): i32 { return Leaf() + Leaf(); }\n"
+                        "fun Unreached(): i32 { return Broken(); }\n"
+                        "fun Broken(): i32 { return undefined_name; }\n"
+                        "fun Main(): i32 { return Middle(); }\n");
+
+    Arena arena;
+    arena_initialize(&arena);
+
+    // Only what Main and the global initializers reach is analyzed, so Broken's error goes unnoticed.
+    SemanticContext *context = sema_test_analyze(&arena, source, true);
+    UASSERT(context && vector_length(context->errors) == 0);
+    UASSERT(sema_test_reached(context, "Main") && sema_test_reached(context, "Middle"));
+    UASSERT(sema_test_reached(context, "Leaf") && sema_test_reached(context, "Size"));
+    UASSERT(sema_test_reached(context, "counter") && sema_test_reached(context, "Start"));
+    UASSERT(!sema_test_reached(context, "Unreached") && !sema_test_reached(context, "Broken"));
+    UASSERT(sema_test_reached(context, "Four") && sema_test_constant(context, "Size").i64 == 4);
+
+    // A constant's initializer only counts once the constant itself is reached.
+    UASSERT(!sema_test_reached(context, "Unused") && !sema_test_reached(context, "Seven"));
+
+    arena_free(&arena);
+    arena_initialize(&arena);
+
+    context = sema_test_analyze(&arena, source, false);
+    UASSERT(context && vector_length(context->errors) == 1);
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+static bool sema_test_error_mentions(SemanticContext *context, cstring reason) {
+    vector_foreach(SemanticError, error, context->errors) {
+        if (strstr((cstring) error->description.data, reason))
+            return true;
+    }
+    return false;
+}
+
+static int sema_test_constants(void) {
+    Arena arena;
+    arena_initialize(&arena);
+
+    // Fib(80) only finishes inside the step budget because calls are memoized.
+    SemanticContext *context = sema_test_analyze(&arena,
+                                                 str("fun Fib(n: i64): i64 { if (n < 2) return n; return Fib(n - 1) + Fib(n - 2); }\n"
+                                                     "fun Sum(n: i32): i32 { total := 0; for (i := 0; i < n; i += 1) total += i; return total; }\n"
+                                                     "const Big: i64 = Fib(80);\n"
+                                                     "const Total: i32 = Sum(10) - 50;\n"),
+                                                 false);
+    UASSERT(context && vector_length(context->errors) == 0);
+    Variant big = sema_test_constant(context, "Big");
+    Variant total = sema_test_constant(context, "Total");
+    UASSERT(big.kind == VARIANT_I64 && big.i64 == 23416728348467685);
+    UASSERT(total.kind == VARIANT_I32 && total.i32 == -5);
+
+    struct {
+        cstring source;
+        cstring reason;
+    } failures[] = {
+            {"var counter: i32 = 3;\nfun Read(): i32 { return counter; }\nconst Value: i32 = Read();\n", "reads a global variable"},
+            {"fun Spin(): i32 { while (1) {} return 0; }\nconst Value: i32 = Spin();\n", "runs for too long"},
+            {"fun Down(n: i32): i32 { return Down(n + 1); }\nconst Value: i32 = Down(0);\n", "recurses too deeply"},
+            {"fun Divide(n: i32): i32 { return 10 / n; }\nconst Value: i32 = Divide(0);\n", "divides by zero"},
+            {"const Min: i64 = -9223372036854775807 - 1;\nconst Quotient: i64 = Min / -1;\n", "overflows"},
+            {"const Min: i64 = -9223372036854775807 - 1;\nconst Remainder: i64 = Min % -1;\n", "overflows"},
+            {"fun Divide(n: i32): i32 { return n / -1; }\nconst Value: i32 = Divide(-2147483647 - 1);\n", "overflows"},
+    };
+
+    for (u32 i = 0; i < array_length(failures); i++) {
+        arena_free(&arena);
+        arena_initialize(&arena);
+
+        context = sema_test_analyze(&arena, string_from_cstring(failures[i].source), false);
+        UASSERT(context && vector_length(context->errors) == 1);
+        UASSERT(sema_test_error_mentions(context, failures[i].reason));
+    }
+
+    arena_free(&arena);
+    return UTEST_PASS;
+}
+
+void sema_register_utest(void) {
+    UTest tests[] = {
+            {str("reachable only"), sema_test_reachable_only},
+            {str("constants"), sema_test_constants},
+    };
+
+    utest_register(str("sema"), tests, array_length(tests));
+}
@@ -0,0 +1,45 @@
+#include "atcc.h"
+#include "ati/utest.h"
+#include "ati/utils.h"
+
+static Type **type_test_parameters(Type *first, Type *second) {
+    Type **parameters = vector_create(Type *);
+    vector_push(parameters, first);
+    vector_push(parameters, second);
+    return parameters;
+}
+
+static int type_test_hash_consing(void) {
+    Type *i32 = make_type(TYPE_I32, 4, 4);
+    Type *u8 = make_type(TYPE_U8, 1, 1);
+
+    Type *pointer = type_pointer(i32);
+    UASSERT(type_pointer(i32) == pointer);
+    UASSERT(type_pointer(u8) != pointer);
+    UASSERT(type_pointer(pointer) == type_pointer(type_pointer(i32)));
+
+    Type *array = type_array(i32, 4, false);
+    UASSERT(type_array(i32, 4, false) == array && array->size == 4 * 4 + POINTER_SIZE);
+    UASSERT(type_array(i32, 5, false) != array);
+    UASSERT(type_array(u8, 4, false) != array);
+    UASSERT(type_array(i32, 0, true) != type_array(i32, 0, false));
+
+    // Signatures built from separate vectors still end up as the same type.
+    Type *function = type_function(type_test_parameters(pointer, array), i32, false);
+    UASSERT(type_function(type_test_parameters(pointer, array), i32, false) == function);
+    UASSERT(type_function(type_test_parameters(pointer, array), i32, true) != function);
+    UASSERT(type_function(type_test_parameters(array, pointer), i32, false) != function);
+    UASSERT(type_function(type_test_parameters(pointer, array), u8, false) != function);
+
+    UASSERT(type_match(function, type_function(type_test_parameters(pointer, array), i32, false)));
+    UASSERT(!type_match(pointer, type_pointer(u8)));
+    return UTEST_PASS;
+}
+
+void type_register_utest(void) {
+    UTest tests[] = {
+            {str("hash consing"), type_test_hash_consing},
+    };
+
+    utest_register(str("type"), tests, array_length(tests));
+}
@@ -1,4 +1,5 @@
 #include "atcc.h"
+#include "ati/thread.h"
 #include "ati/utils.h"
 
 Type *make_type(TypeKind kind, u32 size, u32 pack) {
@@ -11,6 +12,139 @@ Type *make_type(TypeKind kind, u32 size, u32 pack) {
     return type;
 }
 
+// Every pointer, array and function type that was ever built, so that each
+// structure has exactly one instance. Their components are canonical as well,
+// so comparing two candidates only has to compare addresses one level deep.
+static Type **type_table;
+static u32 type_table_capacity;
+static u32 type_table_length;
+static Mutex type_table_lock = MUTEX_INITIALIZER;
+
+static u64 type_hash_mix(u64 hash, u64 value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+static u64 type_hash(Type *type) {
+    u64 hash = type_hash_mix(0, type->kind);
+    switch (type->kind) {
+        case TYPE_POINTER: return type_hash_mix(hash, (u64) type->base_type);
+        case TYPE_ARRAY: {
+            hash = type_hash_mix(hash, (u64) type->array_base);
+            return type_hash_mix(hash, type->array_size | (u64) type->array_is_dynamic << 32);
+        }
+        case TYPE_FUNCTION: {
+            for (u32 i = 0; i < vector_length(type->function_parameters); i++)
+                hash = type_hash_mix(hash, (u64) type->function_parameters[i]);
+            hash = type_hash_mix(hash, (u64) type->function_return_type);
+            return type_hash_mix(hash, type->function_is_variadic);
+        }
+        default: break;
+    }
+
+    panic("ICE: type of kind %d is not hash-consed", type->kind);
+}
+
+static bool type_same_structure(Type *a, Type *b) {
+    if (a->kind != b->kind)
+        return false;
+
+    switch (a->kind) {
+        case TYPE_POINTER: return a->base_type == b->base_type;
+        case TYPE_ARRAY:
+            return a->array_base == b->array_base && a->array_size == b->array_size &&
+                   a->array_is_dynamic == b->array_is_dynamic;
+        case TYPE_FUNCTION: {
+            if (a->function_is_variadic != b->function_is_variadic || a->function_return_type != b->function_return_type)
+                return false;
+            if (vector_length(a->function_parameters) != vector_length(b->function_parameters))
+                return false;
+
+            for (u32 i = 0; i < vector_length(a->function_parameters); i++) {
+                if (a->function_parameters[i] != b->function_parameters[i])
+                    return false;
+            }
+            return true;
+        }
+        default: return false;
+    }
+}
+
+static Type **type_table_find(Type **table, u32 capacity, Type *type) {
+    u32 index = (u32) type_hash(type) & (capacity - 1);
+    while (table[index] && !type_same_structure(table[index], type))
+        index = (index + 1) & (capacity - 1);
+    return &table[index];
+}
+
+static void type_table_grow(void) {
+    u32 capacity = type_table_capacity ? type_table_capacity * 2 : 256;
+    Type **table = make_n(Type *, capacity);
+
+    for (u32 i = 0; i < type_table_capacity; i++) {
+        if (type_table[i])
+            *type_table_find(table, capacity, type_table[i]) = type_table[i];
+    }
+
+    free(type_table);
+    type_table = table;
+    type_table_capacity = capacity;
+}
+
+// Returns the instance with the structure of `key`, which is copied into a new one the first time.
+// `created`, if given, tells whether that happened, so the caller knows who owns the parts of `key`.
+static Type *type_intern(Type *key, bool *created) {
+    mutex_lock(&type_table_lock);
+    if ((type_table_length + 1) * 4 > type_table_capacity * 3)
+        type_table_grow();
+
+    Type **slot = type_table_find(type_table, type_table_capacity, key);
+    if (created)
+        *created = *slot == null;
+    if (!*slot) {
+        Type *type = make_type(key->kind, key->size, key->pack);
+        u32 typeid = type->typeid;
+        *type = *key;
+        type->typeid = typeid;
+
+        *slot = type;
+        type_table_length++;
+    }
+
+    Type *type = *slot;
+    mutex_unlock(&type_table_lock);
+    return type;
+}
+
+Type *type_pointer(Type *base) {
+    Type key = {.kind = TYPE_POINTER, .size = POINTER_SIZE, .pack = POINTER_SIZE, .base_type = base};
+    return type_intern(&key, null);
+}
+
+Type *type_array(Type *base, u32 size, bool is_dynamic) {
+    // Every array starts with its length, which is padded to POINTER_SIZE.
+    u32 bytes = size ? size * base->size + POINTER_SIZE : POINTER_SIZE * 2;
+    Type key = {.kind = TYPE_ARRAY, .size = bytes, .pack = POINTER_SIZE, .array_base = base, .array_size = size, .array_is_dynamic = is_dynamic};
+    return type_intern(&key, null);
+}
+
+Type *type_function(Type **parameters, Type *return_type, bool is_variadic) {
+    Type key = {
+            .kind = TYPE_FUNCTION,
+            .size = POINTER_SIZE,
+            .pack = POINTER_SIZE,
+            .function_parameters = parameters,
+            .function_return_type = return_type,
+            .function_is_variadic = is_variadic,
+    };
+
+    bool created;
+    Type *type = type_intern(&key, &created);
+    if (!created)
+        vector_free(parameters);
+    return type;
+}
+
 string type_to_string(Type *type) {
     switch (type->kind) {
         case TYPE_VOID: return str("void");
@@ -43,49 +177,12 @@ string type_to_string(Type *type) {
 }
 
 bool type_match(Type *a, Type *b) {
-    if (a->kind != b->kind)
-        return false;
-
-    if (a->kind >= TYPE_I8 && a->kind <= TYPE_U64)
-        return true;
-
-    if (a->typeid == b->typeid)
-        return true;
-
-    switch (a->kind) {
-        case TYPE_POINTER: return type_match(a->base_type, b->base_type);
-        case TYPE_ARRAY: {
-            if (a->array_is_dynamic != b->array_is_dynamic)
-                return false;
-            if (a->array_size != b->array_size)
-                return false;
-            return type_match(a->array_base, b->array_base);
-        }
-        case TYPE_FUNCTION: {
-            if (a->function_is_variadic != b->function_is_variadic)
-                return false;
-            if (vector_length(a->function_parameters) != vector_length(b->function_parameters))
-                return false;
-
-            for (u32 i = 0; i < vector_length(a->function_parameters); i += 1) {
-                Type *param_a = a->function_parameters[i];
-                Type *param_b = b->function_parameters[i];
-                if (!type_match(param_a, param_b))
-                    return false;
-            }
-
-            return type_match(a->function_return_type, b->function_return_type);
-        }
-        case TYPE_AGGREGATE: return a->owner == b->owner;
-        case TYPE_STRING: return true;
-        default: break;
-    }
-
-    panic("ICE: Unhandled type in type_match");
+    // Builtins and aggregates are created once and everything else is hash-consed.
+    return a == b;
 }
 
 bool type_is_integer(Type *type) { return type->kind >= TYPE_I8 && type->kind <= TYPE_U64; }
 bool type_is_scalar(Type *type) { return type->kind >= TYPE_I8 && type->kind <= TYPE_FUNCTION; }
 bool type_is_arithmetic(Type *type) { return type->kind >= TYPE_I8 && type->kind <= TYPE_F64; }
 
-Type *node_type(ASTNode *node) { return node->conv_type ? node->conv_type : node->base_type; }
\ No newline at end of file
+Type *node_type(ASTNode *node) { return node->flags & AST_FLAG_CONVERTED ? ast_conversion(node) : node->base_type; }
\ No newline at end of file
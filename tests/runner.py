@@ -18,6 +18,13 @@ tests = [
     Case("cases/03-string.aa"),
     Case("cases/04-array.aa"),
     Case("cases/05-enum.aa"),
+    Case("cases/06-literals.aa"),
+    Case("cases/07-aggregate.aa"),
+    Case("cases/08-scope.aa"),
+    Case("cases/09-ctfe.aa"),
+    Case("cases/10-folding.aa"),
+    Case("cases/02-control.aa", flags=["-O0"]),
+    Case("cases/10-folding.aa", flags=["-O0"]),
 ]
 
 suite = TestSuite(tests)
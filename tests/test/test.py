@@ -29,9 +29,11 @@ class CompilationTestFailed(Exception):
 
 
 class Test:
-    def __init__(self, compiler, path, optimize=False, debug=False, broken=False, arguments=None):
+    def __init__(self, compiler, path, optimize=False, debug=False, broken=False, arguments=None, flags=None):
         if arguments is None:
             arguments = []
+        if flags is None:
+            flags = []
         self.compiler = compiler
         self.path = path
         self.optimize = optimize
@@ -45,6 +47,7 @@ class Test:
         self.executable_name = f"{self.atcc_name}_runner"
 
         self.arguments = arguments
+        self.flags = flags
 
     def try_execute_with_status(self, where, command):
         try:
@@ -54,7 +57,7 @@ class Test:
 
     def execute(self):
         try:
-            self.try_execute_with_status(STATUS_ATCC, [self.compiler, "-verbose-all", "-o", self.atcc_name, self.path])
+            self.try_execute_with_status(STATUS_ATCC, [self.compiler, "-verbose-all", *self.flags, "-o", self.atcc_name, self.path])
             self.try_execute_with_status(STATUS_COMPILER, self.generate_compiler_command())
             self.try_execute_with_status(STATUS_EXECUTION, ["./" + self.executable_name, *self.arguments])
         except CompilationTestFailed as e:
@@ -86,4 +89,4 @@ class Test:
         return command
 
     def __str__(self):
-        return f"Test({self.path}, optimize={self.optimize}, debug={self.debug}, broken={self.broken}, arguments={self.arguments})"
+        return f"Test({self.path}, optimize={self.optimize}, debug={self.debug}, broken={self.broken}, arguments={self.arguments}, flags={self.flags})"